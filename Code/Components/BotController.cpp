@@ -0,0 +1,145 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "BotController.h"
+#include "Player.h"
+
+#include <CrySchematyc/Env/Elements/EnvComponent.h>
+#include <CryCore/StaticInstanceList.h>
+#include <CrySchematyc/Env/IEnvRegistrar.h>
+
+namespace
+{
+	static void RegisterBotControllerComponent(Schematyc::IEnvRegistrar& registrar)
+	{
+		Schematyc::CEnvRegistrationScope scope = registrar.Scope(IEntity::GetEntityScopeGUID());
+		{
+			Schematyc::CEnvRegistrationScope componentScope = scope.Register(SCHEMATYC_MAKE_ENV_COMPONENT(CBotControllerComponent));
+		}
+	}
+
+	CRY_STATIC_AUTO_REGISTER_FUNCTION(&RegisterBotControllerComponent);
+
+	const EPlayerAction s_moveActions[] = { EPlayerAction::MoveForward, EPlayerAction::MoveBackward, EPlayerAction::MoveLeft, EPlayerAction::MoveRight };
+}
+
+void CBotControllerComponent::Start(CPlayerComponent* pPlayer, EMode mode, uint32 seed)
+{
+	m_pPlayer = pPlayer;
+	m_mode = mode;
+	m_random = seed != 0 ? seed : 1;
+	m_fTime = 0.f;
+	m_fNextDecision = 0.f;
+
+	if (m_mode == EMode::Scripted)
+	{
+		// Spread the schedules so the bots don't all jump on the same tick
+		m_fTime = NextRandom(0.f, 5.f);
+		m_fTurnRate = 200.f;
+		Press(EPlayerAction::MoveForward);
+	}
+}
+
+void CBotControllerComponent::Update(float fFrametime)
+{
+	if (m_pPlayer == nullptr)
+		return;
+
+	if (m_mode == EMode::Random)
+	{
+		UpdateRandom(fFrametime);
+	}
+	else
+	{
+		UpdateScripted(fFrametime);
+	}
+
+	// Turning is a stream of mouse deltas like real mouse input
+	m_pPlayer->InjectAction(EPlayerAction::Yaw, eAAM_Always, -m_fTurnRate * fFrametime);
+}
+
+uint32 CBotControllerComponent::NextRandom()
+{
+	// xorshift32, deterministic per seed so runs can be repeated
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
+	return m_random;
+}
+
+float CBotControllerComponent::NextRandom(float min, float max)
+{
+	return min + (max - min) * static_cast<float>(NextRandom() & 0xffffff) / static_cast<float>(0xffffff);
+}
+
+void CBotControllerComponent::Press(EPlayerAction action, float value)
+{
+	m_pPlayer->InjectAction(action, eAAM_OnPress, value);
+}
+
+void CBotControllerComponent::Release(EPlayerAction action)
+{
+	m_pPlayer->InjectAction(action, eAAM_OnRelease, 0.f);
+}
+
+void CBotControllerComponent::UpdateRandom(float fFrametime)
+{
+	m_fTime += fFrametime;
+	if (m_fTime < m_fNextDecision)
+		return;
+
+	m_fNextDecision = m_fTime + NextRandom(0.5f, 2.f);
+
+	if (m_moveAction != EPlayerAction::Count)
+	{
+		Release(m_moveAction);
+		m_moveAction = EPlayerAction::Count;
+	}
+
+	// One in five decisions stands still
+	const uint32 move = NextRandom() % 5;
+	if (move < CRY_ARRAY_COUNT(s_moveActions))
+	{
+		m_moveAction = s_moveActions[move];
+		Press(m_moveAction);
+	}
+
+	m_fTurnRate = NextRandom(-300.f, 300.f);
+
+	if ((NextRandom() % 4) == 0)
+	{
+		m_bSprinting = !m_bSprinting;
+		m_bSprinting ? Press(EPlayerAction::Sprint) : Release(EPlayerAction::Sprint);
+	}
+
+	if ((NextRandom() % 3) == 0)
+	{
+		Press(EPlayerAction::Jump);
+		Release(EPlayerAction::Jump);
+	}
+
+	if ((NextRandom() % 6) == 0)
+	{
+		m_bCrouching = !m_bCrouching;
+		m_bCrouching ? Press(EPlayerAction::Crouch) : Release(EPlayerAction::Crouch);
+	}
+}
+
+void CBotControllerComponent::UpdateScripted(float fFrametime)
+{
+	const float fPreviousTime = m_fTime;
+	m_fTime += fFrametime;
+
+	// Jump every 3 seconds, crouch for one second out of every 5
+	if (floorf(m_fTime / 3.f) != floorf(fPreviousTime / 3.f))
+	{
+		Press(EPlayerAction::Jump);
+		Release(EPlayerAction::Jump);
+	}
+
+	const bool bCrouch = fmodf(m_fTime, 5.f) < 1.f;
+	if (bCrouch != m_bCrouching)
+	{
+		m_bCrouching = bCrouch;
+		m_bCrouching ? Press(EPlayerAction::Crouch) : Release(EPlayerAction::Crouch);
+	}
+}
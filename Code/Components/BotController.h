@@ -0,0 +1,60 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <CryEntitySystem/IEntityComponent.h>
+
+#include "PlayerActions.h"
+
+class CPlayerComponent;
+
+////////////////////////////////////////////////////////
+// Drives a CPlayerComponent on the same entity with
+// generated input, for load testing without people at
+// keyboards. Input goes through the player's own action
+// handlers, so bots cost what real players cost.
+// Must be created before the player component, which
+// then skips binding the local keyboard and mouse.
+////////////////////////////////////////////////////////
+
+class CBotControllerComponent final : public IEntityComponent
+{
+public:
+	enum class EMode
+	{
+		Random,  // Random movement, turning, sprinting, jumping and crouching
+		Scripted // Runs in circles, jumps and crouches on a fixed schedule
+	};
+
+	CBotControllerComponent() = default;
+	virtual ~CBotControllerComponent() override {}
+
+	static void ReflectType(Schematyc::CTypeDesc<CBotControllerComponent>& desc)
+	{
+		desc.SetGUID("{F29732C5-8092-4DFF-8DE5-D7831D65A811}"_cry_guid);
+	}
+
+	void Start(CPlayerComponent* pPlayer, EMode mode, uint32 seed);
+	void Update(float fFrametime);
+
+private:
+	uint32 NextRandom();
+	float  NextRandom(float min, float max);
+
+	void   Press(EPlayerAction action, float value = 1.f);
+	void   Release(EPlayerAction action);
+
+	void   UpdateRandom(float fFrametime);
+	void   UpdateScripted(float fFrametime);
+
+private:
+	CPlayerComponent* m_pPlayer = nullptr;
+	EMode             m_mode = EMode::Random;
+	uint32            m_random = 1;
+
+	float             m_fTime = 0.f;
+	float             m_fNextDecision = 0.f;
+	float             m_fTurnRate = 0.f; // Mouse units per second
+	EPlayerAction     m_moveAction = EPlayerAction::Count; // Count while standing still
+	bool              m_bSprinting = false;
+	bool              m_bCrouching = false;
+};
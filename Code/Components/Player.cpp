@@ -2,10 +2,13 @@
 #include "StdAfx.h"
 #include "Player.h"
 #include "GamePlugin.h"
+#include "BotController.h"
+#include "Systems/HotPathProfiler.h"
 
 #include <CrySchematyc/Env/Elements/EnvComponent.h>
 #include <CryCore/StaticInstanceList.h>
 #include <CrySchematyc/Env/IEnvRegistrar.h>
+#include <CryNetwork/Rmi.h>
 
 
 
@@ -20,6 +23,59 @@ namespace
     }
 
     CRY_STATIC_AUTO_REGISTER_FUNCTION(&RegisterPlayerComponent);
+
+    // Keys for the player actions, the defaults unless the profile's actionmaps.xml rebinds them:
+    //   <ActionMaps><actionmap name="player"><action name="jump" keyboard="mouse2"/></actionmap></ActionMaps>
+    struct SPlayerActionBindings
+    {
+        std::array<EKeyId, static_cast<size_t>(EPlayerAction::Count)> keys;
+    };
+
+    SPlayerActionBindings LoadPlayerActionBindings()
+    {
+        SPlayerActionBindings bindings;
+        for (size_t i = 0; i < PLAYER_ACTIONS.size(); ++i)
+        {
+            bindings.keys[i] = PLAYER_ACTIONS[i].defaultKey;
+        }
+
+        const CConfigNode actionMaps = gEnv->pInput != nullptr ? CGamePlugin::GetInstance()->GetConfigCache()->GetDocument("Libs/config/Profiles/default/actionmaps.xml") : CConfigNode();
+        if (!actionMaps)
+            return bindings;
+
+        for (uint32 i = 0; i < actionMaps.GetChildCount(); ++i)
+        {
+            const CConfigNode actionMap = actionMaps.GetChild(i);
+            if (!actionMap.IsTag("actionmap") || strcmp(actionMap.GetAttr("name"), "player") != 0)
+                continue;
+
+            for (uint32 j = 0; j < actionMap.GetChildCount(); ++j)
+            {
+                const CConfigNode actionNode = actionMap.GetChild(j);
+                const EPlayerAction action = FindPlayerAction(actionNode.GetAttr("name"));
+                if (action == EPlayerAction::Count || !actionNode.HaveAttr("keyboard"))
+                    continue;
+
+                const EKeyId keyId = gEnv->pInput->GetKeyId(actionNode.GetAttr("keyboard"));
+                if (keyId == eKI_Unknown)
+                {
+                    CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "actionmaps.xml: unknown key '%s' for action '%s'", actionNode.GetAttr("keyboard"), actionNode.GetAttr("name"));
+                    continue;
+                }
+
+                bindings.keys[GetPlayerActionIndex(action)] = keyId;
+            }
+        }
+
+        return bindings;
+    }
+
+    // Loaded once per process, players spawned afterwards share the table
+    const SPlayerActionBindings& GetPlayerActionBindings()
+    {
+        static const SPlayerActionBindings bindings = LoadPlayerActionBindings();
+        return bindings;
+    }
 }
 
 CPlayerComponent::CPlayerComponent()
@@ -27,21 +83,19 @@ CPlayerComponent::CPlayerComponent()
     , m_pInputComponent(nullptr)
     , m_pAdvancedAnimationComponent(nullptr)
     , m_pCharacterController(nullptr)
+    , m_pPlayerSystem(nullptr)
+    , m_bBotControlled(false)
+    , m_bSimulated(true)
+    , m_playerHandle(INVALID_PLAYER_HANDLE)
+    , m_standUpQuery(INVALID_PHYSICS_QUERY_HANDLE)
 
-    , vec2MouseDeltaRotation(ZERO)
     , vec3CameraStandingPos(Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_STANDING))
     , vec3CameraCrouchPos(Vec3(0.f, 0.f, DEFAULT_CAMERA_HEIGHT_CROUCH))
     , vec3CamEndOffset(Vec3(0.f,0.f,DEFAULT_CAMERA_HEIGHT_STANDING))
-    , quatCurrentYaw(IDENTITY)
-    , fCurrentPitch(0.f)
 
-    , m_currentPlayerState(DEFAULT_STATE)
-    , fMovementSpeed(ZERO)
     , fWalkSpeed(DEFAULT_SPEED_WALKING)
     , fSprintSpeed(DEFAULT_SPEED_RUNNING)
     , fJumpHeight(DEFAULT_JUMP_ENERGY)    
-    , epsCurrentStance(DEFAULT_STANCE)
-    , epsDesireStance(DEFAULT_STANCE)
     , fCapsuleHeightStanding(DEFAULT_CAPSULE_HEIGHT_STANDING)
     , fCapsuleHeightCrouch(DEFAULT_CAPSULE_HEIGHT_CROUCHING)
     , fCapsuleGroundOffset(DEFAULT_CAPSULE_GROUND_OFFSET)
@@ -56,145 +110,222 @@ CPlayerComponent::CPlayerComponent()
 
 void CPlayerComponent::Initialize()
 {
+    // Bots are driven through InjectAction, an input component would take the local player's action map
+    m_bBotControlled = m_pEntity->GetComponent<CBotControllerComponent>() != nullptr;
+
     m_pCameraComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCameraComponent>();
-    m_pInputComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CInputComponent>();
+    m_pInputComponent = m_bBotControlled ? nullptr : m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CInputComponent>();
     m_pCharacterController = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CCharacterControllerComponent>();
     m_pAdvancedAnimationComponent = m_pEntity->GetOrCreateComponent<Cry::DefaultComponents::CAdvancedAnimationComponent>();
 
+    m_pPlayerSystem = CGamePlugin::GetInstance()->GetPlayerSystem();
+    m_playerHandle = m_pPlayerSystem->Register(this);
 
+    // Clients send their input commands, the server replies with the resulting state
+    m_pEntity->GetNetEntity()->BindToNetwork();
+    SRmi<RMI_WRAP(&CPlayerComponent::SvReceiveInputCommands)>::Register(this, eRAT_NoAttach, false, eNRT_UnreliableUnordered);
+    SRmi<RMI_WRAP(&CPlayerComponent::ClReceiveSnapshot)>::Register(this, eRAT_NoAttach, false, eNRT_UnreliableUnordered);
 
+    InitializeInput();
     Reset();
 }
 
-void CPlayerComponent::InitializeInput()
+void CPlayerComponent::OnShutDown()
 {
+    if (m_playerHandle != INVALID_PLAYER_HANDLE)
+    {
+        m_pPlayerSystem->Unregister(m_playerHandle);
+        m_playerHandle = INVALID_PLAYER_HANDLE;
+    }
+}
 
-    m_pInputComponent->RegisterAction("player", "moveforward", [this](int activatonMode, float value) {vec2MovementDelta.y = value; });
-    m_pInputComponent->BindAction("player", "moveforward", eAID_KeyboardMouse, eKI_W);
-
-
-    m_pInputComponent->RegisterAction("player", "movebackward", [this](int activatonMode, float value) {vec2MovementDelta.y = -value; });
-    m_pInputComponent->BindAction("player", "movebackward", eAID_KeyboardMouse, eKI_S);
+const std::array<CPlayerComponent::TActionHandler, static_cast<size_t>(EPlayerAction::Count)> CPlayerComponent::s_actionHandlers =
+{ {
+    &CPlayerComponent::OnMoveForward,
+    &CPlayerComponent::OnMoveBackward,
+    &CPlayerComponent::OnMoveRight,
+    &CPlayerComponent::OnMoveLeft,
+    &CPlayerComponent::OnSprint,
+    &CPlayerComponent::OnCanter,
+    &CPlayerComponent::OnJump,
+    &CPlayerComponent::OnCrouch,
+    &CPlayerComponent::OnYaw,
+    &CPlayerComponent::OnPitch,
+    &CPlayerComponent::OnCamSwitch,
+} };
+
+void CPlayerComponent::InjectAction(EPlayerAction action, int activationMode, float value)
+{
+    m_pPlayerSystem->InjectInput(m_playerHandle, action, activationMode, value);
+}
 
+void CPlayerComponent::DispatchAction(EPlayerAction action, int activationMode, float value)
+{
+    (this->*s_actionHandlers[GetPlayerActionIndex(action)])(activationMode, value);
+}
 
-    m_pInputComponent->RegisterAction("player", "moveright", [this](int activatonMode, float value) {vec2MovementDelta.x = value; });
-    m_pInputComponent->BindAction("player", "moveright", eAID_KeyboardMouse, eKI_D);
+void CPlayerComponent::InitializeInput()
+{
+    // Called once per component: respawns and level restarts keep the registered actions
+    if (m_pInputComponent == nullptr)
+        return;
 
+    const SPlayerActionBindings& bindings = GetPlayerActionBindings();
 
-    m_pInputComponent->RegisterAction("player", "moveleft", [this](int activatonMode, float value) {vec2MovementDelta.x = -value; });
-    m_pInputComponent->BindAction("player", "moveleft", eAID_KeyboardMouse, eKI_A);
+    for (size_t i = 0; i < PLAYER_ACTIONS.size(); ++i)
+    {
+        const EPlayerAction action = static_cast<EPlayerAction>(i);
 
+        // Input only queues the action, the handler runs on the tick covering the time it arrived
+        // Captures two words, small enough for std::function to keep inline
+        m_pInputComponent->RegisterAction("player", PLAYER_ACTIONS[i].szName, [this, action](int activationMode, float value) { m_pPlayerSystem->QueueInput(m_playerHandle, action, activationMode, value); });
+        m_pInputComponent->BindAction("player", PLAYER_ACTIONS[i].szName, eAID_KeyboardMouse, bindings.keys[i]);
+    }
+}
 
-    m_pInputComponent->RegisterAction("player", "sprint", [this](int activationMode, float value)
-        {
-            if (activationMode == (int)eAAM_OnPress)
-            {
-                m_currentPlayerState = EPlayerState::Sprinting;
-            }
-            else if (activationMode == eAAM_OnRelease)
-            {
-                m_currentPlayerState = EPlayerState::Walking;
-            }
-        });
-    m_pInputComponent->BindAction("player", "sprint", eAID_KeyboardMouse, eKI_LCtrl);
+void CPlayerComponent::OnMoveForward(int activationMode, float value)
+{
+    m_pPlayerSystem->SetMovementY(m_playerHandle, value);
+}
 
+void CPlayerComponent::OnMoveBackward(int activationMode, float value)
+{
+    m_pPlayerSystem->SetMovementY(m_playerHandle, -value);
+}
 
-    m_pInputComponent->RegisterAction("player", "canter", [this](int activationMode, float value)
-        {
-            if (activationMode == (int)eAAM_OnPress)
-            {
-                m_currentPlayerState = EPlayerState::Canter;
-            }
-            else if (activationMode == eAAM_OnRelease)
-            {
-                m_currentPlayerState = EPlayerState::Walking;
-            }
-        });
-    m_pInputComponent->BindAction("player", "canter", eAID_KeyboardMouse, eKI_LAlt);
+void CPlayerComponent::OnMoveRight(int activationMode, float value)
+{
+    m_pPlayerSystem->SetMovementX(m_playerHandle, value);
+}
 
+void CPlayerComponent::OnMoveLeft(int activationMode, float value)
+{
+    m_pPlayerSystem->SetMovementX(m_playerHandle, -value);
+}
 
-    m_pInputComponent->RegisterAction("player", "jump", [this](int activationMode, float value)
+void CPlayerComponent::OnSprint(int activationMode, float value)
+{
+    if (activationMode == (int)eAAM_OnPress)
     {
-        if (m_pCharacterController->IsOnGround())
-        {
-                iJumpCount = 0;
-        }
-        if (activationMode == (int)eAAM_OnPress && iJumpCount < iMaxJump)
-        {
-            CryLog("A Jump Call");
-            m_pCharacterController->AddVelocity(Vec3(0, 0, fJumpHeight));
-            iJumpCount++;
-        }
-    });
-    m_pInputComponent->BindAction("player", "jump", eAID_KeyboardMouse, eKI_Space);
+        m_pPlayerSystem->SetPlayerState(m_playerHandle, EPlayerState::Sprinting);
+    }
+    else if (activationMode == eAAM_OnRelease)
+    {
+        m_pPlayerSystem->SetPlayerState(m_playerHandle, EPlayerState::Walking);
+    }
+}
 
+void CPlayerComponent::OnCanter(int activationMode, float value)
+{
+    if (activationMode == (int)eAAM_OnPress)
+    {
+        m_pPlayerSystem->SetPlayerState(m_playerHandle, EPlayerState::Canter);
+    }
+    else if (activationMode == eAAM_OnRelease)
+    {
+        m_pPlayerSystem->SetPlayerState(m_playerHandle, EPlayerState::Walking);
+    }
+}
 
-    m_pInputComponent->RegisterAction("player", "crouch", [this](int activationMode, float value)
+void CPlayerComponent::OnJump(int activationMode, float value)
+{
+    if (activationMode == (int)eAAM_OnPress)
     {
-        if (activationMode == (int)eAAM_OnPress)
-        {
-            epsDesireStance = EPlayerStance::Crouch;
-            CryLog("Crouch pressed");
-        }
-        else if (activationMode == (int)eAAM_OnRelease)
-        {
-            epsDesireStance = EPlayerStance::Standing;
-        }
-    });
-    m_pInputComponent->BindAction("player", "crouch", eAID_KeyboardMouse, eKI_LShift);
+        m_pPlayerSystem->RequestJump(m_playerHandle);
+    }
+}
 
+void CPlayerComponent::OnCrouch(int activationMode, float value)
+{
+    if (activationMode == (int)eAAM_OnPress)
+    {
+        m_pPlayerSystem->SetDesiredStance(m_playerHandle, EPlayerStance::Crouch);
+        CryLog("Crouch pressed");
+    }
+    else if (activationMode == (int)eAAM_OnRelease)
+    {
+        m_pPlayerSystem->SetDesiredStance(m_playerHandle, EPlayerStance::Standing);
+    }
+}
 
-    m_pInputComponent->RegisterAction("player", "yaw", [this](int activatonMode, float value) {vec2MouseDeltaRotation.x = -value; });
-    m_pInputComponent->BindAction("player", "yaw", eAID_KeyboardMouse, eKI_MouseX);
+void CPlayerComponent::OnYaw(int activationMode, float value)
+{
+    m_pPlayerSystem->AddMouseDeltaX(m_playerHandle, -value);
+}
 
+void CPlayerComponent::OnPitch(int activationMode, float value)
+{
+    m_pPlayerSystem->AddMouseDeltaY(m_playerHandle, -value);
+}
 
-    m_pInputComponent->RegisterAction("player", "pitch", [this](int iActivatonMode, float value) {vec2MouseDeltaRotation.y = -value; });
-    m_pInputComponent->BindAction("player", "pitch", eAID_KeyboardMouse, eKI_MouseY);
+void CPlayerComponent::OnCamSwitch(int activationMode, float value)
+{
+    /*
+    if (iActivationMode == eIS_Pressed)
+    {
 
-    m_pInputComponent->RegisterAction("player", "camswitch", [this](int iActivationMode, float value)
+        if (is_FPS)
         {
-            /*
-            if (iActivationMode == eIS_Pressed)
-            {
-
-                if (is_FPS)
-                {
-                    if(playerState == ePS_Crouching ||)
-                        CryLog("CamChange to FPS Detected");
-                    is_FPS = false;
-                }
-            }
-            else
-            {
-                CryLog("CamChange to TPS Detected");
-                is_FPS = true;
-            }
-            */
-        });
-    m_pInputComponent->BindAction("player", "camswitch", eAID_KeyboardMouse, eKI_F2);
-
+            if(playerState == ePS_Crouching ||)
+                CryLog("CamChange to FPS Detected");
+            is_FPS = false;
+        }
+    }
+    else
+    {
+        CryLog("CamChange to TPS Detected");
+        is_FPS = true;
+    }
+    */
 }
 
 void CPlayerComponent::Reset()
 {
-    vec2MovementDelta = ZERO;
-    vec2MouseDeltaRotation = ZERO;
+    CPlayerSystem::SPlayerTuning tuning;
+    tuning.fWalkSpeed = fWalkSpeed;
+    tuning.fSprintSpeed = fSprintSpeed;
+    tuning.fRotationSpeed = fRotationSpeed;
+    tuning.fPitchMin = fRotationLimitsMinPitch;
+    tuning.fPitchMax = fRotationLimitsMaxPitch;
+    tuning.fCapsuleRadius = m_pCharacterController->GetPhysicsParameters().m_radius * 0.5f;
+    tuning.fCapsuleHeightStanding = fCapsuleHeightStanding;
+    tuning.fCapsuleHeightCrouch = fCapsuleHeightCrouch;
+    tuning.fCapsuleGroundOffset = fCapsuleGroundOffset;
+    m_pPlayerSystem->ResetPlayer(m_playerHandle, m_pEntity->GetWorldRotation().GetRotZ(), tuning);
+    UpdateNetRole();
+
+    iJumpCount = 0;
 
-    InitializeInput();
+    vec3CamEndOffset = vec3CameraStandingPos;
 
-    m_currentPlayerState = EPlayerState::Walking;
-    epsCurrentStance = EPlayerStance::Standing;
-    epsDesireStance = epsCurrentStance;
+}
 
 
-    quatCurrentYaw = Quat::CreateRotationZ(m_pEntity->GetWorldRotation().GetRotZ());
-    fCurrentPitch = 0.f;
 
-    vec3CamEndOffset = vec3CameraStandingPos;
+void CPlayerComponent::UpdateNetRole()
+{
+    EPlayerNetRole role = EPlayerNetRole::Authority;
 
-}
+    if (gEnv->bServer)
+    {
+        // Players owned by a remote channel are simulated from the commands that client sends
+        const INetEntity* pNetEntity = m_pEntity->GetNetEntity();
+        const bool bRemotelyOwned = (m_pEntity->GetFlags() & ENTITY_FLAG_LOCAL_PLAYER) == 0 && pNetEntity != nullptr && pNetEntity->GetChannelId() != 0;
+        role = bRemotelyOwned ? EPlayerNetRole::RemoteOwned : EPlayerNetRole::Authority;
+    }
+    else
+    {
+        role = (m_pEntity->GetFlags() & ENTITY_FLAG_LOCAL_PLAYER) != 0 ? EPlayerNetRole::Predicted : EPlayerNetRole::Proxy;
+    }
 
+    m_pPlayerSystem->SetNetRole(m_playerHandle, role);
 
+    // Only proxies are ever placed instead of simulated
+    if (role != EPlayerNetRole::Proxy)
+    {
+        SetSimulated(true);
+    }
+}
 
 void CPlayerComponent::RecenterCollider()
 {
@@ -223,40 +354,196 @@ void CPlayerComponent::RecenterCollider()
     skip = true;
 
     m_pCharacterController->Physicalize();
+
+    // A new physical entity starts simulated, the player system turns it off again for proxies
+    m_bSimulated = true;
 }
 
-void CPlayerComponent::UpdateMovement()
+void CPlayerComponent::ApplyVelocity(const Vec3& velocity)
 {
+    m_pCharacterController->SetVelocity(velocity);
+}
+
+void CPlayerComponent::TryJump()
+{
+    if (m_pCharacterController->IsOnGround())
+    {
+        iJumpCount = 0;
+    }
+    if (iJumpCount < iMaxJump)
+    {
+        CryLog("A Jump Call");
+        m_pCharacterController->AddVelocity(Vec3(0, 0, fJumpHeight));
+        iJumpCount++;
+    }
+}
 
-    Vec3 velocity = Vec3(vec2MovementDelta.x, vec2MovementDelta.y, 0.0f);
-    velocity.Normalize();
-    fMovementSpeed = m_currentPlayerState == EPlayerState::Sprinting ? fSprintSpeed : fWalkSpeed;
-    //m_pEntity->SetPos(m_pEntity->GetWorldPos() + Vec3(vec2MovementDelta.x, vec2MovementDelta.y, 0.0f));
-    m_pCharacterController->SetVelocity(m_pEntity->GetWorldRotation() * velocity * fMovementSpeed);
+void CPlayerComponent::ApplyPositionCorrection(const Vec3& offset)
+{
+    m_pEntity->SetPos(m_pEntity->GetWorldPos() + offset);
 }
 
-void CPlayerComponent::UpdateRotation()
+void CPlayerComponent::ApplyInterpolatedPosition(const Vec3& position)
 {
-    quatCurrentYaw *= Quat::CreateRotationZ(vec2MouseDeltaRotation.x * fRotationSpeed);
-    m_pEntity->SetRotation(quatCurrentYaw);
+    m_pEntity->SetPos(position);
 }
 
-void CPlayerComponent::UpdateCamera(float fFrametime)
+void CPlayerComponent::SetSimulated(bool bSimulated)
 {
-    fCurrentPitch = crymath::clamp(fCurrentPitch + vec2MouseDeltaRotation.y * fRotationSpeed, fRotationLimitsMinPitch, fRotationLimitsMaxPitch);
+    if (bSimulated == m_bSimulated)
+        return;
+
+    IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
+    if (pPhysEnt == nullptr)
+        return;
+
+    m_bSimulated = bSimulated;
+
+    // An inactive living entity stays where it is put, no gravity, collision response or requested velocity
+    pe_player_dynamics playerDynamics;
+    playerDynamics.bActive = bSimulated ? 1 : 0;
+    pPhysEnt->SetParams(&playerDynamics);
+
+    // The engine's physics updates from the server would move it as well
+    if (INetEntity* pNetEntity = m_pEntity->GetNetEntity())
+    {
+        pNetEntity->EnableAspect(eEA_Physics, bSimulated);
+    }
+}
+
+void CPlayerComponent::MarkAspectsDirty(NetworkAspectType aspects)
+{
+    NetMarkAspectsDirty(aspects);
+}
+
+void CPlayerComponent::SendInputCommands(const CPlayerCommandBuffer& history)
+{
+    // Oldest first, the server queues them in sequence order
+    SPlayerInputCommandsParams params;
+    params.count = static_cast<uint8>(std::min<uint32>(history.GetCount(), SPlayerInputCommandsParams::MaxCommands));
+
+    const uint32 first = history.GetCount() - params.count;
+    for (uint8 i = 0; i < params.count; ++i)
+    {
+        params.commands[i] = history.Get(first + i);
+    }
+    params.ackedSnapshot = m_pPlayerSystem->GetLastReceivedSnapshot();
+    params.ackedSnapshotParts = m_pPlayerSystem->GetLastReceivedSnapshotParts();
+
+    SRmi<RMI_WRAP(&CPlayerComponent::SvReceiveInputCommands)>::InvokeOnServer(this, std::move(params));
+}
+
+bool CPlayerComponent::SvReceiveInputCommands(SPlayerInputCommandsParams&& params, INetChannel* pNetChannel)
+{
+    // Only the owning client may drive this player
+    const INetEntity* pNetEntity = m_pEntity->GetNetEntity();
+    if (pNetEntity == nullptr || gEnv->pGameFramework->GetGameChannelId(pNetChannel) != pNetEntity->GetChannelId())
+        return true;
+
+    m_pPlayerSystem->ReceiveCommands(m_playerHandle, params.commands, params.count);
+    m_pPlayerSystem->AcknowledgeSnapshot(m_playerHandle, params.ackedSnapshot, params.ackedSnapshotParts);
+    return true;
+}
+
+void CPlayerComponent::SendSnapshot(const SPlayerSnapshotParams& params)
+{
+    SRmi<RMI_WRAP(&CPlayerComponent::ClReceiveSnapshot)>::InvokeOnClient(this, SPlayerSnapshotParams(params), m_pEntity->GetNetEntity()->GetChannelId());
+}
+
+bool CPlayerComponent::ClReceiveSnapshot(SPlayerSnapshotParams&& params, INetChannel* pNetChannel)
+{
+    m_pPlayerSystem->ReceiveSnapshot(params);
+    return true;
+}
+
+bool CPlayerComponent::NetSerialize(TSerialize ser, EEntityAspects aspect, uint8 profile, int flags)
+{
+    if ((aspect & GetNetSerializeAspectMask()) == 0)
+        return true;
+
+    // Same quantization as the snapshots. Each aspect only carries its own fields, on the client the others keep
+    // the values of the aspects received before.
+    SPlayerAuthoritativeState state;
+    SQuantizedPlayerState quantized;
+    if (ser.IsWriting())
+    {
+        m_pPlayerSystem->GetAuthoritativeState(m_playerHandle, state);
+        quantized = PlayerStateCodec::Quantize(state);
+    }
+    else
+    {
+        quantized = m_pPlayerSystem->GetReceivedAspectState(m_playerHandle);
+        PlayerStateCodec::Dequantize(quantized, state);
+    }
+
+    if (aspect == PLAYER_MOVEMENT_ASPECT)
+    {
+        ser.Value("lastCommand", quantized.lastCommand, 'ui32');
+        ser.Value("position", state.position, 'lwld');
+        ser.Value("state", quantized.state, 'ui2');
+    }
+    else if (aspect == PLAYER_STANCE_ASPECT)
+    {
+        ser.Value("stance", quantized.stance, 'ui2');
+    }
+    else if (aspect == PLAYER_VIEW_ASPECT)
+    {
+        ser.Value("yaw", quantized.yaw, 'ui16');
+        ser.Value("pitch", quantized.pitch, 'ui16');
+    }
+
+    if (ser.IsReading())
+    {
+        const Vec3 position = state.position;
+        PlayerStateCodec::Dequantize(quantized, state);
+        if (aspect == PLAYER_MOVEMENT_ASPECT)
+        {
+            // The position went through the matching policy instead of the codec
+            state.position = position;
+            quantized = PlayerStateCodec::Quantize(state);
+        }
+
+        m_pPlayerSystem->SetReceivedAspectState(m_playerHandle, quantized);
+        m_pPlayerSystem->SetAuthoritativeState(m_playerHandle, state);
+    }
+
+    return true;
+}
+
+void CPlayerComponent::ApplyView(float fYaw, float fPitch, float fFrametime)
+{
+    m_pEntity->SetRotation(Quat::CreateRotationZ(fYaw));
+    UpdateCamera(fPitch, fFrametime);
+}
+
+void CPlayerComponent::UpdateCamera(float fPitch, float fFrametime)
+{
+    HOTPATH_PROFILE_SCOPE("CPlayerComponent::UpdateCamera");
 
     Vec3 vec3CurrentCamOffset = m_pCameraComponent->GetTransformMatrix().GetTranslation();
     vec3CurrentCamOffset = Vec3::CreateLerp(vec3CurrentCamOffset, vec3CamEndOffset, 10.0f * fFrametime);
 
     Matrix34 finalCamMartix;
     finalCamMartix.SetTranslation(vec3CurrentCamOffset);
-    finalCamMartix.SetRotation33(Matrix33::CreateRotationX(fCurrentPitch));
+    finalCamMartix.SetRotation33(Matrix33::CreateRotationX(fPitch));
     m_pCameraComponent->SetTransformMatrix(finalCamMartix);
 }
 
 void CPlayerComponent::TryUpdateStance()
 {
-    if (epsDesireStance == epsCurrentStance) return;
+    HOTPATH_PROFILE_SCOPE("CPlayerComponent::TryUpdateStance");
+
+    SetStance(m_pPlayerSystem->GetDesiredStance(m_playerHandle), true);
+}
+
+void CPlayerComponent::ApplyStanceCorrection(EPlayerStance stance)
+{
+    SetStance(stance, false);
+}
+
+void CPlayerComponent::SetStance(EPlayerStance epsDesireStance, bool bCheckClearance)
+{
+    if (epsDesireStance == m_pPlayerSystem->GetCurrentStance(m_playerHandle)) return;
     IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
     if (pPhysEnt == nullptr)
     {
@@ -287,6 +574,7 @@ void CPlayerComponent::TryUpdateStance()
             tusHeight = fCapsuleHeightStanding;
             tusCamOffset = vec3CameraStandingPos;
             CryLog("Standing confrimed");
+            if (!bCheckClearance) break;
             primitives::capsule capsol;
 
             capsol.axis.Set(0, 0, 1);
@@ -295,7 +583,17 @@ void CPlayerComponent::TryUpdateStance()
             capsol.r = radius;
             capsol.hh = tusHeight * 0.5f;
 
-            if (IsCapsuleIntersectingGeometry(capsol)) return;
+            // Stand up on the tick after a clear result, keep asking while something is in the way
+            CPhysicsQueryService& physicsQueries = m_pPlayerSystem->GetPhysicsQueries();
+            CPhysicsQueryService::SResult result;
+            const CPhysicsQueryService::EStatus status = physicsQueries.GetResult(m_standUpQuery, result);
+            if (status == CPhysicsQueryService::EStatus::Pending) return;
+            if (status == CPhysicsQueryService::EStatus::Expired || result.bHit)
+            {
+                m_standUpQuery = physicsQueries.QueueCapsuleOverlap(capsol, pPhysEnt);
+                return;
+            }
+            m_standUpQuery = INVALID_PHYSICS_QUERY_HANDLE;
 
 
         }break;
@@ -307,41 +605,21 @@ void CPlayerComponent::TryUpdateStance()
     playerDemensions.sizeCollider = Vec3(radius, radius, tusHeight * 0.5f);
     vec3CamEndOffset = tusCamOffset;
 
-    epsCurrentStance = epsDesireStance;
+    m_pPlayerSystem->SetCurrentStance(m_playerHandle, epsDesireStance);
 
     pPhysEnt->SetParams(&playerDemensions);
 }
 
-bool CPlayerComponent::IsCapsuleIntersectingGeometry(const primitives::capsule& capsule) const
-{
-    IPhysicalEntity* pPhysEnt = m_pEntity->GetPhysicalEntity();
-
-    if (pPhysEnt == nullptr)
-        return false;
-
-    IPhysicalWorld::SPWIParams pwiParams;
-
-    pwiParams.itype = capsule.type;
-    pwiParams.pprim = &capsule;
-
-    pwiParams.pSkipEnts = &pPhysEnt;
-    pwiParams.nSkipEnts = 1;
-
-    intersection_params intersectionParams;
-    intersectionParams.bSweepTest = false;
-    pwiParams.pip = &intersectionParams;
-
-    const int contactCount = static_cast<int>(gEnv->pPhysicalWorld -> PrimitiveWorldIntersection(pwiParams));
-    return contactCount > 0;
-}
-
 Cry::Entity::EventFlags CPlayerComponent::GetEventMask() const
 {
-    return Cry::Entity::EEvent::GameplayStarted | Cry::Entity::EEvent::Update | Cry::Entity::EEvent::PhysicalTypeChanged | Cry::Entity::EEvent::Reset;
+    // No Update event, the per-tick work is batched by CPlayerSystem
+    return Cry::Entity::EEvent::GameplayStarted | Cry::Entity::EEvent::PhysicalTypeChanged | Cry::Entity::EEvent::Reset | Cry::Entity::EEvent::BecomeLocalPlayer;
 }
 
 void CPlayerComponent::ProcessEvent(const SEntityEvent& event)
 {
+    HOTPATH_PROFILE_SCOPE("CPlayerComponent::ProcessEvent");
+
     switch (event.event)
     {
 
@@ -353,45 +631,6 @@ void CPlayerComponent::ProcessEvent(const SEntityEvent& event)
         }break;
 
 
-        case Cry::Entity::EEvent::Update:
-        {
-            const float fFrametime = event.fParam[0];
-
-            TryUpdateStance();
-            UpdateMovement();
-            UpdateRotation();
-            UpdateCamera(fFrametime);
-
-
-
-
-
-            /*
-            Ang3 rotationAng = CCamera::CreateAnglesYPR(Matrix33(quatLookOrientation));
-            rotationAng.x += vec2MouseDeltaRotation.x*fRotationSpeed;
-            rotationAng.y = CLAMP(rotationAng.y +  vec2MouseDeltaRotation.y * fRotationSpeed, fRotationLimitsMinPitch, fRotationLimitsMaxPitch);
-            rotationAng.z = 0;
-            quatLookOrientation = Quat(CCamera::CreateOrientationYPR(rotationAng));
-            //m_pEntity->SetRotation(quatLookOrientation);
-            
-
-            Ang3 yawAngle = CCamera::CreateAnglesYPR(Matrix33(quatLookOrientation));
-            yawAngle.y = 0;
-            const Quat finalYaw =Quat( CCamera::CreateOrientationYPR(yawAngle));
-            m_pEntity->SetRotation(finalYaw);
-
-
-            Ang3 pitchAngle = CCamera::CreateAnglesYPR(Matrix33(quatLookOrientation));
-            pitchAngle.x = 0;
-            Matrix34 finalCamMartix;
-            Matrix33 camRotation = CCamera::CreateOrientationYPR(pitchAngle);
-            finalCamMartix.SetTranslation(m_pCameraComponent->GetTransformMatrix().GetTranslation());
-            finalCamMartix.SetRotation33(camRotation);
-            m_pCameraComponent->SetTransformMatrix(finalCamMartix);
-            */
-            
-
-        }break;
         case Cry::Entity::EEvent::PhysicalTypeChanged:
         {
             RecenterCollider();
@@ -400,6 +639,10 @@ void CPlayerComponent::ProcessEvent(const SEntityEvent& event)
         {
             Reset();
         }break;
+        case Cry::Entity::EEvent::BecomeLocalPlayer:
+        {
+            UpdateNetRole();
+        }break;
 
     }
 }
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <numeric>
+#include <vector>
 
 #include <CryEntitySystem/IEntityComponent.h>
 #include <CryMath/Cry_Camera.h>
@@ -15,6 +16,9 @@
 #include <DefaultComponents/Input/InputComponent.h>
 #include <DefaultComponents/Audio/ListenerComponent.h>
 
+#include "Systems/PlayerSystem.h"
+#include "Network/PlayerInputCommand.h"
+#include "PlayerActions.h"
 
 
 namespace Cry::DefaultComponents
@@ -84,20 +88,65 @@ public:
 	}
 
 	virtual void Initialize() override;
+	virtual void OnShutDown() override;
 	virtual Cry::Entity::EventFlags GetEventMask() const override;
 	virtual void ProcessEvent(const SEntityEvent& event) override;
+	virtual bool NetSerialize(TSerialize ser, EEntityAspects aspect, uint8 profile, int flags) override;
+	virtual NetworkAspectType GetNetSerializeAspectMask() const override { return PLAYER_MOVEMENT_ASPECT | PLAYER_STANCE_ASPECT | PLAYER_VIEW_ASPECT; }
+
+	// Queues an action for the next simulation tick, as if its key had been used. Main thread only, for bots and load test clients.
+	void InjectAction(EPlayerAction action, int activationMode, float value);
+
+	TPlayerHandle GetPlayerHandle() const { return m_playerHandle; }
 
 
 protected:
+	// The per-tick update is driven by CPlayerSystem, which calls back into the entity-facing parts below
+	friend class CPlayerSystem;
+
 	void Reset();
 	void InitializeInput();
+	void UpdateNetRole();
 
 	void RecenterCollider();
-	void UpdateMovement();
-	void UpdateRotation();
-	void UpdateCamera(float fFrametime);
+	void ApplyVelocity(const Vec3& velocity);
+	Vec3 GetVelocity() const { return m_pCharacterController->GetVelocity(); }
+	void ApplyView(float fYaw, float fPitch, float fFrametime);
+	void UpdateCamera(float fPitch, float fFrametime);
 	void TryUpdateStance();
-	bool IsCapsuleIntersectingGeometry(const primitives::capsule& capsule) const;
+	// Takes a stance the server ended up in, without checking there is room for it
+	void ApplyStanceCorrection(EPlayerStance stance);
+	void SetStance(EPlayerStance stance, bool bCheckClearance);
+	void TryJump();
+	void ApplyPositionCorrection(const Vec3& offset);
+	void ApplyInterpolatedPosition(const Vec3& position);
+	void SetSimulated(bool bSimulated);
+
+	// Runs the handler of an action, called by the player system when the tick the action arrived in is simulated
+	void DispatchAction(EPlayerAction action, int activationMode, float value);
+
+	// Action handlers, indexed by EPlayerAction in s_actionHandlers
+	using TActionHandler = void (CPlayerComponent::*)(int activationMode, float value);
+	static const std::array<TActionHandler, static_cast<size_t>(EPlayerAction::Count)> s_actionHandlers;
+
+	void OnMoveForward(int activationMode, float value);
+	void OnMoveBackward(int activationMode, float value);
+	void OnMoveRight(int activationMode, float value);
+	void OnMoveLeft(int activationMode, float value);
+	void OnSprint(int activationMode, float value);
+	void OnCanter(int activationMode, float value);
+	void OnJump(int activationMode, float value);
+	void OnCrouch(int activationMode, float value);
+	void OnYaw(int activationMode, float value);
+	void OnPitch(int activationMode, float value);
+	void OnCamSwitch(int activationMode, float value);
+
+	// Client -> server input, server -> client state
+	void MarkAspectsDirty(NetworkAspectType aspects);
+	void SendInputCommands(const CPlayerCommandBuffer& history);
+	bool SvReceiveInputCommands(SPlayerInputCommandsParams&& params, INetChannel* pNetChannel);
+	void SendSnapshot(const SPlayerSnapshotParams& params);
+	bool ClReceiveSnapshot(SPlayerSnapshotParams&& params, INetChannel* pNetChannel);
 
 private:
 	Cry::DefaultComponents::CCameraComponent* m_pCameraComponent;
@@ -105,6 +154,23 @@ private:
 	Cry::DefaultComponents::CCharacterControllerComponent* m_pCharacterController;
 	Cry::DefaultComponents::CAdvancedAnimationComponent* m_pAdvancedAnimationComponent;
 
+	bool m_bBotControlled;
+	// False while a proxy is placed by the jitter buffer instead of simulated
+	bool m_bSimulated;
+
+	// Hot state (movement delta, yaw, pitch, stance, speed) lives in the player system, addressed by this handle
+	CPlayerSystem* m_pPlayerSystem;
+	TPlayerHandle m_playerHandle;
+
+	// Clearance check for standing up, answered by the player system's physics queries on the following tick
+	TPhysicsQueryHandle m_standUpQuery;
+
+	// Authoritative player state while g_playerStateSnapshots is off, split like the Movement / View extensions of
+	// Scripts/GameObjectSerializationOrder.xml so the server only marks and sends what changed
+	static constexpr EEntityAspects PLAYER_MOVEMENT_ASPECT = eEA_GameServerDynamic; // Last command, position, movement state
+	static constexpr EEntityAspects PLAYER_STANCE_ASPECT = eEA_GameServerStatic;
+	static constexpr EEntityAspects PLAYER_VIEW_ASPECT = eEA_GameServerA;           // Yaw and camera pitch
+
 	static constexpr EPlayerState DEFAULT_STATE = EPlayerState::Walking;
 	static constexpr float DEFAULT_SPEED_WALKING = 3;
 	static constexpr float DEFAULT_SPEED_CANTER = 6;
@@ -133,8 +199,6 @@ private:
 	Vec3 vec3CameraFinalPos;
 
 	Vec3 vec3CamEndOffset;
-	Quat quatCurrentYaw;
-	float fCurrentPitch;
 
 	float fCamOffsetTPSForward;
 	float fCamOffsetTPSUp;
@@ -146,10 +210,6 @@ private:
 
 
 	//Vars of Player
-	EPlayerState m_currentPlayerState;
-
-	Vec2 vec2MovementDelta;
-	float fMovementSpeed;
 	float fCrouchSpeed;
 	float fWalkSpeed;
 	float fCanterSpeed;
@@ -159,8 +219,6 @@ private:
 	int iMaxJump;
 	int iJumpCount;
 
-	EPlayerStance epsCurrentStance;
-	EPlayerStance epsDesireStance;
 	float fCapsuleHeightStanding;
 	float fCapsuleHeightCrouch;
 	float fCapsuleGroundOffset;
@@ -168,7 +226,6 @@ private:
 
 	//Vars of mouse rotation
 
-	Vec2 vec2MouseDeltaRotation;
 	float fRotationSpeed;
 	float fRotationLimitsMinPitch;
 	float fRotationLimitsMaxPitch;
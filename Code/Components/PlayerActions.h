@@ -0,0 +1,87 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+
+#include <CryInput/IInput.h>
+
+////////////////////////////////////////////////////////
+// The player's input actions, declared once. Actions are
+// addressed by ID and CPlayerComponent dispatches them
+// through a table of handlers indexed by that ID, so
+// neither key presses nor injected bot input look up
+// strings or allocate.
+////////////////////////////////////////////////////////
+
+enum class EPlayerAction : uint8
+{
+	MoveForward,
+	MoveBackward,
+	MoveRight,
+	MoveLeft,
+	Sprint,
+	Canter,
+	Jump,
+	Crouch,
+	Yaw,
+	Pitch,
+	CamSwitch,
+
+	Count
+};
+
+struct SPlayerActionDesc
+{
+	const char*   szName;     // Action name in the "player" action map
+	EKeyId        defaultKey; // Used unless actionmaps.xml binds the action to another key
+	EPlayerAction action;     // Must match the entry's index, checked below
+};
+
+// Same order as EPlayerAction
+constexpr std::array<SPlayerActionDesc, static_cast<size_t>(EPlayerAction::Count)> PLAYER_ACTIONS =
+{ {
+	{ "moveforward",  eKI_W,       EPlayerAction::MoveForward },
+	{ "movebackward", eKI_S,       EPlayerAction::MoveBackward },
+	{ "moveright",    eKI_D,       EPlayerAction::MoveRight },
+	{ "moveleft",     eKI_A,       EPlayerAction::MoveLeft },
+	{ "sprint",       eKI_LCtrl,   EPlayerAction::Sprint },
+	{ "canter",       eKI_LAlt,    EPlayerAction::Canter },
+	{ "jump",         eKI_Space,   EPlayerAction::Jump },
+	{ "crouch",       eKI_LShift,  EPlayerAction::Crouch },
+	{ "yaw",          eKI_MouseX,  EPlayerAction::Yaw },
+	{ "pitch",        eKI_MouseY,  EPlayerAction::Pitch },
+	{ "camswitch",    eKI_F2,      EPlayerAction::CamSwitch },
+} };
+
+constexpr bool ArePlayerActionsInOrder()
+{
+	for (size_t i = 0; i < PLAYER_ACTIONS.size(); ++i)
+	{
+		if (static_cast<size_t>(PLAYER_ACTIONS[i].action) != i || PLAYER_ACTIONS[i].szName == nullptr)
+			return false;
+	}
+	return true;
+}
+
+static_assert(ArePlayerActionsInOrder(), "PLAYER_ACTIONS must list every EPlayerAction once, in declaration order, each with a name");
+
+constexpr size_t GetPlayerActionIndex(EPlayerAction action)
+{
+	return static_cast<size_t>(action);
+}
+
+constexpr const SPlayerActionDesc& GetPlayerActionDesc(EPlayerAction action)
+{
+	return PLAYER_ACTIONS[GetPlayerActionIndex(action)];
+}
+
+// Returns EPlayerAction::Count for names that aren't player actions, only meant for loading bindings
+inline EPlayerAction FindPlayerAction(const char* szName)
+{
+	for (size_t i = 0; i < PLAYER_ACTIONS.size(); ++i)
+	{
+		if (strcmp(PLAYER_ACTIONS[i].szName, szName) == 0)
+			return static_cast<EPlayerAction>(i);
+	}
+	return EPlayerAction::Count;
+}
@@ -1,6 +1,7 @@
 // Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
 #include "StdAfx.h"
 #include "GamePlugin.h"
+#include "Systems/HotPathProfiler.h"
 
 
 
@@ -20,6 +21,13 @@ CGamePlugin::~CGamePlugin()
 
 	gEnv->pSystem->GetISystemEventDispatcher()->RemoveListener(this);
 
+	m_playerSystem.UnregisterConsoleCommands();
+	m_botSwarm.UnregisterConsoleCommands();
+	m_loadTestServer.UnregisterConsoleCommands();
+	m_levelLoader.UnregisterConsoleCommands();
+	m_configCache.UnregisterConsoleCommands();
+	CHotPathProfiler::UnregisterConsoleCommands();
+
 	if (gEnv->pSchematyc)
 	{
 		gEnv->pSchematyc->GetEnvRegistry().DeregisterPackage(CGamePlugin::GetCID());
@@ -30,12 +38,36 @@ bool CGamePlugin::Initialize(SSystemGlobalEnvironment& env, const SSystemInitPar
 {
 	// Register for engine system events, in our case we need ESYSTEM_EVENT_GAME_POST_INIT to load the map
 	gEnv->pSystem->GetISystemEventDispatcher()->RegisterListener(this, "CGamePlugin");
+
+	// Players are updated in one batch from MainUpdate instead of per-entity update events
+	EnableUpdate(EUpdateStep::MainUpdate, true);
+	m_playerSystem.RegisterConsoleCommands();
+	m_botSwarm.RegisterConsoleCommands();
+	m_loadTestServer.RegisterConsoleCommands();
+	m_levelLoader.RegisterConsoleCommands();
+	m_configCache.RegisterConsoleCommands();
+	CHotPathProfiler::RegisterConsoleCommands();
 	
 	return true;
 }
 
+void CGamePlugin::MainUpdate(float frameTime)
+{
+	// Issues the map load once its files are read, and notices the first frame of the loaded level
+	m_levelLoader.Update();
+	// Writes the rebuilt config cache once, after documents had to be parsed
+	m_configCache.Update();
+
+	// Bot and load test client input first, so it is part of this frame's ticks like real input
+	m_botSwarm.Update(frameTime);
+	m_loadTestServer.Update(frameTime);
+	m_playerSystem.Update(frameTime);
+}
+
 void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lparam)
 {
+	HOTPATH_PROFILE_SCOPE("CGamePlugin::OnSystemEvent");
+
 	switch (event)
 	{
 		// Called when the game framework has initialized and we are ready for game logic to start
@@ -43,12 +75,11 @@ void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lp
 		{
 			// Listen for client connection events, in order to create the local player
 
-
 			// Don't need to load the map in editor
 			if (!gEnv->IsEditor())
 			{
-				// Load the example map in client server mode
-				gEnv->pConsole->ExecuteString("map example s", false, true);
+				// Load the example map in client server mode, after its files are prefetched instead of blocking on each
+				m_levelLoader.Start("example");
 			}
 		}
 		break;
@@ -77,8 +108,24 @@ void CGamePlugin::OnSystemEvent(ESystemEvent event, UINT_PTR wparam, UINT_PTR lp
 		}
 		break;
 		
+		case ESYSTEM_EVENT_LEVEL_LOAD_END:
+		{
+			m_levelLoader.OnLevelLoadEnd();
+
+			// Baked next to the level by Code/Tools/PvsBake, only the server decides what clients get
+			if (gEnv->bServer)
+			{
+				m_playerSystem.GetInterestManager().LoadVisibility(gEnv->p3DEngine->GetLevelFilePath("visibility.pvs"));
+			}
+		}
+		break;
+
 		case ESYSTEM_EVENT_LEVEL_UNLOAD:
 		{
+			m_playerSystem.GetInterestManager().UnloadVisibility();
+			m_levelLoader.OnLevelUnload();
+			m_botSwarm.Clear();
+			m_loadTestServer.Clear();
 
 		}
 		break;
@@ -5,6 +5,12 @@
 #include <CryGame/IGameFramework.h>
 #include <CryEntitySystem/IEntityClass.h>
 
+#include "Systems/PlayerSystem.h"
+#include "Systems/BotSwarm.h"
+#include "Systems/ConfigCache.h"
+#include "Systems/LevelLoader.h"
+#include "Systems/LoadTestServer.h"
+
 
 class CPlayerComponent;
 
@@ -24,6 +30,7 @@ public:
 	// Cry::IEnginePlugin
 	virtual const char* GetCategory() const override { return "Game"; }
 	virtual bool Initialize(SSystemGlobalEnvironment& env, const SSystemInitParams& initParams) override;
+	virtual void MainUpdate(float frameTime) override;
 	// ~Cry::IEnginePlugin
 
 	// ISystemEventListener
@@ -37,7 +44,22 @@ public:
 	{
 		return cryinterface_cast<CGamePlugin>(CGamePlugin::s_factory.CreateClassInstance().get());
 	}
+
+	CPlayerSystem* GetPlayerSystem() { return &m_playerSystem; }
+	CBotSwarm* GetBotSwarm() { return &m_botSwarm; }
+	CLoadTestServer* GetLoadTestServer() { return &m_loadTestServer; }
+	CLevelLoader* GetLevelLoader() { return &m_levelLoader; }
+	CConfigCache* GetConfigCache() { return &m_configCache; }
 	
 protected:
-	
+	// The XML config baked by Code/Tools/ConfigBake, see g_configCache
+	CConfigCache m_configCache;
+	// Batches the per-tick update of every CPlayerComponent
+	CPlayerSystem m_playerSystem;
+	// Load test bots, see g_botSwarm
+	CBotSwarm m_botSwarm { m_playerSystem };
+	// Fake clients of the LoopbackLoad tool, see g_loadTestPort
+	CLoadTestServer m_loadTestServer { m_playerSystem };
+	// Prefetches the example map's files and loads it, see g_levelLoadAsync
+	CLevelLoader m_levelLoader;
 };
\ No newline at end of file
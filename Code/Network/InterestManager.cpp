@@ -0,0 +1,417 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "InterestManager.h"
+
+#include "GamePlugin.h"
+#include "Systems/HotPathProfiler.h"
+
+namespace
+{
+	float g_interestCellSize = 32.f;
+	float g_interestCullScale = 2.f;
+	int   g_interestVisibility = 2;
+	float g_interestOccludedScale = 0.25f;
+
+	void InterestStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetPlayerSystem()->GetInterestManager().LogStats();
+	}
+}
+
+void CInterestManager::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_interestCellSize", &g_interestCellSize, 32.f, VF_NULL, "Size (m) of the cells of the interest management grid");
+	REGISTER_CVAR2("g_interestCullScale", &g_interestCullScale, 2.f, VF_NULL, "Entities further away from a client than their Scheduler.xml normalDistance times this are not sent to it");
+	REGISTER_CVAR2("g_interestVisibility", &g_interestVisibility, 2, VF_NULL, "Use of the level's baked potentially visible set: 0 = ignored, 1 = entities in cells the client can't see get g_interestOccludedScale of their priority, 2 = they are not sent");
+	REGISTER_CVAR2("g_interestOccludedScale", &g_interestOccludedScale, 0.25f, VF_NULL, "Priority scale of entities in cells the client can't see, with g_interestVisibility 1");
+	REGISTER_COMMAND("g_interestStats", InterestStatsCommand, VF_NULL, "Prints the size of the interest management grid and relevant sets of the last tick");
+}
+
+void CInterestManager::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_interestCellSize", true);
+		gEnv->pConsole->UnregisterVariable("g_interestCullScale", true);
+		gEnv->pConsole->UnregisterVariable("g_interestVisibility", true);
+		gEnv->pConsole->UnregisterVariable("g_interestOccludedScale", true);
+		gEnv->pConsole->RemoveCommand("g_interestStats");
+	}
+}
+
+CInterestManager::CInterestManager()
+{
+	m_buckets.fill(InvalidSlot);
+	m_relevantOffsets.push_back(0);
+}
+
+void CInterestManager::LoadGroups()
+{
+	m_bGroupsLoaded = true;
+	m_groups.clear();
+	m_classGroups.clear();
+
+	CConfigCache& configCache = *CGamePlugin::GetInstance()->GetConfigCache();
+	if (const CConfigNode scheduler = configCache.GetDocument("Scripts/network/Scheduler.xml"))
+	{
+		for (uint32 i = 0; i < scheduler.GetChildCount(); ++i)
+		{
+			const CConfigNode groupNode = scheduler.GetChild(i);
+			if (!groupNode.IsTag("Group"))
+				continue;
+
+			SGroup group;
+			group.name = groupNode.GetAttr("name");
+			groupNode.GetAttr("priority", group.fPriority);
+			groupNode.GetAttr("normalDistance", group.fNormalDistance);
+			groupNode.GetAttr("close", group.fClose);
+			groupNode.GetAttr("far", group.fFar);
+			groupNode.GetAttr("front", group.fFront);
+			groupNode.GetAttr("back", group.fBack);
+
+			float foi = 360.f;
+			groupNode.GetAttr("foi", foi);
+			group.fCosHalfFoi = cosf(DEG2RAD(std::min(foi, 360.f)) * 0.5f);
+
+			m_groups.push_back(group);
+		}
+	}
+
+	if (m_groups.empty())
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[Interest] Scripts/network/Scheduler.xml has no groups, every entity is relevant everywhere");
+		SGroup group;
+		group.name = "obj";
+		m_groups.push_back(group);
+	}
+
+	m_defaultGroup = FindGroup("obj") != 0xff ? FindGroup("obj") : 0;
+	m_ownGroup = FindGroup("own") != 0xff ? FindGroup("own") : m_defaultGroup;
+
+	if (const CConfigNode entityScheduler = configCache.GetDocument("Scripts/network/EntityScheduler.xml"))
+	{
+		for (uint32 i = 0; i < entityScheduler.GetChildCount(); ++i)
+		{
+			const CConfigNode classNode = entityScheduler.GetChild(i);
+			const uint8 group = FindGroup(classNode.GetAttr("policy"));
+			if (group == 0xff)
+				continue;
+
+			if (classNode.IsTag("Class"))
+			{
+				m_classGroups.emplace_back(classNode.GetAttr("name"), group);
+			}
+			else if (classNode.IsTag("Default"))
+			{
+				m_defaultGroup = group;
+			}
+		}
+	}
+}
+
+uint8 CInterestManager::FindGroup(const char* szName) const
+{
+	for (size_t i = 0; i < m_groups.size(); ++i)
+	{
+		if (m_groups[i].name == szName)
+			return static_cast<uint8>(i);
+	}
+	return 0xff;
+}
+
+uint32 CInterestManager::GetBucket(int32 cellX, int32 cellY) const
+{
+	return ((static_cast<uint32>(cellX) * 73856093u) ^ (static_cast<uint32>(cellY) * 19349663u)) & (BucketCount - 1);
+}
+
+void CInterestManager::Link(uint32 slot)
+{
+	m_cellX[slot] = static_cast<int32>(floorf(m_position[slot].x / m_fCellSize));
+	m_cellY[slot] = static_cast<int32>(floorf(m_position[slot].y / m_fCellSize));
+
+	uint32& head = m_buckets[GetBucket(m_cellX[slot], m_cellY[slot])];
+	m_prev[slot] = InvalidSlot;
+	m_next[slot] = head;
+	if (head != InvalidSlot)
+	{
+		m_prev[head] = slot;
+	}
+	head = slot;
+}
+
+void CInterestManager::Unlink(uint32 slot)
+{
+	if (m_prev[slot] != InvalidSlot)
+	{
+		m_next[m_prev[slot]] = m_next[slot];
+	}
+	else
+	{
+		m_buckets[GetBucket(m_cellX[slot], m_cellY[slot])] = m_next[slot];
+	}
+
+	if (m_next[slot] != InvalidSlot)
+	{
+		m_prev[m_next[slot]] = m_prev[slot];
+	}
+}
+
+TInterestHandle CInterestManager::Add(uint32 userId, const char* szSchedulerClass, const Vec3& position)
+{
+	if (!m_bGroupsLoaded)
+	{
+		LoadGroups();
+	}
+
+	if (m_fCellSize <= 0.f)
+	{
+		m_fCellSize = std::max(g_interestCellSize, 1.f);
+	}
+
+	TInterestHandle slot;
+	if (!m_freeHandles.empty())
+	{
+		slot = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		slot = static_cast<TInterestHandle>(m_userId.size());
+		m_userId.push_back(0);
+		m_group.push_back(0);
+		m_position.push_back(Vec3(ZERO));
+		m_cellX.push_back(0);
+		m_cellY.push_back(0);
+		m_prev.push_back(InvalidSlot);
+		m_next.push_back(InvalidSlot);
+		m_bUsed.push_back(0);
+		m_bInGrid.push_back(0);
+		m_visibilityCell.push_back(CPotentiallyVisibleSet::OutsideCell);
+	}
+
+	uint8 group = m_defaultGroup;
+	for (const auto& classGroup : m_classGroups)
+	{
+		if (classGroup.first == szSchedulerClass)
+		{
+			group = classGroup.second;
+			break;
+		}
+	}
+
+	m_userId[slot] = userId;
+	m_group[slot] = group;
+	m_position[slot] = position;
+	m_bUsed[slot] = 1;
+	m_bInGrid[slot] = m_groups[group].fNormalDistance > 0.f ? 1 : 0;
+	m_visibilityCell[slot] = m_visibility.GetCell(position);
+
+	if (m_bInGrid[slot] != 0)
+	{
+		Link(slot);
+	}
+	else
+	{
+		m_global.push_back(slot);
+	}
+
+	return slot;
+}
+
+void CInterestManager::Remove(TInterestHandle handle)
+{
+	if (handle >= m_bUsed.size() || m_bUsed[handle] == 0)
+		return;
+
+	if (m_bInGrid[handle] != 0)
+	{
+		Unlink(handle);
+	}
+	else
+	{
+		stl::find_and_erase(m_global, handle);
+	}
+
+	m_bUsed[handle] = 0;
+	m_freeHandles.push_back(handle);
+}
+
+void CInterestManager::SetPosition(TInterestHandle handle, const Vec3& position)
+{
+	m_position[handle] = position;
+	m_visibilityCell[handle] = m_visibility.GetCell(position);
+
+	// Only entities crossing a cell border touch the grid
+	if (m_bInGrid[handle] != 0)
+	{
+		const int32 cellX = static_cast<int32>(floorf(position.x / m_fCellSize));
+		const int32 cellY = static_cast<int32>(floorf(position.y / m_fCellSize));
+		if (cellX != m_cellX[handle] || cellY != m_cellY[handle])
+		{
+			Unlink(handle);
+			Link(handle);
+		}
+	}
+}
+
+void CInterestManager::AddRelevant(uint32 slot, const SViewer& viewer, const Vec2& forward, uint32 viewerCell)
+{
+	const SGroup& group = m_groups[m_group[slot]];
+	if (group.fNormalDistance <= 0.f)
+	{
+		m_relevant.push_back({ m_userId[slot], group.fPriority });
+		return;
+	}
+
+	const Vec3 offset = m_position[slot] - viewer.position;
+	const float distanceSquared = offset.GetLengthSquared();
+	const float cullDistance = group.fNormalDistance * g_interestCullScale;
+	if (distanceSquared > cullDistance * cullDistance)
+		return;
+
+	// A row lookup and one bit test, the row is everything the viewer's cell can see
+	float visibilityScale = 1.f;
+	if (g_interestVisibility != 0 && !m_visibility.IsVisible(viewerCell, m_visibilityCell[slot]))
+	{
+		++m_entitiesOccluded;
+		if (g_interestVisibility == 2)
+			return;
+		visibilityScale = g_interestOccludedScale;
+	}
+
+	const float distance = sqrtf(distanceSquared);
+	const float distanceWeight = LERP(group.fClose, group.fFar, std::min(distance / group.fNormalDistance, 1.f));
+
+	const Vec2 planar(offset.x, offset.y);
+	const float planarLength = planar.GetLength();
+	const bool bInFront = planarLength < 0.01f || (forward.x * planar.x + forward.y * planar.y) >= group.fCosHalfFoi * planarLength;
+
+	m_relevant.push_back({ m_userId[slot], group.fPriority * distanceWeight * (bInFront ? group.fFront : group.fBack) * visibilityScale });
+}
+
+void CInterestManager::Update(const SViewer* pViewers, uint32 viewerCount)
+{
+	HOTPATH_PROFILE_SCOPE("CInterestManager::Update");
+	const int64 start = CryGetTicks();
+
+	// Changing the cell size moves every entity to its new cell
+	const float fCellSize = std::max(g_interestCellSize, 1.f);
+	if (fCellSize != m_fCellSize)
+	{
+		m_buckets.fill(InvalidSlot);
+		m_fCellSize = fCellSize;
+		for (uint32 slot = 0; slot < m_bUsed.size(); ++slot)
+		{
+			if (m_bUsed[slot] != 0 && m_bInGrid[slot] != 0)
+			{
+				Link(slot);
+			}
+		}
+	}
+
+	float fRadius = 0.f;
+	for (const SGroup& group : m_groups)
+	{
+		fRadius = std::max(fRadius, group.fNormalDistance * g_interestCullScale);
+	}
+
+	m_relevant.clear();
+	m_relevantOffsets.resize(viewerCount + 1);
+	m_relevantOffsets[0] = 0;
+	m_cellsVisited = 0;
+	m_entitiesTested = 0;
+	m_entitiesOccluded = 0;
+
+	for (uint32 viewerIndex = 0; viewerIndex < viewerCount; ++viewerIndex)
+	{
+		const SViewer& viewer = pViewers[viewerIndex];
+		const Vec2 forward(-sinf(viewer.fYaw), cosf(viewer.fYaw));
+		const uint32 first = static_cast<uint32>(m_relevant.size());
+		const uint32 viewerCell = m_visibility.GetCell(viewer.position);
+
+		if (viewer.own < m_bUsed.size() && m_bUsed[viewer.own] != 0)
+		{
+			m_relevant.push_back({ m_userId[viewer.own], m_groups[m_ownGroup].fPriority });
+		}
+
+		const int32 minX = static_cast<int32>(floorf((viewer.position.x - fRadius) / m_fCellSize));
+		const int32 maxX = static_cast<int32>(floorf((viewer.position.x + fRadius) / m_fCellSize));
+		const int32 minY = static_cast<int32>(floorf((viewer.position.y - fRadius) / m_fCellSize));
+		const int32 maxY = static_cast<int32>(floorf((viewer.position.y + fRadius) / m_fCellSize));
+
+		if (static_cast<uint64>(maxX - minX + 1) * static_cast<uint64>(maxY - minY + 1) > BucketCount)
+		{
+			// More cells than buckets, every bucket once is cheaper and still visits every entity exactly once
+			for (uint32 bucket = 0; bucket < BucketCount; ++bucket)
+			{
+				for (uint32 slot = m_buckets[bucket]; slot != InvalidSlot; slot = m_next[slot])
+				{
+					if (slot != viewer.own)
+					{
+						AddRelevant(slot, viewer, forward, viewerCell);
+						++m_entitiesTested;
+					}
+				}
+			}
+			m_cellsVisited += BucketCount;
+		}
+		else
+		{
+			for (int32 cellY = minY; cellY <= maxY; ++cellY)
+			{
+				for (int32 cellX = minX; cellX <= maxX; ++cellX)
+				{
+					// Buckets are shared by colliding cells, only take the entities of this one
+					for (uint32 slot = m_buckets[GetBucket(cellX, cellY)]; slot != InvalidSlot; slot = m_next[slot])
+					{
+						if (m_cellX[slot] == cellX && m_cellY[slot] == cellY && slot != viewer.own)
+						{
+							AddRelevant(slot, viewer, forward, viewerCell);
+							++m_entitiesTested;
+						}
+					}
+				}
+			}
+			m_cellsVisited += static_cast<uint32>((maxX - minX + 1) * (maxY - minY + 1));
+		}
+
+		for (uint32 slot : m_global)
+		{
+			if (slot != viewer.own)
+			{
+				AddRelevant(slot, viewer, forward, viewerCell);
+			}
+		}
+
+		std::sort(m_relevant.begin() + first, m_relevant.end(), [](const SRelevantEntity& a, const SRelevantEntity& b) { return a.fPriority > b.fPriority; });
+		m_relevantOffsets[viewerIndex + 1] = static_cast<uint32>(m_relevant.size());
+	}
+
+	m_updateMicroseconds = (CryGetTicks() - start) * 1000000 / CryGetTicksPerSec();
+}
+
+void CInterestManager::LoadVisibility(const char* szPath)
+{
+	m_visibility.Load(szPath);
+	for (uint32 slot = 0; slot < m_bUsed.size(); ++slot)
+	{
+		m_visibilityCell[slot] = m_visibility.GetCell(m_position[slot]);
+	}
+}
+
+void CInterestManager::UnloadVisibility()
+{
+	m_visibility.Unload();
+	std::fill(m_visibilityCell.begin(), m_visibilityCell.end(), CPotentiallyVisibleSet::OutsideCell);
+}
+
+void CInterestManager::LogStats() const
+{
+	const uint32 entityCount = static_cast<uint32>(m_bUsed.size() - m_freeHandles.size());
+	const uint32 viewerCount = static_cast<uint32>(m_relevantOffsets.size() - 1);
+
+	CryLogAlways("[Interest] %u entities (%u everywhere), %u groups, cell size %.0fm", entityCount, static_cast<uint32>(m_global.size()), static_cast<uint32>(m_groups.size()), m_fCellSize);
+	CryLogAlways("[Interest] Last update: %u viewers, %.1f relevant per viewer, %u cells visited, %u entities tested, %u occluded, %dus",
+		viewerCount, viewerCount > 0 ? static_cast<float>(m_relevant.size()) / viewerCount : 0.f, m_cellsVisited, m_entitiesTested, m_entitiesOccluded, static_cast<int>(m_updateMicroseconds));
+	CryLogAlways("[Interest] Potentially visible set: %s", m_visibility.IsLoaded() ? "loaded" : "none for this level");
+}
@@ -0,0 +1,137 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "PotentiallyVisibleSet.h"
+
+typedef uint32 TInterestHandle;
+static constexpr TInterestHandle INVALID_INTEREST_HANDLE = ~0u;
+
+////////////////////////////////////////////////////////
+// Decides which networked entities each client gets and
+// in what order, using the groups and weights of
+// Scripts/network/Scheduler.xml and the class -> group
+// mapping of Scripts/network/EntityScheduler.xml.
+// Entities live in a uniform spatial hash that is only
+// touched when one crosses a cell border, and all viewers
+// are evaluated in one pass that visits the cells around
+// each viewer, so the cost grows with clients plus nearby
+// entities instead of clients times entities.
+//
+// Per group, for an entity at distance d from the viewer:
+//   weight = priority * lerp(close, far, d / normalDistance) * (inside foi ? front : back)
+// and entities further than normalDistance * g_interestCullScale
+// are not relevant. Groups without a normalDistance are
+// relevant everywhere with their plain priority.
+// When the level has a baked potentially visible set,
+// entities of those groups in cells the viewer's cell
+// can't see are dropped or scaled down, see
+// g_interestVisibility.
+////////////////////////////////////////////////////////
+
+class CInterestManager
+{
+public:
+	struct SViewer
+	{
+		Vec3            position;
+		float           fYaw;
+		TInterestHandle own; // Always relevant to this viewer, with the priority of the 'own' group
+	};
+
+	struct SRelevantEntity
+	{
+		uint32 userId;
+		float  fPriority;
+	};
+
+	static void     RegisterConsoleCommands();
+	static void     UnregisterConsoleCommands();
+
+	CInterestManager();
+
+	// szSchedulerClass is a class name of EntityScheduler.xml, userId is handed back in the relevant sets
+	TInterestHandle Add(uint32 userId, const char* szSchedulerClass, const Vec3& position);
+	void            Remove(TInterestHandle handle);
+	void            SetPosition(TInterestHandle handle, const Vec3& position);
+
+	// Computes the relevant set of every viewer, most important first
+	void            Update(const SViewer* pViewers, uint32 viewerCount);
+	uint32          GetRelevantCount(uint32 viewer) const { return m_relevantOffsets[viewer + 1] - m_relevantOffsets[viewer]; }
+	const SRelevantEntity* GetRelevant(uint32 viewer) const { return m_relevant.data() + m_relevantOffsets[viewer]; }
+
+	// Scheduler.xml groups, entities the viewer owns are sent with the 'own' group instead of their own
+	uint8           GetGroup(TInterestHandle handle) const { return m_group[handle]; }
+	uint8           GetOwnGroup() const                    { return m_ownGroup; }
+	uint32          GetGroupCount() const                  { return static_cast<uint32>(m_groups.size()); }
+	const char*     GetGroupName(uint8 group) const        { return m_groups[group].name.c_str(); }
+
+	// szPath is the game path of the level's visibility.pvs, until then nothing is occluded
+	void            LoadVisibility(const char* szPath);
+	void            UnloadVisibility();
+
+	void            LogStats() const;
+
+private:
+	struct SGroup
+	{
+		string name;
+		float  fPriority = 0.f;
+		float  fNormalDistance = 0.f;
+		float  fClose = 1.f;
+		float  fFar = 1.f;
+		float  fFront = 1.f;
+		float  fBack = 1.f;
+		float  fCosHalfFoi = -1.f;
+	};
+
+	void            LoadGroups();
+	uint8           FindGroup(const char* szName) const;
+	uint32          GetBucket(int32 cellX, int32 cellY) const;
+	void            Link(uint32 slot);
+	void            Unlink(uint32 slot);
+	void            AddRelevant(uint32 slot, const SViewer& viewer, const Vec2& forward, uint32 viewerCell);
+
+private:
+	static constexpr uint32 BucketCount = 4096;
+	static constexpr uint32 InvalidSlot = ~0u;
+
+	std::vector<SGroup>            m_groups;
+	std::vector<std::pair<string, uint8>> m_classGroups;
+	uint8                          m_defaultGroup = 0;
+	uint8                          m_ownGroup = 0;
+	bool                           m_bGroupsLoaded = false;
+
+	// Cell size the grid was built with, the grid is rebuilt when g_interestCellSize changes
+	float                          m_fCellSize = 0.f;
+	std::array<uint32, BucketCount> m_buckets;
+
+	// Entity slots, indexed by handle
+	std::vector<uint32>            m_userId;
+	std::vector<uint8>             m_group;
+	std::vector<Vec3>              m_position;
+	std::vector<int32>             m_cellX;
+	std::vector<int32>             m_cellY;
+	std::vector<uint32>            m_prev;
+	std::vector<uint32>            m_next;
+	std::vector<uint8>             m_bUsed;
+	std::vector<uint8>             m_bInGrid;
+	std::vector<uint32>            m_visibilityCell; // Cell of the potentially visible set
+	std::vector<TInterestHandle>   m_freeHandles;
+
+	CPotentiallyVisibleSet         m_visibility;
+
+	// Entities of groups without a normalDistance, relevant to every viewer
+	std::vector<uint32>            m_global;
+
+	// Relevant sets of the last Update, one range per viewer
+	std::vector<SRelevantEntity>   m_relevant;
+	std::vector<uint32>            m_relevantOffsets;
+
+	uint32                         m_cellsVisited = 0;
+	uint32                         m_entitiesTested = 0;
+	uint32                         m_entitiesOccluded = 0;
+	int64                          m_updateMicroseconds = 0;
+};
@@ -0,0 +1,209 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "LagCompensation.h"
+
+namespace
+{
+	// Entry fraction of the segment o + t * d into a sphere, t in [0, 1]. Starting inside counts as a hit at 0.
+	bool IntersectSphere(const Vec3& origin, const Vec3& direction, const Vec3& center, float radius, float& t)
+	{
+		const Vec3 offset = origin - center;
+		const float c = offset.Dot(offset) - radius * radius;
+		if (c <= 0.f)
+		{
+			t = 0.f;
+			return true;
+		}
+
+		const float a = direction.Dot(direction);
+		const float b = offset.Dot(direction);
+		const float discriminant = b * b - a * c;
+		if (b >= 0.f || discriminant < 0.f || a <= 0.f)
+			return false;
+
+		t = (-b - sqrt_tpl(discriminant)) / a;
+		return t <= 1.f;
+	}
+
+	// Entry fraction into an upright capsule, the union of the vertical cylinder between the caps and the two cap spheres
+	bool IntersectCapsule(const Vec3& origin, const Vec3& direction, float x, float y, float zBottom, float zTop, float radius, float& t, Vec3& normal)
+	{
+		bool bHit = false;
+		t = 1.f;
+
+		const float offsetX = origin.x - x;
+		const float offsetY = origin.y - y;
+		const float c = offsetX * offsetX + offsetY * offsetY - radius * radius;
+
+		if (c <= 0.f && origin.z >= zBottom && origin.z <= zTop)
+		{
+			// Starts inside the cylinder part
+			t = 0.f;
+			normal = -direction.GetNormalizedSafe(Vec3(0.f, 0.f, 1.f));
+			return true;
+		}
+
+		// Side of the cylinder, only in XY since the axis is vertical
+		const float a = direction.x * direction.x + direction.y * direction.y;
+		if (a > 0.f && c > 0.f)
+		{
+			const float b = offsetX * direction.x + offsetY * direction.y;
+			const float discriminant = b * b - a * c;
+			if (discriminant < 0.f)
+				return false; // Misses the infinite cylinder, so it misses the spheres inside it as well
+
+			const float sideT = (-b - sqrt_tpl(discriminant)) / a;
+			const float z = origin.z + direction.z * sideT;
+			if (sideT >= 0.f && sideT <= t && z >= zBottom && z <= zTop)
+			{
+				t = sideT;
+				normal = Vec3(offsetX + direction.x * sideT, offsetY + direction.y * sideT, 0.f) / radius;
+				bHit = true;
+			}
+		}
+
+		const Vec3 caps[2] = { Vec3(x, y, zBottom), Vec3(x, y, zTop) };
+		for (const Vec3& cap : caps)
+		{
+			float capT;
+			if (IntersectSphere(origin, direction, cap, radius, capT) && capT <= t)
+			{
+				t = capT;
+				normal = capT > 0.f ? (origin + direction * capT - cap) / radius : -direction.GetNormalizedSafe(Vec3(0.f, 0.f, 1.f));
+				bHit = true;
+			}
+		}
+
+		return bHit;
+	}
+}
+
+CLagCompensationHistory::CLagCompensationHistory()
+{
+	Reserve(64);
+}
+
+void CLagCompensationHistory::Reserve(uint32 playerCount)
+{
+	if (playerCount <= m_capacity)
+		return;
+
+	const uint32 oldCapacity = m_capacity;
+	m_capacity = std::max(playerCount, m_capacity * 2);
+
+	// Frames keep their capsules, each block moves to where the new capacity puts it
+	Relayout(m_x, oldCapacity);
+	Relayout(m_y, oldCapacity);
+	Relayout(m_zBottom, oldCapacity);
+	Relayout(m_zTop, oldCapacity);
+	Relayout(m_radius, oldCapacity);
+	Relayout(m_ids, oldCapacity);
+}
+
+template<typename T>
+void CLagCompensationHistory::Relayout(std::vector<T>& values, uint32 oldCapacity) const
+{
+	std::vector<T> relaid(static_cast<size_t>(HistoryLength) * m_capacity);
+	for (uint32 frameIndex = 0; frameIndex < HistoryLength; ++frameIndex)
+	{
+		const uint32 count = m_frames[frameIndex].count;
+		const T* pOld = values.data() + static_cast<size_t>(frameIndex) * oldCapacity;
+		std::copy(pOld, pOld + count, relaid.begin() + GetOffset(frameIndex));
+	}
+	values.swap(relaid);
+}
+
+void CLagCompensationHistory::Clear()
+{
+	m_frames.fill(SFrame());
+	m_newest = 0;
+}
+
+void CLagCompensationHistory::BeginFrame(uint32 tick)
+{
+	m_newest = (m_newest + 1) % HistoryLength;
+
+	SFrame& frame = m_frames[m_newest];
+	frame.tick = tick;
+	frame.count = 0;
+	frame.bValid = true;
+}
+
+void CLagCompensationHistory::AddCapsule(uint32 id, const SCapsule& capsule)
+{
+	SFrame& frame = m_frames[m_newest];
+	if (frame.count >= m_capacity)
+		return;
+
+	const uint32 index = GetOffset(m_newest) + frame.count;
+	m_x[index] = capsule.x;
+	m_y[index] = capsule.y;
+	m_zBottom[index] = capsule.zBottom;
+	m_zTop[index] = capsule.zTop;
+	m_radius[index] = capsule.radius;
+	m_ids[index] = id;
+
+	++frame.count;
+}
+
+uint32 CLagCompensationHistory::GetOldestTick() const
+{
+	for (uint32 i = 1; i <= HistoryLength; ++i)
+	{
+		const SFrame& frame = m_frames[(m_newest + i) % HistoryLength];
+		if (frame.bValid)
+			return frame.tick;
+	}
+
+	return GetNewestTick();
+}
+
+const CLagCompensationHistory::SFrame* CLagCompensationHistory::FindFrame(uint32 tick) const
+{
+	// Frames are recorded once per tick, so the age of a tick is its distance from the newest slot
+	const uint32 age = m_frames[m_newest].tick - tick;
+	if (age >= HistoryLength)
+		return nullptr;
+
+	const SFrame& frame = m_frames[(m_newest + HistoryLength - age) % HistoryLength];
+	return frame.bValid && frame.tick == tick ? &frame : nullptr;
+}
+
+bool CLagCompensationHistory::RayTest(uint32 tick, const Vec3& origin, const Vec3& direction, uint32 ignoreId, SHit& hit) const
+{
+	return SweepTest(tick, origin, direction, 0.f, ignoreId, hit);
+}
+
+bool CLagCompensationHistory::SweepTest(uint32 tick, const Vec3& origin, const Vec3& direction, float fSphereRadius, uint32 ignoreId, SHit& hit) const
+{
+	const SFrame* pFrame = FindFrame(tick);
+	if (pFrame == nullptr)
+		return false;
+
+	// A sphere moving along the segment hits a capsule exactly where the segment hits the capsule grown by the sphere's radius
+	const uint32 offset = GetOffset(static_cast<uint32>(pFrame - m_frames.data()));
+	float closest = 1.f;
+	hit.id = InvalidId;
+
+	for (uint32 i = offset, end = offset + pFrame->count; i < end; ++i)
+	{
+		if (m_ids[i] == ignoreId)
+			continue;
+
+		float t;
+		Vec3 normal;
+		if (IntersectCapsule(origin, direction, m_x[i], m_y[i], m_zBottom[i], m_zTop[i], m_radius[i] + fSphereRadius, t, normal) && t <= closest)
+		{
+			closest = t;
+			hit.id = m_ids[i];
+			hit.fraction = t;
+			hit.normal = normal;
+		}
+	}
+
+	if (hit.id == InvalidId)
+		return false;
+
+	hit.point = origin + direction * hit.fraction - hit.normal * fSphereRadius;
+	return true;
+}
@@ -0,0 +1,90 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <vector>
+
+////////////////////////////////////////////////////////
+// Server side history of where every player's collision
+// capsule was on each of the last simulation ticks, so
+// hits can be checked against what the shooter saw
+// instead of where the targets are now.
+// Frames are stored in a fixed ring, each frame as
+// structure-of-arrays of upright capsules, so recording
+// and rewinding never allocate and a query is a linear
+// pass over a few contiguous float arrays.
+////////////////////////////////////////////////////////
+
+class CLagCompensationHistory
+{
+public:
+	// About one second at the default 60 Hz tick rate
+	static constexpr uint32 HistoryLength = 64;
+
+	// Upright capsule, the axis runs from zBottom to zTop
+	struct SCapsule
+	{
+		float x;
+		float y;
+		float zBottom;
+		float zTop;
+		float radius;
+	};
+
+	struct SHit
+	{
+		uint32 id;       // Whatever the recorder passed in, the player handle for CPlayerSystem
+		float  fraction; // Along the query segment, 0 at the origin and 1 at origin + direction
+		Vec3   point;
+		Vec3   normal;
+	};
+
+	static constexpr uint32 InvalidId = ~0u;
+
+	CLagCompensationHistory();
+
+	// Capacity only grows when players join, never during a tick. The recorded history is kept.
+	void   Reserve(uint32 playerCount);
+	void   Clear();
+
+	// Recording, one frame per simulation tick
+	void   BeginFrame(uint32 tick);
+	void   AddCapsule(uint32 id, const SCapsule& capsule);
+
+	bool   HasTick(uint32 tick) const { return FindFrame(tick) != nullptr; }
+	uint32 GetOldestTick() const;
+	uint32 GetNewestTick() const { return m_frames[m_newest].tick; }
+
+	// Tests the segment origin -> origin + direction against the capsules as recorded for the given tick.
+	// Returns the closest hit, the capsule with the id to ignore (usually the shooter) is skipped.
+	bool   RayTest(uint32 tick, const Vec3& origin, const Vec3& direction, uint32 ignoreId, SHit& hit) const;
+	// Same as RayTest for a sphere of the given radius moving along the segment
+	bool   SweepTest(uint32 tick, const Vec3& origin, const Vec3& direction, float fSphereRadius, uint32 ignoreId, SHit& hit) const;
+
+private:
+	struct SFrame
+	{
+		uint32 tick = 0;
+		uint32 count = 0;
+		bool   bValid = false;
+	};
+
+	// Start of the given frame's block of capsules in the flat arrays
+	uint32        GetOffset(uint32 frameIndex) const { return frameIndex * m_capacity; }
+	const SFrame* FindFrame(uint32 tick) const;
+	template<typename T>
+	void          Relayout(std::vector<T>& values, uint32 oldCapacity) const;
+
+private:
+	std::array<SFrame, HistoryLength> m_frames;
+	uint32                            m_newest = 0;
+	uint32                            m_capacity = 0;
+
+	// HistoryLength blocks of m_capacity entries, one block per frame
+	std::vector<float>                m_x;
+	std::vector<float>                m_y;
+	std::vector<float>                m_zBottom;
+	std::vector<float>                m_zTop;
+	std::vector<float>                m_radius;
+	std::vector<uint32>               m_ids;
+};
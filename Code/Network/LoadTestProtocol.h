@@ -0,0 +1,94 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <cstdint>
+
+////////////////////////////////////////////////////////
+// Datagrams between CLoadTestServer and the LoopbackLoad
+// tool (Code/Tools/LoopbackLoad). Both ends run on the
+// same machine, so the structs go over the wire as they
+// are. Only fixed width standard types are used, the tool
+// is built without the engine.
+//
+// Client -> server: Hello once, then Input every tick and
+// Bye when done. Server -> client: Welcome with the
+// Scheduler.xml group names, then the snapshots the player
+// system writes for the client's player.
+////////////////////////////////////////////////////////
+
+namespace LoadTestProtocol
+{
+	static constexpr uint32_t Magic = 0x4C544C33; // 'LTL3'
+	static constexpr uint32_t MaxActions = 16;
+	// Scheduler.xml has 17 groups and the players are in the 13th and 14th, entries of groups past this aren't counted
+	static constexpr uint32_t MaxGroups = 32;
+	static constexpr uint32_t MaxGroupNameLength = 16;
+	// Must hold an SPlayerSnapshotParams worth of ids and bytes
+	static constexpr uint32_t MaxSnapshotEntries = 64;
+	static constexpr uint32_t MaxSnapshotBytes = 1024;
+
+	enum EPacketType : uint8_t
+	{
+		ePacket_Hello,
+		ePacket_Input,
+		ePacket_Bye,
+		ePacket_Welcome,
+		ePacket_Snapshot
+	};
+
+	// One action of the player's action map, see EPlayerAction
+	struct SAction
+	{
+		uint8_t action;
+		uint8_t activationMode; // EActionActivationMode
+		uint8_t padding[2];
+		float   value;
+	};
+
+	struct SInputPacket
+	{
+		uint32_t magic;
+		uint8_t  type;
+		uint8_t  actionCount;
+		uint16_t padding;
+		uint32_t sequence;
+		uint32_t ackedSnapshot;      // Newest snapshot tick received, as in SPlayerInputCommandsParams
+		uint32_t ackedSnapshotParts; // Bit per part of it received
+		uint32_t padding2;
+		uint64_t clientTime;         // Microseconds on the client's clock, echoed back in the snapshots
+		SAction  actions[MaxActions];
+	};
+
+	struct SWelcomePacket
+	{
+		uint32_t magic;
+		uint8_t  type;
+		uint8_t  groupCount;
+		uint16_t tickRate;
+		uint32_t entityId; // Entity of the client's player
+		char     groupNames[MaxGroups][MaxGroupNameLength];
+	};
+
+	struct SSnapshotHeader
+	{
+		uint32_t magic;
+		uint8_t  type;
+		uint8_t  groupCount;
+		uint16_t entryCount;
+		uint32_t sequence;         // Per client, gaps are dropped packets
+		uint32_t tick;
+		uint32_t baselineTick;
+		uint32_t serverHoldMicroseconds; // Time between the echoed input arriving and this packet leaving
+		uint64_t echoedClientTime;
+		uint32_t lastTickBytes;    // Bytes the server sent to all load test clients during the previous tick
+		uint16_t byteCount;
+		uint8_t  part;             // Index among the packets carrying the tick, see SPlayerSnapshotParams::part
+		uint8_t  padding;
+		// Entries of each group sent to this client so far, including this packet. Comparing with the entries
+		// received gives the dropped entries per group.
+		uint32_t groupEntriesSent[MaxGroups];
+	};
+
+	// A snapshot packet is the header, entryCount entity ids, entryCount group indices and byteCount encoded bytes
+	static constexpr uint32_t MaxPacketSize = sizeof(SSnapshotHeader) + MaxSnapshotEntries * (sizeof(uint32_t) + 1) + MaxSnapshotBytes;
+}
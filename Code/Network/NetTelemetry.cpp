@@ -0,0 +1,232 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "NetTelemetry.h"
+
+#include "GamePlugin.h"
+#include "InterestManager.h"
+
+#include <CryString/CryPath.h>
+
+namespace
+{
+	int    g_netTelemetry = 1;
+	float  g_netTelemetryDumpInterval = 0.f;
+	ICVar* g_pNetTelemetryDumpFile = nullptr;
+
+	const char* const s_defaultDumpPath = "%USER%/NetTelemetry/telemetry.bin";
+
+	CNetTelemetry& GetTelemetry()
+	{
+		return CGamePlugin::GetInstance()->GetPlayerSystem()->GetNetTelemetry();
+	}
+
+	void NetTelemetryCommand(IConsoleCmdArgs* pArgs)
+	{
+		const char* szMode = pArgs->GetArgCount() > 1 ? pArgs->GetArg(1) : "dump";
+
+		if (strcmp(szMode, "dump") == 0)
+		{
+			GetTelemetry().LogStats();
+		}
+		else if (strcmp(szMode, "reset") == 0)
+		{
+			GetTelemetry().Reset();
+		}
+		else if (strcmp(szMode, "write") == 0)
+		{
+			const char* szPath = pArgs->GetArgCount() > 2 ? pArgs->GetArg(2) : s_defaultDumpPath;
+			CryLogAlways(GetTelemetry().AppendDump(szPath) ? "[NetTelemetry] Wrote %s" : "[NetTelemetry] Failed to write %s", szPath);
+		}
+		else
+		{
+			CryLogAlways("Usage: g_netTelemetry [dump|reset|write [file]]");
+		}
+	}
+
+	// Upper end of a latency bucket in microseconds, what the percentiles report
+	uint64 GetLatencyBucketLimit(uint32 bucket)
+	{
+		return uint64(2) << bucket;
+	}
+
+	uint64 GetLatencyPercentile(const CNetTelemetry::SCell& cell, float fraction)
+	{
+		const uint64 rank = static_cast<uint64>(fraction * static_cast<float>(cell.latencySamples));
+		uint64 seen = 0;
+		for (uint32 bucket = 0; bucket < CNetTelemetry::LatencyBuckets; ++bucket)
+		{
+			seen += cell.latency[bucket];
+			if (seen > rank)
+				return GetLatencyBucketLimit(bucket);
+		}
+		return GetLatencyBucketLimit(CNetTelemetry::LatencyBuckets - 1);
+	}
+}
+
+void CNetTelemetry::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_netTelemetry", &g_netTelemetry, 1, VF_NULL, "Counts replicated messages, bits and latency per Scheduler.xml group and entity class");
+	REGISTER_CVAR2("g_netTelemetryDumpInterval", &g_netTelemetryDumpInterval, 0.f, VF_NULL, "Seconds between binary telemetry records appended to g_netTelemetryDumpFile, 0 = off. Counters are reset after each record.");
+	g_pNetTelemetryDumpFile = REGISTER_STRING("g_netTelemetryDumpFile", s_defaultDumpPath, VF_NULL, "File the periodic binary telemetry records are appended to");
+	REGISTER_COMMAND("g_netTelemetry", NetTelemetryCommand, VF_NULL, "Replication telemetry per Scheduler.xml group and entity class. Usage: g_netTelemetry [dump|reset|write [file]]");
+}
+
+void CNetTelemetry::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->RemoveCommand("g_netTelemetry");
+		gEnv->pConsole->UnregisterVariable("g_netTelemetry", true);
+		gEnv->pConsole->UnregisterVariable("g_netTelemetryDumpInterval", true);
+		gEnv->pConsole->UnregisterVariable("g_netTelemetryDumpFile", true);
+	}
+}
+
+uint8 CNetTelemetry::RegisterClass(const char* szClass)
+{
+	for (uint32 i = 0; i < m_classCount; ++i)
+	{
+		if (strncmp(m_classNames[i].data(), szClass, NameLength - 1) == 0)
+			return static_cast<uint8>(i);
+	}
+
+	// Classes beyond the limit share the last slot
+	if (m_classCount == MaxClasses)
+	{
+		cry_strcpy(m_classNames[MaxClasses - 1].data(), NameLength, "(other)");
+		return MaxClasses - 1;
+	}
+
+	cry_strcpy(m_classNames[m_classCount].data(), NameLength, szClass);
+	return static_cast<uint8>(m_classCount++);
+}
+
+bool CNetTelemetry::IsEnabled() const
+{
+	return g_netTelemetry != 0;
+}
+
+void CNetTelemetry::RecordLatency(uint8 group, uint8 entityClass, int64 microseconds)
+{
+	const uint64 value = static_cast<uint64>(std::max<int64>(microseconds, 0));
+	const uint32 bucket = value < 2 ? 0 : std::min(IntegerLog2(value), LatencyBuckets - 1);
+
+	SCell& cell = GetCell(group, entityClass);
+	++cell.latency[bucket];
+	++cell.latencySamples;
+	cell.latencySum += value;
+}
+
+void CNetTelemetry::Update(float fFrametime)
+{
+	if (m_intervalStart == 0)
+	{
+		m_intervalStart = gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+	}
+
+	// Scheduler.xml is loaded with the level, keep the recording itself free of allocations
+	if (m_cells.size() < m_interest.GetGroupCount())
+	{
+		m_cells.resize(m_interest.GetGroupCount());
+	}
+
+	if (g_netTelemetry == 0 || g_netTelemetryDumpInterval <= 0.f)
+		return;
+
+	m_fSinceDump += fFrametime;
+	if (m_fSinceDump < g_netTelemetryDumpInterval)
+		return;
+
+	m_fSinceDump = 0.f;
+	const char* szPath = g_pNetTelemetryDumpFile != nullptr ? g_pNetTelemetryDumpFile->GetString() : s_defaultDumpPath;
+	if (!AppendDump(szPath))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[NetTelemetry] Failed to write %s, periodic dump stopped", szPath);
+		g_netTelemetryDumpInterval = 0.f;
+	}
+}
+
+void CNetTelemetry::Reset()
+{
+	for (TGroupCells& groupCells : m_cells)
+	{
+		groupCells.fill(SCell());
+	}
+	m_intervalStart = gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+}
+
+void CNetTelemetry::LogStats() const
+{
+	const int64 now = gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+	const float fSeconds = std::max(static_cast<float>(now - m_intervalStart) / 1000000.f, 0.001f);
+	const uint32 groupCount = std::min(m_interest.GetGroupCount(), static_cast<uint32>(m_cells.size()));
+
+	CryLogAlways("[NetTelemetry] Last %.1fs, %s", fSeconds, g_netTelemetry != 0 ? "recording" : "off (g_netTelemetry 0)");
+	CryLogAlways("[NetTelemetry] %-8s %-16s %10s %10s %10s %9s %9s %9s", "group", "class", "msgs/s", "KB/s", "bits/msg", "lat mean", "lat p50", "lat p99");
+
+	for (uint32 group = 0; group < groupCount; ++group)
+	{
+		for (uint32 entityClass = 0; entityClass < m_classCount; ++entityClass)
+		{
+			const SCell& cell = m_cells[group][entityClass];
+			if (cell.messages == 0 && cell.latencySamples == 0)
+				continue;
+
+			// Latencies are only known for acked snapshots, '-' when nothing was acked
+			char latency[3][16] = { "-", "-", "-" };
+			if (cell.latencySamples > 0)
+			{
+				cry_sprintf(latency[0], "%.1fms", static_cast<float>(cell.latencySum) / cell.latencySamples / 1000.f);
+				cry_sprintf(latency[1], "<%.1fms", GetLatencyPercentile(cell, 0.5f) / 1000.f);
+				cry_sprintf(latency[2], "<%.1fms", GetLatencyPercentile(cell, 0.99f) / 1000.f);
+			}
+
+			CryLogAlways("[NetTelemetry] %-8s %-16s %10.1f %10.2f %10.1f %9s %9s %9s", m_interest.GetGroupName(static_cast<uint8>(group)), m_classNames[entityClass].data(),
+				cell.messages / fSeconds, cell.bits / 8192.f / fSeconds, cell.messages > 0 ? static_cast<float>(cell.bits) / cell.messages : 0.f,
+				latency[0], latency[1], latency[2]);
+		}
+	}
+}
+
+bool CNetTelemetry::AppendDump(const char* szPath)
+{
+	gEnv->pCryPak->MakeDir(PathUtil::GetPathWithoutFilename(szPath).c_str());
+	FILE* pFile = gEnv->pCryPak->FOpen(szPath, "ab");
+	if (pFile == nullptr)
+		return false;
+
+	const int64 now = gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+	const uint32 groupCount = m_interest.GetGroupCount();
+	if (m_cells.size() < groupCount)
+	{
+		m_cells.resize(groupCount);
+	}
+
+	SDumpHeader header;
+	header.magic = DumpMagic;
+	header.version = DumpVersion;
+	header.timeMicroseconds = static_cast<uint64>(now);
+	header.intervalMicroseconds = static_cast<uint64>(now - m_intervalStart);
+	header.groupCount = groupCount;
+	header.classCount = m_classCount;
+	gEnv->pCryPak->FWrite(&header, sizeof(header), 1, pFile);
+
+	for (uint32 group = 0; group < groupCount; ++group)
+	{
+		gEnv->pCryPak->FWrite(m_cells[group].data(), sizeof(SCell), m_classCount, pFile);
+	}
+
+	for (uint32 group = 0; group < groupCount; ++group)
+	{
+		char name[NameLength] = {};
+		cry_strcpy(name, m_interest.GetGroupName(static_cast<uint8>(group)));
+		gEnv->pCryPak->FWrite(name, NameLength, 1, pFile);
+	}
+	gEnv->pCryPak->FWrite(m_classNames.data(), NameLength, m_classCount, pFile);
+
+	gEnv->pCryPak->FClose(pFile);
+
+	// Every record covers only its own interval
+	Reset();
+	return true;
+}
@@ -0,0 +1,107 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <vector>
+
+class CInterestManager;
+
+////////////////////////////////////////////////////////
+// Bandwidth and latency of what the game replicates, per
+// Scheduler.xml group and entity class, to tune the
+// priority / bandwidth / latency of the groups from live
+// data. Recording is a few increments into arrays sized
+// for the groups once they are loaded, on the main
+// thread with no locks, so it stays on in production. Read with g_netTelemetry, or
+// appended to a binary file every
+// g_netTelemetryDumpInterval seconds:
+//
+//   SDumpHeader, then groupCount * classCount SCell
+//   (group major), then groupCount + classCount names of
+//   NameLength chars each, groups first.
+//
+// Only traffic the game writes itself is seen (player
+// snapshots and player aspects), the engine's own
+// scheduling of other entities is internal to CryNetwork.
+////////////////////////////////////////////////////////
+
+class CNetTelemetry
+{
+public:
+	static constexpr uint32 MaxClasses = 16;
+	static constexpr uint32 NameLength = 16;
+	// Bucket i counts latencies of [2^i, 2^(i+1)) microseconds, the first one also takes 0, the last everything above
+	static constexpr uint32 LatencyBuckets = 24;
+
+	static constexpr uint32 DumpMagic = 0x4E544C31; // 'NTL1'
+	static constexpr uint32 DumpVersion = 1;
+
+	struct SCell
+	{
+		uint64 messages = 0;  // Entries in snapshots, aspect updates
+		uint64 bits = 0;      // Payload, without the headers of the packets they share
+		uint64 latencySamples = 0;
+		uint64 latencySum = 0; // Microseconds
+		std::array<uint32, LatencyBuckets> latency = {};
+	};
+
+	// Layout of the binary dump, little endian
+	struct SDumpHeader
+	{
+		uint32 magic;
+		uint32 version;
+		uint64 timeMicroseconds;     // Async timer time the record was written
+		uint64 intervalMicroseconds; // Covered by this record, counters are reset after each dump
+		uint32 groupCount;
+		uint32 classCount;
+	};
+
+	static void RegisterConsoleCommands();
+	static void UnregisterConsoleCommands();
+
+	// Group names come from the interest manager, which loads Scheduler.xml
+	explicit CNetTelemetry(const CInterestManager& interest) : m_interest(interest) {}
+
+	// Entity classes are interned once, records use the returned index
+	uint8 RegisterClass(const char* szClass);
+
+	bool  IsEnabled() const;
+
+	void  RecordMessage(uint8 group, uint8 entityClass, uint32 bits)
+	{
+		SCell& cell = GetCell(group, entityClass);
+		++cell.messages;
+		cell.bits += bits;
+	}
+
+	void  RecordLatency(uint8 group, uint8 entityClass, int64 microseconds);
+
+	// Writes the periodic dump when it is due
+	void  Update(float fFrametime);
+
+	void  LogStats() const;
+	void  Reset();
+	bool  AppendDump(const char* szPath);
+
+private:
+	using TGroupCells = std::array<SCell, MaxClasses>;
+
+	// Update sizes the cells for every group, this only grows them for a group recorded before that
+	SCell& GetCell(uint8 group, uint8 entityClass)
+	{
+		if (group >= m_cells.size())
+		{
+			m_cells.resize(group + 1);
+		}
+		return m_cells[group][entityClass];
+	}
+
+	const CInterestManager& m_interest;
+
+	std::vector<TGroupCells> m_cells; // Indexed by group
+	std::array<std::array<char, NameLength>, MaxClasses> m_classNames = {};
+	uint32 m_classCount = 0;
+
+	int64  m_intervalStart = 0;
+	float  m_fSinceDump = 0.f;
+};
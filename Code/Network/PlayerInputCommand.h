@@ -0,0 +1,135 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <cmath>
+
+#include <CryNetwork/ISerialize.h>
+
+////////////////////////////////////////////////////////
+// Input of one player for one simulation tick.
+// Predicting clients record one per tick and send the
+// unacknowledged ones to the server, which runs them
+// through the same player update.
+////////////////////////////////////////////////////////
+
+struct SPlayerInputCommand
+{
+	uint32 sequence = 0;
+
+	float  moveX = 0.f;
+	float  moveY = 0.f;
+
+	// View after this tick, the owning client is authoritative on where it looks
+	float  yaw = 0.f;
+	float  pitch = 0.f;
+
+	uint8  state = 0;         // EPlayerState
+	uint8  desiredStance = 0; // EPlayerStance
+	bool   bJump = false;
+
+	// A command from the network may carry anything, NaN or infinity would spread through the simulation into every snapshot
+	bool IsFinite() const
+	{
+		return std::isfinite(moveX) && std::isfinite(moveY) && std::isfinite(yaw) && std::isfinite(pitch);
+	}
+
+	void SerializeWith(TSerialize ser)
+	{
+		// Floats are sent unquantized so the server runs exactly the math the client predicted with
+		ser.Value("seq", sequence, 'ui32');
+		ser.Value("moveX", moveX);
+		ser.Value("moveY", moveY);
+		ser.Value("yaw", yaw);
+		ser.Value("pitch", pitch);
+		ser.Value("state", state, 'ui2');
+		ser.Value("stance", desiredStance, 'ui2');
+		ser.Value("jump", bJump, 'bool');
+	}
+};
+
+// Server state of a player as of the last command it processed
+struct SPlayerAuthoritativeState
+{
+	uint32 lastCommand = 0;
+	Vec3   position = ZERO;
+	float  yaw = 0.f;
+	float  pitch = 0.f;
+	uint8  state = 0;  // EPlayerState
+	uint8  stance = 0; // EPlayerStance
+};
+
+// RMI payload, every send repeats the newest unacked commands so a single lost packet doesn't lose input
+struct SPlayerInputCommandsParams
+{
+	static constexpr uint8 MaxCommands = 3;
+
+	SPlayerInputCommand commands[MaxCommands];
+	uint8               count = 0;
+	uint32              ackedSnapshot = 0;      // Newest player snapshot tick the client received, 0 if none
+	uint32              ackedSnapshotParts = 0; // Bit per part of that snapshot the client stored every entry of
+
+	void SerializeWith(TSerialize ser)
+	{
+		ser.Value("ack", ackedSnapshot, 'ui32');
+		ser.Value("ackParts", ackedSnapshotParts, 'ui32');
+		ser.Value("count", count, 'ui2');
+		count = std::min(count, MaxCommands);
+
+		for (uint8 i = 0; i < count; ++i)
+		{
+			ser.BeginGroup("command");
+			commands[i].SerializeWith(ser);
+			ser.EndGroup();
+		}
+	}
+};
+
+// Fixed size ring of commands ordered by sequence number, used for both the client history and the server receive queue
+class CPlayerCommandBuffer
+{
+public:
+	static constexpr uint32 Capacity = 64;
+
+	uint32                     GetCount() const { return m_count; }
+	bool                       IsEmpty() const { return m_count == 0; }
+	const SPlayerInputCommand& Get(uint32 index) const { return m_commands[(m_first + index) % Capacity]; }
+	const SPlayerInputCommand& GetNewest() const { return Get(m_count - 1); }
+
+	void Clear()
+	{
+		m_first = 0;
+		m_count = 0;
+	}
+
+	// Drops the oldest command when full, so a client that stops hearing from the server keeps its most recent inputs
+	void Push(const SPlayerInputCommand& command)
+	{
+		if (m_count == Capacity)
+		{
+			PopFront();
+		}
+		m_commands[(m_first + m_count) % Capacity] = command;
+		++m_count;
+	}
+
+	void PopFront()
+	{
+		m_first = (m_first + 1) % Capacity;
+		--m_count;
+	}
+
+	// Removes every command up to and including the given sequence number
+	void DropUpTo(uint32 sequence)
+	{
+		while (m_count > 0 && static_cast<int32>(Get(0).sequence - sequence) <= 0)
+		{
+			PopFront();
+		}
+	}
+
+private:
+	std::array<SPlayerInputCommand, Capacity> m_commands;
+	uint32 m_first = 0;
+	uint32 m_count = 0;
+};
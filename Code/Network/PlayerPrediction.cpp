@@ -0,0 +1,157 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PlayerPrediction.h"
+
+namespace
+{
+	float g_playerPredictionErrorThreshold = 0.05f;
+	float g_playerPredictionSnapDistance = 2.f;
+	float g_playerPredictionBlend = 0.2f;
+
+	// Cost and size of the corrections, reset whenever they are printed
+	struct SPredictionStats
+	{
+		uint32 reconciliations = 0;
+		uint32 skipped = 0;
+		uint32 rebasedCommands = 0;
+		uint32 maxRebasedCommands = 0;
+		uint32 corrections = 0;
+		uint32 snaps = 0;
+		uint32 stanceCorrections = 0;
+		float  maxError = 0.f;
+		int64  totalMicroseconds = 0;
+		int64  maxMicroseconds = 0;
+	};
+
+	SPredictionStats g_predictionStats;
+
+	void PlayerPredictionStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		const SPredictionStats& stats = g_predictionStats;
+		const float averageRebased = stats.reconciliations > 0 ? static_cast<float>(stats.rebasedCommands) / stats.reconciliations : 0.f;
+		const float averageMicroseconds = stats.reconciliations > 0 ? static_cast<float>(stats.totalMicroseconds) / stats.reconciliations : 0.f;
+
+		CryLogAlways("[PlayerPrediction] reconciliations %u (skipped %u), unacked commands avg %.1f max %u",
+			stats.reconciliations, stats.skipped, averageRebased, stats.maxRebasedCommands);
+		CryLogAlways("[PlayerPrediction] corrections %u, snaps %u, stance corrections %u, max error %.3fm, cost avg %.1fus max %dus",
+			stats.corrections, stats.snaps, stats.stanceCorrections, stats.maxError, averageMicroseconds, static_cast<int>(stats.maxMicroseconds));
+
+		g_predictionStats = SPredictionStats();
+	}
+}
+
+void CPlayerPrediction::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_playerPredictionErrorThreshold", &g_playerPredictionErrorThreshold, 0.05f, VF_NULL, "Prediction errors below this distance (m) are ignored");
+	REGISTER_CVAR2("g_playerPredictionSnapDistance", &g_playerPredictionSnapDistance, 2.f, VF_NULL, "Prediction errors above this distance (m) are corrected immediately instead of blended");
+	REGISTER_CVAR2("g_playerPredictionBlend", &g_playerPredictionBlend, 0.2f, VF_NULL, "Fraction of the prediction error corrected per server update");
+	REGISTER_COMMAND("g_playerPredictionStats", PlayerPredictionStatsCommand, VF_NULL, "Prints and resets the client prediction correction statistics");
+}
+
+void CPlayerPrediction::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_playerPredictionErrorThreshold", true);
+		gEnv->pConsole->UnregisterVariable("g_playerPredictionSnapDistance", true);
+		gEnv->pConsole->UnregisterVariable("g_playerPredictionBlend", true);
+		gEnv->pConsole->RemoveCommand("g_playerPredictionStats");
+	}
+}
+
+void CPlayerPrediction::Reset()
+{
+	m_history.Clear();
+	std::fill(std::begin(m_predicted), std::end(m_predicted), SPredictedState());
+	m_bHasPendingState = false;
+}
+
+void CPlayerPrediction::SetAuthoritativeState(const SPlayerAuthoritativeState& state)
+{
+	// Unreliable updates can arrive out of order, never go back to an older ack
+	if (m_bHasPendingState && static_cast<int32>(state.lastCommand - m_pendingState.lastCommand) < 0)
+		return;
+
+	m_pendingState = state;
+	m_bHasPendingState = true;
+}
+
+void CPlayerPrediction::Record(const SPlayerInputCommand& command, const Vec3& position, uint8 stance)
+{
+	m_history.Push(command);
+
+	SPredictedState& predicted = GetPredicted(command.sequence);
+	predicted.sequence = command.sequence;
+	predicted.position = position;
+	predicted.stance = stance;
+}
+
+bool CPlayerPrediction::Reconcile(SCorrection& correction)
+{
+	if (!m_bHasPendingState)
+		return false;
+
+	m_bHasPendingState = false;
+
+	// The server reports the state at the start of the acked command's tick, the same point Record was given
+	const uint32 ackedSequence = m_pendingState.lastCommand;
+	SPredictedState& acked = GetPredicted(ackedSequence);
+	if (ackedSequence == 0 || acked.sequence != ackedSequence || static_cast<int32>(m_sequence - ackedSequence) >= static_cast<int32>(CPlayerCommandBuffer::Capacity))
+	{
+		// Acks a command older than anything still recorded, keep predicting and wait for a newer one
+		m_history.DropUpTo(ackedSequence);
+		++g_predictionStats.skipped;
+		return false;
+	}
+
+	const CTimeValue startTime = gEnv->pTimer->GetAsyncTime();
+
+	const Vec3 error = m_pendingState.position - acked.position;
+	const float errorLength = error.GetLength();
+
+	if (errorLength > g_playerPredictionSnapDistance)
+	{
+		correction.offset = error;
+		correction.bSnap = true;
+		++g_predictionStats.snaps;
+	}
+	else if (errorLength > g_playerPredictionErrorThreshold)
+	{
+		correction.offset = error * crymath::clamp(g_playerPredictionBlend, 0.f, 1.f);
+		correction.bSnap = false;
+		++g_predictionStats.corrections;
+	}
+
+	if (m_pendingState.stance != acked.stance)
+	{
+		correction.bStance = true;
+		correction.stance = m_pendingState.stance;
+		++g_predictionStats.stanceCorrections;
+	}
+
+	// Every command from the acked one on was predicted from the old position, move their records along with the correction
+	// so the next state for any of them only sees what is left of the error. The acked one stays for repeats of this state.
+	m_history.DropUpTo(ackedSequence);
+	const uint32 count = m_history.GetCount();
+	for (uint32 i = 0; i <= count; ++i)
+	{
+		SPredictedState& predicted = GetPredicted(ackedSequence + i);
+		predicted.position += correction.offset;
+		if (correction.bStance)
+		{
+			predicted.stance = correction.stance;
+		}
+	}
+
+	const int64 microseconds = (gEnv->pTimer->GetAsyncTime() - startTime).GetMicroSecondsAsInt64();
+
+	SPredictionStats& stats = g_predictionStats;
+	++stats.reconciliations;
+	stats.rebasedCommands += count;
+	stats.maxRebasedCommands = std::max(stats.maxRebasedCommands, count);
+	stats.maxError = std::max(stats.maxError, errorLength);
+	stats.totalMicroseconds += microseconds;
+	stats.maxMicroseconds = std::max(stats.maxMicroseconds, microseconds);
+
+	return true;
+}
@@ -0,0 +1,66 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include "PlayerInputCommand.h"
+
+////////////////////////////////////////////////////////
+// Client side prediction for the locally controlled
+// player on a remote client.
+// Every tick's command is kept until the server acks it,
+// together with where the local physics had the player
+// when the command ran. When an authoritative state
+// arrives it is compared with that record for the acked
+// command, and the difference becomes a correction that
+// carries over to the unacked commands built on top of it.
+// Nothing is re-simulated, so collisions, stance and
+// jumps are whatever the local physics made of them.
+// Vertical velocity isn't part of the state, a jump the
+// server rejected shows up as a height error per update
+// until the player lands.
+////////////////////////////////////////////////////////
+
+class CPlayerPrediction
+{
+public:
+	struct SCorrection
+	{
+		Vec3  offset = ZERO;   // To be added to the current position
+		bool  bSnap = false;   // Too far off to blend, move there right away
+		bool  bStance = false; // The server ended up in a different stance
+		uint8 stance = 0;      // EPlayerStance
+	};
+
+	static void RegisterConsoleCommands();
+	static void UnregisterConsoleCommands();
+
+	void                        Reset();
+
+	uint32                      NextSequence() { return ++m_sequence; }
+	// position and stance are the player's at the time the command runs, before physics moves it
+	void                        Record(const SPlayerInputCommand& command, const Vec3& position, uint8 stance);
+	const CPlayerCommandBuffer& GetHistory() const { return m_history; }
+
+	void                        SetAuthoritativeState(const SPlayerAuthoritativeState& state);
+	bool                        HasAuthoritativeState() const { return m_bHasPendingState; }
+
+	// Compares the last authoritative state with the prediction for the command it acks.
+	// Returns false if there was no new state or that command's prediction is gone.
+	bool                        Reconcile(SCorrection& correction);
+
+private:
+	// Predicted result of a command, kept for every command in m_history
+	struct SPredictedState
+	{
+		uint32 sequence = 0;
+		Vec3   position = ZERO;
+		uint8  stance = 0; // EPlayerStance
+	};
+
+	SPredictedState&          GetPredicted(uint32 sequence) { return m_predicted[sequence % CPlayerCommandBuffer::Capacity]; }
+
+	CPlayerCommandBuffer      m_history;
+	SPredictedState           m_predicted[CPlayerCommandBuffer::Capacity];
+	SPlayerAuthoritativeState m_pendingState;
+	bool                      m_bHasPendingState = false;
+	uint32                    m_sequence = 0;
+};
@@ -0,0 +1,453 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PlayerStateCodec.h"
+
+#include <vector>
+
+namespace
+{
+	// Must match the 'lwld' policy in Scripts/network/CompressionPolicy.xml
+	struct SAxisQuantization
+	{
+		float  min;
+		float  max;
+		uint32 bits;
+	};
+
+	constexpr SAxisQuantization PositionAxes[3] =
+	{
+		{ -20.f, 4096.f, 27 },
+		{ -20.f, 4096.f, 27 },
+		{ -20.f, 1023.f, 18 }
+	};
+
+	constexpr uint32 YawBits = 16;
+	constexpr uint32 PitchBits = 12;
+	constexpr uint32 StateBits = 2;
+	constexpr uint32 StanceBits = 2;
+	constexpr uint32 DeltaLengthBits = 5;
+
+	enum EChangedField : uint32
+	{
+		eChanged_Command = BIT(0),
+		eChanged_Position = BIT(1),
+		eChanged_Yaw = BIT(2),
+		eChanged_Pitch = BIT(3),
+		eChanged_Flags = BIT(4),
+
+		eChanged_FieldCount = 5
+	};
+
+	uint32 MaxQuantized(uint32 bits)
+	{
+		return bits >= 32 ? ~0u : (1u << bits) - 1;
+	}
+
+	uint32 QuantizeFloat(float value, float min, float max, uint32 bits)
+	{
+		const float maxQuantized = static_cast<float>(MaxQuantized(bits));
+		const float normalized = crymath::clamp((value - min) / (max - min), 0.f, 1.f);
+		return static_cast<uint32>(normalized * maxQuantized + 0.5f);
+	}
+
+	float DequantizeFloat(uint32 quantized, float min, float max, uint32 bits)
+	{
+		return min + static_cast<float>(quantized) * (max - min) / static_cast<float>(MaxQuantized(bits));
+	}
+
+	uint32 GetBitLength(uint32 value)
+	{
+		uint32 length = 0;
+		while (value != 0)
+		{
+			value >>= 1;
+			++length;
+		}
+		return length;
+	}
+
+	// Small signed deltas turn into small unsigned ones, position axes are at most 27 bits so this can't overflow
+	uint32 ZigZag(int32 value)
+	{
+		return (static_cast<uint32>(value) << 1) ^ static_cast<uint32>(value >> 31);
+	}
+
+	int32 UnZigZag(uint32 value)
+	{
+		return static_cast<int32>(value >> 1) ^ -static_cast<int32>(value & 1);
+	}
+
+	// Sequence deltas: 2 bit size class, then 4, 8, 16 or 32 bits
+	void WriteCommandDelta(CBitWriter& writer, uint32 delta)
+	{
+		static constexpr uint32 ClassBits[] = { 4, 8, 16, 32 };
+		uint32 sizeClass = 0;
+		while (sizeClass < 3 && delta > MaxQuantized(ClassBits[sizeClass]))
+		{
+			++sizeClass;
+		}
+
+		writer.Write(sizeClass, 2);
+		writer.Write(delta, ClassBits[sizeClass]);
+	}
+
+	uint32 ReadCommandDelta(CBitReader& reader)
+	{
+		static constexpr uint32 ClassBits[] = { 4, 8, 16, 32 };
+		return reader.Read(ClassBits[reader.Read(2)]);
+	}
+
+	class CBenchmarkRandom
+	{
+	public:
+		explicit CBenchmarkRandom(uint32 seed) : m_state(seed != 0 ? seed : 1) {}
+
+		uint32 Next()
+		{
+			m_state ^= m_state << 13;
+			m_state ^= m_state >> 17;
+			m_state ^= m_state << 5;
+			return m_state;
+		}
+
+		float Range(float min, float max)
+		{
+			return min + (max - min) * static_cast<float>(Next() & 0xffffff) / static_cast<float>(0xffffff);
+		}
+
+	private:
+		uint32 m_state;
+	};
+}
+
+void CBitWriter::Write(uint32 value, uint32 bits)
+{
+	CRY_ASSERT(bits <= 32);
+	if (bits == 0)
+		return;
+
+	m_scratch |= static_cast<uint64>(value & MaxQuantized(bits)) << m_scratchBits;
+	m_scratchBits += bits;
+	m_bitCount += bits;
+
+	while (m_scratchBits >= 8)
+	{
+		if (m_bytesWritten < m_capacity)
+		{
+			m_pBuffer[m_bytesWritten++] = static_cast<uint8>(m_scratch);
+		}
+		else
+		{
+			m_bOverflowed = true;
+		}
+
+		m_scratch >>= 8;
+		m_scratchBits -= 8;
+	}
+}
+
+void CBitWriter::Append(const uint8* pBits, uint32 bitCount)
+{
+	// Both sides are least significant bit first, so whole bytes can be fed through Write in 32 bit chunks
+	for (; bitCount >= 32; bitCount -= 32, pBits += 4)
+	{
+		Write(pBits[0] | (pBits[1] << 8) | (pBits[2] << 16) | (static_cast<uint32>(pBits[3]) << 24), 32);
+	}
+	for (; bitCount >= 8; bitCount -= 8, ++pBits)
+	{
+		Write(*pBits, 8);
+	}
+	if (bitCount > 0)
+	{
+		Write(*pBits, bitCount);
+	}
+}
+
+void CBitWriter::Flush()
+{
+	if (m_scratchBits > 0)
+	{
+		const uint32 padding = 8 - m_scratchBits;
+		Write(0, padding);
+		m_bitCount -= padding;
+	}
+}
+
+uint32 CBitReader::Read(uint32 bits)
+{
+	CRY_ASSERT(bits <= 32);
+	if (bits == 0)
+		return 0;
+
+	while (m_scratchBits < bits)
+	{
+		if (m_bytesRead >= m_size)
+		{
+			m_bOverflowed = true;
+			return 0;
+		}
+
+		m_scratch |= static_cast<uint64>(m_pBuffer[m_bytesRead++]) << m_scratchBits;
+		m_scratchBits += 8;
+	}
+
+	const uint32 value = static_cast<uint32>(m_scratch & MaxQuantized(bits));
+	m_scratch >>= bits;
+	m_scratchBits -= bits;
+	return value;
+}
+
+namespace PlayerStateCodec
+{
+	SQuantizedPlayerState Quantize(const SPlayerAuthoritativeState& state)
+	{
+		SQuantizedPlayerState quantized;
+		quantized.lastCommand = state.lastCommand;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const SAxisQuantization& quantization = PositionAxes[axis];
+			quantized.position[axis] = QuantizeFloat(state.position[axis], quantization.min, quantization.max, quantization.bits);
+		}
+
+		// Yaw wraps, so pi and -pi share the same value
+		const float yawSteps = (state.yaw + gf_PI) / gf_PI2 * static_cast<float>(1u << YawBits);
+		quantized.yaw = static_cast<uint16>(static_cast<int32>(floorf(yawSteps + 0.5f)) & MaxQuantized(YawBits));
+		quantized.pitch = static_cast<uint16>(QuantizeFloat(state.pitch, -gf_PI * 0.5f, gf_PI * 0.5f, PitchBits));
+		quantized.state = std::min<uint8>(state.state, MaxQuantized(StateBits));
+		quantized.stance = std::min<uint8>(state.stance, MaxQuantized(StanceBits));
+		return quantized;
+	}
+
+	void Dequantize(const SQuantizedPlayerState& quantized, SPlayerAuthoritativeState& state)
+	{
+		state.lastCommand = quantized.lastCommand;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const SAxisQuantization& quantization = PositionAxes[axis];
+			state.position[axis] = DequantizeFloat(quantized.position[axis], quantization.min, quantization.max, quantization.bits);
+		}
+
+		state.yaw = -gf_PI + static_cast<float>(quantized.yaw) * gf_PI2 / static_cast<float>(1u << YawBits);
+		state.pitch = DequantizeFloat(quantized.pitch, -gf_PI * 0.5f, gf_PI * 0.5f, PitchBits);
+		state.state = quantized.state;
+		state.stance = quantized.stance;
+	}
+
+	void Encode(const SQuantizedPlayerState* pBaseline, const SQuantizedPlayerState& state, CBitWriter& writer)
+	{
+		writer.Write(pBaseline != nullptr ? 1 : 0, 1);
+
+		if (pBaseline == nullptr)
+		{
+			writer.Write(state.lastCommand, 32);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				writer.Write(state.position[axis], PositionAxes[axis].bits);
+			}
+			writer.Write(state.yaw, YawBits);
+			writer.Write(state.pitch, PitchBits);
+			writer.Write(state.state, StateBits);
+			writer.Write(state.stance, StanceBits);
+			return;
+		}
+
+		const SQuantizedPlayerState& baseline = *pBaseline;
+		const bool bPositionChanged = state.position[0] != baseline.position[0] || state.position[1] != baseline.position[1] || state.position[2] != baseline.position[2];
+
+		uint32 changed = 0;
+		changed |= state.lastCommand != baseline.lastCommand ? eChanged_Command : 0;
+		changed |= bPositionChanged ? eChanged_Position : 0;
+		changed |= state.yaw != baseline.yaw ? eChanged_Yaw : 0;
+		changed |= state.pitch != baseline.pitch ? eChanged_Pitch : 0;
+		changed |= state.state != baseline.state || state.stance != baseline.stance ? eChanged_Flags : 0;
+		writer.Write(changed, eChanged_FieldCount);
+
+		if (changed & eChanged_Command)
+		{
+			WriteCommandDelta(writer, state.lastCommand - baseline.lastCommand);
+		}
+		if (changed & eChanged_Position)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const uint32 delta = ZigZag(static_cast<int32>(state.position[axis] - baseline.position[axis]));
+				const uint32 length = GetBitLength(delta);
+				writer.Write(length, DeltaLengthBits);
+				writer.Write(delta, length);
+			}
+		}
+		if (changed & eChanged_Yaw)
+		{
+			writer.Write(state.yaw, YawBits);
+		}
+		if (changed & eChanged_Pitch)
+		{
+			writer.Write(state.pitch, PitchBits);
+		}
+		if (changed & eChanged_Flags)
+		{
+			writer.Write(state.state, StateBits);
+			writer.Write(state.stance, StanceBits);
+		}
+	}
+
+	bool Decode(const SQuantizedPlayerState* pBaseline, CBitReader& reader, SQuantizedPlayerState& state)
+	{
+		const bool bDelta = reader.Read(1) != 0;
+
+		if (!bDelta)
+		{
+			state.lastCommand = reader.Read(32);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				state.position[axis] = reader.Read(PositionAxes[axis].bits);
+			}
+			state.yaw = static_cast<uint16>(reader.Read(YawBits));
+			state.pitch = static_cast<uint16>(reader.Read(PitchBits));
+			state.state = static_cast<uint8>(reader.Read(StateBits));
+			state.stance = static_cast<uint8>(reader.Read(StanceBits));
+			return !reader.HasOverflowed();
+		}
+
+		// Without the baseline the entry is still read to the end, so the entries after it can be decoded
+		bool bValid = pBaseline != nullptr;
+		state = bValid ? *pBaseline : SQuantizedPlayerState();
+		const uint32 changed = reader.Read(eChanged_FieldCount);
+
+		if (changed & eChanged_Command)
+		{
+			state.lastCommand += ReadCommandDelta(reader);
+		}
+		if (changed & eChanged_Position)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const uint32 length = reader.Read(DeltaLengthBits);
+				state.position[axis] += static_cast<uint32>(UnZigZag(reader.Read(length)));
+				bValid &= length <= PositionAxes[axis].bits + 1 && state.position[axis] <= MaxQuantized(PositionAxes[axis].bits);
+			}
+		}
+		if (changed & eChanged_Yaw)
+		{
+			state.yaw = static_cast<uint16>(reader.Read(YawBits));
+		}
+		if (changed & eChanged_Pitch)
+		{
+			state.pitch = static_cast<uint16>(reader.Read(PitchBits));
+		}
+		if (changed & eChanged_Flags)
+		{
+			state.state = static_cast<uint8>(reader.Read(StateBits));
+			state.stance = static_cast<uint8>(reader.Read(StanceBits));
+		}
+
+		return bValid && !reader.HasOverflowed();
+	}
+
+	bool RunBenchmark(uint32 playerCount, uint32 tickCount, uint32 seed)
+	{
+		CBenchmarkRandom random(seed);
+
+		// Every player walks, runs or idles around the map at 60 Hz, a quarter of them never move
+		std::vector<SPlayerAuthoritativeState> players(playerCount);
+		std::vector<Vec3> velocities(playerCount, Vec3(ZERO));
+		for (SPlayerAuthoritativeState& player : players)
+		{
+			player.position = Vec3(random.Range(100.f, 3000.f), random.Range(100.f, 3000.f), random.Range(20.f, 200.f));
+			player.yaw = random.Range(-gf_PI, gf_PI);
+		}
+
+		std::vector<SQuantizedPlayerState> baselines(playerCount);
+		std::vector<SQuantizedPlayerState> current(playerCount);
+		std::vector<SQuantizedPlayerState> decoded(playerCount);
+		std::vector<uint8> buffer(playerCount * MaxEntryBytes + 8);
+
+		int64 encodeTicks = 0;
+		int64 decodeTicks = 0;
+		uint64 deltaBytes = 0;
+		uint64 keyframeBytes = 0;
+		uint32 encodedTicks = 0;
+
+		for (uint32 tick = 0; tick <= tickCount; ++tick)
+		{
+			for (uint32 i = 0; i < playerCount; ++i)
+			{
+				SPlayerAuthoritativeState& player = players[i];
+				if ((i & 3) != 0)
+				{
+					if ((random.Next() % 30) == 0)
+					{
+						const float speed = static_cast<float>(random.Next() % 3) * 3.f;
+						player.yaw = random.Range(-gf_PI, gf_PI);
+						player.state = static_cast<uint8>(random.Next() % 3);
+						velocities[i] = Vec3(-sinf(player.yaw) * speed, cosf(player.yaw) * speed, 0.f);
+					}
+					if ((random.Next() % 120) == 0)
+					{
+						player.stance = player.stance == 2 ? 1 : 2;
+					}
+
+					player.position += velocities[i] / 60.f;
+					player.pitch = crymath::clamp(player.pitch + random.Range(-0.01f, 0.01f), -0.85f, 1.5f);
+					++player.lastCommand;
+				}
+
+				current[i] = Quantize(player);
+			}
+
+			// The first tick has nothing to delta against
+			const bool bKeyframe = tick == 0;
+
+			CBitWriter writer(buffer.data(), static_cast<uint32>(buffer.size()));
+			const int64 encodeStart = CryGetTicks();
+			for (uint32 i = 0; i < playerCount; ++i)
+			{
+				Encode(bKeyframe ? nullptr : &baselines[i], current[i], writer);
+			}
+			writer.Flush();
+			const int64 encodeEnd = CryGetTicks();
+
+			CBitReader reader(buffer.data(), writer.GetByteCount());
+			bool bDecoded = true;
+			for (uint32 i = 0; i < playerCount; ++i)
+			{
+				bDecoded &= Decode(bKeyframe ? nullptr : &baselines[i], reader, decoded[i]);
+			}
+			const int64 decodeEnd = CryGetTicks();
+
+			for (uint32 i = 0; i < playerCount; ++i)
+			{
+				if (!bDecoded || decoded[i] != current[i])
+				{
+					CryLogAlways("[PlayerStateCodec] Tick %u, player %u decoded differently than encoded", tick, i);
+					return false;
+				}
+			}
+
+			if (bKeyframe)
+			{
+				keyframeBytes = writer.GetByteCount();
+			}
+			else
+			{
+				encodeTicks += encodeEnd - encodeStart;
+				decodeTicks += decodeEnd - encodeEnd;
+				deltaBytes += writer.GetByteCount();
+				++encodedTicks;
+			}
+
+			baselines.swap(current);
+		}
+
+		const double states = static_cast<double>(playerCount) * std::max(encodedTicks, 1u);
+		const double nanosecondsPerTick = 1000000000.0 / static_cast<double>(CryGetTicksPerSec());
+		CryLogAlways("[PlayerStateCodec] %u players, %u ticks: encode %.1f ns, decode %.1f ns per player",
+			playerCount, encodedTicks, encodeTicks * nanosecondsPerTick / states, decodeTicks * nanosecondsPerTick / states);
+		CryLogAlways("[PlayerStateCodec] %.2f bytes per player delta encoded, %.2f as keyframe, %u unquantized",
+			deltaBytes / states, static_cast<double>(keyframeBytes) / std::max(playerCount, 1u),
+			static_cast<uint32>(sizeof(uint32) + sizeof(Vec3) + 2 * sizeof(float) + 2 * sizeof(uint8)));
+		return true;
+	}
+}
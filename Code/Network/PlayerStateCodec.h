@@ -0,0 +1,237 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <CryNetwork/ISerialize.h>
+
+#include "PlayerInputCommand.h"
+
+////////////////////////////////////////////////////////
+// Bit-packed wire format of the player state.
+// Positions are quantized like the 'lwld' QuantizedVec3
+// policy in Scripts/network/CompressionPolicy.xml, angles
+// to 16 / 12 bits, movement state and stance to 2 bits
+// each. Against a baseline the receiver already has, only
+// the changed fields are written and the position as a
+// variable length delta, so an idle player costs one byte
+// and a running one about eight.
+////////////////////////////////////////////////////////
+
+// Player state after quantization, what both ends agree on
+struct SQuantizedPlayerState
+{
+	uint32 lastCommand = 0;
+	uint32 position[3] = { 0, 0, 0 };
+	uint16 yaw = 0;
+	uint16 pitch = 0;
+	uint8  state = 0;  // EPlayerState
+	uint8  stance = 0; // EPlayerStance
+
+	bool operator==(const SQuantizedPlayerState& other) const
+	{
+		return lastCommand == other.lastCommand && position[0] == other.position[0] && position[1] == other.position[1] && position[2] == other.position[2]
+			&& yaw == other.yaw && pitch == other.pitch && state == other.state && stance == other.stance;
+	}
+	bool operator!=(const SQuantizedPlayerState& other) const { return !(*this == other); }
+};
+
+// Writes values of up to 32 bits into a byte buffer, least significant bit first
+class CBitWriter
+{
+public:
+	CBitWriter(uint8* pBuffer, uint32 capacity) : m_pBuffer(pBuffer), m_capacity(capacity) {}
+
+	void   Write(uint32 value, uint32 bits);
+	// Appends the first bitCount bits of a buffer written by another CBitWriter
+	void   Append(const uint8* pBits, uint32 bitCount);
+
+	// Pads the last byte, the writer can't be used afterwards
+	void   Flush();
+
+	bool   HasOverflowed() const { return m_bOverflowed; }
+	uint32 GetBitCount() const { return m_bitCount; }
+	uint32 GetByteCount() const { return (m_bitCount + 7) / 8; }
+
+private:
+	uint8* m_pBuffer;
+	uint32 m_capacity;
+	uint32 m_bytesWritten = 0;
+	uint32 m_bitCount = 0;
+	uint64 m_scratch = 0;
+	uint32 m_scratchBits = 0;
+	bool   m_bOverflowed = false;
+};
+
+class CBitReader
+{
+public:
+	CBitReader(const uint8* pBuffer, uint32 size) : m_pBuffer(pBuffer), m_size(size) {}
+
+	// Returns 0 and flags an overflow when reading past the end
+	uint32 Read(uint32 bits);
+
+	bool   HasOverflowed() const { return m_bOverflowed; }
+
+private:
+	const uint8* m_pBuffer;
+	uint32       m_size;
+	uint32       m_bytesRead = 0;
+	uint64       m_scratch = 0;
+	uint32       m_scratchBits = 0;
+	bool         m_bOverflowed = false;
+};
+
+// Quantized states of one player over the last ticks, the baselines deltas are taken against
+class CPlayerStateHistory
+{
+public:
+	static constexpr uint32 Length = 32;
+
+	void Reset() { m_ticks.fill(0); m_valid.fill(false); }
+
+	void Add(uint32 tick, const SQuantizedPlayerState& state)
+	{
+		const uint32 slot = tick % Length;
+		m_ticks[slot] = tick;
+		m_states[slot] = state;
+		m_valid[slot] = true;
+	}
+
+	const SQuantizedPlayerState* Find(uint32 tick) const
+	{
+		const uint32 slot = tick % Length;
+		return m_valid[slot] && m_ticks[slot] == tick ? &m_states[slot] : nullptr;
+	}
+
+private:
+	std::array<SQuantizedPlayerState, Length> m_states;
+	std::array<uint32, Length>                m_ticks = {};
+	std::array<bool, Length>                  m_valid = {};
+};
+
+// Players each of a client's last snapshots contained and the part of the snapshot that carried them. A delta against
+// an acked snapshot is only possible for the players in the parts the client acked.
+// Also keeps when each snapshot was sent and which Scheduler.xml groups it carried, for the ack latency telemetry.
+class CSnapshotContentsHistory
+{
+public:
+	void Begin(uint32 tick, int64 sendTime)
+	{
+		m_current = tick % CPlayerStateHistory::Length;
+		m_ticks[m_current] = tick;
+		m_sendTimes[m_current] = sendTime;
+		m_groupMasks[m_current] = 0;
+		m_players[m_current].clear();
+		m_valid[m_current] = false;
+	}
+
+	void Add(uint32 player, uint8 group, uint8 part)
+	{
+		m_players[m_current].push_back({ player, part });
+		m_groupMasks[m_current] |= BIT(group & 31);
+	}
+
+	void End()
+	{
+		std::sort(m_players[m_current].begin(), m_players[m_current].end(), [](const SEntry& left, const SEntry& right) { return left.player < right.player; });
+		m_valid[m_current] = true;
+	}
+
+	// receivedParts holds a bit per part of the snapshot the client acked, see SPlayerSnapshotParams::part
+	bool Contains(uint32 tick, uint32 player, uint32 receivedParts) const
+	{
+		const uint32 slot = tick % CPlayerStateHistory::Length;
+		if (!m_valid[slot] || m_ticks[slot] != tick)
+			return false;
+
+		const std::vector<SEntry>& players = m_players[slot];
+		const auto found = std::lower_bound(players.begin(), players.end(), player, [](const SEntry& entry, uint32 key) { return entry.player < key; });
+		return found != players.end() && found->player == player && found->part < 32 && (receivedParts & BIT(found->part)) != 0;
+	}
+
+	bool GetSendInfo(uint32 tick, int64& sendTime, uint32& groupMask) const
+	{
+		const uint32 slot = tick % CPlayerStateHistory::Length;
+		if (!m_valid[slot] || m_ticks[slot] != tick)
+			return false;
+
+		sendTime = m_sendTimes[slot];
+		groupMask = m_groupMasks[slot];
+		return true;
+	}
+
+private:
+	struct SEntry
+	{
+		uint32 player;
+		uint8  part;
+	};
+
+	// Capacity is kept between ticks, so this stops allocating once the relevant sets stop growing
+	std::array<std::vector<SEntry>, CPlayerStateHistory::Length> m_players;
+	std::array<uint32, CPlayerStateHistory::Length>              m_ticks = {};
+	std::array<int64, CPlayerStateHistory::Length>               m_sendTimes = {};
+	std::array<uint32, CPlayerStateHistory::Length>              m_groupMasks = {};
+	std::array<bool, CPlayerStateHistory::Length>                m_valid = {};
+	uint32                                                       m_current = 0;
+};
+
+// RMI payload: the states of a batch of players for one tick, encoded for one client.
+// A tick with more players than fit is sent as several parts, each acked on its own since any of them may be lost.
+struct SPlayerSnapshotParams
+{
+	static constexpr uint32 MaxEntries = 64;
+	static constexpr uint32 MaxBytes = 1024;
+	// Parts past this can't be acked, their players are always sent in full
+	static constexpr uint32 MaxAckedParts = 32;
+
+	uint32   tick = 0;
+	uint32   baselineTick = 0; // Tick the delta encoded entries are relative to
+	uint8    part = 0;         // Index of this message among the ones carrying the tick
+	uint8    count = 0;
+	uint16   byteCount = 0;
+	EntityId ids[MaxEntries];
+	uint8    bytes[MaxBytes];
+
+	void SerializeWith(TSerialize ser)
+	{
+		ser.Value("tick", tick, 'ui32');
+		ser.Value("baseline", baselineTick, 'ui32');
+		ser.Value("part", part, 'ui8');
+		ser.Value("count", count, 'ui8');
+		ser.Value("bytes", byteCount, 'ui16');
+		count = std::min<uint8>(count, MaxEntries);
+		byteCount = std::min<uint16>(byteCount, MaxBytes);
+
+		for (uint8 i = 0; i < count; ++i)
+		{
+			ser.Value("id", ids[i], 'eid');
+		}
+		for (uint16 i = 0; i < byteCount; ++i)
+		{
+			ser.Value("b", bytes[i], 'ui8');
+		}
+	}
+};
+
+namespace PlayerStateCodec
+{
+	// Upper bound of one encoded entry, keyframe with every field at full width
+	static constexpr uint32 MaxEntryBits = 1 + 5 + 34 + 3 * (5 + 28) + 16 + 12 + 4;
+	static constexpr uint32 MaxEntryBytes = (MaxEntryBits + 7) / 8;
+
+	SQuantizedPlayerState Quantize(const SPlayerAuthoritativeState& state);
+	void                  Dequantize(const SQuantizedPlayerState& quantized, SPlayerAuthoritativeState& state);
+
+	// Without a baseline every field is written at full width
+	void                  Encode(const SQuantizedPlayerState* pBaseline, const SQuantizedPlayerState& state, CBitWriter& writer);
+	// pBaseline must be the state the sender encoded against. Returns false on malformed data or a missing baseline,
+	// the entry is consumed either way.
+	bool                  Decode(const SQuantizedPlayerState* pBaseline, CBitReader& reader, SQuantizedPlayerState& state);
+
+	// Encodes and decodes simulated player movement for a number of ticks and logs the speed and size per player.
+	// Returns false if a decoded state differs from the encoded one.
+	bool                  RunBenchmark(uint32 playerCount, uint32 tickCount, uint32 seed);
+}
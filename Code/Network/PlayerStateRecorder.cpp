@@ -0,0 +1,102 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PlayerStateRecorder.h"
+
+#include "GamePlugin.h"
+
+#include <CryString/CryPath.h>
+
+namespace
+{
+	const char* const s_defaultRecordingPath = "%USER%/PlayerStates/players.psr";
+
+	void PlayerStateRecordCommand(IConsoleCmdArgs* pArgs)
+	{
+		CPlayerSystem* pPlayerSystem = CGamePlugin::GetInstance()->GetPlayerSystem();
+		CPlayerStateRecorder& recorder = pPlayerSystem->GetStateRecorder();
+		const char* szMode = pArgs->GetArgCount() > 1 ? pArgs->GetArg(1) : "";
+
+		if (strcmp(szMode, "start") == 0)
+		{
+			if (!gEnv->bServer)
+			{
+				CryLogAlways("[PlayerStateRecorder] Only the server has the authoritative states to record");
+				return;
+			}
+
+			const char* szPath = pArgs->GetArgCount() > 2 ? pArgs->GetArg(2) : s_defaultRecordingPath;
+			if (recorder.Start(szPath, 1.f / pPlayerSystem->GetTickTime()))
+			{
+				CryLogAlways("[PlayerStateRecorder] Recording to %s", szPath);
+			}
+			else
+			{
+				CryLogAlways("[PlayerStateRecorder] Failed to open %s", szPath);
+			}
+		}
+		else if (strcmp(szMode, "stop") == 0)
+		{
+			recorder.Stop();
+		}
+		else
+		{
+			CryLogAlways("Usage: g_playerStateRecord start [file] | stop");
+		}
+	}
+}
+
+void CPlayerStateRecorder::RegisterConsoleCommands()
+{
+	REGISTER_COMMAND("g_playerStateRecord", PlayerStateRecordCommand, VF_NULL, "Records the server's player positions and velocities for the CompressionTuner tool. Usage: g_playerStateRecord start [file] | stop");
+}
+
+void CPlayerStateRecorder::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->RemoveCommand("g_playerStateRecord");
+	}
+}
+
+bool CPlayerStateRecorder::Start(const char* szPath, float tickRate)
+{
+	Stop();
+
+	gEnv->pCryPak->MakeDir(PathUtil::GetPathWithoutFilename(szPath).c_str());
+	m_pFile = gEnv->pCryPak->FOpen(szPath, "wb");
+	if (m_pFile == nullptr)
+		return false;
+
+	PlayerStateRecording::SHeader header;
+	header.magic = PlayerStateRecording::Magic;
+	header.version = PlayerStateRecording::Version;
+	header.tickRate = tickRate;
+	header.sampleSize = sizeof(PlayerStateRecording::SSample);
+	gEnv->pCryPak->FWrite(&header, sizeof(header), 1, m_pFile);
+
+	m_samples.reserve(BlockSamples);
+	m_sampleCount = 0;
+	return true;
+}
+
+void CPlayerStateRecorder::Stop()
+{
+	if (m_pFile == nullptr)
+		return;
+
+	WriteSamples();
+	gEnv->pCryPak->FClose(m_pFile);
+	m_pFile = nullptr;
+
+	CryLogAlways("[PlayerStateRecorder] Recorded %" PRIu64 " samples", m_sampleCount);
+}
+
+void CPlayerStateRecorder::WriteSamples()
+{
+	if (!m_samples.empty())
+	{
+		gEnv->pCryPak->FWrite(m_samples.data(), sizeof(PlayerStateRecording::SSample), m_samples.size(), m_pFile);
+		m_sampleCount += m_samples.size();
+		m_samples.clear();
+	}
+}
@@ -0,0 +1,60 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include "PlayerStateRecording.h"
+
+////////////////////////////////////////////////////////
+// Writes the authoritative position and velocity of every
+// player each server tick, in the PlayerStateRecording
+// format, for tuning the compression policies offline:
+//   g_playerStateRecord start [file]
+//   g_playerStateRecord stop
+//   CompressionTuner --input <file> --base CompressionPolicy.xml
+// Samples are buffered and written in blocks, recording
+// costs a copy per player and tick.
+////////////////////////////////////////////////////////
+
+class CPlayerStateRecorder
+{
+public:
+	static void RegisterConsoleCommands();
+	static void UnregisterConsoleCommands();
+
+	~CPlayerStateRecorder() { Stop(); }
+
+	bool Start(const char* szPath, float tickRate);
+	void Stop();
+
+	bool IsRecording() const { return m_pFile != nullptr; }
+
+	void Record(uint32 tick, EntityId entityId, const Vec3& position, const Vec3& velocity)
+	{
+		PlayerStateRecording::SSample sample;
+		sample.tick = tick;
+		sample.entityId = entityId;
+		sample.position[0] = position.x;
+		sample.position[1] = position.y;
+		sample.position[2] = position.z;
+		sample.velocity[0] = velocity.x;
+		sample.velocity[1] = velocity.y;
+		sample.velocity[2] = velocity.z;
+		m_samples.push_back(sample);
+
+		if (m_samples.size() >= BlockSamples)
+		{
+			WriteSamples();
+		}
+	}
+
+private:
+	static constexpr size_t BlockSamples = 4096;
+
+	void WriteSamples();
+
+private:
+	FILE*                                      m_pFile = nullptr;
+	std::vector<PlayerStateRecording::SSample> m_samples;
+	uint64                                     m_sampleCount = 0;
+};
@@ -0,0 +1,41 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <cstdint>
+
+////////////////////////////////////////////////////////
+// File format of the authoritative player states the
+// server records with g_playerStateRecord, read by the
+// CompressionTuner tool (Code/Tools/CompressionTuner) to
+// size the position and velocity policies in
+// Scripts/network/CompressionPolicy.xml. Structs are
+// written as they are, little endian, and only use fixed
+// width standard types, the tool is built without the
+// engine.
+//
+// One SHeader, then SSample until the end of the file, in
+// tick order. Every player simulated on a tick has one
+// sample for it.
+////////////////////////////////////////////////////////
+
+namespace PlayerStateRecording
+{
+	static constexpr uint32_t Magic = 0x50535231; // 'PSR1'
+	static constexpr uint32_t Version = 1;
+
+	struct SHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		float    tickRate;   // Ticks per second, the samples' ticks are this far apart
+		uint32_t sampleSize; // sizeof(SSample) when written
+	};
+
+	struct SSample
+	{
+		uint32_t tick;
+		uint32_t entityId;
+		float    position[3]; // World space, what the 'lwld' policy quantizes
+		float    velocity[3]; // Character controller velocity after the tick's movement
+	};
+}
@@ -0,0 +1,127 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PotentiallyVisibleSet.h"
+
+#include "Systems/PakArchive.h"
+
+bool CPotentiallyVisibleSet::Load(const char* szPath)
+{
+	Unload();
+
+	char szRealPath[ICryPak::g_nMaxPath];
+	const char* szAdjustedPath = gEnv->pCryPak->AdjustFileName(szPath, szRealPath, 0);
+	if (m_file.Open(szAdjustedPath))
+		return Attach(m_file.GetData(), m_file.GetSize(), szPath);
+
+	if (MapFromLevelPak(szPath))
+		return true;
+
+	// A compressed or misaligned entry is read once instead
+	FILE* pFile = gEnv->pCryPak->FOpen(szPath, "rb");
+	if (pFile == nullptr)
+	{
+		CryLog("[PotentiallyVisibleSet] No %s, every cell sees every other", szPath);
+		return false;
+	}
+
+	// uint64 elements, the rows are read in place and need their alignment
+	const size_t size = gEnv->pCryPak->FGetSize(pFile);
+	std::vector<uint8> contents(size + sizeof(uint64));
+	uint8* pAligned = contents.data() + (sizeof(uint64) - reinterpret_cast<UINT_PTR>(contents.data()) % sizeof(uint64)) % sizeof(uint64);
+	const bool bRead = gEnv->pCryPak->FRead(pAligned, 1, size, pFile) == size;
+	gEnv->pCryPak->FClose(pFile);
+
+	m_fallback.swap(contents);
+	if (!bRead)
+	{
+		Unload();
+		return false;
+	}
+	return Attach(pAligned, size, szPath);
+}
+
+bool CPotentiallyVisibleSet::MapFromLevelPak(const char* szPath)
+{
+	// A packed level has it in the level.pak of its folder
+	const char* szName = szPath;
+	for (const char* szChar = szPath; *szChar != '\0'; ++szChar)
+	{
+		szName = *szChar == '/' || *szChar == '\\' ? szChar + 1 : szName;
+	}
+	const string pakPath = string(szPath, szName) + "level.pak";
+
+	char szRealPath[ICryPak::g_nMaxPath];
+	if (!m_file.Open(gEnv->pCryPak->AdjustFileName(pakPath.c_str(), szRealPath, 0)))
+		return false;
+
+	// Only a stored entry is usable in place, and only when the rows land on their alignment
+	CPakArchive archive;
+	size_t size = 0;
+	const uint32 index = archive.Open(m_file.GetData(), m_file.GetSize()) ? archive.Find(szName) : CPakArchive::NotFound;
+	const uint8* pView = index != CPakArchive::NotFound ? archive.GetStoredView(index, size) : nullptr;
+	if (pView == nullptr || reinterpret_cast<UINT_PTR>(pView) % alignof(uint64) != 0)
+	{
+		m_file.Close();
+		return false;
+	}
+	return Attach(pView, size, szPath);
+}
+
+void CPotentiallyVisibleSet::Unload()
+{
+	m_file.Close();
+	m_fallback.clear();
+	m_fallback.shrink_to_fit();
+	m_pHeader = nullptr;
+	m_pRowIndex = nullptr;
+	m_pRows = nullptr;
+}
+
+bool CPotentiallyVisibleSet::Attach(const void* pData, size_t size, const char* szPath)
+{
+	using namespace PotentiallyVisibleSetFile;
+
+	const SHeader* pHeader = static_cast<const SHeader*>(pData);
+	const uint64 cellCount = size >= sizeof(SHeader) ? static_cast<uint64>(pHeader->cellCountX) * pHeader->cellCountY * pHeader->cellCountZ : 0;
+	if (size < sizeof(SHeader) || pHeader->magic != Magic || pHeader->version != Version || cellCount == 0 || cellCount > OutsideCell
+		|| pHeader->rowWords != (cellCount + 63) / 64 || pHeader->cellSize <= 0.f || GetFileSize(*pHeader) != size)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[PotentiallyVisibleSet] %s is not a version %u set of the expected size, rebake it with Code/Tools/PvsBake", szPath, Version);
+		Unload();
+		return false;
+	}
+
+	const uint32* pRowIndex = reinterpret_cast<const uint32*>(pHeader + 1);
+	for (uint64 cell = 0; cell < cellCount; ++cell)
+	{
+		if (pRowIndex[cell] >= pHeader->rowCount)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[PotentiallyVisibleSet] %s has a cell without a row, rebake it with Code/Tools/PvsBake", szPath);
+			Unload();
+			return false;
+		}
+	}
+
+	m_pHeader = pHeader;
+	m_pRowIndex = pRowIndex;
+	m_pRows = reinterpret_cast<const uint64*>(reinterpret_cast<const uint8*>(pRowIndex) + GetRowIndexSize(static_cast<uint32>(cellCount)));
+	m_fInvCellSize = 1.f / pHeader->cellSize;
+
+	CryLog("[PotentiallyVisibleSet] Loaded %s%s: %u x %u x %u cells of %.1fm, %u distinct rows, source %08x", szPath, m_file.IsOpen() ? " (mapped)" : "",
+		pHeader->cellCountX, pHeader->cellCountY, pHeader->cellCountZ, pHeader->cellSize, pHeader->rowCount, pHeader->sourceHash);
+	return true;
+}
+
+uint32 CPotentiallyVisibleSet::GetCell(const Vec3& position) const
+{
+	if (m_pHeader == nullptr)
+		return OutsideCell;
+
+	const float x = floorf((position.x - m_pHeader->origin[0]) * m_fInvCellSize);
+	const float y = floorf((position.y - m_pHeader->origin[1]) * m_fInvCellSize);
+	const float z = floorf((position.z - m_pHeader->origin[2]) * m_fInvCellSize);
+	if (x < 0.f || y < 0.f || z < 0.f || x >= m_pHeader->cellCountX || y >= m_pHeader->cellCountY || z >= m_pHeader->cellCountZ)
+		return OutsideCell;
+
+	return static_cast<uint32>(x) + m_pHeader->cellCountX * (static_cast<uint32>(y) + m_pHeader->cellCountY * static_cast<uint32>(z));
+}
@@ -0,0 +1,51 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include "PotentiallyVisibleSetFile.h"
+#include "Systems/MemoryMappedFile.h"
+
+////////////////////////////////////////////////////////
+// The current level's baked cell to cell visibility,
+// <level>/visibility.pvs (see PotentiallyVisibleSetFile.h
+// and Code/Tools/PvsBake). The file is memory-mapped and
+// used in place, a lookup is the row of the viewer's cell
+// and one bit of it. Positions outside the baked cells
+// see and are seen from everywhere.
+////////////////////////////////////////////////////////
+
+class CPotentiallyVisibleSet
+{
+public:
+	static constexpr uint32 OutsideCell = ~0u;
+
+	// szPath is a game path, levels without a baked set simply have none
+	bool   Load(const char* szPath);
+	void   Unload();
+	bool   IsLoaded() const { return m_pHeader != nullptr; }
+
+	uint32 GetCell(const Vec3& position) const;
+
+	bool   IsVisible(uint32 fromCell, uint32 toCell) const
+	{
+		if (fromCell == OutsideCell || toCell == OutsideCell)
+			return true;
+
+		const uint64* pRow = m_pRows + static_cast<size_t>(m_pRowIndex[fromCell]) * m_pHeader->rowWords;
+		return ((pRow[toCell >> 6] >> (toCell & 63)) & 1) != 0;
+	}
+
+private:
+	bool   MapFromLevelPak(const char* szPath);
+	bool   Attach(const void* pData, size_t size, const char* szPath);
+
+private:
+	CMemoryMappedFile m_file;     // The loose file, or the level.pak holding it uncompressed
+	std::vector<uint8> m_fallback; // Contents read through ICryPak when it is compressed inside a pak
+
+	const PotentiallyVisibleSetFile::SHeader* m_pHeader = nullptr;
+	const uint32*     m_pRowIndex = nullptr;
+	const uint64*     m_pRows = nullptr;
+	float             m_fInvCellSize = 0.f;
+};
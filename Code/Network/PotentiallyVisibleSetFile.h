@@ -0,0 +1,52 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <cstdint>
+
+////////////////////////////////////////////////////////
+// File format of a level's potentially visible set,
+// <level>/visibility.pvs, baked by the PvsBake tool
+// (Code/Tools/PvsBake) and memory-mapped by the server
+// (see CPotentiallyVisibleSet). Structs are written as
+// they are, little endian, and only use fixed width
+// standard types, the tool is built without the engine.
+//
+// The level is split into cubic cells, cell index
+// x + cellCountX * (y + cellCountY * z). Bit b of a row
+// tells whether cell b may be seen from the row's cell.
+// Cells that see the same set share one row:
+//   SHeader
+//   uint32_t rowIndex[cellCount], padded to 8 bytes
+//   uint64_t rows[rowCount][rowWords]
+////////////////////////////////////////////////////////
+
+namespace PotentiallyVisibleSetFile
+{
+	static constexpr uint32_t Magic = 0x31535650; // 'PVS1'
+	static constexpr uint32_t Version = 1;
+
+	struct SHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t cellCountX;
+		uint32_t cellCountY;
+		uint32_t cellCountZ;
+		uint32_t rowWords;   // 64 bit words per row, cellCount rounded up
+		uint32_t rowCount;   // Distinct rows
+		uint32_t sourceHash; // FNV-1a of the layer files and bake options the set was baked from
+		float    origin[3];  // World position of the minimum corner of cell 0
+		float    cellSize;
+	};
+
+	inline uint64_t GetRowIndexSize(uint32_t cellCount)
+	{
+		return (static_cast<uint64_t>(cellCount) * sizeof(uint32_t) + 7) & ~static_cast<uint64_t>(7);
+	}
+
+	inline uint64_t GetFileSize(const SHeader& header)
+	{
+		const uint32_t cellCount = header.cellCountX * header.cellCountY * header.cellCountZ;
+		return sizeof(SHeader) + GetRowIndexSize(cellCount) + static_cast<uint64_t>(header.rowCount) * header.rowWords * sizeof(uint64_t);
+	}
+}
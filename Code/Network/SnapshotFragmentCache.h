@@ -0,0 +1,106 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "PlayerStateCodec.h"
+
+////////////////////////////////////////////////////////
+// Encoded snapshot entries of the current tick, shared by
+// every client. An entity's entry only depends on the
+// baseline it is encoded against, and clients with similar
+// latency ack the same ticks, so each entity is encoded
+// once per distinct baseline per tick and every further
+// client that needs the same entry gets it bit-copied
+// into its packet. Encoding cost then grows with entities
+// plus clients instead of entities times clients.
+// Fragments are immutable until the next Begin.
+////////////////////////////////////////////////////////
+
+class CSnapshotFragmentCache
+{
+public:
+	// Baselines cached per entity and tick, entries against any further baseline are encoded straight into the packet
+	static constexpr uint32 MaxBaselines = 4;
+
+	explicit CSnapshotFragmentCache(uint32 maxFragmentBytes) : m_maxFragmentBytes(maxFragmentBytes) {}
+
+	// Drops the fragments of the previous tick, entities are indices below entityCount
+	void Begin(uint32 entityCount)
+	{
+		m_slots.resize(entityCount);
+		for (SEntitySlots& slots : m_slots)
+		{
+			slots.count = 0;
+		}
+		m_bytes.clear();
+		m_encoded = 0;
+		m_reused = 0;
+	}
+
+	// Appends the entry of an entity against baselineTick, 0 being no baseline. encode(CBitWriter&) writes the
+	// entry and is only called the first time this tick the entity is needed against that baseline.
+	template<typename TEncode>
+	void Append(uint32 entity, uint32 baselineTick, CBitWriter& writer, TEncode encode)
+	{
+		SEntitySlots& slots = m_slots[entity];
+		for (uint32 i = 0; i < slots.count; ++i)
+		{
+			const SFragment& fragment = slots.fragments[i];
+			if (fragment.baselineTick == baselineTick)
+			{
+				writer.Append(m_bytes.data() + fragment.offset, fragment.bitCount);
+				++m_reused;
+				return;
+			}
+		}
+
+		++m_encoded;
+		if (slots.count == MaxBaselines)
+		{
+			encode(writer);
+			return;
+		}
+
+		SFragment& fragment = slots.fragments[slots.count++];
+		fragment.baselineTick = baselineTick;
+		fragment.offset = static_cast<uint32>(m_bytes.size());
+
+		m_bytes.resize(fragment.offset + m_maxFragmentBytes);
+		CBitWriter fragmentWriter(m_bytes.data() + fragment.offset, m_maxFragmentBytes);
+		encode(fragmentWriter);
+		fragmentWriter.Flush();
+		fragment.bitCount = fragmentWriter.GetBitCount();
+		m_bytes.resize(fragment.offset + fragmentWriter.GetByteCount());
+
+		writer.Append(m_bytes.data() + fragment.offset, fragment.bitCount);
+	}
+
+	// Entries encoded and entries copied from an earlier encode since the last Begin
+	uint32 GetEncodedCount() const { return m_encoded; }
+	uint32 GetReusedCount() const  { return m_reused; }
+	uint32 GetByteCount() const    { return static_cast<uint32>(m_bytes.size()); }
+
+private:
+	struct SFragment
+	{
+		uint32 baselineTick;
+		uint32 offset;
+		uint32 bitCount;
+	};
+
+	struct SEntitySlots
+	{
+		std::array<SFragment, MaxBaselines> fragments;
+		uint32                              count = 0;
+	};
+
+	uint32                    m_maxFragmentBytes;
+	// Encoded bits of all fragments of the tick, capacity is kept between ticks
+	std::vector<uint8>        m_bytes;
+	std::vector<SEntitySlots> m_slots;
+
+	uint32                    m_encoded = 0;
+	uint32                    m_reused = 0;
+};
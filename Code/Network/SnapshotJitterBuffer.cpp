@@ -0,0 +1,250 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "SnapshotJitterBuffer.h"
+
+namespace
+{
+	int   g_playerInterpolation = 1;
+	float g_playerInterpMinDelay = 0.f;
+	float g_playerInterpMaxDelay = 0.3f;
+	float g_playerInterpJitterMargin = 2.f;
+	float g_playerInterpSafety = 0.005f;
+	float g_playerInterpMaxExtrapolation = 0.1f;
+	float g_playerInterpAdaptRate = 0.1f;
+
+	// Weight of a new sample in the running averages of the arrival deviation and the snapshot spacing
+	constexpr float JitterSmoothing = 0.05f;
+	constexpr float SpacingSmoothing = 0.1f;
+	// Fraction of a late arrival the clock offset follows, so a drifting clock or a slower route is picked up
+	constexpr float ClockDrift = 0.002f;
+
+	// How the remote players were rendered, reset whenever they are printed
+	struct SInterpolationStats
+	{
+		uint32 samples = 0;
+		uint32 interpolated = 0;
+		uint32 extrapolated = 0;
+		uint32 held = 0;      // Past the extrapolation limit
+		uint32 behind = 0;    // Render time older than every buffered snapshot, the delay grew faster than snapshots came
+		uint32 snapshots = 0;
+		uint32 late = 0;      // Arrived after their tick was rendered
+		float  delaySum = 0.f;
+		float  maxDelay = 0.f;
+	};
+
+	SInterpolationStats g_interpolationStats;
+
+	void PlayerInterpStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		const SInterpolationStats& stats = g_interpolationStats;
+		const float samples = static_cast<float>(std::max(stats.samples, 1u));
+
+		CryLogAlways("[SnapshotJitterBuffer] %u samples: interpolated %.1f%%, extrapolated %.1f%%, held %.1f%%, behind %.1f%%",
+			stats.samples, 100.f * stats.interpolated / samples, 100.f * stats.extrapolated / samples, 100.f * stats.held / samples, 100.f * stats.behind / samples);
+		CryLogAlways("[SnapshotJitterBuffer] delay avg %.1fms max %.1fms, %u snapshots of which %u arrived too late",
+			1000.f * stats.delaySum / samples, 1000.f * stats.maxDelay, stats.snapshots, stats.late);
+
+		g_interpolationStats = SInterpolationStats();
+	}
+
+	// Whole microseconds, the clock offset and the render time must use the same tick length or they drift apart
+	int64 GetTickMicroseconds(float fTickTime)
+	{
+		return static_cast<int64>(fTickTime * 1000000.f);
+	}
+
+	float WrapAngle(float angle)
+	{
+		angle = angle > gf_PI ? angle - gf_PI2 : angle;
+		return angle < -gf_PI ? angle + gf_PI2 : angle;
+	}
+}
+
+void CSnapshotJitterBuffer::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_playerInterpolation", &g_playerInterpolation, 1, VF_NULL, "Renders other clients' players interpolated between buffered snapshots instead of at the newest one");
+	REGISTER_CVAR2("g_playerInterpMinDelay", &g_playerInterpMinDelay, 0.f, VF_NULL, "Lower limit of the adaptive interpolation delay (s)");
+	REGISTER_CVAR2("g_playerInterpMaxDelay", &g_playerInterpMaxDelay, 0.3f, VF_NULL, "Upper limit of the adaptive interpolation delay (s)");
+	REGISTER_CVAR2("g_playerInterpJitterMargin", &g_playerInterpJitterMargin, 2.f, VF_NULL, "Standard deviations of the arrival jitter added to the interpolation delay");
+	REGISTER_CVAR2("g_playerInterpSafety", &g_playerInterpSafety, 0.005f, VF_NULL, "Fixed margin added to the interpolation delay (s)");
+	REGISTER_CVAR2("g_playerInterpMaxExtrapolation", &g_playerInterpMaxExtrapolation, 0.1f, VF_NULL, "How far past the newest snapshot a player is extrapolated before it is held (s)");
+	REGISTER_CVAR2("g_playerInterpAdaptRate", &g_playerInterpAdaptRate, 0.1f, VF_NULL, "Playback speed change used to move the interpolation delay, 0.1 = up to 10% faster or slower");
+	REGISTER_COMMAND("g_playerInterpStats", PlayerInterpStatsCommand, VF_NULL, "Prints and resets how other clients' players were interpolated");
+}
+
+void CSnapshotJitterBuffer::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_playerInterpolation", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpMinDelay", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpMaxDelay", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpJitterMargin", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpSafety", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpMaxExtrapolation", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterpAdaptRate", true);
+		gEnv->pConsole->RemoveCommand("g_playerInterpStats");
+	}
+}
+
+bool CSnapshotJitterBuffer::IsEnabled()
+{
+	return g_playerInterpolation != 0;
+}
+
+void CSnapshotJitterBuffer::Reset()
+{
+	*this = CSnapshotJitterBuffer();
+}
+
+void CSnapshotJitterBuffer::Add(uint32 tick, int64 arrivalTime, const SPlayerAuthoritativeState& state, float fTickTime)
+{
+	++g_interpolationStats.snapshots;
+	if (m_fDelay >= 0.f && static_cast<double>(tick) <= m_renderTick)
+	{
+		++g_interpolationStats.late;
+	}
+
+	// Clock and jitter are measured on the snapshots that bring something new, an older one only fills a gap
+	const bool bNewest = m_count == 0 || static_cast<int32>(tick - m_entries[m_count - 1].tick) > 0;
+	if (bNewest)
+	{
+		const int64 clockOffset = arrivalTime - static_cast<int64>(tick) * GetTickMicroseconds(fTickTime);
+		if (m_count == 0)
+		{
+			m_clockOffset = clockOffset;
+			m_fSpacing = fTickTime;
+		}
+		else
+		{
+			float deviation = static_cast<float>(clockOffset - m_clockOffset) / 1000000.f;
+			if (deviation < 0.f)
+			{
+				// Faster than any before: that is the new baseline, everything measured so far was that much later
+				m_clockOffset = clockOffset;
+				m_fDeviationMean -= deviation;
+				deviation = 0.f;
+			}
+			else
+			{
+				m_clockOffset += static_cast<int64>(deviation * ClockDrift * 1000000.f);
+			}
+
+			const float difference = deviation - m_fDeviationMean;
+			m_fDeviationMean += difference * JitterSmoothing;
+			m_fDeviationVariance += (difference * difference - m_fDeviationVariance) * JitterSmoothing;
+
+			const float spacing = static_cast<float>(tick - m_entries[m_count - 1].tick) * fTickTime;
+			m_fSpacing += (spacing - m_fSpacing) * SpacingSmoothing;
+		}
+	}
+
+	// Insert by tick, the oldest entry makes room
+	uint32 position = m_count;
+	while (position > 0 && static_cast<int32>(m_entries[position - 1].tick - tick) > 0)
+	{
+		--position;
+	}
+	if ((position > 0 && m_entries[position - 1].tick == tick) || (position == 0 && m_count == Capacity))
+		return;
+
+	if (m_count == Capacity)
+	{
+		std::move(m_entries.begin() + 1, m_entries.begin() + position, m_entries.begin());
+		--position;
+	}
+	else
+	{
+		std::move_backward(m_entries.begin() + position, m_entries.begin() + m_count, m_entries.begin() + m_count + 1);
+		++m_count;
+	}
+
+	m_entries[position].tick = tick;
+	m_entries[position].state = state;
+}
+
+float CSnapshotJitterBuffer::GetTargetDelay() const
+{
+	// The next snapshot has to be there when the render time reaches the current one, plus its likely lateness
+	const float jitter = m_fDeviationMean + g_playerInterpJitterMargin * sqrtf(m_fDeviationVariance);
+	return crymath::clamp(m_fSpacing + jitter + g_playerInterpSafety, g_playerInterpMinDelay, std::max(g_playerInterpMaxDelay, g_playerInterpMinDelay));
+}
+
+bool CSnapshotJitterBuffer::Sample(int64 now, float fFrametime, float fTickTime, SPlayerAuthoritativeState& state)
+{
+	if (m_count == 0)
+		return false;
+
+	const float targetDelay = GetTargetDelay();
+	if (m_fDelay < 0.f)
+	{
+		m_fDelay = targetDelay;
+	}
+	else
+	{
+		const float maxChange = g_playerInterpAdaptRate * fFrametime;
+		m_fDelay += crymath::clamp(targetDelay - m_fDelay, -maxChange, maxChange);
+	}
+
+	m_renderTick = (static_cast<double>(now - m_clockOffset) - m_fDelay * 1000000.0) / static_cast<double>(GetTickMicroseconds(fTickTime));
+
+	SInterpolationStats& stats = g_interpolationStats;
+	++stats.samples;
+	stats.delaySum += m_fDelay;
+	stats.maxDelay = std::max(stats.maxDelay, m_fDelay);
+
+	const SEntry& newest = m_entries[m_count - 1];
+	if (m_renderTick >= static_cast<double>(newest.tick))
+	{
+		state = newest.state;
+		if (m_count < 2)
+		{
+			++stats.held;
+			return true;
+		}
+
+		// Keep moving the way the last two snapshots did, for a limited time
+		const SEntry& previous = m_entries[m_count - 2];
+		const float ahead = static_cast<float>(m_renderTick - static_cast<double>(newest.tick)) * fTickTime;
+		const float span = static_cast<float>(newest.tick - previous.tick) * fTickTime;
+		const Vec3 velocity = (newest.state.position - previous.state.position) / span;
+		state.position += velocity * std::min(ahead, g_playerInterpMaxExtrapolation);
+
+		if (ahead > g_playerInterpMaxExtrapolation)
+		{
+			++stats.held;
+		}
+		else
+		{
+			++stats.extrapolated;
+		}
+		return true;
+	}
+
+	const SEntry& oldest = m_entries[0];
+	if (m_renderTick <= static_cast<double>(oldest.tick))
+	{
+		state = oldest.state;
+		++stats.behind;
+		return true;
+	}
+
+	uint32 next = 1;
+	while (static_cast<double>(m_entries[next].tick) <= m_renderTick)
+	{
+		++next;
+	}
+
+	const SEntry& from = m_entries[next - 1];
+	const SEntry& to = m_entries[next];
+	const float alpha = static_cast<float>((m_renderTick - static_cast<double>(from.tick)) / static_cast<double>(to.tick - from.tick));
+
+	// Discrete fields change when the render time reaches the snapshot that changed them
+	state = from.state;
+	state.position = Vec3::CreateLerp(from.state.position, to.state.position, alpha);
+	state.yaw = WrapAngle(from.state.yaw + WrapAngle(to.state.yaw - from.state.yaw) * alpha);
+	state.pitch = from.state.pitch + (to.state.pitch - from.state.pitch) * alpha;
+
+	++stats.interpolated;
+	return true;
+}
@@ -0,0 +1,64 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+
+#include "PlayerInputCommand.h"
+
+////////////////////////////////////////////////////////
+// Client side playback of another client's player from
+// the server's snapshots. The snapshots are kept ordered
+// by tick and the player is rendered a delay behind the
+// server, interpolated between the two snapshots around
+// the render time, so a late or lost packet doesn't make
+// it stutter.
+// The delay follows how the snapshots actually arrive:
+// the spacing of the player's snapshots (interest
+// management sends distant players less often) plus a
+// margin for the measured arrival jitter. It changes by
+// playing back slightly faster or slower, never by
+// jumping. When the buffer runs dry the last motion is
+// extrapolated for a bounded time, then held.
+////////////////////////////////////////////////////////
+
+class CSnapshotJitterBuffer
+{
+public:
+	static constexpr uint32 Capacity = 16;
+
+	static void RegisterConsoleCommands();
+	static void UnregisterConsoleCommands();
+	static bool IsEnabled();
+
+	void  Reset();
+
+	// arrivalTime: local async time the snapshot was received, in microseconds
+	void  Add(uint32 tick, int64 arrivalTime, const SPlayerAuthoritativeState& state, float fTickTime);
+
+	// State to render at the local time now, false until a snapshot has arrived
+	bool  Sample(int64 now, float fFrametime, float fTickTime, SPlayerAuthoritativeState& state);
+
+	// Seconds the player is rendered behind the server, negative before the first sample
+	float GetDelay() const { return m_fDelay; }
+
+private:
+	float GetTargetDelay() const;
+
+private:
+	struct SEntry
+	{
+		uint32                    tick;
+		SPlayerAuthoritativeState state;
+	};
+
+	std::array<SEntry, Capacity> m_entries; // Oldest first
+	uint32 m_count = 0;
+
+	// Server clock on the local one: the earliest arrival seen minus the tick's time, so the fastest packets have no deviation
+	int64  m_clockOffset = 0;
+	float  m_fDeviationMean = 0.f;     // Seconds later than the earliest arrivals the snapshots come
+	float  m_fDeviationVariance = 0.f;
+	float  m_fSpacing = 0.f;           // Seconds between the player's snapshots
+	float  m_fDelay = -1.f;
+	double m_renderTick = 0.0;         // Server tick last rendered, snapshots older than it arrived too late
+};
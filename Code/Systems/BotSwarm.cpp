@@ -0,0 +1,252 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "BotSwarm.h"
+
+#include "GamePlugin.h"
+#include "Components/Player.h"
+#include "Components/BotController.h"
+
+#include <CryEntitySystem/IEntitySystem.h>
+#include <CryMemory/IMemory.h>
+
+namespace
+{
+	int   g_botSwarmAutoStart = 0;
+	int   g_botSwarmScripted = 0;
+	int   g_botSwarmSeed = 1;
+	int   g_botSwarmQuitWhenDone = 0;
+	float g_botSwarmWarmup = 2.f;
+	float g_botSwarmDuration = 30.f;
+	float g_botSwarmSpacing = 2.f;
+	ICVar* g_pBotSwarmAnchor = nullptr;
+
+	void BotSwarmCommand(IConsoleCmdArgs* pArgs)
+	{
+		if (pArgs->GetArgCount() < 2)
+		{
+			CryLogAlways("Usage: g_botSwarm <count> [seed] [scripted]");
+			return;
+		}
+
+		const int count = atoi(pArgs->GetArg(1));
+		const int seed = pArgs->GetArgCount() > 2 ? atoi(pArgs->GetArg(2)) : g_botSwarmSeed;
+		const bool bScripted = pArgs->GetArgCount() > 3 && atoi(pArgs->GetArg(3)) != 0;
+		CGamePlugin::GetInstance()->GetBotSwarm()->Spawn(static_cast<uint32>(std::max(count, 0)), static_cast<uint32>(seed), bScripted);
+	}
+
+	void BotSwarmClearCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetBotSwarm()->Clear();
+	}
+
+	void BotSwarmReportCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetBotSwarm()->Report();
+	}
+
+	int64 GetPercentile(std::vector<int64>& sortedSamples, float fraction)
+	{
+		const size_t index = std::min(static_cast<size_t>(fraction * sortedSamples.size()), sortedSamples.size() - 1);
+		return sortedSamples[index];
+	}
+}
+
+CBotSwarm::CBotSwarm(CPlayerSystem& playerSystem)
+	: m_playerSystem(playerSystem)
+{
+	m_playerSystem.AddTickListener(this);
+}
+
+CBotSwarm::~CBotSwarm()
+{
+	m_playerSystem.RemoveTickListener(this);
+}
+
+void CBotSwarm::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_botSwarmAutoStart", &g_botSwarmAutoStart, 0, VF_NULL, "Number of bots to spawn as soon as a level is running, for unattended load tests on the dedicated server");
+	REGISTER_CVAR2("g_botSwarmScripted", &g_botSwarmScripted, 0, VF_NULL, "Input of auto started bots: 0 = random, 1 = scripted");
+	REGISTER_CVAR2("g_botSwarmSeed", &g_botSwarmSeed, 1, VF_NULL, "Seed of the bot input, the same seed repeats the same run");
+	REGISTER_CVAR2("g_botSwarmQuitWhenDone", &g_botSwarmQuitWhenDone, 0, VF_NULL, "Quit after the bot swarm report has been written");
+	REGISTER_CVAR2("g_botSwarmWarmup", &g_botSwarmWarmup, 2.f, VF_NULL, "Seconds after spawning before tick times are recorded");
+	REGISTER_CVAR2("g_botSwarmDuration", &g_botSwarmDuration, 30.f, VF_NULL, "Seconds of tick times recorded before the bot swarm report is written");
+	REGISTER_CVAR2("g_botSwarmSpacing", &g_botSwarmSpacing, 2.f, VF_NULL, "Distance (m) between spawned bots");
+	g_pBotSwarmAnchor = REGISTER_STRING("g_botSwarmAnchor", "player", VF_NULL, "Name of the entity bots are spawned around");
+
+	REGISTER_COMMAND("g_botSwarm", BotSwarmCommand, VF_NULL, "Spawns bot players and measures the player tick. Usage: g_botSwarm <count> [seed] [scripted]");
+	REGISTER_COMMAND("g_botSwarmClear", BotSwarmClearCommand, VF_NULL, "Removes all bot players");
+	REGISTER_COMMAND("g_botSwarmReport", BotSwarmReportCommand, VF_NULL, "Prints the player tick times and memory recorded so far");
+}
+
+void CBotSwarm::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_botSwarmAutoStart", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmScripted", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmSeed", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmQuitWhenDone", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmWarmup", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmDuration", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmSpacing", true);
+		gEnv->pConsole->UnregisterVariable("g_botSwarmAnchor", true);
+		gEnv->pConsole->RemoveCommand("g_botSwarm");
+		gEnv->pConsole->RemoveCommand("g_botSwarmClear");
+		gEnv->pConsole->RemoveCommand("g_botSwarmReport");
+	}
+}
+
+void CBotSwarm::Spawn(uint32 count, uint32 seed, bool bScripted)
+{
+	if (!gEnv->pGameFramework->IsGameStarted())
+	{
+		CryLogAlways("[BotSwarm] No level running");
+		return;
+	}
+
+	m_memoryBefore = GetWorkingSetSize();
+
+	const IEntity* pAnchor = gEnv->pEntitySystem->FindEntityByName(g_pBotSwarmAnchor != nullptr ? g_pBotSwarmAnchor->GetString() : "player");
+	const Vec3 center = pAnchor != nullptr ? pAnchor->GetWorldPos() : Vec3(ZERO);
+
+	// Square grid next to the anchor, continuing after the bots already spawned
+	const uint32 first = static_cast<uint32>(m_bots.size());
+	const uint32 total = first + count;
+	const uint32 columns = std::max(static_cast<uint32>(ceilf(sqrtf(static_cast<float>(total)))), 1u);
+
+	SEntitySpawnParams spawnParams;
+	spawnParams.pClass = gEnv->pEntitySystem->GetClassRegistry()->GetDefaultClass();
+	spawnParams.qRotation = IDENTITY;
+
+	for (uint32 i = first; i < total; ++i)
+	{
+		const float x = static_cast<float>(i % columns + 1) * g_botSwarmSpacing;
+		const float y = (static_cast<float>(i / columns) - 0.5f * static_cast<float>(columns)) * g_botSwarmSpacing;
+
+		string name;
+		name.Format("Bot%u", i);
+		spawnParams.sName = name.c_str();
+		spawnParams.vPosition = center + Vec3(x, y, 0.5f);
+
+		IEntity* pEntity = gEnv->pEntitySystem->SpawnEntity(spawnParams);
+		if (pEntity == nullptr)
+			continue;
+
+		// The controller goes first so the player component knows not to bind the keyboard
+		CBotControllerComponent* pController = pEntity->GetOrCreateComponent<CBotControllerComponent>();
+		CPlayerComponent* pPlayer = pEntity->GetOrCreateComponent<CPlayerComponent>();
+		pController->Start(pPlayer, bScripted ? CBotControllerComponent::EMode::Scripted : CBotControllerComponent::EMode::Random, seed * 7919u + i);
+
+		m_bots.push_back(pEntity->GetId());
+	}
+
+	m_memoryAfterSpawn = GetWorkingSetSize();
+
+	// 60 Hz for the whole window plus some headroom for higher tick rates
+	m_tickMicroseconds.clear();
+	m_tickMicroseconds.reserve(static_cast<size_t>(std::max(g_botSwarmDuration, 1.f) * 240.f));
+	m_fElapsed = 0.f;
+	m_bMeasuring = true;
+
+	CryLogAlways("[BotSwarm] Spawned %u bots (%u total, %s input, seed %u)", count, static_cast<uint32>(m_bots.size()), bScripted ? "scripted" : "random", seed);
+}
+
+void CBotSwarm::Clear()
+{
+	for (EntityId id : m_bots)
+	{
+		if (gEnv->pEntitySystem->GetEntity(id) != nullptr)
+		{
+			gEnv->pEntitySystem->RemoveEntity(id);
+		}
+	}
+
+	m_bots.clear();
+	m_bMeasuring = false;
+}
+
+void CBotSwarm::Update(float fFrametime)
+{
+	if (g_botSwarmAutoStart > 0 && !m_bAutoStarted && gEnv->pGameFramework->IsGameStarted() && !gEnv->IsEditing())
+	{
+		m_bAutoStarted = true;
+		Spawn(static_cast<uint32>(g_botSwarmAutoStart), static_cast<uint32>(g_botSwarmSeed), g_botSwarmScripted != 0);
+	}
+
+	if (m_bots.empty())
+		return;
+
+	for (EntityId id : m_bots)
+	{
+		if (IEntity* pEntity = gEnv->pEntitySystem->GetEntity(id))
+		{
+			if (CBotControllerComponent* pController = pEntity->GetComponent<CBotControllerComponent>())
+			{
+				pController->Update(fFrametime);
+			}
+		}
+	}
+
+	if (!m_bMeasuring)
+		return;
+
+	m_fElapsed += fFrametime;
+	if (m_fElapsed >= g_botSwarmWarmup + g_botSwarmDuration)
+	{
+		m_bMeasuring = false;
+		Report();
+
+		if (g_botSwarmQuitWhenDone != 0)
+		{
+			gEnv->pSystem->Quit();
+		}
+	}
+}
+
+void CBotSwarm::OnPlayerTick(uint32 tick, int64 microseconds)
+{
+	if (m_bMeasuring && m_fElapsed >= g_botSwarmWarmup)
+	{
+		m_tickMicroseconds.push_back(microseconds);
+	}
+}
+
+void CBotSwarm::Report() const
+{
+	const uint64 memoryNow = GetWorkingSetSize();
+	const uint32 botCount = static_cast<uint32>(m_bots.size());
+
+	CryLogAlways("[BotSwarm] %u bots, %u players simulated", botCount, static_cast<uint32>(m_playerSystem.GetPlayerCount()));
+	CryLogAlways("[BotSwarm] Memory: %.1f MB before spawning, %.1f MB after, %.1f MB now (%.1f KB per bot)",
+		m_memoryBefore / (1024.f * 1024.f), m_memoryAfterSpawn / (1024.f * 1024.f), memoryNow / (1024.f * 1024.f),
+		botCount > 0 ? (static_cast<float>(m_memoryAfterSpawn) - static_cast<float>(m_memoryBefore)) / (1024.f * botCount) : 0.f);
+
+	if (m_tickMicroseconds.empty())
+	{
+		CryLogAlways("[BotSwarm] No ticks recorded yet");
+		return;
+	}
+
+	std::vector<int64> samples = m_tickMicroseconds;
+	std::sort(samples.begin(), samples.end());
+
+	int64 total = 0;
+	for (int64 sample : samples)
+	{
+		total += sample;
+	}
+
+	CryLogAlways("[BotSwarm] Tick time over %u ticks: p50 %dus, p99 %dus, max %dus, mean %.1fus (budget %dus)",
+		static_cast<uint32>(samples.size()),
+		static_cast<int>(GetPercentile(samples, 0.5f)), static_cast<int>(GetPercentile(samples, 0.99f)), static_cast<int>(samples.back()),
+		static_cast<float>(total) / samples.size(), static_cast<int>(m_playerSystem.GetTickTime() * 1000000.f));
+}
+
+uint64 CBotSwarm::GetWorkingSetSize() const
+{
+	IMemoryManager::SProcessMemInfo memoryInfo;
+	if (gEnv->pSystem->GetIMemoryManager() == nullptr || !gEnv->pSystem->GetIMemoryManager()->GetProcessMemInfo(memoryInfo))
+		return 0;
+
+	return memoryInfo.WorkingSetSize;
+}
@@ -0,0 +1,52 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include "PlayerSystem.h"
+
+////////////////////////////////////////////////////////
+// Load test harness: spawns bot players on the current
+// level, drives them with generated input and reports
+// the player tick time percentiles and process memory.
+// Works on the dedicated server, which has no renderer:
+//   Game_Server +g_botSwarmAutoStart 128 +g_botSwarmQuitWhenDone 1
+// or from the console with g_botSwarm <count> [seed] [scripted].
+////////////////////////////////////////////////////////
+
+class CBotSwarm final : public IPlayerTickListener
+{
+public:
+	CBotSwarm(CPlayerSystem& playerSystem);
+	virtual ~CBotSwarm() override;
+
+	// IPlayerTickListener
+	virtual void OnPlayerTick(uint32 tick, int64 microseconds) override;
+	// ~IPlayerTickListener
+
+	void RegisterConsoleCommands();
+	void UnregisterConsoleCommands();
+
+	void Spawn(uint32 count, uint32 seed, bool bScripted);
+	void Clear();
+	void Report() const;
+
+	// Feeds the bots their input for this frame, call before the player system update
+	void Update(float fFrametime);
+
+private:
+	uint64 GetWorkingSetSize() const;
+
+private:
+	CPlayerSystem&        m_playerSystem;
+	std::vector<EntityId> m_bots;
+
+	bool                  m_bAutoStarted = false;
+	bool                  m_bMeasuring = false;
+	float                 m_fElapsed = 0.f;
+
+	// Samples of the measuring window, reserved up front so recording doesn't show up in the numbers
+	std::vector<int64>    m_tickMicroseconds;
+	uint64                m_memoryBefore = 0;
+	uint64                m_memoryAfterSpawn = 0;
+};
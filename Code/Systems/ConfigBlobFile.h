@@ -0,0 +1,316 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////
+// File format of the baked game config,
+// Scripts/ConfigCache.bin: the XML documents the game
+// reads at startup, flattened into tables. Baked by the
+// ConfigBake tool (Code/Tools/ConfigBake), rebuilt by the
+// game into %USER%/ConfigCache.bin when a source changed
+// since, and used in place by CConfigCache. Structs are
+// written as they are, little endian, and only use fixed
+// width standard types, the tool is built without the
+// engine.
+//   SHeader
+//   SDocument  documents[documentCount], sorted by path
+//   SNode      nodes[nodeCount]
+//   SAttribute attributes[attributeCount]
+//   char       strings[stringBytes]
+// A node's attributes are consecutive, and so are its
+// children, which always come after it. Strings are zero
+// terminated and each distinct one is stored once, tags,
+// keys and values are offsets into them, 0 being "".
+////////////////////////////////////////////////////////
+
+namespace ConfigBlobFile
+{
+	static constexpr uint32_t Magic = 0x31474643; // 'CFG1'
+	static constexpr uint32_t Version = 1;
+	static constexpr uint32_t NotFound = ~0u;
+
+	struct SHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t documentCount;
+		uint32_t nodeCount;
+		uint32_t attributeCount;
+		uint32_t stringBytes;
+	};
+
+	struct SDocument
+	{
+		uint32_t path;       // Lower case game path with forward slashes, see NormalizePath
+		uint32_t rootNode;
+		uint32_t sourceSize;
+		uint32_t padding;
+		uint64_t sourceHash; // Of the XML it was baked from, see HashSource
+	};
+
+	struct SNode
+	{
+		uint32_t tag;
+		uint32_t content;
+		uint32_t firstAttribute;
+		uint32_t attributeCount;
+		uint32_t firstChild;
+		uint32_t childCount;
+	};
+
+	struct SAttribute
+	{
+		uint32_t key;
+		uint32_t value;
+	};
+
+	// FNV-1a of the bytes without carriage returns, a checkout with either line ending matches the bake
+	inline uint64_t HashSource(const void* pData, size_t size)
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+		{
+			if (pBytes[i] != '\r')
+			{
+				hash ^= pBytes[i];
+				hash *= 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+
+	inline std::string NormalizePath(const char* szPath)
+	{
+		std::string path = szPath;
+		for (char& c : path)
+		{
+			c = c == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		}
+		return path;
+	}
+
+	inline uint64_t GetFileSize(const SHeader& header)
+	{
+		return sizeof(SHeader) + static_cast<uint64_t>(header.documentCount) * sizeof(SDocument) + static_cast<uint64_t>(header.nodeCount) * sizeof(SNode)
+			+ static_cast<uint64_t>(header.attributeCount) * sizeof(SAttribute) + header.stringBytes;
+	}
+
+	// A document as a parser produced it, what CWriter flattens
+	struct SSourceNode
+	{
+		std::string                                      tag;
+		std::string                                      content;
+		std::vector<std::pair<std::string, std::string>> attributes;
+		std::vector<SSourceNode>                         children;
+	};
+
+	// The tables of a file in memory, checked once so reads need no checks
+	class CView
+	{
+	public:
+		bool Attach(const void* pData, size_t size)
+		{
+			Detach();
+
+			const SHeader* pHeader = static_cast<const SHeader*>(pData);
+			if (pData == nullptr || reinterpret_cast<uintptr_t>(pData) % alignof(uint64_t) != 0 || size < sizeof(SHeader) || pHeader->magic != Magic
+				|| pHeader->version != Version || GetFileSize(*pHeader) != size || pHeader->stringBytes == 0)
+				return false;
+
+			const SDocument* pDocuments = reinterpret_cast<const SDocument*>(pHeader + 1);
+			const SNode* pNodes = reinterpret_cast<const SNode*>(pDocuments + pHeader->documentCount);
+			const SAttribute* pAttributes = reinterpret_cast<const SAttribute*>(pNodes + pHeader->nodeCount);
+			const char* pStrings = reinterpret_cast<const char*>(pAttributes + pHeader->attributeCount);
+			const uint32_t stringBytes = pHeader->stringBytes;
+			if (pStrings[0] != '\0' || pStrings[stringBytes - 1] != '\0')
+				return false;
+
+			for (uint32_t i = 0; i < pHeader->documentCount; ++i)
+			{
+				if (pDocuments[i].path >= stringBytes || pDocuments[i].rootNode >= pHeader->nodeCount
+					|| (i > 0 && strcmp(pStrings + pDocuments[i - 1].path, pStrings + pDocuments[i].path) >= 0))
+					return false;
+			}
+			for (uint32_t i = 0; i < pHeader->nodeCount; ++i)
+			{
+				const SNode& node = pNodes[i];
+				if (node.tag >= stringBytes || node.content >= stringBytes
+					|| static_cast<uint64_t>(node.firstAttribute) + node.attributeCount > pHeader->attributeCount
+					|| (node.childCount != 0 && (node.firstChild <= i || static_cast<uint64_t>(node.firstChild) + node.childCount > pHeader->nodeCount)))
+					return false;
+			}
+			for (uint32_t i = 0; i < pHeader->attributeCount; ++i)
+			{
+				if (pAttributes[i].key >= stringBytes || pAttributes[i].value >= stringBytes)
+					return false;
+			}
+
+			m_pHeader = pHeader;
+			m_pDocuments = pDocuments;
+			m_pNodes = pNodes;
+			m_pAttributes = pAttributes;
+			m_pStrings = pStrings;
+			return true;
+		}
+
+		void Detach() { *this = CView(); }
+		bool IsAttached() const { return m_pHeader != nullptr; }
+
+		uint32_t          GetDocumentCount() const               { return m_pHeader != nullptr ? m_pHeader->documentCount : 0; }
+		const SDocument&  GetDocument(uint32_t index) const      { return m_pDocuments[index]; }
+		const SNode&      GetNode(uint32_t index) const          { return m_pNodes[index]; }
+		const SAttribute& GetAttribute(uint32_t index) const     { return m_pAttributes[index]; }
+		const char*       GetString(uint32_t offset) const       { return m_pStrings + offset; }
+		size_t            GetSize() const                        { return m_pHeader != nullptr ? static_cast<size_t>(GetFileSize(*m_pHeader)) : 0; }
+
+		// szPath as NormalizePath makes it
+		uint32_t FindDocument(const char* szPath) const
+		{
+			const SDocument* pEnd = m_pDocuments + GetDocumentCount();
+			const SDocument* pFound = std::lower_bound(m_pDocuments, pEnd, szPath, [this](const SDocument& document, const char* szKey) { return strcmp(GetString(document.path), szKey) < 0; });
+			return pFound != pEnd && strcmp(GetString(pFound->path), szPath) == 0 ? static_cast<uint32_t>(pFound - m_pDocuments) : NotFound;
+		}
+
+		void ToSource(uint32_t nodeIndex, SSourceNode& source) const
+		{
+			const SNode& node = m_pNodes[nodeIndex];
+			source.tag = GetString(node.tag);
+			source.content = GetString(node.content);
+			source.attributes.clear();
+			for (uint32_t i = node.firstAttribute; i < node.firstAttribute + node.attributeCount; ++i)
+			{
+				source.attributes.emplace_back(GetString(m_pAttributes[i].key), GetString(m_pAttributes[i].value));
+			}
+			source.children.resize(node.childCount);
+			for (uint32_t i = 0; i < node.childCount; ++i)
+			{
+				ToSource(node.firstChild + i, source.children[i]);
+			}
+		}
+
+	private:
+		const SHeader*    m_pHeader = nullptr;
+		const SDocument*  m_pDocuments = nullptr;
+		const SNode*      m_pNodes = nullptr;
+		const SAttribute* m_pAttributes = nullptr;
+		const char*       m_pStrings = nullptr;
+	};
+
+	class CWriter
+	{
+	public:
+		// A document added again replaces the first
+		void AddDocument(const char* szPath, uint64_t sourceHash, uint32_t sourceSize, SSourceNode root)
+		{
+			SPendingDocument& document = m_documents[NormalizePath(szPath)];
+			document.sourceHash = sourceHash;
+			document.sourceSize = sourceSize;
+			document.root = std::move(root);
+		}
+
+		bool HasDocument(const char* szPath) const { return m_documents.count(NormalizePath(szPath)) != 0; }
+
+		std::vector<uint8_t> Write() const
+		{
+			std::vector<std::pair<const std::string*, const SPendingDocument*>> sorted;
+			for (const auto& document : m_documents)
+			{
+				sorted.emplace_back(&document.first, &document.second);
+			}
+			std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string*, const SPendingDocument*>& left, const std::pair<const std::string*, const SPendingDocument*>& right)
+			{
+				return strcmp(left.first->c_str(), right.first->c_str()) < 0;
+			});
+
+			std::unordered_map<std::string, uint32_t> offsets;
+			std::string strings(1, '\0');
+			offsets.emplace(std::string(), 0);
+			auto intern = [&offsets, &strings](const std::string& value)
+			{
+				const auto inserted = offsets.emplace(value, static_cast<uint32_t>(strings.size()));
+				if (inserted.second)
+				{
+					strings.append(value.c_str(), value.size() + 1);
+				}
+				return inserted.first->second;
+			};
+
+			std::vector<SDocument> documents;
+			std::vector<SNode> nodes;
+			std::vector<SAttribute> attributes;
+			std::deque<std::pair<const SSourceNode*, uint32_t>> queue;
+			for (const auto& document : sorted)
+			{
+				documents.push_back({ intern(*document.first), static_cast<uint32_t>(nodes.size()), document.second->sourceSize, 0, document.second->sourceHash });
+
+				// Breadth first, so the children of each node are consecutive
+				nodes.emplace_back();
+				queue.emplace_back(&document.second->root, static_cast<uint32_t>(nodes.size() - 1));
+				while (!queue.empty())
+				{
+					const SSourceNode& source = *queue.front().first;
+					const uint32_t index = queue.front().second;
+					queue.pop_front();
+
+					SNode& node = nodes[index];
+					node.tag = intern(source.tag);
+					node.content = intern(source.content);
+					node.firstAttribute = static_cast<uint32_t>(attributes.size());
+					node.attributeCount = static_cast<uint32_t>(source.attributes.size());
+					node.firstChild = static_cast<uint32_t>(nodes.size());
+					node.childCount = static_cast<uint32_t>(source.children.size());
+					for (const auto& attribute : source.attributes)
+					{
+						attributes.push_back({ intern(attribute.first), intern(attribute.second) });
+					}
+					for (const SSourceNode& child : source.children)
+					{
+						queue.emplace_back(&child, static_cast<uint32_t>(nodes.size()));
+						nodes.emplace_back();
+					}
+				}
+			}
+
+			SHeader header;
+			header.magic = Magic;
+			header.version = Version;
+			header.documentCount = static_cast<uint32_t>(documents.size());
+			header.nodeCount = static_cast<uint32_t>(nodes.size());
+			header.attributeCount = static_cast<uint32_t>(attributes.size());
+			header.stringBytes = static_cast<uint32_t>(strings.size());
+
+			std::vector<uint8_t> file;
+			file.reserve(static_cast<size_t>(GetFileSize(header)));
+			auto append = [&file](const void* pData, size_t size)
+			{
+				file.insert(file.end(), static_cast<const uint8_t*>(pData), static_cast<const uint8_t*>(pData) + size);
+			};
+			append(&header, sizeof(header));
+			append(documents.data(), documents.size() * sizeof(SDocument));
+			append(nodes.data(), nodes.size() * sizeof(SNode));
+			append(attributes.data(), attributes.size() * sizeof(SAttribute));
+			append(strings.data(), strings.size());
+			return file;
+		}
+
+	private:
+		struct SPendingDocument
+		{
+			uint64_t    sourceHash = 0;
+			uint32_t    sourceSize = 0;
+			SSourceNode root;
+		};
+
+		std::unordered_map<std::string, SPendingDocument> m_documents;
+	};
+}
@@ -0,0 +1,312 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "ConfigCache.h"
+
+#include "GamePlugin.h"
+
+namespace
+{
+	int g_configCache = 1;
+
+	const char* const s_bakedPath = "Scripts/ConfigCache.bin";
+	const char* const s_rebuiltPath = "%USER%/ConfigCache.bin";
+
+	void ConfigCacheStatusCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetConfigCache()->LogStatus();
+	}
+
+	const char* GetSourceName(int source)
+	{
+		static const char* const names[] = { "missing", "baked", "rebuilt", "parsed" };
+		return names[source];
+	}
+
+	void ToSource(const XmlNodeRef& node, ConfigBlobFile::SSourceNode& source)
+	{
+		source.tag = node->getTag();
+		source.content = node->getContent();
+		for (int i = 0; i < node->getNumAttributes(); ++i)
+		{
+			const char* szKey = nullptr;
+			const char* szValue = nullptr;
+			if (node->getAttributeByIndex(i, &szKey, &szValue))
+			{
+				source.attributes.emplace_back(szKey, szValue);
+			}
+		}
+		source.children.resize(node->getChildCount());
+		for (int i = 0; i < node->getChildCount(); ++i)
+		{
+			ToSource(node->getChild(i), source.children[i]);
+		}
+	}
+}
+
+CConfigNode CConfigNode::FindChild(const char* szTag) const
+{
+	for (uint32 i = 0; i < GetChildCount(); ++i)
+	{
+		const CConfigNode child = GetChild(i);
+		if (child.IsTag(szTag))
+			return child;
+	}
+	return CConfigNode();
+}
+
+bool CConfigNode::GetAttr(const char* szKey, float& value) const
+{
+	const char* szValue = FindAttr(szKey);
+	if (szValue == nullptr)
+		return false;
+
+	value = static_cast<float>(atof(szValue));
+	return true;
+}
+
+bool CConfigNode::GetAttr(const char* szKey, int& value) const
+{
+	const char* szValue = FindAttr(szKey);
+	if (szValue == nullptr)
+		return false;
+
+	value = atoi(szValue);
+	return true;
+}
+
+const char* CConfigNode::FindAttr(const char* szKey) const
+{
+	const ConfigBlobFile::SNode& node = GetNode();
+	for (uint32 i = node.firstAttribute; i < node.firstAttribute + node.attributeCount; ++i)
+	{
+		const ConfigBlobFile::SAttribute& attribute = m_pView->GetAttribute(i);
+		if (stricmp(m_pView->GetString(attribute.key), szKey) == 0)
+			return m_pView->GetString(attribute.value);
+	}
+	return nullptr;
+}
+
+void CConfigCache::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_configCache", &g_configCache, 1, VF_NULL, "Reads the game's XML config from the tables baked by Code/Tools/ConfigBake: 0 = parse the XML, 1 = use them while their source is unchanged, 2 = use them without reading the source");
+	REGISTER_COMMAND("g_configCacheStatus", ConfigCacheStatusCommand, VF_NULL, "Prints where each config document was read from");
+}
+
+void CConfigCache::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole != nullptr)
+	{
+		gEnv->pConsole->UnregisterVariable("g_configCache", true);
+		gEnv->pConsole->RemoveCommand("g_configCacheStatus");
+	}
+}
+
+CConfigNode CConfigCache::GetDocument(const char* szPath)
+{
+	if (!m_bLoaded)
+	{
+		LoadBlobs();
+	}
+
+	const std::string key = ConfigBlobFile::NormalizePath(szPath);
+	const auto found = m_documents.find(key);
+	if (found != m_documents.end())
+		return found->second.root;
+
+	SDocument& document = m_documents[key];
+	std::vector<char> source;
+	const bool bRead = g_configCache < 2 && ReadSource(szPath, source);
+	if (bRead)
+	{
+		document.sourceHash = ConfigBlobFile::HashSource(source.data(), source.size());
+		document.sourceSize = static_cast<uint32>(source.size());
+	}
+
+	// A baked document stands in for a source that isn't there, as in a build that only ships the cache
+	for (const SBlob* pBlob : { &m_baked, &m_rebuilt })
+	{
+		const ConfigBlobFile::CView& view = pBlob->view;
+		const uint32 index = g_configCache != 0 ? view.FindDocument(key.c_str()) : ConfigBlobFile::NotFound;
+		if (index == ConfigBlobFile::NotFound)
+			continue;
+
+		const ConfigBlobFile::SDocument& baked = view.GetDocument(index);
+		if (!bRead || baked.sourceHash == document.sourceHash)
+		{
+			document.root = CConfigNode(&view, baked.rootNode);
+			document.source = pBlob == &m_baked ? ESource::Baked : ESource::Rebuilt;
+			document.sourceHash = baked.sourceHash;
+			document.sourceSize = baked.sourceSize;
+			return document.root;
+		}
+	}
+
+	if (!bRead && g_configCache >= 2 && ReadSource(szPath, source))
+	{
+		// Not baked at all, parsed after all
+		document.sourceHash = ConfigBlobFile::HashSource(source.data(), source.size());
+		document.sourceSize = static_cast<uint32>(source.size());
+	}
+	if (source.empty() || !Parse(szPath, source, document))
+		return CConfigNode();
+
+	if (g_configCache != 0)
+	{
+		CryLog("[ConfigCache] %s is not baked or changed since, parsed it", szPath);
+		m_bDirty = true;
+	}
+	return document.root;
+}
+
+void CConfigCache::Update()
+{
+	if (m_bDirty)
+	{
+		m_bDirty = false;
+		Save();
+	}
+}
+
+void CConfigCache::LogStatus() const
+{
+	CryLogAlways("[ConfigCache] %s: %u documents, %s: %u documents", s_bakedPath, m_baked.view.GetDocumentCount(), s_rebuiltPath, m_rebuilt.view.GetDocumentCount());
+	for (const auto& document : m_documents)
+	{
+		CryLogAlways("  %s %s, source %u bytes %016" PRIx64, document.first.c_str(), GetSourceName(static_cast<int>(document.second.source)),
+			document.second.sourceSize, document.second.sourceHash);
+	}
+}
+
+void CConfigCache::LoadBlobs()
+{
+	m_bLoaded = true;
+	if (g_configCache == 0)
+		return;
+
+	if (LoadBlob(s_bakedPath, m_baked, true))
+	{
+		CryLog("[ConfigCache] Loaded %s%s, %u documents", s_bakedPath, m_baked.file.IsOpen() ? " (mapped)" : "", m_baked.view.GetDocumentCount());
+	}
+	else
+	{
+		CryLog("[ConfigCache] No %s, the config XML is parsed, bake it with Code/Tools/ConfigBake", s_bakedPath);
+	}
+
+	LoadBlob(s_rebuiltPath, m_rebuilt, false);
+}
+
+bool CConfigCache::LoadBlob(const char* szPath, SBlob& blob, bool bMap)
+{
+	char szRealPath[ICryPak::g_nMaxPath];
+	if (bMap && blob.file.Open(gEnv->pCryPak->AdjustFileName(szPath, szRealPath, 0)))
+	{
+		if (blob.view.Attach(blob.file.GetData(), blob.file.GetSize()))
+			return true;
+		blob.file.Close();
+	}
+
+	// Inside a pak, or rewritten while running
+	FILE* pFile = gEnv->pCryPak->FOpen(szPath, "rb");
+	if (pFile == nullptr)
+		return false;
+
+	const size_t size = gEnv->pCryPak->FGetSize(pFile);
+	blob.contents.resize((size + sizeof(uint64) - 1) / sizeof(uint64));
+	const bool bRead = gEnv->pCryPak->FRead(blob.contents.data(), 1, size, pFile) == size;
+	gEnv->pCryPak->FClose(pFile);
+
+	if (!bRead || !blob.view.Attach(blob.contents.data(), size))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[ConfigCache] %s is not a version %u config cache, it is ignored", szPath, ConfigBlobFile::Version);
+		blob.contents.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CConfigCache::ReadSource(const char* szPath, std::vector<char>& source) const
+{
+	FILE* pFile = gEnv->pCryPak->FOpen(szPath, "rb");
+	if (pFile == nullptr)
+		return false;
+
+	source.resize(gEnv->pCryPak->FGetSize(pFile));
+	const bool bRead = gEnv->pCryPak->FRead(source.data(), 1, source.size(), pFile) == source.size();
+	gEnv->pCryPak->FClose(pFile);
+	if (!bRead)
+	{
+		source.clear();
+	}
+	return !source.empty();
+}
+
+bool CConfigCache::Parse(const char* szPath, const std::vector<char>& source, SDocument& document)
+{
+	XmlNodeRef root = gEnv->pSystem->LoadXmlFromBuffer(source.data(), source.size());
+	if (!root)
+		return false;
+
+	// Flattened like the baked ones, so every document is read the same way
+	ConfigBlobFile::SSourceNode sourceRoot;
+	ToSource(root, sourceRoot);
+	ConfigBlobFile::CWriter writer;
+	writer.AddDocument(szPath, document.sourceHash, document.sourceSize, std::move(sourceRoot));
+	const std::vector<uint8_t> file = writer.Write();
+
+	m_parsed.emplace_back();
+	SBlob& blob = m_parsed.back();
+	blob.contents.resize((file.size() + sizeof(uint64) - 1) / sizeof(uint64));
+	memcpy(blob.contents.data(), file.data(), file.size());
+	if (!blob.view.Attach(blob.contents.data(), file.size()))
+	{
+		m_parsed.pop_back();
+		return false;
+	}
+
+	document.root = CConfigNode(&blob.view, blob.view.GetDocument(0).rootNode);
+	document.source = ESource::Parsed;
+	return true;
+}
+
+void CConfigCache::Save()
+{
+	// What was parsed this run, and what the rebuilt cache had that wasn't needed yet
+	ConfigBlobFile::CWriter writer;
+	for (const auto& document : m_documents)
+	{
+		if (document.second.source == ESource::Parsed || document.second.source == ESource::Rebuilt)
+		{
+			ConfigBlobFile::SSourceNode root;
+			document.second.root.m_pView->ToSource(document.second.root.m_index, root);
+			writer.AddDocument(document.first.c_str(), document.second.sourceHash, document.second.sourceSize, std::move(root));
+		}
+	}
+	for (uint32 i = 0; i < m_rebuilt.view.GetDocumentCount(); ++i)
+	{
+		const ConfigBlobFile::SDocument& rebuilt = m_rebuilt.view.GetDocument(i);
+		if (m_documents.count(m_rebuilt.view.GetString(rebuilt.path)) == 0)
+		{
+			ConfigBlobFile::SSourceNode root;
+			m_rebuilt.view.ToSource(rebuilt.rootNode, root);
+			writer.AddDocument(m_rebuilt.view.GetString(rebuilt.path), rebuilt.sourceHash, rebuilt.sourceSize, std::move(root));
+		}
+	}
+
+	const std::vector<uint8_t> file = writer.Write();
+	gEnv->pCryPak->MakeDir(PathUtil::GetPathWithoutFilename(s_rebuiltPath).c_str());
+	FILE* pFile = gEnv->pCryPak->FOpen(s_rebuiltPath, "wb");
+	const bool bWritten = pFile != nullptr && gEnv->pCryPak->FWrite(file.data(), 1, file.size(), pFile) == file.size();
+	if (pFile != nullptr)
+	{
+		gEnv->pCryPak->FClose(pFile);
+	}
+
+	if (bWritten)
+	{
+		CryLog("[ConfigCache] Wrote %s, %u bytes", s_rebuiltPath, static_cast<uint32>(file.size()));
+	}
+	else
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[ConfigCache] Could not write %s, changed config is parsed again next start", s_rebuiltPath);
+	}
+}
@@ -0,0 +1,114 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ConfigBlobFile.h"
+#include "MemoryMappedFile.h"
+
+// A node of a document of CConfigCache, valid as long as the cache is. Reads like
+// IXmlNode: tags and keys compare case insensitively, a missing attribute is ""
+// or leaves the value as it was.
+class CConfigNode
+{
+public:
+	CConfigNode() = default;
+
+	explicit operator bool() const { return m_pView != nullptr; }
+
+	const char* GetTag() const                      { return m_pView->GetString(GetNode().tag); }
+	bool        IsTag(const char* szTag) const      { return stricmp(GetTag(), szTag) == 0; }
+	const char* GetContent() const                  { return m_pView->GetString(GetNode().content); }
+
+	uint32      GetChildCount() const               { return GetNode().childCount; }
+	CConfigNode GetChild(uint32 index) const        { return CConfigNode(m_pView, GetNode().firstChild + index); }
+	CConfigNode FindChild(const char* szTag) const;
+
+	bool        HaveAttr(const char* szKey) const   { return FindAttr(szKey) != nullptr; }
+	const char* GetAttr(const char* szKey) const    { const char* szValue = FindAttr(szKey); return szValue != nullptr ? szValue : ""; }
+	bool        GetAttr(const char* szKey, float& value) const;
+	bool        GetAttr(const char* szKey, int& value) const;
+
+private:
+	friend class CConfigCache;
+
+	CConfigNode(const ConfigBlobFile::CView* pView, uint32 index) : m_pView(pView), m_index(index) {}
+
+	const ConfigBlobFile::SNode& GetNode() const { return m_pView->GetNode(m_index); }
+	const char* FindAttr(const char* szKey) const;
+
+private:
+	const ConfigBlobFile::CView* m_pView = nullptr;
+	uint32                       m_index = 0;
+};
+
+////////////////////////////////////////////////////////
+// The game's XML config, read from the tables ConfigBake
+// baked into Scripts/ConfigCache.bin instead of parsed
+// (see ConfigBlobFile.h). The baked file is mapped and
+// its documents are used in place, a lookup walks flat
+// arrays and compares interned strings.
+// A document is only taken from it while its source XML
+// still hashes to what it was baked from. A source that
+// changed since is parsed as before, and every parsed
+// document is written to %USER%/ConfigCache.bin at the
+// end of the frame, the next start takes them from there
+// until the bake is run again. g_configCache 2 skips
+// reading the sources for the check, for builds whose
+// cache is baked with them.
+// Main thread only.
+////////////////////////////////////////////////////////
+
+class CConfigCache
+{
+public:
+	void RegisterConsoleCommands();
+	void UnregisterConsoleCommands();
+
+	// szPath is a game path, the node is empty when there is no such XML file
+	CConfigNode GetDocument(const char* szPath);
+	// Writes the rebuilt cache once documents were parsed
+	void Update();
+	void LogStatus() const;
+
+private:
+	enum class ESource : uint8
+	{
+		Missing,
+		Baked,
+		Rebuilt,
+		Parsed
+	};
+
+	struct SBlob
+	{
+		CMemoryMappedFile     file;
+		std::vector<uint64>   contents; // When not mapped, uint64 for the tables' alignment
+		ConfigBlobFile::CView view;
+	};
+
+	struct SDocument
+	{
+		CConfigNode root;
+		ESource     source = ESource::Missing;
+		uint64      sourceHash = 0;
+		uint32      sourceSize = 0;
+	};
+
+	void LoadBlobs();
+	bool LoadBlob(const char* szPath, SBlob& blob, bool bMap);
+	bool ReadSource(const char* szPath, std::vector<char>& source) const;
+	bool Parse(const char* szPath, const std::vector<char>& source, SDocument& document);
+	void Save();
+
+private:
+	bool                             m_bLoaded = false;
+	bool                             m_bDirty = false;
+	SBlob                            m_baked;   // Scripts/ConfigCache.bin
+	SBlob                            m_rebuilt; // %USER%/ConfigCache.bin, read into memory as it is rewritten
+	std::deque<SBlob>                m_parsed;  // One per parsed document
+	std::map<std::string, SDocument> m_documents; // By normalized path
+};
@@ -0,0 +1,464 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+////////////////////////////////////////////////////////
+// MD5 (RFC 1321), the hash the download manifests
+// (a level's filelist.xml) list for their files.
+////////////////////////////////////////////////////////
+
+class CMd5
+{
+public:
+	static constexpr size_t DigestSize = 16;
+
+	CMd5() { Reset(); }
+
+	void Reset()
+	{
+		m_state[0] = 0x67452301u;
+		m_state[1] = 0xefcdab89u;
+		m_state[2] = 0x98badcfeu;
+		m_state[3] = 0x10325476u;
+		m_length = 0;
+	}
+
+	void Update(const void* pData, size_t size)
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		size_t buffered = static_cast<size_t>(m_length % BlockSize);
+		m_length += size;
+
+		if (buffered != 0)
+		{
+			const size_t count = std::min(size, BlockSize - buffered);
+			memcpy(m_buffer + buffered, pBytes, count);
+			pBytes += count;
+			size -= count;
+			buffered += count;
+			if (buffered < BlockSize)
+				return;
+			Transform(m_buffer);
+		}
+
+		for (; size >= BlockSize; pBytes += BlockSize, size -= BlockSize)
+		{
+			Transform(pBytes);
+		}
+		memcpy(m_buffer, pBytes, size);
+	}
+
+	void Final(uint8_t digest[DigestSize])
+	{
+		const uint64_t bitLength = m_length * 8;
+		const size_t buffered = static_cast<size_t>(m_length % BlockSize);
+		uint8_t padding[BlockSize * 2] = { 0x80 };
+		const size_t paddingSize = (buffered < BlockSize - 8 ? BlockSize : BlockSize * 2) - buffered;
+		for (int i = 0; i < 8; ++i)
+		{
+			padding[paddingSize - 8 + i] = static_cast<uint8_t>(bitLength >> (i * 8));
+		}
+		Update(padding, paddingSize);
+
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				digest[i * 4 + j] = static_cast<uint8_t>(m_state[i] >> (j * 8));
+			}
+		}
+		Reset();
+	}
+
+	// Lower case, as the manifests have them
+	static std::string ToHex(const uint8_t digest[DigestSize])
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string hex(DigestSize * 2, '0');
+		for (size_t i = 0; i < DigestSize; ++i)
+		{
+			hex[i * 2] = digits[digest[i] >> 4];
+			hex[i * 2 + 1] = digits[digest[i] & 15];
+		}
+		return hex;
+	}
+
+private:
+	static constexpr size_t BlockSize = 64;
+
+	static uint32_t RotateLeft(uint32_t value, uint32_t bits) { return (value << bits) | (value >> (32 - bits)); }
+
+	void Transform(const uint8_t* pBlock)
+	{
+		static const uint32_t sines[64] =
+		{
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+		};
+		static const uint32_t shifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+		uint32_t words[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			words[i] = pBlock[i * 4] | (pBlock[i * 4 + 1] << 8) | (pBlock[i * 4 + 2] << 16) | (static_cast<uint32_t>(pBlock[i * 4 + 3]) << 24);
+		}
+
+		uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		for (uint32_t i = 0; i < 64; ++i)
+		{
+			uint32_t f, word;
+			switch (i / 16)
+			{
+			case 0:  f = (b & c) | (~b & d); word = i;                break;
+			case 1:  f = (d & b) | (~d & c); word = (5 * i + 1) % 16; break;
+			case 2:  f = b ^ c ^ d;          word = (3 * i + 5) % 16; break;
+			default: f = c ^ (b | ~d);       word = (7 * i) % 16;     break;
+			}
+			const uint32_t rotated = b + RotateLeft(a + f + sines[i] + words[word], shifts[(i / 16) * 4 + i % 4]);
+			a = d;
+			d = c;
+			c = b;
+			b = rotated;
+		}
+
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+	}
+
+private:
+	uint32_t m_state[4];
+	uint64_t m_length;
+	uint8_t  m_buffer[BlockSize];
+};
+
+////////////////////////////////////////////////////////
+// Checks files against the md5 their manifest lists.
+// Every file is stat'ed first, one the cache has seen with
+// the same size and modification time is not read again,
+// so checking an unchanged package is one stat per file.
+// The others are hashed on worker threads, biggest first
+// so a large pak doesn't start last, each read in 1MB
+// chunks. md5 can only run through a file front to back,
+// a single file is hashed by one thread.
+// The cache is a small text file of path, size, time and
+// md5 lines. Only hashes that were computed are kept in
+// it, whether they matched or not, and entries of files
+// that weren't part of this check stay as they were.
+// Verify may run on a thread of its own, Cancel stops it
+// from any other within a chunk.
+// Only uses standard types, the VerifyFiles tool
+// (Code/Tools/VerifyFiles) is built without the engine.
+////////////////////////////////////////////////////////
+
+class CFileVerifier
+{
+public:
+	enum class EResult : uint8_t
+	{
+		Unchecked,
+		Verified,   // Matches the expected md5
+		Recorded,   // Hashed, there was nothing to compare with
+		Mismatch,
+		Missing,
+		Unreadable
+	};
+
+	struct SFile
+	{
+		std::string key;          // Names the file in the cache, its game path
+		std::string path;         // Where it is on disk
+		std::string expectedMd5;  // Empty to only record it
+		std::string md5;
+		uint64_t    size = 0;
+		int64_t     modified = 0; // Nanoseconds where the file system has them
+		EResult     result = EResult::Unchecked;
+		bool        bFromCache = false;
+	};
+
+	struct SStatistics
+	{
+		uint32_t files = 0;
+		uint32_t fromCache = 0;
+		uint32_t hashed = 0;
+		uint32_t failed = 0; // Mismatched, missing or unreadable
+		uint64_t bytesHashed = 0;
+	};
+
+	static const char* GetResultName(EResult result)
+	{
+		switch (result)
+		{
+		case EResult::Verified:   return "verified";
+		case EResult::Recorded:   return "recorded";
+		case EResult::Mismatch:   return "does not match its md5";
+		case EResult::Missing:    return "is missing";
+		case EResult::Unreadable: return "could not be read";
+		default:                  return "unchecked";
+		}
+	}
+
+	void Add(const std::string& key, const std::string& path, const std::string& expectedMd5)
+	{
+		SFile file;
+		file.key = key;
+		file.path = path;
+		file.expectedMd5 = expectedMd5;
+		std::transform(file.expectedMd5.begin(), file.expectedMd5.end(), file.expectedMd5.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+		m_files.push_back(std::move(file));
+	}
+
+	// A missing or outdated cache is simply empty
+	bool LoadCache(const std::string& path)
+	{
+		m_cache.clear();
+		m_bCacheDirty = false;
+
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+			return false;
+
+		char line[4096];
+		bool bValid = fgets(line, sizeof(line), pFile) != nullptr && strcmp(line, CacheHeader) == 0;
+		while (bValid && fgets(line, sizeof(line), pFile) != nullptr)
+		{
+			// <md5> <size> <modified> <key>, the key last as it may have spaces
+			char md5[33];
+			unsigned long long size;
+			long long modified;
+			int keyStart = 0;
+			if (sscanf(line, "%32s %llu %lld %n", md5, &size, &modified, &keyStart) != 3 || keyStart == 0)
+			{
+				bValid = false;
+				break;
+			}
+
+			std::string key = line + keyStart;
+			while (!key.empty() && (key.back() == '\n' || key.back() == '\r'))
+			{
+				key.pop_back();
+			}
+			SCacheEntry& entry = m_cache[key];
+			entry.md5 = md5;
+			entry.size = size;
+			entry.modified = modified;
+		}
+		fclose(pFile);
+
+		if (!bValid)
+		{
+			m_cache.clear();
+			m_bCacheDirty = true;
+		}
+		return bValid;
+	}
+
+	// Written next to it first, so a crash leaves the old one
+	bool SaveCache(const std::string& path)
+	{
+		const std::string temporaryPath = path + ".tmp";
+		FILE* pFile = fopen(temporaryPath.c_str(), "wb");
+		if (pFile == nullptr)
+			return false;
+
+		bool bWritten = fputs(CacheHeader, pFile) >= 0;
+		for (const auto& entry : m_cache)
+		{
+			bWritten = bWritten && fprintf(pFile, "%s %llu %lld %s\n", entry.second.md5.c_str(), static_cast<unsigned long long>(entry.second.size),
+				static_cast<long long>(entry.second.modified), entry.first.c_str()) > 0;
+		}
+		bWritten = fclose(pFile) == 0 && bWritten;
+
+		remove(path.c_str());
+		if (!bWritten || rename(temporaryPath.c_str(), path.c_str()) != 0)
+		{
+			remove(temporaryPath.c_str());
+			return false;
+		}
+		m_bCacheDirty = false;
+		return true;
+	}
+
+	bool IsCacheDirty() const { return m_bCacheDirty; }
+
+	// Files not hashed yet come out unreadable, the results of a cancelled check are only good for discarding
+	void Cancel() { m_bCancelled = true; }
+	bool IsCancelled() const { return m_bCancelled; }
+
+	// 0 threads uses every core
+	void Verify(uint32_t threadCount = 0)
+	{
+		m_statistics = SStatistics();
+		m_statistics.files = static_cast<uint32_t>(m_files.size());
+
+		std::vector<SFile*> toHash;
+		for (SFile& file : m_files)
+		{
+			file.md5.clear();
+			file.result = EResult::Unchecked;
+			file.bFromCache = false;
+			if (!GetFileState(file.path, file.size, file.modified))
+			{
+				file.result = EResult::Missing;
+				continue;
+			}
+
+			const auto cached = m_cache.find(file.key);
+			if (cached != m_cache.end() && cached->second.size == file.size && cached->second.modified == file.modified)
+			{
+				file.md5 = cached->second.md5;
+				file.bFromCache = true;
+				++m_statistics.fromCache;
+			}
+			else
+			{
+				toHash.push_back(&file);
+			}
+		}
+
+		std::sort(toHash.begin(), toHash.end(), [](const SFile* pLeft, const SFile* pRight) { return pLeft->size > pRight->size; });
+
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		threadCount = std::min(threadCount, static_cast<uint32_t>(toHash.size()));
+
+		std::atomic<size_t> next(0);
+		auto hashFiles = [this, &toHash, &next]()
+		{
+			std::vector<uint8_t> chunk(ChunkSize);
+			for (size_t index = next++; index < toHash.size() && !m_bCancelled; index = next++)
+			{
+				toHash[index]->md5 = HashFile(toHash[index]->path, chunk, m_bCancelled);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < threadCount; ++i)
+		{
+			threads.emplace_back(hashFiles);
+		}
+		if (threadCount > 0)
+		{
+			hashFiles();
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		for (SFile* pFile : toHash)
+		{
+			if (pFile->md5.empty())
+			{
+				pFile->result = EResult::Unreadable;
+				continue;
+			}
+
+			SCacheEntry& entry = m_cache[pFile->key];
+			entry.md5 = pFile->md5;
+			entry.size = pFile->size;
+			entry.modified = pFile->modified;
+			m_bCacheDirty = true;
+			++m_statistics.hashed;
+			m_statistics.bytesHashed += pFile->size;
+		}
+
+		for (SFile& file : m_files)
+		{
+			if (file.result == EResult::Missing || file.result == EResult::Unreadable)
+			{
+				++m_statistics.failed;
+				continue;
+			}
+
+			file.result = file.expectedMd5.empty() ? EResult::Recorded : file.md5 == file.expectedMd5 ? EResult::Verified : EResult::Mismatch;
+			m_statistics.failed += file.result == EResult::Mismatch ? 1 : 0;
+		}
+	}
+
+	const std::vector<SFile>& GetFiles() const      { return m_files; }
+	const SStatistics&        GetStatistics() const { return m_statistics; }
+
+private:
+	struct SCacheEntry
+	{
+		std::string md5;
+		uint64_t    size = 0;
+		int64_t     modified = 0;
+	};
+
+	static constexpr const char* CacheHeader = "FileVerifierCache 1\n";
+	static constexpr size_t ChunkSize = 1024 * 1024;
+
+	static bool GetFileState(const std::string& path, uint64_t& size, int64_t& modified)
+	{
+#if defined(_WIN32)
+		struct _stat64 status;
+		if (_stat64(path.c_str(), &status) != 0 || (status.st_mode & _S_IFREG) == 0)
+			return false;
+		modified = static_cast<int64_t>(status.st_mtime) * 1000000000;
+#else
+		struct stat status;
+		if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+			return false;
+	#if defined(__linux__)
+		modified = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+	#else
+		modified = static_cast<int64_t>(status.st_mtime) * 1000000000;
+	#endif
+#endif
+		size = static_cast<uint64_t>(status.st_size);
+		return true;
+	}
+
+	// Empty when the file can't be read or the check was cancelled
+	static std::string HashFile(const std::string& path, std::vector<uint8_t>& chunk, const std::atomic<bool>& bCancelled)
+	{
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+			return std::string();
+
+		CMd5 md5;
+		size_t read;
+		while (!bCancelled && (read = fread(chunk.data(), 1, chunk.size(), pFile)) > 0)
+		{
+			md5.Update(chunk.data(), read);
+		}
+		const bool bFailed = ferror(pFile) != 0 || bCancelled;
+		fclose(pFile);
+		if (bFailed)
+			return std::string();
+
+		uint8_t digest[CMd5::DigestSize];
+		md5.Final(digest);
+		return CMd5::ToHex(digest);
+	}
+
+private:
+	std::vector<SFile>                 m_files;
+	std::map<std::string, SCacheEntry> m_cache;
+	SStatistics                        m_statistics;
+	bool                               m_bCacheDirty = false;
+	std::atomic<bool>                  m_bCancelled { false };
+};
@@ -0,0 +1,367 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "HotPathProfiler.h"
+
+#include <CryThreading/CryThread.h>
+#include <CryString/CryPath.h>
+
+#include <limits>
+
+#if CRY_COMPILER_MSVC
+	#include <intrin.h>
+#endif
+
+namespace
+{
+	CryCriticalSection                                 g_registryLock;
+	std::array<const char*, CHotPathProfiler::MaxScopes> g_scopeNames = {};
+	std::atomic<uint32>                                g_scopeCount { 0 };
+
+	const char* const s_defaultCsvPath = "%USER%/HotPath/hotpath.csv";
+	const char* const s_defaultTracePath = "%USER%/HotPath/hotpath.json";
+
+	uint32 GetMostSignificantBit(uint64 value)
+	{
+#if CRY_COMPILER_MSVC
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<uint32>(index);
+#else
+		return 63u - static_cast<uint32>(__builtin_clzll(value));
+#endif
+	}
+
+	FILE* OpenForWriting(const char* szPath)
+	{
+		gEnv->pCryPak->MakeDir(PathUtil::GetPathWithoutFilename(szPath).c_str());
+		return gEnv->pCryPak->FOpen(szPath, "wt");
+	}
+
+	double GetNanosecondsPerTick()
+	{
+		static const double nanosecondsPerTick = 1000000000.0 / static_cast<double>(CryGetTicksPerSec());
+		return nanosecondsPerTick;
+	}
+
+	void HotPathProfileCommand(IConsoleCmdArgs* pArgs)
+	{
+		const char* szMode = pArgs->GetArgCount() > 1 ? pArgs->GetArg(1) : "dump";
+
+		if (strcmp(szMode, "dump") == 0)
+		{
+			CHotPathProfiler::Dump();
+		}
+		else if (strcmp(szMode, "reset") == 0)
+		{
+			CHotPathProfiler::Reset();
+		}
+		else if (strcmp(szMode, "csv") == 0)
+		{
+			const char* szPath = pArgs->GetArgCount() > 2 ? pArgs->GetArg(2) : s_defaultCsvPath;
+			CryLogAlways(CHotPathProfiler::WriteCsv(szPath) ? "[HotPath] Wrote %s" : "[HotPath] Failed to write %s", szPath);
+		}
+		else if (strcmp(szMode, "trace") == 0)
+		{
+			const char* szPath = pArgs->GetArgCount() > 2 ? pArgs->GetArg(2) : s_defaultTracePath;
+			CryLogAlways(CHotPathProfiler::WriteChromeTrace(szPath) ? "[HotPath] Wrote %s" : "[HotPath] Failed to write %s", szPath);
+		}
+		else
+		{
+			CryLogAlways("Usage: g_hotPathProfile [dump|reset|csv [file]|trace [file]]");
+		}
+	}
+
+	// Thread records are created once per thread and live as long as the module, so readers never see one go away
+	std::array<std::atomic<void*>, CHotPathProfiler::MaxThreads> g_threads = {};
+	std::atomic<uint32>                                          g_threadCount { 0 };
+}
+
+void CHotPathProfiler::RegisterConsoleCommands()
+{
+	REGISTER_COMMAND("g_hotPathProfile", HotPathProfileCommand, VF_NULL, "Player hot path timings. Usage: g_hotPathProfile [dump|reset|csv [file]|trace [file]], files default to %USER%/HotPath/");
+}
+
+void CHotPathProfiler::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->RemoveCommand("g_hotPathProfile");
+	}
+}
+
+uint32 CHotPathProfiler::RegisterScope(const char* szName)
+{
+	CryAutoCriticalSection lock(g_registryLock);
+
+	const uint32 count = g_scopeCount.load(std::memory_order_relaxed);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (strcmp(g_scopeNames[i], szName) == 0)
+			return i;
+	}
+
+	if (count == MaxScopes)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[HotPath] More than %u scopes, %s is not timed", MaxScopes, szName);
+		return MaxScopes;
+	}
+
+	g_scopeNames[count] = szName;
+	g_scopeCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+uint32 CHotPathProfiler::GetBucketIndex(uint64 value)
+{
+	if (value < SubBucketCount)
+		return static_cast<uint32>(value);
+
+	value = std::min(value, (uint64(1) << MaxValueBits) - 1);
+
+	// Keep the top SubBucketBits - 1 bits below the leading one
+	const uint32 shift = GetMostSignificantBit(value) - (SubBucketBits - 1);
+	return SubBucketCount + (shift - 1) * HalfSubBucketCount + static_cast<uint32>(value >> shift) - HalfSubBucketCount;
+}
+
+uint64 CHotPathProfiler::GetBucketValue(uint32 index)
+{
+	if (index < SubBucketCount)
+		return index;
+
+	// Middle of the bucket
+	const uint32 shift = (index - SubBucketCount) / HalfSubBucketCount + 1;
+	const uint64 subBucket = (index - SubBucketCount) % HalfSubBucketCount + HalfSubBucketCount;
+	return (subBucket << shift) + (uint64(1) << (shift - 1));
+}
+
+CHotPathProfiler::SThreadData* CHotPathProfiler::GetThreadData()
+{
+	static thread_local SThreadData* s_pThreadData = nullptr;
+	if (s_pThreadData == nullptr)
+	{
+		s_pThreadData = CreateThreadData();
+	}
+	return s_pThreadData;
+}
+
+CHotPathProfiler::SThreadData* CHotPathProfiler::CreateThreadData()
+{
+	CryAutoCriticalSection lock(g_registryLock);
+
+	const uint32 count = g_threadCount.load(std::memory_order_relaxed);
+	if (count == MaxThreads)
+		return nullptr;
+
+	// Value initialized, so every counter starts at zero
+	SThreadData* pData = new SThreadData();
+	pData->threadId = CryGetCurrentThreadId();
+
+	g_threads[count].store(pData, std::memory_order_release);
+	g_threadCount.store(count + 1, std::memory_order_release);
+	return pData;
+}
+
+void CHotPathProfiler::Record(uint32 scopeId, int64 startTicks, int64 endTicks)
+{
+	SThreadData* pData = GetThreadData();
+	if (pData == nullptr || scopeId >= MaxScopes)
+		return;
+
+	const uint64 nanoseconds = static_cast<uint64>(static_cast<double>(std::max<int64>(endTicks - startTicks, 0)) * GetNanosecondsPerTick());
+
+	// Single writer per histogram, so plain load and store instead of read-modify-write
+	SHistogram& histogram = pData->histograms[scopeId];
+	std::atomic<uint32>& bucket = histogram.buckets[GetBucketIndex(nanoseconds)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	histogram.count.store(histogram.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	histogram.total.store(histogram.total.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+	if (nanoseconds > histogram.max.load(std::memory_order_relaxed))
+	{
+		histogram.max.store(nanoseconds, std::memory_order_relaxed);
+	}
+
+	const uint32 written = pData->traceWritten.load(std::memory_order_relaxed);
+	STraceEvent& event = pData->trace[written % TraceLength];
+	event.start = startTicks;
+	event.end = endTicks;
+	event.scopeId = scopeId;
+	pData->traceWritten.store(written + 1, std::memory_order_release);
+}
+
+void CHotPathProfiler::Reset()
+{
+	// Samples recorded while resetting may survive, good enough for a console command
+	const uint32 threadCount = g_threadCount.load(std::memory_order_acquire);
+	for (uint32 t = 0; t < threadCount; ++t)
+	{
+		SThreadData* pData = static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire));
+		for (SHistogram& histogram : pData->histograms)
+		{
+			for (std::atomic<uint32>& bucket : histogram.buckets)
+			{
+				bucket.store(0, std::memory_order_relaxed);
+			}
+			histogram.count.store(0, std::memory_order_relaxed);
+			histogram.total.store(0, std::memory_order_relaxed);
+			histogram.max.store(0, std::memory_order_relaxed);
+		}
+		pData->traceWritten.store(0, std::memory_order_relaxed);
+	}
+}
+
+void CHotPathProfiler::SSummary::Add(const SHistogram& histogram)
+{
+	count += histogram.count.load(std::memory_order_relaxed);
+	total += histogram.total.load(std::memory_order_relaxed);
+	max = std::max(max, histogram.max.load(std::memory_order_relaxed));
+	for (uint32 i = 0; i < BucketCount; ++i)
+	{
+		buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+	}
+}
+
+uint64 CHotPathProfiler::SSummary::GetPercentile(float fraction) const
+{
+	// Bucket totals, not count, so a sample counted in one but not yet the other doesn't push past the end
+	uint64 samples = 0;
+	for (uint64 bucket : buckets)
+	{
+		samples += bucket;
+	}
+
+	const uint64 target = static_cast<uint64>(fraction * static_cast<double>(samples));
+	uint64 seen = 0;
+	for (uint32 i = 0; i < BucketCount; ++i)
+	{
+		seen += buckets[i];
+		if (seen > target)
+			return std::min(GetBucketValue(i), max);
+	}
+
+	return max;
+}
+
+void CHotPathProfiler::Dump()
+{
+	const uint32 scopeCount = g_scopeCount.load(std::memory_order_acquire);
+	const uint32 threadCount = g_threadCount.load(std::memory_order_acquire);
+
+	CryLogAlways("[HotPath] %-40s %10s %10s %10s %10s %10s %10s", "scope", "count", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+	for (uint32 scope = 0; scope < scopeCount; ++scope)
+	{
+		SSummary summary;
+		for (uint32 t = 0; t < threadCount; ++t)
+		{
+			summary.Add(static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire))->histograms[scope]);
+		}
+
+		if (summary.count == 0)
+			continue;
+
+		CryLogAlways("[HotPath] %-40s %10u %10.2f %10.2f %10.2f %10.2f %10.2f", g_scopeNames[scope], static_cast<uint32>(summary.count),
+			summary.total / (1000.0 * summary.count), summary.GetPercentile(0.5f) / 1000.0, summary.GetPercentile(0.9f) / 1000.0,
+			summary.GetPercentile(0.99f) / 1000.0, summary.max / 1000.0);
+	}
+}
+
+bool CHotPathProfiler::WriteCsv(const char* szPath)
+{
+	FILE* pFile = OpenForWriting(szPath);
+	if (pFile == nullptr)
+		return false;
+
+	const uint32 scopeCount = g_scopeCount.load(std::memory_order_acquire);
+	const uint32 threadCount = g_threadCount.load(std::memory_order_acquire);
+
+	// One row per scope and thread, then one over all threads
+	gEnv->pCryPak->FPrintf(pFile, "scope,thread,count,mean_us,p50_us,p90_us,p99_us,max_us\n");
+	for (uint32 scope = 0; scope < scopeCount; ++scope)
+	{
+		SSummary allThreads;
+		for (uint32 t = 0; t <= threadCount; ++t)
+		{
+			SSummary threadSummary;
+			const bool bAllThreads = t == threadCount;
+			if (!bAllThreads)
+			{
+				const SThreadData* pData = static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire));
+				threadSummary.Add(pData->histograms[scope]);
+				allThreads.Add(pData->histograms[scope]);
+			}
+
+			const SSummary& summary = bAllThreads ? allThreads : threadSummary;
+			if (summary.count == 0)
+				continue;
+
+			string thread;
+			if (bAllThreads)
+			{
+				thread = "all";
+			}
+			else
+			{
+				thread.Format("%u", static_cast<uint32>(static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire))->threadId));
+			}
+
+			gEnv->pCryPak->FPrintf(pFile, "%s,%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n", g_scopeNames[scope], thread.c_str(), static_cast<uint32>(summary.count),
+				summary.total / (1000.0 * summary.count), summary.GetPercentile(0.5f) / 1000.0, summary.GetPercentile(0.9f) / 1000.0,
+				summary.GetPercentile(0.99f) / 1000.0, summary.max / 1000.0);
+		}
+	}
+
+	gEnv->pCryPak->FClose(pFile);
+	return true;
+}
+
+bool CHotPathProfiler::WriteChromeTrace(const char* szPath)
+{
+	FILE* pFile = OpenForWriting(szPath);
+	if (pFile == nullptr)
+		return false;
+
+	const uint32 threadCount = g_threadCount.load(std::memory_order_acquire);
+	const double microsecondsPerTick = GetNanosecondsPerTick() / 1000.0;
+
+	// Timestamps start at the oldest event still in any ring
+	int64 base = std::numeric_limits<int64>::max();
+	for (uint32 t = 0; t < threadCount; ++t)
+	{
+		const SThreadData* pData = static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire));
+		const uint32 written = pData->traceWritten.load(std::memory_order_acquire);
+		const uint32 first = written > TraceLength ? written - TraceLength : 0;
+		for (uint32 i = first; i < written; ++i)
+		{
+			base = std::min(base, pData->trace[i % TraceLength].start);
+		}
+	}
+
+	gEnv->pCryPak->FPrintf(pFile, "{\"traceEvents\":[\n");
+
+	bool bFirst = true;
+	for (uint32 t = 0; t < threadCount; ++t)
+	{
+		const SThreadData* pData = static_cast<SThreadData*>(g_threads[t].load(std::memory_order_acquire));
+		const uint32 threadId = static_cast<uint32>(pData->threadId);
+		const char* szThreadName = gEnv->pThreadManager != nullptr ? gEnv->pThreadManager->GetThreadName(pData->threadId) : nullptr;
+
+		gEnv->pCryPak->FPrintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			bFirst ? "" : ",\n", threadId, szThreadName != nullptr && szThreadName[0] != '\0' ? szThreadName : "unnamed");
+		bFirst = false;
+
+		const uint32 written = pData->traceWritten.load(std::memory_order_acquire);
+		const uint32 first = written > TraceLength ? written - TraceLength : 0;
+		for (uint32 i = first; i < written; ++i)
+		{
+			const STraceEvent& event = pData->trace[i % TraceLength];
+			if (event.end < event.start || event.scopeId >= MaxScopes)
+				continue; // Overwritten while reading
+
+			gEnv->pCryPak->FPrintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				g_scopeNames[event.scopeId], threadId, (event.start - base) * microsecondsPerTick, (event.end - event.start) * microsecondsPerTick);
+		}
+	}
+
+	gEnv->pCryPak->FPrintf(pFile, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	gEnv->pCryPak->FClose(pFile);
+	return true;
+}
@@ -0,0 +1,114 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <atomic>
+
+////////////////////////////////////////////////////////
+// Scoped timers for the player hot path, cheap enough to
+// leave on in live servers and compiled out of release.
+// Every thread records into its own histograms, so timing
+// a scope never takes a lock. Histograms are log-linear
+// (HDR style, about 3% precision from 1ns to days) and
+// each thread also keeps a ring of its latest scopes for
+// a Chrome trace. See g_hotPathProfile.
+////////////////////////////////////////////////////////
+
+#if !defined(_RELEASE)
+	#define GAME_HOTPATH_PROFILING 1
+#else
+	#define GAME_HOTPATH_PROFILING 0
+#endif
+
+#if GAME_HOTPATH_PROFILING
+	#define HOTPATH_PROFILE_CONCAT_IMPL(a, b) a ## b
+	#define HOTPATH_PROFILE_CONCAT(a, b)      HOTPATH_PROFILE_CONCAT_IMPL(a, b)
+	// Times the rest of the enclosing scope under the given name, which must be a string literal
+	#define HOTPATH_PROFILE_SCOPE(szName)                                                                      \
+		static const uint32 HOTPATH_PROFILE_CONCAT(hotPathScopeId, __LINE__) = CHotPathProfiler::RegisterScope(szName); \
+		CHotPathProfiler::CScopedTimer HOTPATH_PROFILE_CONCAT(hotPathScopeTimer, __LINE__)(HOTPATH_PROFILE_CONCAT(hotPathScopeId, __LINE__))
+#else
+	#define HOTPATH_PROFILE_SCOPE(szName)
+#endif
+
+class CHotPathProfiler
+{
+public:
+	static constexpr uint32 MaxScopes = 32;
+	static constexpr uint32 MaxThreads = 64;
+
+	// Nanoseconds below 2^SubBucketBits are exact, above that every power of two up to 2^MaxValueBits is split into 2^(SubBucketBits - 1) buckets
+	static constexpr uint32 SubBucketBits = 6;
+	static constexpr uint32 MaxValueBits = 48;
+	static constexpr uint32 SubBucketCount = 1u << SubBucketBits;
+	static constexpr uint32 HalfSubBucketCount = SubBucketCount / 2;
+	static constexpr uint32 BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * HalfSubBucketCount;
+
+	// Latest scopes per thread kept for the Chrome trace
+	static constexpr uint32 TraceLength = 4096;
+
+	class CScopedTimer
+	{
+	public:
+		explicit CScopedTimer(uint32 scopeId) : m_scopeId(scopeId), m_start(CryGetTicks()) {}
+		~CScopedTimer() { CHotPathProfiler::Record(m_scopeId, m_start, CryGetTicks()); }
+
+	private:
+		uint32 m_scopeId;
+		int64  m_start;
+	};
+
+	static void   RegisterConsoleCommands();
+	static void   UnregisterConsoleCommands();
+
+	static uint32 RegisterScope(const char* szName);
+	static void   Record(uint32 scopeId, int64 startTicks, int64 endTicks);
+
+	static void   Reset();
+	static void   Dump();
+	static bool   WriteCsv(const char* szPath);
+	static bool   WriteChromeTrace(const char* szPath);
+
+	static uint32 GetBucketIndex(uint64 value);
+	static uint64 GetBucketValue(uint32 index);
+
+private:
+	// Only the owning thread writes, readers may see a sample in one counter but not yet the others
+	struct SHistogram
+	{
+		std::array<std::atomic<uint32>, BucketCount> buckets;
+		std::atomic<uint64> count;
+		std::atomic<uint64> total;
+		std::atomic<uint64> max;
+	};
+
+	struct STraceEvent
+	{
+		int64  start;
+		int64  end;
+		uint32 scopeId;
+	};
+
+	struct SThreadData
+	{
+		threadID                                threadId;
+		std::array<SHistogram, MaxScopes>       histograms;
+		std::array<STraceEvent, TraceLength>    trace;
+		std::atomic<uint32>                     traceWritten;
+	};
+
+	// Merged view of one scope over a set of threads, for reporting
+	struct SSummary
+	{
+		uint64 count = 0;
+		uint64 total = 0;
+		uint64 max = 0;
+		std::array<uint64, BucketCount> buckets = {};
+
+		void   Add(const SHistogram& histogram);
+		uint64 GetPercentile(float fraction) const;
+	};
+
+	static SThreadData* GetThreadData();
+	static SThreadData* CreateThreadData();
+};
@@ -0,0 +1,672 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "LevelLoader.h"
+
+#include "FileVerifier.h"
+#include "GamePlugin.h"
+#include "MemoryMappedFile.h"
+#include "PakArchive.h"
+#include "PakDecompressor.h"
+
+#include <CryGame/IGameFramework.h>
+
+namespace
+{
+	int   g_levelLoadAsync = 1;
+	int   g_levelPrefetchReads = 16;
+	float g_levelPrefetchTimeout = 5.f;
+	int   g_levelVerifyFiles = 1;
+
+	const char* const s_verifyCachePath = "%USER%/LevelFiles.cache";
+
+	void LevelLoadStatusCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetLevelLoader()->LogStatus();
+	}
+
+	const char* GetStageName(ELevelLoadStage stage)
+	{
+		switch (stage)
+		{
+		case ELevelLoadStage::Verifying:   return "verifying";
+		case ELevelLoadStage::Prefetching: return "prefetching";
+		case ELevelLoadStage::Loading:     return "loading";
+		case ELevelLoadStage::Playable:    return "playable";
+		case ELevelLoadStage::Complete:    return "complete";
+		default:                           return "idle";
+		}
+	}
+
+	int64 GetMicroseconds()
+	{
+		return gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+	}
+}
+
+CLevelLoader::~CLevelLoader()
+{
+	Abort();
+}
+
+void CLevelLoader::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_levelLoadAsync", &g_levelLoadAsync, 1, VF_NULL, "Prefetches the level's files before the map loads and keeps reading cosmetic ones in the background: 0 = load the map right away");
+	REGISTER_CVAR2("g_levelPrefetchReads", &g_levelPrefetchReads, 16, VF_NULL, "Level files read through the stream engine at once while prefetching");
+	REGISTER_CVAR2("g_levelPrefetchTimeout", &g_levelPrefetchTimeout, 5.f, VF_NULL, "Seconds the map load waits for the level's critical files before it starts anyway");
+	REGISTER_CVAR2("g_levelVerifyFiles", &g_levelVerifyFiles, 1, VF_NULL, "Checks the level's files against the md5s of its filelist.xml in the background while it loads, unchanged files are skipped: 0 = off, 1 = warn, 2 = the map waits for the check and isn't loaded when a file doesn't match");
+
+	REGISTER_COMMAND("g_levelLoadStatus", LevelLoadStatusCommand, VF_NULL, "Prints how far the level load and its prefetching are");
+}
+
+void CLevelLoader::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole != nullptr)
+	{
+		gEnv->pConsole->UnregisterVariable("g_levelLoadAsync", true);
+		gEnv->pConsole->UnregisterVariable("g_levelPrefetchReads", true);
+		gEnv->pConsole->UnregisterVariable("g_levelPrefetchTimeout", true);
+		gEnv->pConsole->UnregisterVariable("g_levelVerifyFiles", true);
+		gEnv->pConsole->RemoveCommand("g_levelLoadStatus");
+	}
+}
+
+void CLevelLoader::Start(const char* szLevel)
+{
+	Abort();
+
+	m_level = szLevel;
+	m_startTime = GetMicroseconds();
+	m_loadTime = 0;
+	m_bLevelLoaded = false;
+
+	const XmlNodeRef files = LoadFileList();
+	StartVerification(files);
+
+	if (g_levelLoadAsync == 0)
+	{
+		if (m_verification == EVerification::Running && m_bVerificationGates)
+		{
+			SetStage(ELevelLoadStage::Verifying);
+			return;
+		}
+		LoadMap();
+		return;
+	}
+
+	ReadFileList(files);
+	ReadLayers();
+	ReadLevelResourceList();
+	SetStage(ELevelLoadStage::Prefetching);
+
+	const SLevelLoadProgress progress = GetProgress();
+	CryLog("[LevelLoader] Prefetching %u critical and %u cosmetic files of %s", progress.criticalCount, progress.cosmeticCount, m_level.c_str());
+	IssueReads();
+}
+
+void CLevelLoader::Update()
+{
+	// A check that only warns may finish long after the level is playable
+	UpdateVerification();
+
+	if (m_stage == ELevelLoadStage::Idle || m_stage == ELevelLoadStage::Complete)
+		return;
+
+	if (m_bVerificationGates && m_verification == EVerification::Failed && (m_stage == ELevelLoadStage::Verifying || m_stage == ELevelLoadStage::Prefetching))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LevelLoader] Not loading %s, its files don't match its filelist.xml", m_level.c_str());
+		Abort();
+		return;
+	}
+
+	const bool bVerifying = m_bVerificationGates && m_verification == EVerification::Running;
+	if (m_stage == ELevelLoadStage::Verifying)
+	{
+		if (!bVerifying)
+		{
+			LoadMap();
+		}
+		return;
+	}
+
+	{
+		CryAutoCriticalSection lock(m_lock);
+		for (const uint32 index : m_doneFiles)
+		{
+			m_files[index].pStream = nullptr;
+		}
+		m_doneFiles.clear();
+	}
+
+	const SLevelLoadProgress progress = GetProgress();
+	const bool bCriticalRead = progress.criticalRead == progress.criticalCount;
+	if (m_stage == ELevelLoadStage::Prefetching && !bVerifying && (bCriticalRead || progress.fSeconds >= g_levelPrefetchTimeout))
+	{
+		if (!bCriticalRead)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LevelLoader] Only %u of %u critical files of %s read after %.1fs, loading the map anyway",
+				progress.criticalRead, progress.criticalCount, m_level.c_str(), progress.fSeconds);
+		}
+		LoadMap();
+	}
+	else if (m_stage == ELevelLoadStage::Loading && m_bLevelLoaded && gEnv->pGameFramework->IsGameStarted())
+	{
+		// This frame runs the level's first tick
+		CryLogAlways("[LevelLoader] %s playable after %.2fs: %.2fs prefetching %u/%u critical files, %.2fs loading the map, %u/%u cosmetic files read so far",
+			m_level.c_str(), progress.fSeconds, static_cast<float>(m_loadTime - m_startTime) * 1e-6f, progress.criticalRead, progress.criticalCount,
+			GetSeconds(m_loadTime), progress.cosmeticRead, progress.cosmeticCount);
+		SetStage(ELevelLoadStage::Playable);
+	}
+	else if (m_stage == ELevelLoadStage::Playable && bCriticalRead && progress.cosmeticRead == progress.cosmeticCount)
+	{
+		CryLog("[LevelLoader] Every file of %s read after %.2fs, %" PRIu64 " bytes, %u failed", m_level.c_str(), progress.fSeconds, progress.bytesRead, m_failed);
+		SetStage(ELevelLoadStage::Complete);
+	}
+	else if (progress.criticalRead + progress.cosmeticRead != m_reportedDone)
+	{
+		m_reportedDone = progress.criticalRead + progress.cosmeticRead;
+		for (ILevelLoadListener* pListener : m_listeners)
+		{
+			pListener->OnLevelLoadProgress(progress);
+		}
+	}
+}
+
+void CLevelLoader::OnLevelLoadEnd()
+{
+	m_bLevelLoaded = m_stage == ELevelLoadStage::Loading;
+}
+
+void CLevelLoader::OnLevelUnload()
+{
+	// Only the level this loaded going away, the map command unloads whatever ran before
+	if (m_stage == ELevelLoadStage::Playable || m_stage == ELevelLoadStage::Complete)
+	{
+		Abort();
+	}
+}
+
+void CLevelLoader::LogStatus()
+{
+	const SLevelLoadProgress progress = GetProgress();
+	CryLogAlways("[LevelLoader] %s %s for %.2fs: %u/%u critical and %u/%u cosmetic files read, %" PRIu64 " bytes, %u failed, %u reads in flight",
+		m_level.c_str(), GetStageName(progress.stage), progress.fSeconds, progress.criticalRead, progress.criticalCount, progress.cosmeticRead, progress.cosmeticCount,
+		progress.bytesRead, m_failed, m_inFlight);
+}
+
+void CLevelLoader::StreamAsyncOnComplete(IReadStream* pStream, unsigned nError)
+{
+	const DWORD_PTR userData = pStream->GetUserData();
+	{
+		CryAutoCriticalSection lock(m_lock);
+		if (static_cast<uint32>(userData >> 32) != m_generation)
+			return;
+
+		const uint32 index = static_cast<uint32>(userData);
+		SFile& file = m_files[index];
+		file.bDone = true;
+		m_doneFiles.push_back(index);
+		--m_inFlight;
+
+		if (nError == 0)
+		{
+			const uint32 size = pStream->GetBytesRead();
+			m_bytesRead += size;
+			if (file.bScan)
+			{
+				AddReferences(static_cast<const char*>(pStream->GetBuffer()), size);
+			}
+		}
+		else
+		{
+			++m_failed;
+		}
+		++(file.fileClass == EFileClass::Critical ? m_criticalRead : m_cosmeticRead);
+	}
+
+	IssueReads();
+}
+
+CLevelLoader::EFileClass CLevelLoader::Classify(const char* szPath, size_t length, bool& bScan)
+{
+	struct SExtension
+	{
+		const char* szExtension;
+		EFileClass  fileClass;
+		bool        bScan;
+	};
+
+	// What the server needs to simulate the level is critical, including materials for their surface types.
+	// Paks are left out: CryPak opens them itself and reads only the entries asked for, a stream read would pull the
+	// whole archive (level.pak, terraintexture.pak) into memory.
+	static const SExtension extensions[] =
+	{
+		{ "cgf",        EFileClass::Critical, false },
+		{ "cga",        EFileClass::Critical, false },
+		{ "chr",        EFileClass::Critical, false },
+		{ "skin",       EFileClass::Critical, false },
+		{ "cdf",        EFileClass::Critical, true  },
+		{ "mtl",        EFileClass::Critical, true  },
+		{ "caf",        EFileClass::Critical, false },
+		{ "dba",        EFileClass::Critical, false },
+		{ "bspace",     EFileClass::Critical, false },
+		{ "comb",       EFileClass::Critical, false },
+		{ "adb",        EFileClass::Critical, true  },
+		{ "chrparams",  EFileClass::Critical, true  },
+		{ "animevents", EFileClass::Critical, false },
+		{ "xml",        EFileClass::Critical, true  },
+		{ "lua",        EFileClass::Critical, false },
+		{ "ent",        EFileClass::Critical, false },
+		{ "dds",        EFileClass::Cosmetic, false },
+		{ "tif",        EFileClass::Cosmetic, false },
+		{ "cfx",        EFileClass::Cosmetic, false },
+		{ "cfi",        EFileClass::Cosmetic, false },
+		{ "pfx",        EFileClass::Cosmetic, false },
+		{ "pfx2",       EFileClass::Cosmetic, false },
+		{ "ogg",        EFileClass::Cosmetic, false },
+		{ "wav",        EFileClass::Cosmetic, false },
+		{ "wem",        EFileClass::Cosmetic, false },
+		{ "bnk",        EFileClass::Cosmetic, false },
+		{ "dat",        EFileClass::Cosmetic, false },
+	};
+
+	size_t dot = length;
+	while (dot > 0 && szPath[dot - 1] != '.' && szPath[dot - 1] != '/' && szPath[dot - 1] != '\\')
+	{
+		--dot;
+	}
+	if (dot == 0 || szPath[dot - 1] != '.')
+		return EFileClass::Ignored;
+
+	const size_t extensionLength = length - dot;
+	for (const SExtension& extension : extensions)
+	{
+		if (strlen(extension.szExtension) == extensionLength && strnicmp(szPath + dot, extension.szExtension, extensionLength) == 0)
+		{
+			bScan = extension.bScan;
+			return extension.fileClass;
+		}
+	}
+	return EFileClass::Ignored;
+}
+
+XmlNodeRef CLevelLoader::LoadFileList() const
+{
+	string path;
+	path.Format("Levels/%s/filelist.xml", m_level.c_str());
+	XmlNodeRef root = gEnv->pSystem->LoadXmlFromFile(path.c_str());
+	return root ? root->findChild("files") : XmlNodeRef();
+}
+
+void CLevelLoader::StartVerification(const XmlNodeRef& files)
+{
+	StopVerification();
+	if (g_levelVerifyFiles == 0 || !files)
+		return;
+
+	char szRealPath[ICryPak::g_nMaxPath];
+	m_verificationCachePath = gEnv->pCryPak->AdjustFileName(s_verifyCachePath, szRealPath, ICryPak::FLAGS_FOR_WRITING);
+
+	m_pVerifier.reset(new CFileVerifier());
+	m_pVerifier->LoadCache(m_verificationCachePath.c_str());
+
+	string path;
+	for (int i = 0; i < files->getChildCount(); ++i)
+	{
+		const XmlNodeRef file = files->getChild(i);
+		path.Format("Levels/%s/%s", m_level.c_str(), file->getAttr("src"));
+		m_pVerifier->Add(path.c_str(), gEnv->pCryPak->AdjustFileName(path.c_str(), szRealPath, 0), file->getAttr("md5"));
+	}
+
+	// Only a check the map waits for takes every core, otherwise a single thread leaves the disk to the prefetch and the map load
+	m_bVerificationGates = g_levelVerifyFiles >= 2;
+	m_verification = EVerification::Running;
+	m_verificationStartTime = GetMicroseconds();
+	m_bVerificationDone = false;
+
+	CFileVerifier* const pVerifier = m_pVerifier.get();
+	const uint32 threadCount = m_bVerificationGates ? 0 : 1;
+	const std::string cachePath = m_verificationCachePath.c_str();
+	m_verificationThread = std::thread([this, pVerifier, threadCount, cachePath]()
+	{
+		pVerifier->Verify(threadCount);
+		if (!pVerifier->IsCancelled() && pVerifier->IsCacheDirty() && !pVerifier->SaveCache(cachePath))
+		{
+			CryLog("[LevelLoader] Could not write %s, the level's files are hashed again next time", cachePath.c_str());
+		}
+		m_bVerificationDone = true;
+	});
+}
+
+void CLevelLoader::UpdateVerification()
+{
+	if (m_verification != EVerification::Running || !m_bVerificationDone)
+		return;
+
+	m_verificationThread.join();
+
+	const CFileVerifier::SStatistics& statistics = m_pVerifier->GetStatistics();
+	for (const CFileVerifier::SFile& file : m_pVerifier->GetFiles())
+	{
+		if (file.result != CFileVerifier::EResult::Verified && file.result != CFileVerifier::EResult::Recorded)
+		{
+			CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LevelLoader] %s %s", file.key.c_str(), CFileVerifier::GetResultName(file.result));
+		}
+	}
+	CryLog("[LevelLoader] Checked %u files of %s in %.1fms, %u hashed (%" PRIu64 " bytes), %u unchanged, %u failed", statistics.files, m_level.c_str(),
+		static_cast<float>(GetMicroseconds() - m_verificationStartTime) * 1e-3f, statistics.hashed, statistics.bytesHashed, statistics.fromCache, statistics.failed);
+
+	m_verification = statistics.failed == 0 ? EVerification::Passed : EVerification::Failed;
+	m_pVerifier.reset();
+}
+
+void CLevelLoader::StopVerification()
+{
+	if (m_verificationThread.joinable())
+	{
+		// Returns within a chunk of the file being hashed
+		m_pVerifier->Cancel();
+		m_verificationThread.join();
+	}
+	m_pVerifier.reset();
+	m_verification = EVerification::None;
+	m_bVerificationGates = false;
+}
+
+void CLevelLoader::ReadFileList(const XmlNodeRef& files)
+{
+	if (!files)
+	{
+		CryLog("[LevelLoader] No Levels/%s/filelist.xml, only the level's layers and resource list are prefetched", m_level.c_str());
+		return;
+	}
+
+	string path;
+	CryAutoCriticalSection lock(m_lock);
+	for (int i = 0; i < files->getChildCount(); ++i)
+	{
+		path.Format("Levels/%s/%s", m_level.c_str(), files->getChild(i)->getAttr("src"));
+		AddFile(path.c_str(), path.length());
+	}
+}
+
+void CLevelLoader::ReadLayers()
+{
+	// Only a project has them loose, a package has them exported into level.pak
+	string directory;
+	directory.Format("Levels/%s/Layers/", m_level.c_str());
+
+	_finddata_t findData;
+	const intptr_t handle = gEnv->pCryPak->FindFirst((directory + "*.lyr").c_str(), &findData);
+	if (handle == -1)
+		return;
+
+	do
+	{
+		if ((findData.attrib & _A_SUBDIR) == 0)
+		{
+			XmlNodeRef layer = gEnv->pSystem->LoadXmlFromFile((directory + findData.name).c_str());
+			if (layer)
+			{
+				CryAutoCriticalSection lock(m_lock);
+				AddReferences(layer);
+			}
+		}
+	}
+	while (gEnv->pCryPak->FindNext(handle, &findData) >= 0);
+	gEnv->pCryPak->FindClose(handle);
+}
+
+void CLevelLoader::ReadLevelResourceList()
+{
+	// The engine only opens level.pak as part of the map load, so it is read directly
+	string pakPath;
+	pakPath.Format("Levels/%s/level.pak", m_level.c_str());
+	char szRealPath[ICryPak::g_nMaxPath];
+	CMemoryMappedFile file;
+	CPakArchive archive;
+	if (!file.Open(gEnv->pCryPak->AdjustFileName(pakPath.c_str(), szRealPath, 0)) || !archive.Open(file.GetData(), file.GetSize()))
+		return;
+
+	const uint32 index = archive.Find("resourcelist.txt");
+	if (index == CPakArchive::NotFound)
+		return;
+
+	CPakDecompressor decompressor(1);
+	decompressor.Queue(archive, index, 0);
+	decompressor.DeliverAll([this](const CPakDecompressor::SResult& result)
+	{
+		if (result.bValid)
+		{
+			CryAutoCriticalSection lock(m_lock);
+			AddResourceList(reinterpret_cast<const char*>(result.pData), result.size);
+		}
+	});
+}
+
+void CLevelLoader::AddReferences(const XmlNodeRef& node)
+{
+	for (int i = 0; i < node->getNumAttributes(); ++i)
+	{
+		const char* szKey = nullptr;
+		const char* szValue = nullptr;
+		if (!node->getAttributeByIndex(i, &szKey, &szValue) || strpbrk(szValue, "/\\") == nullptr)
+			continue;
+
+		// Materials are referenced without their extension
+		bool bScan = false;
+		const size_t length = strlen(szValue);
+		if (stricmp(szKey, "Material") == 0 && Classify(szValue, length, bScan) == EFileClass::Ignored)
+		{
+			const string material = string(szValue) + ".mtl";
+			AddFile(material.c_str(), material.length());
+		}
+		else
+		{
+			AddFile(szValue, length);
+		}
+	}
+
+	for (int i = 0; i < node->getChildCount(); ++i)
+	{
+		AddReferences(node->getChild(i));
+	}
+}
+
+void CLevelLoader::AddReferences(const char* szText, size_t length)
+{
+	// Every quoted value that is a path, attributes of XML files are what this is for
+	const char* const szEnd = szText + length;
+	const char* szQuote = std::find(szText, szEnd, '"');
+	while (szQuote != szEnd)
+	{
+		const char* const szValue = szQuote + 1;
+		const char* const szClose = std::find(szValue, szEnd, '"');
+		if (szClose == szEnd)
+			break;
+
+		if (std::find(szValue, szClose, '/') != szClose || std::find(szValue, szClose, '\\') != szClose)
+		{
+			AddFile(szValue, szClose - szValue);
+		}
+		szQuote = std::find(szClose + 1, szEnd, '"');
+	}
+}
+
+void CLevelLoader::AddResourceList(const char* szText, size_t length)
+{
+	const char* const szEnd = szText + length;
+	for (const char* szLine = szText; szLine < szEnd;)
+	{
+		const char* szLineEnd = std::find(szLine, szEnd, '\n');
+		const char* szValueEnd = szLineEnd;
+		while (szValueEnd > szLine && (szValueEnd[-1] == '\r' || szValueEnd[-1] == ' '))
+		{
+			--szValueEnd;
+		}
+		AddFile(szLine, szValueEnd - szLine);
+		szLine = szLineEnd + (szLineEnd != szEnd ? 1 : 0);
+	}
+}
+
+void CLevelLoader::AddFile(const char* szPath, size_t length)
+{
+	bool bScan = false;
+	const EFileClass fileClass = length > 0 && length < ICryPak::g_nMaxPath ? Classify(szPath, length, bScan) : EFileClass::Ignored;
+	if (fileClass == EFileClass::Ignored || (fileClass == EFileClass::Cosmetic && gEnv->IsDedicated()))
+		return;
+
+	string path(szPath, length);
+	path.MakeLower();
+	path.replace('\\', '/');
+
+	// The level's own files are read with level.pak, the editor's are only there in the editor.
+	// Absolute paths are source files the assets were exported from, as some carry in their metadata.
+	if (strncmp(path.c_str(), "%level%", 7) == 0 || (strncmp(path.c_str(), "%editor%", 8) == 0 && !gEnv->IsEditor()) || path[0] == '/' || path.find(':') != string::npos)
+		return;
+
+	if (!m_knownPaths.insert(path).second)
+		return;
+
+	SFile file;
+	file.path = path;
+	file.fileClass = fileClass;
+	file.bScan = bScan;
+	m_files.push_back(file);
+
+	const uint32 index = static_cast<uint32>(m_files.size() - 1);
+	if (fileClass == EFileClass::Critical)
+	{
+		m_criticalQueue.push_back(index);
+		++m_criticalCount;
+	}
+	else
+	{
+		m_cosmeticQueue.push_back(index);
+		++m_cosmeticCount;
+	}
+}
+
+void CLevelLoader::IssueReads()
+{
+	for (;;)
+	{
+		uint32 index;
+		uint32 generation;
+		string path;
+		bool bCritical;
+		{
+			CryAutoCriticalSection lock(m_lock);
+			std::deque<uint32>& queue = !m_criticalQueue.empty() ? m_criticalQueue : m_cosmeticQueue;
+			if (queue.empty() || m_inFlight >= static_cast<uint32>(std::max(g_levelPrefetchReads, 1)))
+				return;
+
+			index = queue.front();
+			queue.pop_front();
+			++m_inFlight;
+			generation = m_generation;
+			path = m_files[index].path;
+			bCritical = m_files[index].fileClass == EFileClass::Critical;
+		}
+
+		// Only the async callback, the buffer is freed right after it and the main thread never waits for a read
+		StreamReadParams params;
+		params.dwUserData = (static_cast<DWORD_PTR>(generation) << 32) | index;
+		params.ePriority = bCritical ? estpNormal : estpIdle;
+		params.nFlags = IStreamEngine::FLAGS_NO_SYNC_CALLBACK;
+		IReadStreamPtr pStream = gEnv->pSystem->GetStreamEngine()->StartRead(eStreamTaskTypeReadAhead, path.c_str(), this, &params);
+
+		CryAutoCriticalSection lock(m_lock);
+		if (generation != m_generation || m_files[index].bDone)
+			continue;
+
+		if (pStream)
+		{
+			m_files[index].pStream = pStream;
+		}
+		else
+		{
+			m_files[index].bDone = true;
+			--m_inFlight;
+			++m_failed;
+			++(bCritical ? m_criticalRead : m_cosmeticRead);
+		}
+	}
+}
+
+void CLevelLoader::Abort()
+{
+	std::vector<IReadStreamPtr> streams;
+	{
+		CryAutoCriticalSection lock(m_lock);
+		++m_generation;
+		for (SFile& file : m_files)
+		{
+			if (file.pStream && !file.bDone)
+			{
+				streams.push_back(file.pStream);
+			}
+		}
+
+		m_files.clear();
+		m_knownPaths.clear();
+		m_doneFiles.clear();
+		m_criticalQueue.clear();
+		m_cosmeticQueue.clear();
+		m_inFlight = 0;
+		m_criticalCount = m_criticalRead = 0;
+		m_cosmeticCount = m_cosmeticRead = 0;
+		m_bytesRead = 0;
+		m_failed = 0;
+		m_reportedDone = ~0u;
+	}
+
+	// Outside the lock, aborting completes the read with an error
+	for (IReadStreamPtr& pStream : streams)
+	{
+		pStream->Abort();
+	}
+	StopVerification();
+	m_stage = ELevelLoadStage::Idle;
+}
+
+void CLevelLoader::LoadMap()
+{
+	m_loadTime = GetMicroseconds();
+	SetStage(ELevelLoadStage::Loading);
+
+	string command;
+	command.Format("map %s s", m_level.c_str());
+	gEnv->pConsole->ExecuteString(command.c_str(), false, true);
+}
+
+void CLevelLoader::SetStage(ELevelLoadStage stage)
+{
+	m_stage = stage;
+
+	const SLevelLoadProgress progress = GetProgress();
+	m_reportedDone = progress.criticalRead + progress.cosmeticRead;
+	for (ILevelLoadListener* pListener : m_listeners)
+	{
+		pListener->OnLevelLoadProgress(progress);
+	}
+}
+
+SLevelLoadProgress CLevelLoader::GetProgress()
+{
+	CryAutoCriticalSection lock(m_lock);
+
+	SLevelLoadProgress progress;
+	progress.stage = m_stage;
+	progress.criticalRead = m_criticalRead;
+	progress.criticalCount = m_criticalCount;
+	progress.cosmeticRead = m_cosmeticRead;
+	progress.cosmeticCount = m_cosmeticCount;
+	progress.bytesRead = m_bytesRead;
+	progress.fSeconds = m_stage != ELevelLoadStage::Idle ? GetSeconds(m_startTime) : 0.f;
+	return progress;
+}
+
+float CLevelLoader::GetSeconds(int64 since) const
+{
+	return static_cast<float>(GetMicroseconds() - since) * 1e-6f;
+}
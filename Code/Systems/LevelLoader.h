@@ -0,0 +1,186 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <CrySystem/IStreamEngine.h>
+
+enum class ELevelLoadStage : uint8
+{
+	Idle,
+	Verifying,   // Only with g_levelLoadAsync 0 and g_levelVerifyFiles 2, the map waits for the check of the level's files
+	Prefetching, // Reading the files the server needs ahead of the engine, the map isn't loading yet
+	Loading,     // The engine is loading the map, cosmetic files are still read in the background
+	Playable,    // The loaded level ran its first tick, clients can connect
+	Complete     // Every prefetched file has been read too
+};
+
+struct SLevelLoadProgress
+{
+	ELevelLoadStage stage;
+	uint32          criticalRead;
+	uint32          criticalCount;
+	uint32          cosmeticRead;
+	uint32          cosmeticCount;
+	uint64          bytesRead;
+	float           fSeconds; // Since the load started
+};
+
+// Told how a load started by CLevelLoader advances, always on the main thread
+struct ILevelLoadListener
+{
+	virtual ~ILevelLoadListener() {}
+	virtual void OnLevelLoadProgress(const SLevelLoadProgress& progress) = 0;
+};
+
+class CFileVerifier;
+
+////////////////////////////////////////////////////////
+// Loads a level in client server mode without making the
+// process wait on all of its assets first.
+// The level's filelist.xml, its layers (when they are
+// loose, as in the project) and the resource list the
+// editor exported into its level.pak name every file the
+// level uses. Text files among them are scanned for more
+// references once read. All of them are read through the
+// stream engine, several at a time:
+//  - critical files, the ones the server simulates with
+//    (geometry, materials, characters, animation, data),
+//    are read first, and the map command only runs once
+//    they are read, so the engine's serial load finds
+//    them in the file cache
+//  - cosmetic files (textures, shaders, sounds, effects)
+//    are read at idle priority while the map loads and
+//    after, nothing waits for them. A dedicated server
+//    skips them.
+//  - paks listed among them are skipped, CryPak reads
+//    the entries it needs out of them
+// Listeners get the progress every frame it changes. The
+// time to the first playable tick is logged for every
+// load, and g_levelLoadAsync 0 loads the map right away
+// as before so both can be compared.
+// Either way the files filelist.xml lists are checked
+// against its md5s (see CFileVerifier) on a thread of its
+// own while the load goes on, files that didn't change
+// since the last check aren't read again. Mismatches are
+// logged once it is done, only g_levelVerifyFiles 2 holds
+// the map command back until then.
+////////////////////////////////////////////////////////
+
+class CLevelLoader final : public IStreamCallback
+{
+public:
+	virtual ~CLevelLoader() override;
+
+	void RegisterConsoleCommands();
+	void UnregisterConsoleCommands();
+
+	void AddListener(ILevelLoadListener* pListener)    { stl::push_back_unique(m_listeners, pListener); }
+	void RemoveListener(ILevelLoadListener* pListener) { stl::find_and_erase(m_listeners, pListener); }
+
+	// The map command itself runs from a later Update
+	void Start(const char* szLevel);
+	// Every frame, on the main thread
+	void Update();
+	// ESYSTEM_EVENT_LEVEL_LOAD_END and ESYSTEM_EVENT_LEVEL_UNLOAD
+	void OnLevelLoadEnd();
+	void OnLevelUnload();
+
+	ELevelLoadStage GetStage() const { return m_stage; }
+	void LogStatus();
+
+	// IStreamCallback
+	virtual void StreamAsyncOnComplete(IReadStream* pStream, unsigned nError) override;
+	virtual void StreamOnComplete(IReadStream* pStream, unsigned nError) override {}
+	// ~IStreamCallback
+
+private:
+	enum class EFileClass : uint8
+	{
+		Ignored,
+		Critical,
+		Cosmetic
+	};
+
+	struct SFile
+	{
+		string         path;
+		EFileClass     fileClass;
+		bool           bScan;         // Text that references more files
+		bool           bDone = false;
+		IReadStreamPtr pStream;       // Until the main thread sees it done
+	};
+
+	static EFileClass Classify(const char* szPath, size_t length, bool& bScan);
+
+	// The files node of the level's filelist.xml
+	XmlNodeRef LoadFileList() const;
+	// Starts checking the files against their md5s, see g_levelVerifyFiles
+	void StartVerification(const XmlNodeRef& files);
+	// Logs the result once the check is done
+	void UpdateVerification();
+	void StopVerification();
+	void ReadFileList(const XmlNodeRef& files);
+	void ReadLayers();
+	void ReadLevelResourceList();
+	// Called with m_lock held
+	void AddReferences(const XmlNodeRef& node);
+	void AddReferences(const char* szText, size_t length);
+	void AddResourceList(const char* szText, size_t length);
+	void AddFile(const char* szPath, size_t length);
+
+	void IssueReads();
+	void Abort();
+
+	void LoadMap();
+	void SetStage(ELevelLoadStage stage);
+	SLevelLoadProgress GetProgress();
+	float GetSeconds(int64 since) const;
+
+private:
+	string                           m_level;
+	ELevelLoadStage                  m_stage = ELevelLoadStage::Idle;
+	std::vector<ILevelLoadListener*> m_listeners;
+
+	int64                            m_startTime = 0;  // Microseconds, async time
+	int64                            m_loadTime = 0;   // When the map command was issued
+	bool                             m_bLevelLoaded = false;
+
+	enum class EVerification : uint8
+	{
+		None,
+		Running,
+		Passed,
+		Failed
+	};
+
+	// Written by the verification thread until it sets m_bVerificationDone
+	std::unique_ptr<CFileVerifier>   m_pVerifier;
+	std::thread                      m_verificationThread;
+	std::atomic<bool>                m_bVerificationDone { false };
+	EVerification                    m_verification = EVerification::None;
+	bool                             m_bVerificationGates = false; // g_levelVerifyFiles 2 when the load started
+	int64                            m_verificationStartTime = 0;
+	string                           m_verificationCachePath;
+
+	CryCriticalSection               m_lock;           // Everything below, reads complete on stream engine threads
+	uint32                           m_generation = 0; // Of the load, reads of an aborted one are ignored
+	std::deque<SFile>                m_files;          // Never shrinks while loading, indices are the reads' user data
+	std::set<string>                 m_knownPaths;     // Lower case, forward slashes
+	std::vector<uint32>              m_doneFiles;      // Read since the last Update
+	std::deque<uint32>               m_criticalQueue;
+	std::deque<uint32>               m_cosmeticQueue;
+	uint32                           m_inFlight = 0;
+	uint32                           m_criticalCount = 0;
+	uint32                           m_criticalRead = 0;
+	uint32                           m_cosmeticCount = 0;
+	uint32                           m_cosmeticRead = 0;
+	uint64                           m_bytesRead = 0;
+	uint32                           m_failed = 0;
+	uint32                           m_reportedDone = ~0u; // Critical and cosmetic reads last given to the listeners
+};
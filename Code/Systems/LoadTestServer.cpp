@@ -0,0 +1,404 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "LoadTestServer.h"
+
+#include "GamePlugin.h"
+#include "Components/Player.h"
+#include "Components/BotController.h"
+
+#include <CryEntitySystem/IEntitySystem.h>
+
+static_assert(LoadTestProtocol::MaxSnapshotEntries >= SPlayerSnapshotParams::MaxEntries && LoadTestProtocol::MaxSnapshotBytes >= SPlayerSnapshotParams::MaxBytes, "Load test packets must fit a whole snapshot");
+
+namespace
+{
+	int   g_loadTestPort = 0;
+	int   g_loadTestMaxClients = 512;
+	float g_loadTestTimeout = 5.f;
+	float g_loadTestSpacing = 2.f;
+
+	void LoadTestStatusCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetLoadTestServer()->LogStatus();
+	}
+
+	uint64 GetAddressKey(const CRYSOCKADDR_IN& address)
+	{
+		return (static_cast<uint64>(address.sin_addr.s_addr) << 16) | address.sin_port;
+	}
+}
+
+CLoadTestServer::CLoadTestServer(CPlayerSystem& playerSystem)
+	: m_playerSystem(playerSystem)
+{
+	m_playerSystem.AddTickListener(this);
+	m_packet.resize(LoadTestProtocol::MaxPacketSize);
+}
+
+CLoadTestServer::~CLoadTestServer()
+{
+	m_playerSystem.RemoveTickListener(this);
+	CloseSocket();
+}
+
+void CLoadTestServer::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_loadTestPort", &g_loadTestPort, 0, VF_NULL, "UDP port on 127.0.0.1 the LoopbackLoad tool connects to, 0 = off");
+	REGISTER_CVAR2("g_loadTestMaxClients", &g_loadTestMaxClients, 512, VF_NULL, "Maximum number of load test clients");
+	REGISTER_CVAR2("g_loadTestTimeout", &g_loadTestTimeout, 5.f, VF_NULL, "Seconds without input after which a load test client and its player are removed");
+	REGISTER_CVAR2("g_loadTestSpacing", &g_loadTestSpacing, 2.f, VF_NULL, "Distance (m) between the players of load test clients");
+	REGISTER_COMMAND("g_loadTestStatus", LoadTestStatusCommand, VF_NULL, "Prints the connected load test clients and the bytes sent to them");
+}
+
+void CLoadTestServer::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_loadTestPort", true);
+		gEnv->pConsole->UnregisterVariable("g_loadTestMaxClients", true);
+		gEnv->pConsole->UnregisterVariable("g_loadTestTimeout", true);
+		gEnv->pConsole->UnregisterVariable("g_loadTestSpacing", true);
+		gEnv->pConsole->RemoveCommand("g_loadTestStatus");
+	}
+}
+
+void CLoadTestServer::OpenSocket(int port)
+{
+	m_port = port;
+
+	m_socket = CrySock::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (m_socket == CRY_INVALID_SOCKET)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LoadTest] Can't create a UDP socket");
+		return;
+	}
+
+	// Loopback only, the protocol has no authentication
+	CRYSOCKADDR_IN address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (CrySock::bind(m_socket, reinterpret_cast<const CRYSOCKADDR*>(&address), sizeof(address)) == CRY_SOCKET_ERROR || !CrySock::MakeSocketNonBlocking(m_socket))
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LoadTest] Can't listen on 127.0.0.1:%d", port);
+		CloseSocket();
+		return;
+	}
+
+	// Hundreds of clients send their input within the same few milliseconds and get their snapshots in one burst
+	const int bufferSize = 8 << 20;
+	CrySock::setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+	CrySock::setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+
+	CryLogAlways("[LoadTest] Listening on 127.0.0.1:%d", port);
+}
+
+void CLoadTestServer::CloseSocket()
+{
+	if (m_socket != CRY_INVALID_SOCKET)
+	{
+		CrySock::closesocket(m_socket);
+		m_socket = CRY_INVALID_SOCKET;
+	}
+}
+
+void CLoadTestServer::Clear()
+{
+	while (!m_clients.empty())
+	{
+		RemoveClient(static_cast<uint32>(m_clients.size() - 1));
+	}
+}
+
+void CLoadTestServer::Update(float fFrametime)
+{
+	if (g_loadTestPort != m_port)
+	{
+		Clear();
+		CloseSocket();
+		m_port = 0;
+
+		if (g_loadTestPort > 0 && gEnv->bServer)
+		{
+			OpenSocket(g_loadTestPort);
+		}
+	}
+
+	if (m_socket == CRY_INVALID_SOCKET)
+		return;
+
+	for (SClient& client : m_clients)
+	{
+		client.fSilentTime += fFrametime;
+	}
+
+	ReceivePackets();
+
+	for (uint32 i = 0; i < m_clients.size();)
+	{
+		if (m_clients[i].fSilentTime > g_loadTestTimeout)
+		{
+			RemoveClient(i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void CLoadTestServer::ReceivePackets()
+{
+	LoadTestProtocol::SInputPacket packet;
+	for (;;)
+	{
+		CRYSOCKADDR_IN from;
+		CRYSOCKLEN_T fromLength = sizeof(from);
+		const int size = CrySock::recvfrom(m_socket, reinterpret_cast<char*>(&packet), sizeof(packet), 0, reinterpret_cast<CRYSOCKADDR*>(&from), &fromLength);
+		if (size <= 0)
+			break;
+
+		if (static_cast<uint32>(size) < offsetof(LoadTestProtocol::SInputPacket, actions) || packet.magic != LoadTestProtocol::Magic)
+		{
+			++m_rejectedPackets;
+			continue;
+		}
+
+		const uint64 address = GetAddressKey(from);
+		const auto it = m_clientByAddress.find(address);
+
+		switch (packet.type)
+		{
+		case LoadTestProtocol::ePacket_Hello:
+			if (it == m_clientByAddress.end())
+			{
+				OnHello(address, from);
+			}
+			else
+			{
+				// The welcome got lost
+				SendWelcome(m_clients[it->second]);
+			}
+			break;
+
+		case LoadTestProtocol::ePacket_Input:
+			if (it != m_clientByAddress.end() && static_cast<uint32>(size) >= offsetof(LoadTestProtocol::SInputPacket, actions) + packet.actionCount * sizeof(LoadTestProtocol::SAction))
+			{
+				OnInput(m_clients[it->second], packet);
+			}
+			else
+			{
+				++m_rejectedPackets;
+			}
+			break;
+
+		case LoadTestProtocol::ePacket_Bye:
+			if (it != m_clientByAddress.end())
+			{
+				RemoveClient(it->second);
+			}
+			break;
+
+		default:
+			++m_rejectedPackets;
+			break;
+		}
+	}
+}
+
+void CLoadTestServer::OnHello(uint64 address, const CRYSOCKADDR_IN& from)
+{
+	if (!gEnv->pGameFramework->IsGameStarted() || m_clients.size() >= static_cast<size_t>(std::max(g_loadTestMaxClients, 0)))
+	{
+		++m_rejectedPackets;
+		return;
+	}
+
+	// Square grid around the origin, filled in the order clients arrive
+	const uint32 index = static_cast<uint32>(m_clients.size());
+	const uint32 columns = static_cast<uint32>(ceilf(sqrtf(static_cast<float>(std::max(g_loadTestMaxClients, 1)))));
+
+	string name;
+	name.Format("LoadTest%u", index);
+
+	SEntitySpawnParams spawnParams;
+	spawnParams.pClass = gEnv->pEntitySystem->GetClassRegistry()->GetDefaultClass();
+	spawnParams.qRotation = IDENTITY;
+	spawnParams.sName = name.c_str();
+	spawnParams.vPosition = Vec3(static_cast<float>(index % columns), static_cast<float>(index / columns), 0.f) * g_loadTestSpacing + Vec3(0.f, 0.f, 0.5f);
+
+	IEntity* pEntity = gEnv->pEntitySystem->SpawnEntity(spawnParams);
+	if (pEntity == nullptr)
+		return;
+
+	// The controller is never started, it only keeps the player off the local keyboard. Input comes from the client.
+	pEntity->GetOrCreateComponent<CBotControllerComponent>();
+	CPlayerComponent* pPlayer = pEntity->GetOrCreateComponent<CPlayerComponent>();
+
+	SClient client;
+	client.address = address;
+	client.sockAddr = from;
+	client.entityId = pEntity->GetId();
+	client.playerHandle = pPlayer->GetPlayerHandle();
+	m_clients.push_back(client);
+
+	m_clientByAddress[address] = index;
+	m_clientByPlayer[client.playerHandle] = index;
+	m_playerSystem.SetSnapshotSink(client.playerHandle, this);
+
+	SendWelcome(m_clients.back());
+}
+
+void CLoadTestServer::OnInput(SClient& client, const LoadTestProtocol::SInputPacket& packet)
+{
+	client.fSilentTime = 0.f;
+
+	// Reordered or duplicated input is dropped, like commands the server already simulated
+	if (client.lastInputSequence != 0 && static_cast<int32>(packet.sequence - client.lastInputSequence) <= 0)
+		return;
+
+	client.lastInputSequence = packet.sequence;
+	client.echoedClientTime = packet.clientTime;
+	client.inputArrivalTicks = CryGetTicks();
+
+	const IEntity* pEntity = gEnv->pEntitySystem->GetEntity(client.entityId);
+	CPlayerComponent* pPlayer = pEntity != nullptr ? pEntity->GetComponent<CPlayerComponent>() : nullptr;
+	if (pPlayer == nullptr)
+		return;
+
+	const uint32 actionCount = std::min<uint32>(packet.actionCount, LoadTestProtocol::MaxActions);
+	for (uint32 i = 0; i < actionCount; ++i)
+	{
+		const LoadTestProtocol::SAction& action = packet.actions[i];
+		if (action.action < static_cast<uint8>(EPlayerAction::Count))
+		{
+			pPlayer->InjectAction(static_cast<EPlayerAction>(action.action), action.activationMode, action.value);
+		}
+	}
+
+	m_playerSystem.AcknowledgeSnapshot(client.playerHandle, packet.ackedSnapshot, packet.ackedSnapshotParts);
+}
+
+void CLoadTestServer::SendWelcome(const SClient& client)
+{
+	const CInterestManager& interest = m_playerSystem.GetInterestManager();
+
+	LoadTestProtocol::SWelcomePacket packet = {};
+	packet.magic = LoadTestProtocol::Magic;
+	packet.type = LoadTestProtocol::ePacket_Welcome;
+	packet.groupCount = static_cast<uint8>(std::min(interest.GetGroupCount(), LoadTestProtocol::MaxGroups));
+	if (interest.GetGroupCount() > LoadTestProtocol::MaxGroups)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[LoadTest] %u scheduling groups, only the first %u are reported to the clients", interest.GetGroupCount(), LoadTestProtocol::MaxGroups);
+	}
+	packet.tickRate = static_cast<uint16>(1.f / m_playerSystem.GetTickTime() + 0.5f);
+	packet.entityId = client.entityId;
+
+	for (uint8 group = 0; group < packet.groupCount; ++group)
+	{
+		cry_strcpy(packet.groupNames[group], interest.GetGroupName(group));
+	}
+
+	Send(client, &packet, sizeof(packet));
+}
+
+void CLoadTestServer::RemoveClient(uint32 index)
+{
+	const SClient client = m_clients[index];
+	m_clientByAddress.erase(client.address);
+	m_clientByPlayer.erase(client.playerHandle);
+
+	if (gEnv->pEntitySystem->GetEntity(client.entityId) != nullptr)
+	{
+		gEnv->pEntitySystem->RemoveEntity(client.entityId);
+	}
+
+	if (index + 1 != m_clients.size())
+	{
+		m_clients[index] = m_clients.back();
+		m_clientByAddress[m_clients[index].address] = index;
+		m_clientByPlayer[m_clients[index].playerHandle] = index;
+	}
+	m_clients.pop_back();
+}
+
+bool CLoadTestServer::Send(const SClient& client, const void* pData, uint32 size)
+{
+	const int sent = CrySock::sendto(m_socket, static_cast<const char*>(pData), static_cast<int>(size), 0, reinterpret_cast<const CRYSOCKADDR*>(&client.sockAddr), sizeof(client.sockAddr));
+	if (sent != static_cast<int>(size))
+	{
+		// A full socket buffer is load the server couldn't take, the client sees it as dropped
+		++m_sendFailures;
+		return false;
+	}
+
+	m_tickBytes += size;
+	return true;
+}
+
+void CLoadTestServer::SendSnapshot(TPlayerHandle viewer, const SPlayerSnapshotParams& params, const uint8* pGroups)
+{
+	const auto it = m_clientByPlayer.find(viewer);
+	if (it == m_clientByPlayer.end() || m_socket == CRY_INVALID_SOCKET)
+		return;
+
+	SClient& client = m_clients[it->second];
+
+	LoadTestProtocol::SSnapshotHeader header = {};
+	header.magic = LoadTestProtocol::Magic;
+	header.type = LoadTestProtocol::ePacket_Snapshot;
+	header.groupCount = static_cast<uint8>(std::min(m_playerSystem.GetInterestManager().GetGroupCount(), LoadTestProtocol::MaxGroups));
+	header.entryCount = params.count;
+	header.sequence = ++client.snapshotSequence;
+	header.tick = params.tick;
+	header.baselineTick = params.baselineTick;
+	header.serverHoldMicroseconds = static_cast<uint32>((CryGetTicks() - client.inputArrivalTicks) * 1000000 / CryGetTicksPerSec());
+	header.echoedClientTime = client.echoedClientTime;
+	header.lastTickBytes = m_lastTickBytes;
+	header.byteCount = params.byteCount;
+	header.part = params.part;
+
+	for (uint8 i = 0; i < params.count; ++i)
+	{
+		if (pGroups[i] < LoadTestProtocol::MaxGroups)
+		{
+			++client.groupEntriesSent[pGroups[i]];
+		}
+	}
+	std::copy(std::begin(client.groupEntriesSent), std::end(client.groupEntriesSent), header.groupEntriesSent);
+
+	uint8* pPacket = m_packet.data();
+	memcpy(pPacket, &header, sizeof(header));
+	pPacket += sizeof(header);
+	for (uint8 i = 0; i < params.count; ++i)
+	{
+		const uint32 id = params.ids[i];
+		memcpy(pPacket, &id, sizeof(id));
+		pPacket += sizeof(id);
+	}
+	memcpy(pPacket, pGroups, params.count);
+	pPacket += params.count;
+	memcpy(pPacket, params.bytes, params.byteCount);
+	pPacket += params.byteCount;
+
+	Send(client, m_packet.data(), static_cast<uint32>(pPacket - m_packet.data()));
+}
+
+void CLoadTestServer::OnPlayerTick(uint32 tick, int64 microseconds)
+{
+	m_lastTickBytes = m_tickBytes;
+	m_tickBytes = 0;
+}
+
+void CLoadTestServer::LogStatus() const
+{
+	if (m_socket == CRY_INVALID_SOCKET)
+	{
+		CryLogAlways("[LoadTest] Not listening, set g_loadTestPort");
+		return;
+	}
+
+	CryLogAlways("[LoadTest] 127.0.0.1:%d, %u clients, %u bytes sent last tick, %u sends failed, %u packets rejected",
+		m_port, static_cast<uint32>(m_clients.size()), m_lastTickBytes, m_sendFailures, m_rejectedPackets);
+}
@@ -0,0 +1,87 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <CryNetwork/CrySocks.h>
+
+#include "PlayerSystem.h"
+#include "Network/LoadTestProtocol.h"
+
+////////////////////////////////////////////////////////
+// Server end of the LoopbackLoad tool: listens on a UDP
+// port on 127.0.0.1, gives every fake client that says
+// hello a player of its own and feeds it the actions the
+// client sends. The player system writes the client's
+// snapshots exactly as for a real one (interest, shared
+// fragments, acked baselines) and this hands them back
+// over the socket, so replication can be measured with
+// hundreds of clients and no CryNetwork channels:
+//   Game_Server +g_loadTestPort 27016
+//   LoopbackLoad --port 27016 --clients 256
+////////////////////////////////////////////////////////
+
+class CLoadTestServer final : public IPlayerTickListener, public IPlayerSnapshotSink
+{
+public:
+	CLoadTestServer(CPlayerSystem& playerSystem);
+	virtual ~CLoadTestServer() override;
+
+	// IPlayerTickListener
+	virtual void OnPlayerTick(uint32 tick, int64 microseconds) override;
+	// ~IPlayerTickListener
+
+	// IPlayerSnapshotSink
+	virtual void SendSnapshot(TPlayerHandle viewer, const SPlayerSnapshotParams& params, const uint8* pGroups) override;
+	// ~IPlayerSnapshotSink
+
+	void RegisterConsoleCommands();
+	void UnregisterConsoleCommands();
+
+	// Receives what the clients sent since the last frame, call before the player system update
+	void Update(float fFrametime);
+	void Clear();
+	void LogStatus() const;
+
+private:
+	struct SClient
+	{
+		uint64         address;
+		CRYSOCKADDR_IN sockAddr;
+		EntityId       entityId;
+		TPlayerHandle  playerHandle;
+		uint32         lastInputSequence = 0;
+		uint64         echoedClientTime = 0;
+		int64          inputArrivalTicks = 0;
+		uint32         snapshotSequence = 0;
+		uint32         groupEntriesSent[LoadTestProtocol::MaxGroups] = {};
+		float          fSilentTime = 0.f;
+	};
+
+	void OpenSocket(int port);
+	void CloseSocket();
+	void ReceivePackets();
+	void OnHello(uint64 address, const CRYSOCKADDR_IN& from);
+	void OnInput(SClient& client, const LoadTestProtocol::SInputPacket& packet);
+	void SendWelcome(const SClient& client);
+	void RemoveClient(uint32 index);
+	bool Send(const SClient& client, const void* pData, uint32 size);
+
+private:
+	CPlayerSystem&                         m_playerSystem;
+	CRYSOCKET                              m_socket = CRY_INVALID_SOCKET;
+	int                                    m_port = 0;
+
+	std::vector<SClient>                   m_clients;
+	std::unordered_map<uint64, uint32>     m_clientByAddress;
+	std::unordered_map<TPlayerHandle, uint32> m_clientByPlayer;
+
+	// Reused for every packet sent
+	std::vector<uint8>                     m_packet;
+
+	uint32                                 m_tickBytes = 0;
+	uint32                                 m_lastTickBytes = 0;
+	uint32                                 m_sendFailures = 0;
+	uint32                                 m_rejectedPackets = 0;
+};
@@ -0,0 +1,88 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "MemoryMappedFile.h"
+
+#if CRY_PLATFORM_POSIX
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+bool CMemoryMappedFile::Open(const char* szPath)
+{
+	Close();
+
+#if CRY_PLATFORM_WINDOWS
+	m_file = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_pData = m_mapping != nullptr ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (m_pData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+#elif CRY_PLATFORM_POSIX
+	const int file = open(szPath, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	// The mapping keeps the file alive, the descriptor isn't needed past this
+	struct stat status;
+	void* pData = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size > 0)
+	{
+		pData = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+	}
+	close(file);
+
+	if (pData == MAP_FAILED)
+		return false;
+
+	m_pData = pData;
+	m_size = static_cast<size_t>(status.st_size);
+#else
+	return false;
+#endif
+
+	return true;
+}
+
+void CMemoryMappedFile::Close()
+{
+#if CRY_PLATFORM_WINDOWS
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#elif CRY_PLATFORM_POSIX
+	if (m_pData != nullptr)
+	{
+		munmap(const_cast<void*>(m_pData), m_size);
+	}
+#endif
+
+	m_pData = nullptr;
+	m_size = 0;
+}
@@ -0,0 +1,36 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+////////////////////////////////////////////////////////
+// Read only view of a whole file on disk, mapped instead
+// of read so baked data is used in place and its pages
+// are shared by every server process on the machine.
+// Only works on loose files, callers fall back to
+// reading through ICryPak for files inside a pak.
+////////////////////////////////////////////////////////
+
+class CMemoryMappedFile
+{
+public:
+	CMemoryMappedFile() = default;
+	~CMemoryMappedFile() { Close(); }
+
+	CMemoryMappedFile(const CMemoryMappedFile&) = delete;
+	CMemoryMappedFile& operator=(const CMemoryMappedFile&) = delete;
+
+	// szPath is a path on disk, not a game path, see ICryPak::AdjustFileName
+	bool        Open(const char* szPath);
+	void        Close();
+
+	bool        IsOpen() const  { return m_pData != nullptr; }
+	const void* GetData() const { return m_pData; }
+	size_t      GetSize() const { return m_size; }
+
+private:
+	const void* m_pData = nullptr;
+	size_t      m_size = 0;
+#if CRY_PLATFORM_WINDOWS
+	HANDLE      m_file = INVALID_HANDLE_VALUE;
+	HANDLE      m_mapping = nullptr;
+#endif
+};
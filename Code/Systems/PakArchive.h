@@ -0,0 +1,372 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+////////////////////////////////////////////////////////
+// Directory of a .pak (zip) archive that is already in
+// memory, usually a mapping of the whole file (see
+// CMemoryMappedFile), so nothing is read or copied up
+// front: opening walks the central directory once and
+// builds a minimal-ish perfect hash over the names, a
+// lookup is one hash, two table reads and one name
+// compare. Stored entries are handed out as views into
+// the archive's memory, deflated ones as their
+// compressed bytes.
+// Names match the way ICryPak does, case insensitive and
+// with either slash. Zip64 and encrypted headers are not
+// supported, Open fails on them.
+// Only uses standard types, the PakBenchmark tool
+// (Code/Tools/PakBenchmark) is built without the engine.
+////////////////////////////////////////////////////////
+
+class CPakArchive
+{
+public:
+	static constexpr uint32_t NotFound = ~0u;
+
+	enum EMethod : uint16_t
+	{
+		Stored = 0,
+		Deflated = 8,
+	};
+
+	struct SEntry
+	{
+		uint32_t nameOffset;        // Into the archive, the name as the central directory has it
+		uint16_t nameLength;
+		uint16_t method;
+		uint32_t compressedSize;
+		uint32_t size;
+		uint32_t crc;
+		uint32_t localHeaderOffset;
+	};
+
+	bool Open(const void* pData, size_t size)
+	{
+		Close();
+
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		if (pBytes == nullptr || size < EndRecordSize)
+			return false;
+
+		// The end record is last, followed by a comment of up to 64KB
+		size_t endRecord = size - EndRecordSize;
+		const size_t searchEnd = size > EndRecordSize + 0xffff ? size - EndRecordSize - 0xffff : 0;
+		while (ReadU32(pBytes + endRecord) != EndRecordSignature)
+		{
+			if (endRecord == searchEnd)
+				return false;
+			--endRecord;
+		}
+
+		const uint16_t entryCount = ReadU16(pBytes + endRecord + 10);
+		const uint32_t directorySize = ReadU32(pBytes + endRecord + 12);
+		const uint32_t directoryOffset = ReadU32(pBytes + endRecord + 16);
+		if (entryCount == 0xffff || directoryOffset == 0xffffffffu || static_cast<uint64_t>(directoryOffset) + directorySize > endRecord)
+			return false;
+
+		m_entries.reserve(entryCount);
+		size_t position = directoryOffset;
+		for (uint32_t i = 0; i < entryCount; ++i)
+		{
+			if (position + DirectoryHeaderSize > endRecord || ReadU32(pBytes + position) != DirectoryHeaderSignature)
+			{
+				Close();
+				return false;
+			}
+
+			const uint8_t* pHeader = pBytes + position;
+			SEntry entry;
+			entry.method = ReadU16(pHeader + 10);
+			entry.crc = ReadU32(pHeader + 16);
+			entry.compressedSize = ReadU32(pHeader + 20);
+			entry.size = ReadU32(pHeader + 24);
+			entry.nameLength = ReadU16(pHeader + 28);
+			entry.localHeaderOffset = ReadU32(pHeader + 42);
+			entry.nameOffset = static_cast<uint32_t>(position + DirectoryHeaderSize);
+
+			const size_t next = position + DirectoryHeaderSize + entry.nameLength + ReadU16(pHeader + 30) + ReadU16(pHeader + 32);
+			if (next > endRecord || (ReadU16(pHeader + 8) & EncryptedFlag) != 0 || entry.compressedSize == 0xffffffffu || entry.localHeaderOffset == 0xffffffffu)
+			{
+				Close();
+				return false;
+			}
+
+			// Directories take no lookups
+			if (entry.nameLength > 0 && pBytes[entry.nameOffset + entry.nameLength - 1] != '/' && pBytes[entry.nameOffset + entry.nameLength - 1] != '\\')
+			{
+				m_entries.push_back(entry);
+			}
+			position = next;
+		}
+
+		m_pData = pBytes;
+		m_size = size;
+		if (!BuildIndex())
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+		m_pData = nullptr;
+		m_size = 0;
+		m_entries.clear();
+		m_seeds.clear();
+		m_slots.clear();
+	}
+
+	bool          IsOpen() const                { return m_pData != nullptr; }
+	uint32_t      GetEntryCount() const         { return static_cast<uint32_t>(m_entries.size()); }
+	const SEntry& GetEntry(uint32_t index) const { return m_entries[index]; }
+	const char*   GetName(uint32_t index) const { return reinterpret_cast<const char*>(m_pData + m_entries[index].nameOffset); } // Not terminated, see SEntry::nameLength
+
+	uint32_t Find(const char* szPath) const
+	{
+		return Find(szPath, strlen(szPath));
+	}
+
+	uint32_t Find(const char* szPath, size_t length) const
+	{
+		if (m_slots.empty())
+			return NotFound;
+
+		const uint64_t hash = HashName(szPath, length);
+		const uint32_t seed = m_seeds[GetBucket(hash)];
+		const uint32_t index = m_slots[GetSlot(hash, seed)];
+		if (index == NotFound)
+			return NotFound;
+
+		// Names not in the archive land on some slot too
+		const SEntry& entry = m_entries[index];
+		return entry.nameLength == length && NamesEqual(GetName(index), szPath, length) ? index : NotFound;
+	}
+
+	// The entry's bytes as they are in the archive, compressedSize of them, nullptr if the local header is broken.
+	// The local header is only read here, opening never touches the pages of the entries.
+	const uint8_t* GetData(uint32_t index) const
+	{
+		const SEntry& entry = m_entries[index];
+		if (static_cast<uint64_t>(entry.localHeaderOffset) + LocalHeaderSize > m_size || ReadU32(m_pData + entry.localHeaderOffset) != LocalHeaderSignature)
+			return nullptr;
+
+		const uint8_t* pHeader = m_pData + entry.localHeaderOffset;
+		const uint64_t dataOffset = static_cast<uint64_t>(entry.localHeaderOffset) + LocalHeaderSize + ReadU16(pHeader + 26) + ReadU16(pHeader + 28);
+		return dataOffset + entry.compressedSize <= m_size ? m_pData + dataOffset : nullptr;
+	}
+
+	// Zero copy view of a stored entry, nullptr for compressed ones
+	const uint8_t* GetStoredView(uint32_t index, size_t& size) const
+	{
+		const SEntry& entry = m_entries[index];
+		if (entry.method != Stored || entry.compressedSize != entry.size)
+			return nullptr;
+
+		size = entry.size;
+		return GetData(index);
+	}
+
+private:
+	static constexpr uint32_t EndRecordSignature = 0x06054b50;
+	static constexpr uint32_t DirectoryHeaderSignature = 0x02014b50;
+	static constexpr uint32_t LocalHeaderSignature = 0x04034b50;
+	static constexpr size_t   EndRecordSize = 22;
+	static constexpr size_t   DirectoryHeaderSize = 46;
+	static constexpr size_t   LocalHeaderSize = 30;
+	static constexpr uint16_t EncryptedFlag = 1;
+
+	// Keys per bucket on average, fewer buckets need more seed tries to build
+	static constexpr uint32_t KeysPerBucket = 4;
+	static constexpr uint32_t MaxSeed = 1u << 20;
+
+	static uint16_t ReadU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+	static uint32_t ReadU32(const uint8_t* p) { return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+	// Up to 8 bytes of a name, the bytes past its end are zero
+	static uint64_t LoadWord(const char* p, size_t remaining)
+	{
+		uint64_t word = 0;
+		if (remaining >= sizeof(word))
+		{
+			memcpy(&word, p, sizeof(word));
+			return word;
+		}
+
+		for (size_t i = 0; i < remaining; ++i)
+		{
+			word |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+		}
+		return word;
+	}
+
+	// Lower case and forward slashes in 8 bytes at once, bytes of 0x80 and above are left alone
+	static uint64_t NormalizeWord(uint64_t word)
+	{
+		const uint64_t ones = 0x0101010101010101ull;
+		const uint64_t low = 0x7f7f7f7f7f7f7f7full;
+		const uint64_t high = 0x8080808080808080ull;
+
+		// The high bit of a byte is set by the first sum when it is >= 'A' and by the second when it is > 'Z'
+		const uint64_t ascii = word & low;
+		const uint64_t upper = (ascii + (0x80 - 'A') * ones) & ~(ascii + (0x80 - 'Z' - 1) * ones) & ~word & high;
+		word |= upper >> 2;
+
+		const uint64_t backslash = word ^ ('\\' * ones);
+		const uint64_t isBackslash = ~(((backslash & low) + low) | backslash | low);
+		return word ^ ((isBackslash >> 7) * ('\\' ^ '/'));
+	}
+
+	static bool NamesEqual(const char* a, const char* b, size_t length)
+	{
+		for (size_t i = 0; i < length; i += sizeof(uint64_t))
+		{
+			if (NormalizeWord(LoadWord(a + i, length - i)) != NormalizeWord(LoadWord(b + i, length - i)))
+				return false;
+		}
+		return true;
+	}
+
+	// Of the normalized name, a word at a time. The seeds only remix it, so a key is hashed once per lookup and per build.
+	static uint64_t HashName(const char* szName, size_t length)
+	{
+		uint64_t hash = length * 0x9e3779b97f4a7c15ull;
+		for (size_t i = 0; i < length; i += sizeof(uint64_t))
+		{
+			hash = (hash ^ NormalizeWord(LoadWord(szName + i, length - i))) * 0xff51afd7ed558ccdull;
+			hash ^= hash >> 29;
+		}
+		return Mix(hash);
+	}
+
+	static uint64_t Mix(uint64_t value)
+	{
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		value *= 0xc4ceb9fe1a85ec53ull;
+		return value ^ (value >> 33);
+	}
+
+	// Multiply and shift instead of a modulo, which is a 64 bit division
+	uint32_t GetBucket(uint64_t hash) const              { return static_cast<uint32_t>(((hash >> 32) * m_seeds.size()) >> 32); }
+	uint32_t GetSlot(uint64_t hash, uint32_t seed) const { return static_cast<uint32_t>(((Mix(hash + seed * 0x9e3779b97f4a7c15ull) & 0xffffffffu) * m_slots.size()) >> 32); }
+
+	// Hash and displace: the biggest buckets pick first, each the first seed that puts all its keys in free slots
+	bool BuildIndex()
+	{
+		const uint32_t keyCount = static_cast<uint32_t>(m_entries.size());
+		if (keyCount == 0)
+			return true;
+
+		std::vector<uint64_t> hashes(keyCount);
+		for (uint32_t i = 0; i < keyCount; ++i)
+		{
+			hashes[i] = HashName(GetName(i), m_entries[i].nameLength);
+		}
+
+		// A name added again later replaces the earlier entry, as when a file is updated by appending to the archive
+		std::vector<uint32_t> byHash(keyCount);
+		for (uint32_t i = 0; i < keyCount; ++i)
+		{
+			byHash[i] = i;
+		}
+		std::sort(byHash.begin(), byHash.end(), [&hashes](uint32_t a, uint32_t b) { return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : a < b; });
+
+		std::vector<uint8_t> replaced(keyCount, 0);
+		for (uint32_t i = 1; i < keyCount; ++i)
+		{
+			const uint32_t previous = byHash[i - 1];
+			const uint32_t current = byHash[i];
+			if (hashes[previous] == hashes[current] && m_entries[previous].nameLength == m_entries[current].nameLength && NamesEqual(GetName(previous), GetName(current), m_entries[current].nameLength))
+			{
+				replaced[previous] = 1;
+			}
+		}
+
+		if (std::find(replaced.begin(), replaced.end(), 1) != replaced.end())
+		{
+			uint32_t kept = 0;
+			for (uint32_t i = 0; i < keyCount; ++i)
+			{
+				if (replaced[i] == 0)
+				{
+					m_entries[kept] = m_entries[i];
+					hashes[kept] = hashes[i];
+					++kept;
+				}
+			}
+			return BuildIndex(kept, hashes);
+		}
+		return BuildIndex(keyCount, hashes);
+	}
+
+	bool BuildIndex(uint32_t keyCount, const std::vector<uint64_t>& hashes)
+	{
+		m_entries.resize(keyCount);
+
+		// Slots get a little slack over the key count, which keeps the seed search short
+		m_seeds.assign(keyCount / KeysPerBucket + 1, 0);
+		m_slots.assign(keyCount + keyCount / 8 + 1, static_cast<uint32_t>(NotFound));
+
+		std::vector<std::vector<uint32_t>> buckets(m_seeds.size());
+		for (uint32_t i = 0; i < keyCount; ++i)
+		{
+			buckets[GetBucket(hashes[i])].push_back(i);
+		}
+
+		std::vector<uint32_t> order(buckets.size());
+		for (uint32_t i = 0; i < order.size(); ++i)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+		std::vector<uint32_t> slots;
+		for (const uint32_t bucket : order)
+		{
+			const std::vector<uint32_t>& keys = buckets[bucket];
+			if (keys.empty())
+				break;
+
+			uint32_t seed = 0;
+			for (; seed < MaxSeed; ++seed)
+			{
+				slots.clear();
+				for (const uint32_t key : keys)
+				{
+					const uint32_t slot = GetSlot(hashes[key], seed);
+					if (m_slots[slot] != NotFound || std::find(slots.begin(), slots.end(), slot) != slots.end())
+						break;
+					slots.push_back(slot);
+				}
+				if (slots.size() == keys.size())
+					break;
+			}
+
+			// Only when two different names have the same 64 bit hash
+			if (seed == MaxSeed)
+				return false;
+
+			m_seeds[bucket] = seed;
+			for (size_t i = 0; i < keys.size(); ++i)
+			{
+				m_slots[slots[i]] = keys[i];
+			}
+		}
+		return true;
+	}
+
+private:
+	const uint8_t*        m_pData = nullptr;
+	size_t                m_size = 0;
+	std::vector<SEntry>   m_entries;
+	std::vector<uint32_t> m_seeds; // Per bucket
+	std::vector<uint32_t> m_slots; // Entry index per slot, NotFound when empty
+};
@@ -0,0 +1,424 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include "PakArchive.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+////////////////////////////////////////////////////////
+// Inflates entries of mapped .pak archives (see
+// CPakArchive) in a pipeline instead of one after another:
+//  - a reader thread runs ahead of the inflaters and
+//    touches the compressed bytes of queued entries, so
+//    their pages are resident when they are inflated
+//  - inflater threads inflate entries into pooled buffers,
+//    up to a budget of inflated bytes not yet delivered
+//  - Deliver hands completed entries to the consumer on
+//    the calling thread in priority order, equal
+//    priorities in queue order. A buffer goes back to the
+//    pool when the consumer returns.
+// Workers pick entries in delivery order too, so the entry
+// Deliver waits for is always the first one started.
+// Stored entries skip the inflaters and are delivered as
+// views into their archive.
+// Archives must stay open and mapped until their entries
+// are delivered. Uses zlib and standard types only, the
+// PakBenchmark tool (Code/Tools/PakBenchmark) is built
+// without the engine.
+////////////////////////////////////////////////////////
+
+class CPakDecompressor
+{
+public:
+	struct SResult
+	{
+		const CPakArchive* pArchive;
+		uint32_t           entry;
+		int32_t            priority;
+		uint64_t           userData; // As passed to Queue
+		const uint8_t*     pData;    // Valid until the consumer returns
+		size_t             size;
+		bool               bValid;   // False for a broken entry or one that doesn't match its crc
+	};
+
+	struct SStatistics
+	{
+		uint64_t entries = 0;
+		uint64_t inflatedEntries = 0;
+		uint64_t compressedBytes = 0;
+		uint64_t inflatedBytes = 0;
+		uint64_t failedEntries = 0;
+		uint64_t buffersAllocated = 0;
+		uint64_t buffersReused = 0;
+	};
+
+	typedef std::function<void (const SResult&)> TConsumer;
+
+	// threadCount 0 uses one inflater per hardware thread. maxPendingBytes bounds the inflated bytes
+	// waiting for delivery, readAheadBytes the compressed bytes read ahead of the inflaters.
+	explicit CPakDecompressor(uint32_t threadCount = 0, size_t maxPendingBytes = 64u << 20, size_t readAheadBytes = 32u << 20)
+		: m_maxPendingBytes(maxPendingBytes)
+		, m_readAheadBytes(readAheadBytes)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		m_reader = std::thread([this]() { RunReader(); });
+		m_inflaters.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			m_inflaters.emplace_back([this]() { RunInflater(); });
+		}
+	}
+
+	// Entries not delivered yet are dropped
+	~CPakDecompressor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_readAvailable.notify_all();
+		m_inflateAvailable.notify_all();
+		m_reader.join();
+		for (std::thread& inflater : m_inflaters)
+		{
+			inflater.join();
+		}
+	}
+
+	CPakDecompressor(const CPakDecompressor&) = delete;
+	CPakDecompressor& operator=(const CPakDecompressor&) = delete;
+
+	// Higher priorities are delivered first
+	void Queue(const CPakArchive& archive, uint32_t entry, int32_t priority, uint64_t userData = 0)
+	{
+		const CPakArchive::SEntry& header = archive.GetEntry(entry);
+
+		SJob job;
+		job.pArchive = &archive;
+		job.entry = entry;
+		job.priority = priority;
+		job.userData = userData;
+		job.pSource = archive.GetData(entry);
+		job.compressedSize = header.compressedSize;
+		job.size = header.size;
+		job.crc = header.crc;
+
+		// Only deflated entries take a trip through the workers
+		const bool bStored = header.method == CPakArchive::Stored && header.compressedSize == header.size;
+		const bool bInflate = job.pSource != nullptr && header.method == CPakArchive::Deflated;
+		job.state = bInflate ? EState::Queued : EState::Done;
+		job.bValid = bStored && job.pSource != nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const SOrder order = { priority, m_nextSequence++ };
+			m_jobs.emplace(order, std::move(job));
+			if (bInflate)
+			{
+				m_toRead.insert(order);
+			}
+			++m_statistics.entries;
+		}
+		if (bInflate)
+		{
+			m_readAvailable.notify_one();
+			m_inflateAvailable.notify_one();
+		}
+	}
+
+	// Delivers the completed entries at the front of the order, returns how many. Never blocks on the workers.
+	size_t Deliver(const TConsumer& consumer)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return DeliverReady(consumer, lock);
+	}
+
+	// Blocks until every queued entry is delivered
+	void DeliverAll(const TConsumer& consumer)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			DeliverReady(consumer, lock);
+			if (m_jobs.empty())
+				return;
+
+			m_jobDone.wait(lock, [this]() { return m_jobs.begin()->second.state == EState::Done; });
+		}
+	}
+
+	size_t GetPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_jobs.size();
+	}
+
+	SStatistics GetStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_statistics;
+	}
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_inflaters.size()); }
+
+private:
+	enum class EState : uint8_t
+	{
+		Queued,
+		Reading,
+		Read,
+		Inflating,
+		Done,
+	};
+
+	// Delivery order, highest priority first and then first queued
+	struct SOrder
+	{
+		int32_t  priority;
+		uint64_t sequence;
+
+		bool operator<(const SOrder& other) const { return priority != other.priority ? priority > other.priority : sequence < other.sequence; }
+	};
+
+	struct SBuffer
+	{
+		std::unique_ptr<uint8_t[]> pData;
+		size_t                     capacity = 0;
+	};
+
+	struct SJob
+	{
+		const CPakArchive* pArchive = nullptr;
+		uint32_t           entry = 0;
+		int32_t            priority = 0;
+		uint64_t           userData = 0;
+		const uint8_t*     pSource = nullptr;
+		uint32_t           compressedSize = 0;
+		uint32_t           size = 0;
+		uint32_t           crc = 0;
+		EState             state = EState::Queued;
+		bool               bValid = false;
+		SBuffer            buffer;
+	};
+
+	// Pooled buffers come in power of two sizes from 4KB up, so one fits any entry of up to its capacity
+	static constexpr uint32_t MinBufferClass = 12;
+	static constexpr size_t   PageSize = 4096;
+
+	static uint32_t GetBufferClass(size_t size)
+	{
+		uint32_t bufferClass = MinBufferClass;
+		while ((static_cast<size_t>(1) << bufferClass) < size)
+		{
+			++bufferClass;
+		}
+		return bufferClass;
+	}
+
+	// Called with the lock held
+	SBuffer AcquireBuffer(size_t size)
+	{
+		const uint32_t bufferClass = GetBufferClass(size);
+		if (bufferClass < m_pool.size() && !m_pool[bufferClass].empty())
+		{
+			SBuffer buffer = std::move(m_pool[bufferClass].back());
+			m_pool[bufferClass].pop_back();
+			m_pooledBytes -= buffer.capacity;
+			++m_statistics.buffersReused;
+			return buffer;
+		}
+
+		SBuffer buffer;
+		buffer.capacity = static_cast<size_t>(1) << bufferClass;
+		buffer.pData.reset(new uint8_t[buffer.capacity]);
+		++m_statistics.buffersAllocated;
+		return buffer;
+	}
+
+	// Called with the lock held. The pool keeps no more than the pending budget, anything above it is freed.
+	void ReleaseBuffer(SBuffer&& buffer)
+	{
+		if (buffer.pData == nullptr || m_pooledBytes + buffer.capacity > m_maxPendingBytes)
+			return;
+
+		const uint32_t bufferClass = GetBufferClass(buffer.capacity);
+		if (bufferClass >= m_pool.size())
+		{
+			m_pool.resize(bufferClass + 1);
+		}
+		m_pooledBytes += buffer.capacity;
+		m_pool[bufferClass].push_back(std::move(buffer));
+	}
+
+	size_t DeliverReady(const TConsumer& consumer, std::unique_lock<std::mutex>& lock)
+	{
+		size_t delivered = 0;
+		while (!m_jobs.empty() && m_jobs.begin()->second.state == EState::Done)
+		{
+			SJob job = std::move(m_jobs.begin()->second);
+			m_jobs.erase(m_jobs.begin());
+
+			const bool bInflated = job.buffer.pData != nullptr;
+			const SResult result = { job.pArchive, job.entry, job.priority, job.userData, bInflated ? job.buffer.pData.get() : job.pSource, job.size, job.bValid };
+			m_statistics.failedEntries += job.bValid ? 0 : 1;
+
+			lock.unlock();
+			consumer(result);
+			lock.lock();
+
+			if (bInflated)
+			{
+				m_pendingBytes -= job.size;
+				ReleaseBuffer(std::move(job.buffer));
+				m_inflateAvailable.notify_all();
+			}
+			++delivered;
+		}
+		return delivered;
+	}
+
+	void RunReader()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_readAvailable.wait(lock, [this]() { return m_bStop || (!m_toRead.empty() && m_readBytes < m_readAheadBytes); });
+			if (m_bStop)
+				return;
+
+			const SOrder order = *m_toRead.begin();
+			m_toRead.erase(m_toRead.begin());
+			SJob& job = m_jobs.find(order)->second;
+			job.state = EState::Reading;
+			m_readBytes += job.compressedSize;
+
+			lock.unlock();
+			// A byte per page faults the entry in, the sum keeps the loads from being dropped
+			uint32_t sum = 0;
+			for (size_t offset = 0; offset < job.compressedSize; offset += PageSize)
+			{
+				sum += static_cast<const volatile uint8_t*>(job.pSource)[offset];
+			}
+			m_touchSum.fetch_add(sum, std::memory_order_relaxed);
+			lock.lock();
+
+			job.state = EState::Read;
+			m_toInflate.insert(order);
+			m_inflateAvailable.notify_one();
+		}
+	}
+
+	// The first entry in order that is read, or queued ones when the reader is behind, within the pending budget.
+	// The front of the delivery order is always taken, however big it is.
+	bool PickInflateJob(SOrder& order, bool& bWasRead) const
+	{
+		const bool bHasRead = !m_toInflate.empty();
+		const bool bHasQueued = !m_toRead.empty();
+		if (!bHasRead && !bHasQueued)
+			return false;
+
+		bWasRead = bHasRead && (!bHasQueued || *m_toInflate.begin() < *m_toRead.begin());
+		order = bWasRead ? *m_toInflate.begin() : *m_toRead.begin();
+
+		const SJob& job = m_jobs.find(order)->second;
+		return m_pendingBytes + job.size <= m_maxPendingBytes || m_jobs.begin()->first.sequence == order.sequence;
+	}
+
+	void RunInflater()
+	{
+		z_stream stream = {};
+		const bool bInitialized = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			SOrder order;
+			bool bWasRead = false;
+			m_inflateAvailable.wait(lock, [&]() { return m_bStop || PickInflateJob(order, bWasRead); });
+			if (m_bStop)
+				break;
+
+			(bWasRead ? m_toInflate : m_toRead).erase(order);
+			SJob& job = m_jobs.find(order)->second;
+			m_readBytes -= bWasRead ? job.compressedSize : 0;
+			job.state = EState::Inflating;
+			job.buffer = AcquireBuffer(job.size);
+			m_pendingBytes += job.size;
+
+			lock.unlock();
+			bool bValid = false;
+			if (bInitialized && inflateReset(&stream) == Z_OK)
+			{
+				stream.next_in = const_cast<Bytef*>(job.pSource);
+				stream.avail_in = job.compressedSize;
+				stream.next_out = job.buffer.pData.get();
+				stream.avail_out = job.size;
+				bValid = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == job.size
+					&& crc32(0, job.buffer.pData.get(), job.size) == job.crc;
+			}
+			lock.lock();
+
+			job.bValid = bValid;
+			job.state = EState::Done;
+			++m_statistics.inflatedEntries;
+			m_statistics.compressedBytes += job.compressedSize;
+			m_statistics.inflatedBytes += job.size;
+			if (bWasRead)
+			{
+				// Lets the reader move on
+				m_readAvailable.notify_one();
+			}
+			if (m_jobs.begin()->first.sequence == order.sequence)
+			{
+				// Anything behind the front can't be delivered yet, no point waking the consumer for it
+				m_jobDone.notify_all();
+			}
+		}
+		lock.unlock();
+
+		if (bInitialized)
+		{
+			inflateEnd(&stream);
+		}
+	}
+
+private:
+	const size_t                      m_maxPendingBytes;
+	const size_t                      m_readAheadBytes;
+
+	mutable std::mutex                m_mutex;
+	std::condition_variable           m_readAvailable;    // A job was queued or read ahead bytes were freed
+	std::condition_variable           m_inflateAvailable; // A job was queued or read, or pending bytes were freed
+	std::condition_variable           m_jobDone;
+
+	std::map<SOrder, SJob>            m_jobs;          // Every entry not delivered yet, in delivery order
+	std::set<SOrder>                  m_toRead;
+	std::set<SOrder>                  m_toInflate;
+	uint64_t                          m_nextSequence = 0;
+	size_t                            m_readBytes = 0;    // Compressed, read ahead and not taken by an inflater yet
+	size_t                            m_pendingBytes = 0; // Inflated or being inflated, not delivered yet
+	bool                              m_bStop = false;
+
+	std::vector<std::vector<SBuffer>> m_pool;          // Free buffers per power of two size
+	size_t                            m_pooledBytes = 0;
+	SStatistics                       m_statistics;
+	std::atomic<uint32_t>             m_touchSum { 0 };
+
+	std::thread                       m_reader;
+	std::vector<std::thread>          m_inflaters;
+};
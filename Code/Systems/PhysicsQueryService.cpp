@@ -0,0 +1,293 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PhysicsQueryService.h"
+#include "HotPathProfiler.h"
+
+namespace
+{
+	int g_physicsQueryJobSize = 16;
+	int g_physicsQueryCacheTicks = 6;
+
+	struct SQueryStats
+	{
+		uint32 queued = 0;
+		uint32 cacheHits = 0;
+		uint32 rejected = 0;
+		uint32 maxBatch = 0;
+	};
+
+	SQueryStats g_queryStats;
+
+	void PhysicsQueryStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		const SQueryStats& stats = g_queryStats;
+		CryLogAlways("[PhysicsQueries] queued %u, served from cache %u, rejected (batch full) %u, largest batch %u",
+			stats.queued, stats.cacheHits, stats.rejected, stats.maxBatch);
+
+		g_queryStats = SQueryStats();
+	}
+
+	// Positions are compared at centimeter precision, so a player standing still maps to the same key every tick
+	uint64 HashQuery(uint64 hash, float value)
+	{
+		const int32 quantized = static_cast<int32>(floorf(value * 100.f + 0.5f));
+		hash ^= static_cast<uint32>(quantized);
+		return hash * 0x100000001b3ull;
+	}
+
+	uint64 HashQuery(uint64 hash, const Vec3& value)
+	{
+		return HashQuery(HashQuery(HashQuery(hash, value.x), value.y), value.z);
+	}
+}
+
+void CPhysicsQueryService::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_physicsQueryJobSize", &g_physicsQueryJobSize, 16, VF_NULL, "Number of batched physics queries per job, 0 runs the whole batch on the main thread");
+	REGISTER_CVAR2("g_physicsQueryCacheTicks", &g_physicsQueryCacheTicks, 6, VF_NULL, "Ticks a physics query result is reused for identical queries, 0 disables the cache");
+	REGISTER_COMMAND("g_physicsQueryStats", PhysicsQueryStatsCommand, VF_NULL, "Prints and resets the batched physics query statistics");
+}
+
+void CPhysicsQueryService::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_physicsQueryJobSize", true);
+		gEnv->pConsole->UnregisterVariable("g_physicsQueryCacheTicks", true);
+		gEnv->pConsole->RemoveCommand("g_physicsQueryStats");
+	}
+}
+
+CPhysicsQueryService::CPhysicsQueryService()
+{
+}
+
+CPhysicsQueryService::~CPhysicsQueryService()
+{
+	Flush();
+}
+
+TPhysicsQueryHandle CPhysicsQueryService::QueueCapsuleOverlap(const primitives::capsule& capsule, IPhysicalEntity* pSkipEntity)
+{
+	SQuery query;
+	query.type = EType::CapsuleOverlap;
+	query.capsule = capsule;
+	query.origin = capsule.center;
+	query.direction = ZERO;
+	query.pSkipEntity = pSkipEntity;
+	return Queue(query);
+}
+
+TPhysicsQueryHandle CPhysicsQueryService::QueueCapsuleSweep(const primitives::capsule& capsule, const Vec3& sweep, IPhysicalEntity* pSkipEntity)
+{
+	SQuery query;
+	query.type = EType::CapsuleSweep;
+	query.capsule = capsule;
+	query.origin = capsule.center;
+	query.direction = sweep;
+	query.pSkipEntity = pSkipEntity;
+	return Queue(query);
+}
+
+TPhysicsQueryHandle CPhysicsQueryService::QueueRay(const Vec3& origin, const Vec3& direction, IPhysicalEntity* pSkipEntity)
+{
+	SQuery query;
+	query.type = EType::Ray;
+	query.capsule = primitives::capsule();
+	query.origin = origin;
+	query.direction = direction;
+	query.pSkipEntity = pSkipEntity;
+	return Queue(query);
+}
+
+TPhysicsQueryHandle CPhysicsQueryService::Queue(SQuery& query)
+{
+	if (m_pendingCount >= MaxQueriesPerTick)
+	{
+		++g_queryStats.rejected;
+		return INVALID_PHYSICS_QUERY_HANDLE;
+	}
+
+	uint64 key = 0xcbf29ce484222325ull ^ static_cast<uint64>(query.type);
+	key = HashQuery(key, query.origin);
+	key = HashQuery(key, query.direction);
+	key = HashQuery(key, query.capsule.axis);
+	key = HashQuery(HashQuery(key, query.capsule.r), query.capsule.hh);
+	key ^= static_cast<uint64>(reinterpret_cast<UINT_PTR>(query.pSkipEntity));
+	query.key = key;
+
+	const SCacheEntry& entry = m_cache[key % CacheSize];
+	query.bCached = g_physicsQueryCacheTicks > 0 && entry.key == key && m_tick - entry.tick <= static_cast<uint32>(g_physicsQueryCacheTicks);
+	if (query.bCached)
+	{
+		query.cachedResult = entry.result;
+		++g_queryStats.cacheHits;
+	}
+
+	m_pending[m_pendingCount] = query;
+	++g_queryStats.queued;
+	return m_pendingFirst + m_pendingCount++;
+}
+
+CPhysicsQueryService::EStatus CPhysicsQueryService::GetResult(TPhysicsQueryHandle handle, SResult& result) const
+{
+	if (handle != INVALID_PHYSICS_QUERY_HANDLE && handle - m_pendingFirst < m_pendingCount)
+		return EStatus::Pending;
+
+	if (handle == INVALID_PHYSICS_QUERY_HANDLE || handle - m_executingFirst >= m_executingCount)
+		return EStatus::Expired;
+
+	if (!m_bResultsReady)
+		return EStatus::Pending;
+
+	result = m_results[handle - m_executingFirst];
+	return EStatus::Ready;
+}
+
+void CPhysicsQueryService::BeginTick(uint32 tick)
+{
+	m_tick = tick;
+
+	// The batch of the previous tick has had the rest of the frame to run
+	Flush();
+}
+
+void CPhysicsQueryService::EndTick()
+{
+	Flush();
+
+	// This tick's queries become the running batch, the previous results expire
+	std::swap(m_pending, m_executing);
+	m_executingFirst = m_pendingFirst;
+	m_executingCount = m_pendingCount;
+	m_pendingFirst += m_pendingCount;
+	m_pendingCount = 0;
+	m_bResultsReady = false;
+
+	// Zero is the invalid handle
+	if (m_pendingFirst == INVALID_PHYSICS_QUERY_HANDLE)
+	{
+		++m_pendingFirst;
+	}
+
+	g_queryStats.maxBatch = std::max(g_queryStats.maxBatch, m_executingCount);
+
+	if (m_executingCount == 0)
+	{
+		m_bResultsReady = true;
+		return;
+	}
+
+	const uint32 jobSize = static_cast<uint32>(std::max(g_physicsQueryJobSize, 0));
+	if (jobSize == 0 || gEnv->pJobManager == nullptr)
+	{
+		Execute(0, m_executingCount);
+		return;
+	}
+
+	// At most MaxJobs jobs, larger batches get larger jobs
+	const uint32 jobCount = std::min((m_executingCount + jobSize - 1) / jobSize, MaxJobs);
+	const uint32 queriesPerJob = (m_executingCount + jobCount - 1) / jobCount;
+
+	for (uint32 first = 0; first < m_executingCount; first += queriesPerJob)
+	{
+		const uint32 end = std::min(first + queriesPerJob, m_executingCount);
+		gEnv->pJobManager->AddLambdaJob("PhysicsQueries", [this, first, end]() { Execute(first, end); }, JobManager::eRegularPriority, &m_jobStates[m_jobCount]);
+		++m_jobCount;
+	}
+}
+
+void CPhysicsQueryService::Flush()
+{
+	if (m_bResultsReady)
+		return;
+
+	for (uint32 i = 0; i < m_jobCount; ++i)
+	{
+		m_jobStates[i].Wait();
+	}
+	m_jobCount = 0;
+
+	// Cache on the main thread, the jobs only ever write their own result slots
+	for (uint32 i = 0; i < m_executingCount; ++i)
+	{
+		const SQuery& query = m_executing[i];
+		if (!query.bCached)
+		{
+			SCacheEntry& entry = m_cache[query.key % CacheSize];
+			entry.key = query.key;
+			entry.tick = m_tick;
+			entry.result = m_results[i];
+		}
+	}
+
+	m_bResultsReady = true;
+}
+
+void CPhysicsQueryService::Execute(uint32 first, uint32 end)
+{
+	HOTPATH_PROFILE_SCOPE("CPhysicsQueryService::Execute");
+
+	for (uint32 i = first; i < end; ++i)
+	{
+		const SQuery& query = m_executing[i];
+		m_results[i] = query.bCached ? query.cachedResult : Run(query);
+	}
+}
+
+CPhysicsQueryService::SResult CPhysicsQueryService::Run(const SQuery& query)
+{
+	// Where the stance check's PrimitiveWorldIntersection is spent now
+	HOTPATH_PROFILE_SCOPE("CPhysicsQueryService::Run");
+
+	SResult result;
+	IPhysicalEntity* pSkipEntity = query.pSkipEntity;
+
+	if (query.type == EType::Ray)
+	{
+		ray_hit hit;
+		if (gEnv->pPhysicalWorld->RayWorldIntersection(query.origin, query.direction, ent_all, rwi_stop_at_pierceable | rwi_colltype_any, &hit, 1, &pSkipEntity, pSkipEntity != nullptr ? 1 : 0) > 0)
+		{
+			result.bHit = true;
+			result.fDistance = hit.dist;
+			result.point = hit.pt;
+			result.normal = hit.n;
+		}
+		return result;
+	}
+
+	IPhysicalWorld::SPWIParams pwiParams;
+	pwiParams.itype = query.capsule.type;
+	pwiParams.pprim = &query.capsule;
+	pwiParams.pSkipEnts = &pSkipEntity;
+	pwiParams.nSkipEnts = pSkipEntity != nullptr ? 1 : 0;
+
+	intersection_params intersectionParams;
+	intersectionParams.bSweepTest = query.type == EType::CapsuleSweep;
+	pwiParams.pip = &intersectionParams;
+
+	if (query.type == EType::CapsuleSweep)
+	{
+		pwiParams.sweepDir = query.direction;
+	}
+
+	// Contacts live in a per-call buffer that stays locked until the lock goes out of scope
+	geom_contact* pContacts = nullptr;
+	pwiParams.ppcontact = &pContacts;
+	WriteLockCond lockContacts;
+
+	const float distance = gEnv->pPhysicalWorld->PrimitiveWorldIntersection(pwiParams, &lockContacts, "CPhysicsQueryService");
+	if (query.type == EType::CapsuleOverlap)
+	{
+		result.bHit = distance > 0.f;
+	}
+	else if (distance > 0.f && pContacts != nullptr)
+	{
+		result.bHit = true;
+		result.fDistance = pContacts->t;
+		result.point = pContacts->pt;
+		result.normal = pContacts->n;
+	}
+
+	return result;
+}
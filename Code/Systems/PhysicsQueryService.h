@@ -0,0 +1,119 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+
+#include <CryPhysics/physinterface.h>
+#include <CryThreading/IJobManager.h>
+
+typedef uint32 TPhysicsQueryHandle;
+static constexpr TPhysicsQueryHandle INVALID_PHYSICS_QUERY_HANDLE = 0;
+
+////////////////////////////////////////////////////////
+// Collects the physics queries issued during a player
+// tick and runs them as one batch once the tick is done,
+// spread over the job system, so no component blocks on
+// the physical world mid-update.
+// A query's result is available on the next tick through
+// the handle returned when queuing it, and only then.
+// Queries identical to one answered recently, such as a
+// player holding crouch under a low ceiling, are answered
+// from a small cache without touching physics.
+////////////////////////////////////////////////////////
+
+class CPhysicsQueryService
+{
+public:
+	enum class EStatus
+	{
+		Pending, // Runs at the end of the current tick
+		Ready,   // Ran at the end of the previous tick
+		Expired  // Older than the previous tick, or never queued
+	};
+
+	struct SResult
+	{
+		bool  bHit = false;
+		float fDistance = 0.f; // Rays and sweeps only, along the query direction
+		Vec3  point = ZERO;
+		Vec3  normal = ZERO;
+	};
+
+	// Fixed per tick budget, queuing beyond it fails and the caller tries again next tick
+	static constexpr uint32 MaxQueriesPerTick = 256;
+
+	static void RegisterConsoleCommands();
+	static void UnregisterConsoleCommands();
+
+	CPhysicsQueryService();
+	~CPhysicsQueryService();
+
+	TPhysicsQueryHandle QueueCapsuleOverlap(const primitives::capsule& capsule, IPhysicalEntity* pSkipEntity);
+	TPhysicsQueryHandle QueueCapsuleSweep(const primitives::capsule& capsule, const Vec3& sweep, IPhysicalEntity* pSkipEntity);
+	TPhysicsQueryHandle QueueRay(const Vec3& origin, const Vec3& direction, IPhysicalEntity* pSkipEntity);
+
+	EStatus             GetResult(TPhysicsQueryHandle handle, SResult& result) const;
+
+	// Called by CPlayerSystem around every tick
+	void                BeginTick(uint32 tick);
+	void                EndTick();
+
+	// Waits for the running batch, so nothing refers to physical entities about to go away
+	void                Flush();
+
+private:
+	enum class EType : uint8
+	{
+		CapsuleOverlap,
+		CapsuleSweep,
+		Ray
+	};
+
+	struct SQuery
+	{
+		EType               type;
+		bool                bCached;
+		primitives::capsule capsule;
+		Vec3                origin;
+		Vec3                direction;
+		IPhysicalEntity*    pSkipEntity;
+		uint64              key;
+		SResult             cachedResult;
+	};
+
+	struct SCacheEntry
+	{
+		uint64  key = 0;
+		uint32  tick = 0;
+		SResult result;
+	};
+
+	typedef std::array<SQuery, MaxQueriesPerTick>  TQueries;
+	typedef std::array<SResult, MaxQueriesPerTick> TResults;
+
+	static constexpr uint32 CacheSize = 256;
+	static constexpr uint32 MaxJobs = 8;
+
+	TPhysicsQueryHandle Queue(SQuery& query);
+	void                Execute(uint32 first, uint32 end);
+	static SResult      Run(const SQuery& query);
+
+private:
+	// Filled during the tick
+	TQueries                               m_pending;
+	uint32                                 m_pendingCount = 0;
+	TPhysicsQueryHandle                    m_pendingFirst = 1;
+
+	// Handed to the jobs at the end of the tick, read back on the next one
+	TQueries                               m_executing;
+	TResults                               m_results;
+	uint32                                 m_executingCount = 0;
+	TPhysicsQueryHandle                    m_executingFirst = 1;
+	bool                                   m_bResultsReady = false;
+
+	std::array<JobManager::SJobState, MaxJobs> m_jobStates;
+	uint32                                 m_jobCount = 0;
+
+	std::array<SCacheEntry, CacheSize>     m_cache;
+	uint32                                 m_tick = 0;
+};
@@ -0,0 +1,103 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "Components/PlayerActions.h"
+
+// One input action, stamped with CryGetTicks() when it arrived
+struct SPlayerInputEvent
+{
+	int64         time;
+	uint32        handle; // TPlayerHandle of the player the action is for
+	EPlayerAction action;
+	uint8         activationMode;
+	float         value;
+};
+
+////////////////////////////////////////////////////////
+// Lock-free single producer / single consumer queue of
+// input events. The thread dispatching input pushes every
+// event as it arrives, the player simulation pops them at
+// its tick, so high rate mice cost one copy per event on
+// the producer side and nothing is ever overwritten.
+// Push is producer only, everything else consumer only.
+////////////////////////////////////////////////////////
+
+class CPlayerInputBuffer
+{
+public:
+	// Around 20 frames of an 8 kHz mouse, must be a power of two
+	static constexpr uint32 Capacity = 2048;
+
+	// Returns false and drops the event when the consumer fell behind by a whole buffer
+	bool Push(const SPlayerInputEvent& event)
+	{
+		const uint32 head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail == Capacity)
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail == Capacity)
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		m_events[head & (Capacity - 1)] = event;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Oldest event not popped yet, nullptr if there is none
+	SPlayerInputEvent* Peek()
+	{
+		const uint32 tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_cachedHead)
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail == m_cachedHead)
+				return nullptr;
+		}
+
+		return &m_events[tail & (Capacity - 1)];
+	}
+
+	void Pop()
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Calls func on every event pushed so far and not popped yet, which the consumer may still modify
+	template<typename TFunc>
+	void ForEachQueued(TFunc func)
+	{
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		for (uint32 i = m_tail.load(std::memory_order_relaxed); i != m_cachedHead; ++i)
+		{
+			func(m_events[i & (Capacity - 1)]);
+		}
+	}
+
+	void Clear()
+	{
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		m_tail.store(m_cachedHead, std::memory_order_release);
+	}
+
+	uint32 GetDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	// Producer and consumer indices on their own cache lines, each side caches the other's index
+	alignas(64) std::atomic<uint32>                 m_head { 0 };
+	uint32                                          m_cachedTail = 0;
+	std::atomic<uint32>                             m_dropped { 0 };
+
+	alignas(64) std::atomic<uint32>                 m_tail { 0 };
+	uint32                                          m_cachedHead = 0;
+
+	alignas(64) std::array<SPlayerInputEvent, Capacity> m_events;
+};
@@ -0,0 +1,599 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PlayerKernels.h"
+
+#include "Components/Player.h"
+
+// The vector paths are only bit-identical to the scalar path if the compiler neither fuses
+// multiply-adds nor reorders the float math. This file is built outside of the uber files so
+// these settings don't leak into other translation units.
+#if CRY_COMPILER_MSVC
+	#pragma float_control(precise, on)
+	#pragma fp_contract(off)
+#elif CRY_COMPILER_CLANG
+	#pragma clang fp contract(off)
+#elif CRY_COMPILER_GCC
+	#pragma GCC optimize("fp-contract=off", "no-fast-math")
+#endif
+
+#if CRY_PLATFORM_SSE2
+	#include <immintrin.h>
+	#if CRY_COMPILER_MSVC
+		#include <intrin.h>
+		#define PLAYER_KERNELS_AVX2_TARGET
+	#else
+		#define PLAYER_KERNELS_AVX2_TARGET __attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace PlayerKernels
+{
+namespace
+{
+	// Cody-Waite reduction by pi/2 followed by the Cephes single precision polynomials
+	constexpr float TWO_OVER_PI = 0.636619772367581343f;
+	constexpr float PIO2_1 = 1.5703125f;
+	constexpr float PIO2_2 = 4.837512969970703125e-4f;
+	constexpr float PIO2_3 = 7.54978995489188216e-8f;
+
+	constexpr float SIN_C0 = -1.9515295891e-4f;
+	constexpr float SIN_C1 = 8.3321608736e-3f;
+	constexpr float SIN_C2 = -1.6666654611e-1f;
+
+	constexpr float COS_C0 = 2.443315711809948e-5f;
+	constexpr float COS_C1 = -1.388731625493765e-3f;
+	constexpr float COS_C2 = 4.166664568298827e-2f;
+
+	constexpr float YAW_WRAP = gf_PI;
+	constexpr float YAW_RANGE = gf_PI2;
+
+	constexpr uint8 SPRINT_STATE = static_cast<uint8>(EPlayerState::Sprinting);
+
+	//////////////////////////////////////////////////////////////////////////
+	// Scalar reference
+	//////////////////////////////////////////////////////////////////////////
+
+	inline float FlipSign(float value, bool bFlip)
+	{
+		return bFlip ? -value : value;
+	}
+
+	inline void SinCos(float x, float& outSin, float& outCos)
+	{
+		const float t = x * TWO_OVER_PI;
+		const int32 quadrant = static_cast<int32>(t + (std::signbit(t) ? -0.5f : 0.5f));
+		const float q = static_cast<float>(quadrant);
+
+		const float r = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+		const float z = r * r;
+
+		const float sinPoly = ((SIN_C0 * z + SIN_C1) * z + SIN_C2) * z * r + r;
+		const float cosPoly = ((COS_C0 * z + COS_C1) * z + COS_C2) * z * z - 0.5f * z + 1.f;
+
+		const bool bSwap = (quadrant & 1) != 0;
+		outSin = FlipSign(bSwap ? cosPoly : sinPoly, (quadrant & 2) != 0);
+		outCos = FlipSign(bSwap ? sinPoly : cosPoly, ((quadrant + 1) & 2) != 0);
+	}
+
+	void IntegrateMovementScalar(const SMovementStreams& s, uint32 begin, uint32 end)
+	{
+		for (uint32 i = begin; i < end; ++i)
+		{
+			const float x = s.pMoveX[i];
+			const float y = s.pMoveY[i];
+			const float lengthSquared = x * x + y * y;
+			const float invLength = lengthSquared > 0.f ? 1.f / sqrtf(lengthSquared) : 0.f;
+
+			const float speed = s.pState[i] == SPRINT_STATE ? s.pSprintSpeed[i] : s.pWalkSpeed[i];
+			const float scale = invLength * speed;
+
+			float sinYaw, cosYaw;
+			SinCos(s.pYaw[i], sinYaw, cosYaw);
+
+			s.pSpeed[i] = speed;
+			s.pVelocityX[i] = (cosYaw * x - sinYaw * y) * scale;
+			s.pVelocityY[i] = (sinYaw * x + cosYaw * y) * scale;
+		}
+	}
+
+	void IntegrateYawScalar(float* pYaw, const float* pMouseX, const float* pRotationSpeed, uint32 begin, uint32 end)
+	{
+		for (uint32 i = begin; i < end; ++i)
+		{
+			float yaw = pYaw[i] + pMouseX[i] * pRotationSpeed[i];
+			yaw = yaw > YAW_WRAP ? yaw - YAW_RANGE : yaw;
+			yaw = yaw < -YAW_WRAP ? yaw + YAW_RANGE : yaw;
+			pYaw[i] = yaw;
+		}
+	}
+
+	void IntegratePitchScalar(float* pPitch, const float* pMouseY, const float* pRotationSpeed, const float* pPitchMin, const float* pPitchMax, uint32 begin, uint32 end)
+	{
+		for (uint32 i = begin; i < end; ++i)
+		{
+			// Written the way maxps / minps evaluate so the vector paths match even for NaN
+			float pitch = pPitch[i] + pMouseY[i] * pRotationSpeed[i];
+			pitch = pitch > pPitchMin[i] ? pitch : pPitchMin[i];
+			pitch = pitch < pPitchMax[i] ? pitch : pPitchMax[i];
+			pPitch[i] = pitch;
+		}
+	}
+
+#if CRY_PLATFORM_SSE2
+	//////////////////////////////////////////////////////////////////////////
+	// SSE2, 4 players per iteration
+	//////////////////////////////////////////////////////////////////////////
+
+	inline __m128 Select4(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	inline void SinCos4(__m128 x, __m128& outSin, __m128& outCos)
+	{
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i two = _mm_set1_epi32(2);
+
+		const __m128 t = _mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI));
+		const __m128 rounding = _mm_or_ps(_mm_and_ps(t, signMask), _mm_set1_ps(0.5f));
+		const __m128i quadrant = _mm_cvttps_epi32(_mm_add_ps(t, rounding));
+		const __m128 q = _mm_cvtepi32_ps(quadrant);
+
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(PIO2_1)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(PIO2_2)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(PIO2_3)));
+		const __m128 z = _mm_mul_ps(r, r);
+
+		__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_C0), z), _mm_set1_ps(SIN_C1));
+		sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_C2));
+		sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), r), r);
+
+		__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_C0), z), _mm_set1_ps(COS_C1));
+		cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_C2));
+		cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+		cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+
+		const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+		const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+		const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+
+		outSin = _mm_xor_ps(Select4(swap, cosPoly, sinPoly), sinSign);
+		outCos = _mm_xor_ps(Select4(swap, sinPoly, cosPoly), cosSign);
+	}
+
+	inline __m128i LoadState4(const uint8* pState)
+	{
+		int32 packed;
+		memcpy(&packed, pState, sizeof(packed));
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+	}
+
+	uint32 IntegrateMovementSSE2(const SMovementStreams& s, uint32 count)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128i sprint = _mm_set1_epi32(SPRINT_STATE);
+
+		const uint32 end = count & ~3u;
+		for (uint32 i = 0; i < end; i += 4)
+		{
+			const __m128 x = _mm_loadu_ps(s.pMoveX + i);
+			const __m128 y = _mm_loadu_ps(s.pMoveY + i);
+			const __m128 lengthSquared = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+			const __m128 invLength = _mm_and_ps(_mm_cmpgt_ps(lengthSquared, zero), _mm_div_ps(one, _mm_sqrt_ps(lengthSquared)));
+
+			const __m128 isSprinting = _mm_castsi128_ps(_mm_cmpeq_epi32(LoadState4(s.pState + i), sprint));
+			const __m128 speed = Select4(isSprinting, _mm_loadu_ps(s.pSprintSpeed + i), _mm_loadu_ps(s.pWalkSpeed + i));
+			const __m128 scale = _mm_mul_ps(invLength, speed);
+
+			__m128 sinYaw, cosYaw;
+			SinCos4(_mm_loadu_ps(s.pYaw + i), sinYaw, cosYaw);
+
+			_mm_storeu_ps(s.pSpeed + i, speed);
+			_mm_storeu_ps(s.pVelocityX + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cosYaw, x), _mm_mul_ps(sinYaw, y)), scale));
+			_mm_storeu_ps(s.pVelocityY + i, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sinYaw, x), _mm_mul_ps(cosYaw, y)), scale));
+		}
+		return end;
+	}
+
+	uint32 IntegrateYawSSE2(float* pYaw, const float* pMouseX, const float* pRotationSpeed, uint32 count)
+	{
+		const __m128 wrap = _mm_set1_ps(YAW_WRAP);
+		const __m128 negativeWrap = _mm_set1_ps(-YAW_WRAP);
+		const __m128 range = _mm_set1_ps(YAW_RANGE);
+
+		const uint32 end = count & ~3u;
+		for (uint32 i = 0; i < end; i += 4)
+		{
+			__m128 yaw = _mm_add_ps(_mm_loadu_ps(pYaw + i), _mm_mul_ps(_mm_loadu_ps(pMouseX + i), _mm_loadu_ps(pRotationSpeed + i)));
+			yaw = Select4(_mm_cmpgt_ps(yaw, wrap), _mm_sub_ps(yaw, range), yaw);
+			yaw = Select4(_mm_cmplt_ps(yaw, negativeWrap), _mm_add_ps(yaw, range), yaw);
+			_mm_storeu_ps(pYaw + i, yaw);
+		}
+		return end;
+	}
+
+	uint32 IntegratePitchSSE2(float* pPitch, const float* pMouseY, const float* pRotationSpeed, const float* pPitchMin, const float* pPitchMax, uint32 count)
+	{
+		const uint32 end = count & ~3u;
+		for (uint32 i = 0; i < end; i += 4)
+		{
+			__m128 pitch = _mm_add_ps(_mm_loadu_ps(pPitch + i), _mm_mul_ps(_mm_loadu_ps(pMouseY + i), _mm_loadu_ps(pRotationSpeed + i)));
+			pitch = _mm_max_ps(pitch, _mm_loadu_ps(pPitchMin + i));
+			pitch = _mm_min_ps(pitch, _mm_loadu_ps(pPitchMax + i));
+			_mm_storeu_ps(pPitch + i, pitch);
+		}
+		return end;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// AVX2, 8 players per iteration, only called after the CPU check in GetBestPath
+	//////////////////////////////////////////////////////////////////////////
+
+	PLAYER_KERNELS_AVX2_TARGET inline __m256 Select8(__m256 mask, __m256 a, __m256 b)
+	{
+		return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+	}
+
+	PLAYER_KERNELS_AVX2_TARGET inline void SinCos8(__m256 x, __m256& outSin, __m256& outCos)
+	{
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i two = _mm256_set1_epi32(2);
+
+		const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI));
+		const __m256 rounding = _mm256_or_ps(_mm256_and_ps(t, signMask), _mm256_set1_ps(0.5f));
+		const __m256i quadrant = _mm256_cvttps_epi32(_mm256_add_ps(t, rounding));
+		const __m256 q = _mm256_cvtepi32_ps(quadrant);
+
+		__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(q, _mm256_set1_ps(PIO2_1)));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(PIO2_2)));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(PIO2_3)));
+		const __m256 z = _mm256_mul_ps(r, r);
+
+		__m256 sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_C0), z), _mm256_set1_ps(SIN_C1));
+		sinPoly = _mm256_add_ps(_mm256_mul_ps(sinPoly, z), _mm256_set1_ps(SIN_C2));
+		sinPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sinPoly, z), r), r);
+
+		__m256 cosPoly = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_C0), z), _mm256_set1_ps(COS_C1));
+		cosPoly = _mm256_add_ps(_mm256_mul_ps(cosPoly, z), _mm256_set1_ps(COS_C2));
+		cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+		cosPoly = _mm256_add_ps(_mm256_sub_ps(cosPoly, _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.f));
+
+		const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+		const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+		const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+
+		outSin = _mm256_xor_ps(Select8(swap, cosPoly, sinPoly), sinSign);
+		outCos = _mm256_xor_ps(Select8(swap, sinPoly, cosPoly), cosSign);
+	}
+
+	PLAYER_KERNELS_AVX2_TARGET uint32 IntegrateMovementAVX2(const SMovementStreams& s, uint32 count)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256i sprint = _mm256_set1_epi32(SPRINT_STATE);
+
+		const uint32 end = count & ~7u;
+		for (uint32 i = 0; i < end; i += 8)
+		{
+			const __m256 x = _mm256_loadu_ps(s.pMoveX + i);
+			const __m256 y = _mm256_loadu_ps(s.pMoveY + i);
+			const __m256 lengthSquared = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+			const __m256 invLength = _mm256_and_ps(_mm256_cmp_ps(lengthSquared, zero, _CMP_GT_OQ), _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared)));
+
+			const __m256i state = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s.pState + i)));
+			const __m256 isSprinting = _mm256_castsi256_ps(_mm256_cmpeq_epi32(state, sprint));
+			const __m256 speed = Select8(isSprinting, _mm256_loadu_ps(s.pSprintSpeed + i), _mm256_loadu_ps(s.pWalkSpeed + i));
+			const __m256 scale = _mm256_mul_ps(invLength, speed);
+
+			__m256 sinYaw, cosYaw;
+			SinCos8(_mm256_loadu_ps(s.pYaw + i), sinYaw, cosYaw);
+
+			_mm256_storeu_ps(s.pSpeed + i, speed);
+			_mm256_storeu_ps(s.pVelocityX + i, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(cosYaw, x), _mm256_mul_ps(sinYaw, y)), scale));
+			_mm256_storeu_ps(s.pVelocityY + i, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(sinYaw, x), _mm256_mul_ps(cosYaw, y)), scale));
+		}
+		return end;
+	}
+
+	PLAYER_KERNELS_AVX2_TARGET uint32 IntegrateYawAVX2(float* pYaw, const float* pMouseX, const float* pRotationSpeed, uint32 count)
+	{
+		const __m256 wrap = _mm256_set1_ps(YAW_WRAP);
+		const __m256 negativeWrap = _mm256_set1_ps(-YAW_WRAP);
+		const __m256 range = _mm256_set1_ps(YAW_RANGE);
+
+		const uint32 end = count & ~7u;
+		for (uint32 i = 0; i < end; i += 8)
+		{
+			__m256 yaw = _mm256_add_ps(_mm256_loadu_ps(pYaw + i), _mm256_mul_ps(_mm256_loadu_ps(pMouseX + i), _mm256_loadu_ps(pRotationSpeed + i)));
+			yaw = Select8(_mm256_cmp_ps(yaw, wrap, _CMP_GT_OQ), _mm256_sub_ps(yaw, range), yaw);
+			yaw = Select8(_mm256_cmp_ps(yaw, negativeWrap, _CMP_LT_OQ), _mm256_add_ps(yaw, range), yaw);
+			_mm256_storeu_ps(pYaw + i, yaw);
+		}
+		return end;
+	}
+
+	PLAYER_KERNELS_AVX2_TARGET uint32 IntegratePitchAVX2(float* pPitch, const float* pMouseY, const float* pRotationSpeed, const float* pPitchMin, const float* pPitchMax, uint32 count)
+	{
+		const uint32 end = count & ~7u;
+		for (uint32 i = 0; i < end; i += 8)
+		{
+			__m256 pitch = _mm256_add_ps(_mm256_loadu_ps(pPitch + i), _mm256_mul_ps(_mm256_loadu_ps(pMouseY + i), _mm256_loadu_ps(pRotationSpeed + i)));
+			pitch = _mm256_max_ps(pitch, _mm256_loadu_ps(pPitchMin + i));
+			pitch = _mm256_min_ps(pitch, _mm256_loadu_ps(pPitchMax + i));
+			_mm256_storeu_ps(pPitch + i, pitch);
+		}
+		return end;
+	}
+
+	bool IsAVX2Supported()
+	{
+	#if CRY_COMPILER_MSVC
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		const bool bOSXSave = (info[2] & (1 << 27)) != 0;
+		const bool bAVX = (info[2] & (1 << 28)) != 0;
+		if (!bOSXSave || !bAVX || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#else
+		return __builtin_cpu_supports("avx2") != 0;
+	#endif
+	}
+#endif // CRY_PLATFORM_SSE2
+
+	//////////////////////////////////////////////////////////////////////////
+	// Self test
+	//////////////////////////////////////////////////////////////////////////
+
+	class CTestRandom
+	{
+	public:
+		explicit CTestRandom(uint32 seed) : m_state(seed ? seed : 1) {}
+
+		uint32 Next()
+		{
+			m_state ^= m_state << 13;
+			m_state ^= m_state >> 17;
+			m_state ^= m_state << 5;
+			return m_state;
+		}
+
+		float Range(float min, float max)
+		{
+			return min + (max - min) * static_cast<float>(Next() & 0xFFFFFF) / static_cast<float>(0xFFFFFF);
+		}
+
+	private:
+		uint32 m_state;
+	};
+
+	struct STestData
+	{
+		std::vector<float> moveX, moveY, yaw, walkSpeed, sprintSpeed, mouseX, mouseY, rotationSpeed, pitch, pitchMin, pitchMax;
+		std::vector<uint8> state;
+		std::vector<float> speed, velocityX, velocityY;
+
+		void Run(EPath path)
+		{
+			const uint32 count = static_cast<uint32>(moveX.size());
+
+			SMovementStreams streams;
+			streams.pMoveX = moveX.data();
+			streams.pMoveY = moveY.data();
+			streams.pYaw = yaw.data();
+			streams.pState = state.data();
+			streams.pWalkSpeed = walkSpeed.data();
+			streams.pSprintSpeed = sprintSpeed.data();
+			streams.pSpeed = speed.data();
+			streams.pVelocityX = velocityX.data();
+			streams.pVelocityY = velocityY.data();
+
+			IntegrateMovement(streams, count, path);
+			IntegrateYaw(yaw.data(), mouseX.data(), rotationSpeed.data(), count, path);
+			IntegratePitch(pitch.data(), mouseY.data(), rotationSpeed.data(), pitchMin.data(), pitchMax.data(), count, path);
+		}
+	};
+
+	bool CompareStream(const char* szName, const std::vector<float>& reference, const std::vector<float>& result, EPath path)
+	{
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			if (memcmp(&reference[i], &result[i], sizeof(float)) != 0)
+			{
+				CryLogAlways("[PlayerKernels] %s mismatch in '%s' at player %d: scalar %.9g, vector %.9g", GetPathName(path), szName, static_cast<int>(i), reference[i], result[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// The math CPlayerComponent ran per entity before the kernels: Vec3::Normalize, the entity's yaw Quat rotating the
+	// input, and the yaw built up as a product of Quats. Its sin/cos differ from the kernels' polynomial in the last bits.
+	void RunPreviousMath(STestData& data)
+	{
+		for (size_t i = 0; i < data.moveX.size(); ++i)
+		{
+			Vec3 velocity = Vec3(data.moveX[i], data.moveY[i], 0.f);
+			velocity.Normalize();
+			data.speed[i] = data.state[i] == SPRINT_STATE ? data.sprintSpeed[i] : data.walkSpeed[i];
+			velocity = Quat::CreateRotationZ(data.yaw[i]) * velocity * data.speed[i];
+			data.velocityX[i] = velocity.x;
+			data.velocityY[i] = velocity.y;
+
+			const Quat yaw = Quat::CreateRotationZ(data.yaw[i]) * Quat::CreateRotationZ(data.mouseX[i] * data.rotationSpeed[i]);
+			data.yaw[i] = yaw.GetRotZ();
+			data.pitch[i] = crymath::clamp(data.pitch[i] + data.mouseY[i] * data.rotationSpeed[i], data.pitchMin[i], data.pitchMax[i]);
+		}
+	}
+
+	// Largest difference, angles compared across the wrap at +-pi
+	float GetMaxError(const std::vector<float>& reference, const std::vector<float>& result, bool bAngle)
+	{
+		float maxError = 0.f;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			float error = fabsf(reference[i] - result[i]);
+			error = bAngle ? std::min(error, fabsf(error - gf_PI2)) : error;
+			maxError = std::max(maxError, error);
+		}
+		return maxError;
+	}
+}
+
+EPath GetBestPath()
+{
+#if CRY_PLATFORM_SSE2
+	static const EPath bestPath = IsAVX2Supported() ? EPath::AVX2 : EPath::SSE2;
+	return bestPath;
+#else
+	return EPath::Scalar;
+#endif
+}
+
+const char* GetPathName(EPath path)
+{
+	switch (path)
+	{
+	case EPath::SSE2:
+		return "SSE2";
+	case EPath::AVX2:
+		return "AVX2";
+	default:
+		return "Scalar";
+	}
+}
+
+void IntegrateMovement(const SMovementStreams& streams, uint32 count, EPath path)
+{
+	uint32 done = 0;
+#if CRY_PLATFORM_SSE2
+	if (path == EPath::AVX2)
+		done = IntegrateMovementAVX2(streams, count);
+	else if (path == EPath::SSE2)
+		done = IntegrateMovementSSE2(streams, count);
+#endif
+	IntegrateMovementScalar(streams, done, count);
+}
+
+void IntegrateYaw(float* pYaw, const float* pMouseX, const float* pRotationSpeed, uint32 count, EPath path)
+{
+	uint32 done = 0;
+#if CRY_PLATFORM_SSE2
+	if (path == EPath::AVX2)
+		done = IntegrateYawAVX2(pYaw, pMouseX, pRotationSpeed, count);
+	else if (path == EPath::SSE2)
+		done = IntegrateYawSSE2(pYaw, pMouseX, pRotationSpeed, count);
+#endif
+	IntegrateYawScalar(pYaw, pMouseX, pRotationSpeed, done, count);
+}
+
+void IntegratePitch(float* pPitch, const float* pMouseY, const float* pRotationSpeed, const float* pPitchMin, const float* pPitchMax, uint32 count, EPath path)
+{
+	uint32 done = 0;
+#if CRY_PLATFORM_SSE2
+	if (path == EPath::AVX2)
+		done = IntegratePitchAVX2(pPitch, pMouseY, pRotationSpeed, pPitchMin, pPitchMax, count);
+	else if (path == EPath::SSE2)
+		done = IntegratePitchSSE2(pPitch, pMouseY, pRotationSpeed, pPitchMin, pPitchMax, count);
+#endif
+	IntegratePitchScalar(pPitch, pMouseY, pRotationSpeed, pPitchMin, pPitchMax, done, count);
+}
+
+bool RunSelfTest(uint32 count, uint32 seed)
+{
+	CTestRandom random(seed);
+
+	STestData input;
+	auto fill = [&random, count](std::vector<float>& values, float min, float max)
+	{
+		values.resize(count);
+		for (float& value : values)
+			value = random.Range(min, max);
+	};
+
+	fill(input.moveX, -1.f, 1.f);
+	fill(input.moveY, -1.f, 1.f);
+	fill(input.yaw, -gf_PI, gf_PI);
+	fill(input.walkSpeed, 1.f, 5.f);
+	fill(input.sprintSpeed, 5.f, 12.f);
+	fill(input.mouseX, -200.f, 200.f);
+	fill(input.mouseY, -200.f, 200.f);
+	fill(input.rotationSpeed, 0.001f, 0.01f);
+	fill(input.pitch, -0.85f, 1.5f);
+	fill(input.pitchMin, -1.f, -0.5f);
+	fill(input.pitchMax, 1.f, 1.5f);
+
+	input.state.resize(count);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		input.state[i] = static_cast<uint8>(random.Next() % 3);
+
+		// Idle players hit the zero-length branch of the normalization
+		if ((random.Next() & 7) == 0)
+		{
+			input.moveX[i] = 0.f;
+			input.moveY[i] = 0.f;
+		}
+	}
+
+	input.speed.resize(count);
+	input.velocityX.resize(count);
+	input.velocityY.resize(count);
+
+	STestData reference = input;
+	reference.Run(EPath::Scalar);
+
+	bool bPassed = true;
+	const EPath bestPath = GetBestPath();
+	for (EPath path : { EPath::SSE2, EPath::AVX2 })
+	{
+		if (static_cast<int>(path) > static_cast<int>(bestPath))
+		{
+			CryLogAlways("[PlayerKernels] %s not supported on this CPU, skipped", GetPathName(path));
+			continue;
+		}
+
+		STestData result = input;
+		result.Run(path);
+
+		const bool bPathPassed = CompareStream("speed", reference.speed, result.speed, path)
+			&& CompareStream("velocityX", reference.velocityX, result.velocityX, path)
+			&& CompareStream("velocityY", reference.velocityY, result.velocityY, path)
+			&& CompareStream("yaw", reference.yaw, result.yaw, path)
+			&& CompareStream("pitch", reference.pitch, result.pitch, path);
+
+		CryLogAlways("[PlayerKernels] %s vs Scalar on %d players: %s", GetPathName(path), static_cast<int>(count), bPathPassed ? "bit-exact" : "FAILED");
+		bPassed &= bPathPassed;
+	}
+
+	// The scalar kernel against the behavior it replaced. Speed and pitch are the same operations and must match exactly,
+	// velocity and yaw only within what the different sin/cos and the Quat round trip allow.
+	static constexpr float MaxVelocityError = 1e-4f; // m/s, at up to 12 m/s
+	static constexpr float MaxYawError = 1e-5f;      // Radians
+
+	STestData previous = input;
+	RunPreviousMath(previous);
+
+	const float velocityError = std::max(GetMaxError(previous.velocityX, reference.velocityX, false), GetMaxError(previous.velocityY, reference.velocityY, false));
+	const float yawError = GetMaxError(previous.yaw, reference.yaw, true);
+	const bool bPreviousPassed = CompareStream("speed", previous.speed, reference.speed, EPath::Scalar)
+		&& CompareStream("pitch", previous.pitch, reference.pitch, EPath::Scalar)
+		&& velocityError <= MaxVelocityError && yawError <= MaxYawError;
+
+	CryLogAlways("[PlayerKernels] Scalar vs the previous CPlayerComponent math on %d players: max velocity error %g m/s (%g allowed), max yaw error %g (%g allowed): %s",
+		static_cast<int>(count), velocityError, MaxVelocityError, yawError, MaxYawError, bPreviousPassed ? "passed" : "FAILED");
+	bPassed &= bPreviousPassed;
+
+	return bPassed;
+}
+}
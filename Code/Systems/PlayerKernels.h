@@ -0,0 +1,55 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+////////////////////////////////////////////////////////
+// Batch kernels for the player movement, yaw and pitch
+// integration done by CPlayerSystem.
+// Every kernel has a scalar version and SSE2 / AVX2
+// versions that process 4 / 8 players per instruction.
+// The vector versions perform exactly the same float
+// operations in the same order as the scalar version, so
+// the results are bit-identical on every path.
+////////////////////////////////////////////////////////
+
+namespace PlayerKernels
+{
+	enum class EPath
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	struct SMovementStreams
+	{
+		// Inputs
+		const float* pMoveX;
+		const float* pMoveY;
+		const float* pYaw;
+		const uint8* pState;       // EPlayerState
+		const float* pWalkSpeed;
+		const float* pSprintSpeed;
+
+		// Outputs
+		float*       pSpeed;
+		float*       pVelocityX;
+		float*       pVelocityY;
+	};
+
+	// Fastest path supported by the CPU we are running on
+	EPath       GetBestPath();
+	const char* GetPathName(EPath path);
+
+	// Normalizes the movement delta, picks walk or sprint speed and rotates the result by the yaw
+	void        IntegrateMovement(const SMovementStreams& streams, uint32 count, EPath path);
+
+	// yaw += mouseX * rotationSpeed, wrapped to [-pi, pi]
+	void        IntegrateYaw(float* pYaw, const float* pMouseX, const float* pRotationSpeed, uint32 count, EPath path);
+
+	// pitch = clamp(pitch + mouseY * rotationSpeed, min, max)
+	void        IntegratePitch(float* pPitch, const float* pMouseY, const float* pRotationSpeed, const float* pPitchMin, const float* pPitchMax, uint32 count, EPath path);
+
+	// Runs every kernel on random data through every supported path and compares the results bit by bit against the scalar path.
+	// Returns false and logs the first mismatch if any path differs.
+	bool        RunSelfTest(uint32 count, uint32 seed);
+}
@@ -0,0 +1,1064 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#include "StdAfx.h"
+#include "PlayerSystem.h"
+
+#include "GamePlugin.h"
+#include "Components/Player.h"
+#include "HotPathProfiler.h"
+
+namespace
+{
+	int g_playerKernelPath = -1;
+	int g_playerTickRate = 60;
+	int g_playerMaxTicksPerFrame = 4;
+	float g_playerLagCompensationMaxRewind = 0.5f;
+	int g_playerInputTimestamps = 1;
+	int g_playerStateSnapshots = 1;
+	int g_playerInterestManagement = 1;
+	int g_playerSnapshotFragments = 1;
+
+	void PlayerSnapshotStatsCommand(IConsoleCmdArgs* pArgs)
+	{
+		CGamePlugin::GetInstance()->GetPlayerSystem()->LogSnapshotStats();
+	}
+
+	void PlayerStateCodecBenchmarkCommand(IConsoleCmdArgs* pArgs)
+	{
+		const int count = pArgs->GetArgCount() > 1 ? atoi(pArgs->GetArg(1)) : 256;
+		const int ticks = pArgs->GetArgCount() > 2 ? atoi(pArgs->GetArg(2)) : 600;
+		const int seed = pArgs->GetArgCount() > 3 ? atoi(pArgs->GetArg(3)) : 12345;
+		PlayerStateCodec::RunBenchmark(static_cast<uint32>(std::max(count, 1)), static_cast<uint32>(std::max(ticks, 1)), static_cast<uint32>(seed));
+	}
+
+	void PlayerKernelsSelfTestCommand(IConsoleCmdArgs* pArgs)
+	{
+		const int count = pArgs->GetArgCount() > 1 ? atoi(pArgs->GetArg(1)) : 1021;
+		const int seed = pArgs->GetArgCount() > 2 ? atoi(pArgs->GetArg(2)) : 12345;
+		PlayerKernels::RunSelfTest(static_cast<uint32>(std::max(count, 1)), static_cast<uint32>(seed));
+	}
+
+	// Ticks between movement aspect updates of a player that only sends commands without moving
+	constexpr uint32 IdleCommandAckInterval = 8;
+
+	// Into [-pi, pi], the range UpdateRotation keeps the yaw in. Values already in it are left untouched so the server uses the exact yaw the client predicted with.
+	float WrapYaw(float yaw)
+	{
+		if (yaw >= -gf_PI && yaw <= gf_PI)
+			return yaw;
+
+		yaw = fmodf(yaw + gf_PI, gf_PI2);
+		return (yaw < 0.f ? yaw + gf_PI2 : yaw) - gf_PI;
+	}
+
+	template<typename T>
+	void SwapRemove(std::vector<T>& values, uint32 index)
+	{
+		values[index] = values.back();
+		values.pop_back();
+	}
+}
+
+void CPlayerSystem::RegisterConsoleCommands()
+{
+	REGISTER_CVAR2("g_playerKernelPath", &g_playerKernelPath, -1, VF_CHEAT, "Player update kernels: -1 = fastest supported, 0 = scalar, 1 = SSE2, 2 = AVX2");
+	REGISTER_CVAR2("g_playerTickRate", &g_playerTickRate, 60, VF_NULL, "Fixed player simulation rate in Hz");
+	REGISTER_CVAR2("g_playerMaxTicksPerFrame", &g_playerMaxTicksPerFrame, 4, VF_NULL, "Maximum number of player simulation ticks per frame, time beyond that is dropped so slow clients don't fall further behind");
+	REGISTER_CVAR2("g_playerLagCompensationMaxRewind", &g_playerLagCompensationMaxRewind, 0.5f, VF_NULL, "Maximum time (s) hit checks are rewound to compensate for client latency");
+	REGISTER_CVAR2("g_playerInputTimestamps", &g_playerInputTimestamps, 1, VF_NULL, "1 = input is handed to the tick covering the time it arrived, 0 = all input queued during a frame goes to its first tick");
+	REGISTER_CVAR2("g_playerStateSnapshots", &g_playerStateSnapshots, 1, VF_NULL, "1 = the server sends every client a delta encoded snapshot of all players per tick, 0 = player state goes through the movement, stance and view entity aspects, each only sent when it changed");
+	REGISTER_CVAR2("g_playerInterestManagement", &g_playerInterestManagement, 1, VF_NULL, "1 = snapshots only contain the players relevant to the client, by the Scheduler.xml 'player' group, 0 = every player");
+	REGISTER_CVAR2("g_playerSnapshotFragments", &g_playerSnapshotFragments, 1, VF_NULL, "1 = each player is encoded once per tick and baseline and shared by all snapshots, 0 = encoded for every client");
+	REGISTER_COMMAND("g_playerSnapshotStats", PlayerSnapshotStatsCommand, VF_NULL, "Prints how many player snapshot entries the last tick encoded and how many it shared between clients");
+	REGISTER_COMMAND("g_playerKernelsSelfTest", PlayerKernelsSelfTestCommand, VF_NULL, "Compares the vector player kernels bit by bit against the scalar ones. Usage: g_playerKernelsSelfTest [playerCount] [seed]");
+	REGISTER_COMMAND("g_playerStateCodecBenchmark", PlayerStateCodecBenchmarkCommand, VF_NULL, "Measures encode and decode time and size of the player state wire format. Usage: g_playerStateCodecBenchmark [playerCount] [ticks] [seed]");
+
+	CPlayerPrediction::RegisterConsoleCommands();
+	CSnapshotJitterBuffer::RegisterConsoleCommands();
+	CPhysicsQueryService::RegisterConsoleCommands();
+	CInterestManager::RegisterConsoleCommands();
+	CNetTelemetry::RegisterConsoleCommands();
+	CPlayerStateRecorder::RegisterConsoleCommands();
+}
+
+void CPlayerSystem::UnregisterConsoleCommands()
+{
+	if (gEnv->pConsole)
+	{
+		gEnv->pConsole->UnregisterVariable("g_playerKernelPath", true);
+		gEnv->pConsole->UnregisterVariable("g_playerTickRate", true);
+		gEnv->pConsole->UnregisterVariable("g_playerMaxTicksPerFrame", true);
+		gEnv->pConsole->UnregisterVariable("g_playerLagCompensationMaxRewind", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInputTimestamps", true);
+		gEnv->pConsole->UnregisterVariable("g_playerStateSnapshots", true);
+		gEnv->pConsole->UnregisterVariable("g_playerInterestManagement", true);
+		gEnv->pConsole->UnregisterVariable("g_playerSnapshotFragments", true);
+		gEnv->pConsole->RemoveCommand("g_playerSnapshotStats");
+		gEnv->pConsole->RemoveCommand("g_playerKernelsSelfTest");
+		gEnv->pConsole->RemoveCommand("g_playerStateCodecBenchmark");
+	}
+
+	CPlayerPrediction::UnregisterConsoleCommands();
+	CSnapshotJitterBuffer::UnregisterConsoleCommands();
+	CPhysicsQueryService::UnregisterConsoleCommands();
+	CInterestManager::UnregisterConsoleCommands();
+	CNetTelemetry::UnregisterConsoleCommands();
+	CPlayerStateRecorder::UnregisterConsoleCommands();
+}
+
+PlayerKernels::EPath CPlayerSystem::GetKernelPath() const
+{
+	// Never pick a path the CPU can't run, even if the cvar asks for it
+	const PlayerKernels::EPath bestPath = PlayerKernels::GetBestPath();
+	if (g_playerKernelPath < 0 || g_playerKernelPath > static_cast<int>(bestPath))
+		return bestPath;
+
+	return static_cast<PlayerKernels::EPath>(g_playerKernelPath);
+}
+
+float CPlayerSystem::GetTickTime() const
+{
+	return 1.f / static_cast<float>(std::max(g_playerTickRate, 1));
+}
+
+TPlayerHandle CPlayerSystem::Register(CPlayerComponent* pComponent)
+{
+	TPlayerHandle handle;
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		handle = static_cast<TPlayerHandle>(m_handleToIndex.size());
+		m_handleToIndex.push_back(0);
+	}
+
+	m_handleToIndex[handle] = static_cast<uint32>(m_components.size());
+	m_indexToHandle.push_back(handle);
+	m_components.push_back(pComponent);
+
+	m_moveX.push_back(0.f);
+	m_moveY.push_back(0.f);
+	m_mouseX.push_back(0.f);
+	m_mouseY.push_back(0.f);
+	m_yaw.push_back(0.f);
+	m_pitch.push_back(0.f);
+	m_previousYaw.push_back(0.f);
+	m_previousPitch.push_back(0.f);
+	m_speed.push_back(0.f);
+	m_velocityX.push_back(0.f);
+	m_velocityY.push_back(0.f);
+	m_state.push_back(static_cast<uint8>(EPlayerState::Walking));
+	m_stance.push_back(static_cast<uint8>(EPlayerStance::Standing));
+	m_desiredStance.push_back(static_cast<uint8>(EPlayerStance::Standing));
+	m_jumpRequested.push_back(0);
+	m_role.push_back(static_cast<uint8>(EPlayerNetRole::Authority));
+	m_netState.emplace_back();
+	m_interestHandle.push_back(m_interest.Add(handle, "Player", pComponent->GetEntity()->GetWorldPos()));
+
+	m_walkSpeed.push_back(0.f);
+	m_sprintSpeed.push_back(0.f);
+	m_rotationSpeed.push_back(0.f);
+	m_pitchMin.push_back(0.f);
+	m_pitchMax.push_back(0.f);
+	m_capsuleRadius.push_back(0.f);
+	m_capsuleHeightStanding.push_back(0.f);
+	m_capsuleHeightCrouch.push_back(0.f);
+	m_capsuleGroundOffset.push_back(0.f);
+
+	// Only reallocates when the player count outgrows it, so recording stays allocation free
+	m_lagCompensation.Reserve(static_cast<uint32>(m_components.size()));
+
+	return handle;
+}
+
+void CPlayerSystem::Unregister(TPlayerHandle handle)
+{
+	if (handle >= m_handleToIndex.size())
+		return;
+
+	// Queries still running may refer to the player's physical entity
+	m_physicsQueries.Flush();
+
+	// The handle may be reused before the queued input is consumed
+	const auto forgetHandle = [handle](SPlayerInputEvent& event)
+	{
+		if (event.handle == handle)
+		{
+			event.handle = INVALID_PLAYER_HANDLE;
+		}
+	};
+	m_inputBuffer.ForEachQueued(forgetHandle);
+	std::for_each(m_injectedInput.begin(), m_injectedInput.end(), forgetHandle);
+
+	const uint32 index = m_handleToIndex[handle];
+	const TPlayerHandle movedHandle = m_indexToHandle.back();
+
+	SwapRemove(m_indexToHandle, index);
+	SwapRemove(m_components, index);
+
+	SwapRemove(m_moveX, index);
+	SwapRemove(m_moveY, index);
+	SwapRemove(m_mouseX, index);
+	SwapRemove(m_mouseY, index);
+	SwapRemove(m_yaw, index);
+	SwapRemove(m_pitch, index);
+	SwapRemove(m_previousYaw, index);
+	SwapRemove(m_previousPitch, index);
+	SwapRemove(m_speed, index);
+	SwapRemove(m_velocityX, index);
+	SwapRemove(m_velocityY, index);
+	SwapRemove(m_state, index);
+	SwapRemove(m_stance, index);
+	SwapRemove(m_desiredStance, index);
+	SwapRemove(m_jumpRequested, index);
+	SwapRemove(m_role, index);
+	SwapRemove(m_netState, index);
+	m_interest.Remove(m_interestHandle[index]);
+	SwapRemove(m_interestHandle, index);
+
+	SwapRemove(m_walkSpeed, index);
+	SwapRemove(m_sprintSpeed, index);
+	SwapRemove(m_rotationSpeed, index);
+	SwapRemove(m_pitchMin, index);
+	SwapRemove(m_pitchMax, index);
+	SwapRemove(m_capsuleRadius, index);
+	SwapRemove(m_capsuleHeightStanding, index);
+	SwapRemove(m_capsuleHeightCrouch, index);
+	SwapRemove(m_capsuleGroundOffset, index);
+
+	m_handleToIndex[movedHandle] = index;
+	m_freeHandles.push_back(handle);
+}
+
+void CPlayerSystem::ResetPlayer(TPlayerHandle handle, float fYaw, const SPlayerTuning& tuning)
+{
+	const uint32 index = ToIndex(handle);
+
+	m_moveX[index] = 0.f;
+	m_moveY[index] = 0.f;
+	m_mouseX[index] = 0.f;
+	m_mouseY[index] = 0.f;
+	m_yaw[index] = fYaw;
+	m_pitch[index] = 0.f;
+	m_previousYaw[index] = fYaw;
+	m_previousPitch[index] = 0.f;
+	m_speed[index] = 0.f;
+	m_velocityX[index] = 0.f;
+	m_velocityY[index] = 0.f;
+	m_state[index] = static_cast<uint8>(EPlayerState::Walking);
+	m_stance[index] = static_cast<uint8>(EPlayerStance::Standing);
+	m_desiredStance[index] = static_cast<uint8>(EPlayerStance::Standing);
+	m_jumpRequested[index] = 0;
+
+	ResetNetState(index);
+
+	m_walkSpeed[index] = tuning.fWalkSpeed;
+	m_sprintSpeed[index] = tuning.fSprintSpeed;
+	m_rotationSpeed[index] = tuning.fRotationSpeed;
+	m_pitchMin[index] = tuning.fPitchMin;
+	m_pitchMax[index] = tuning.fPitchMax;
+	m_capsuleRadius[index] = tuning.fCapsuleRadius;
+	m_capsuleHeightStanding[index] = tuning.fCapsuleHeightStanding;
+	m_capsuleHeightCrouch[index] = tuning.fCapsuleHeightCrouch;
+	m_capsuleGroundOffset[index] = tuning.fCapsuleGroundOffset;
+}
+
+void CPlayerSystem::SetNetRole(TPlayerHandle handle, EPlayerNetRole role)
+{
+	const uint32 index = ToIndex(handle);
+	if (m_role[index] != static_cast<uint8>(role))
+	{
+		m_role[index] = static_cast<uint8>(role);
+		ResetNetState(index);
+	}
+}
+
+void CPlayerSystem::ResetNetState(uint32 index)
+{
+	// The sink belongs to whoever set it (the load test server), not to the player's current life or role
+	IPlayerSnapshotSink* const pSnapshotSink = m_netState[index].pSnapshotSink;
+	m_netState[index] = SPlayerNetState();
+	m_netState[index].pSnapshotSink = pSnapshotSink;
+}
+
+void CPlayerSystem::ReceiveCommands(TPlayerHandle handle, const SPlayerInputCommand* pCommands, uint32 count)
+{
+	const uint32 index = ToIndex(handle);
+	if (m_role[index] != static_cast<uint8>(EPlayerNetRole::RemoteOwned))
+		return;
+
+	// Every packet repeats the last few commands, only queue the ones not seen yet
+	SPlayerNetState& netState = m_netState[index];
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (static_cast<int32>(pCommands[i].sequence - netState.lastReceived) <= 0)
+			continue;
+
+		// A malformed command is skipped, the player holds the previous input for its tick as if it was lost
+		netState.lastReceived = pCommands[i].sequence;
+		if (!pCommands[i].IsFinite())
+			continue;
+
+		SPlayerInputCommand command = pCommands[i];
+		command.yaw = WrapYaw(command.yaw);
+		netState.receivedCommands.Push(command);
+	}
+}
+
+void CPlayerSystem::GetAuthoritativeState(TPlayerHandle handle, SPlayerAuthoritativeState& state) const
+{
+	const uint32 index = ToIndex(handle);
+
+	state.lastCommand = m_netState[index].command.sequence;
+	state.position = m_components[index]->GetEntity()->GetWorldPos();
+	state.yaw = m_yaw[index];
+	state.pitch = m_pitch[index];
+	state.state = m_state[index];
+	state.stance = m_stance[index];
+}
+
+void CPlayerSystem::SetAuthoritativeState(TPlayerHandle handle, const SPlayerAuthoritativeState& state)
+{
+	const uint32 index = ToIndex(handle);
+
+	switch (static_cast<EPlayerNetRole>(m_role[index]))
+	{
+	case EPlayerNetRole::Predicted:
+		m_netState[index].prediction.SetAuthoritativeState(state);
+		break;
+	case EPlayerNetRole::Proxy:
+		// Picked up by the next tick after it kept the current view as the previous one, so the view is interpolated towards it
+		m_netState[index].proxyState = state;
+		m_netState[index].bProxyStatePending = true;
+		break;
+	default:
+		break;
+	}
+}
+
+void CPlayerSystem::AcknowledgeSnapshot(TPlayerHandle handle, uint32 tick, uint32 parts)
+{
+	SPlayerNetState& netState = m_netState[ToIndex(handle)];
+
+	// Later parts of the acked tick may still come in and be acked by the next command
+	if (tick == netState.ackedSnapshot && tick != 0)
+	{
+		netState.ackedSnapshotParts |= parts;
+	}
+
+	// Acks arrive out of order and must not be ahead of what was actually sent
+	if (static_cast<int32>(tick - netState.ackedSnapshot) > 0 && static_cast<int32>(tick - m_tick) < 0)
+	{
+		netState.ackedSnapshot = tick;
+		netState.ackedSnapshotParts = parts;
+
+		// The ack rides on the client's next input, so this is the round trip plus up to a client frame
+		int64 sendTime;
+		uint32 groupMask;
+		if (m_telemetry.IsEnabled() && netState.sentPlayers.GetSendInfo(tick, sendTime, groupMask))
+		{
+			const int64 microseconds = (CryGetTicks() - sendTime) * 1000000 / CryGetTicksPerSec();
+			for (uint8 group = 0; groupMask != 0; ++group, groupMask >>= 1)
+			{
+				if (groupMask & 1)
+				{
+					m_telemetry.RecordLatency(group, m_telemetryClass, microseconds);
+				}
+			}
+		}
+	}
+}
+
+void CPlayerSystem::ReceiveSnapshot(const SPlayerSnapshotParams& params)
+{
+	// A part is only acked once every entry in it is stored, the server deltas against it for all of them
+	bool bComplete = true;
+
+	CBitReader reader(params.bytes, params.byteCount);
+	for (uint8 i = 0; i < params.count; ++i)
+	{
+		const IEntity* pEntity = gEnv->pEntitySystem->GetEntity(params.ids[i]);
+		const CPlayerComponent* pPlayer = pEntity != nullptr ? pEntity->GetComponent<CPlayerComponent>() : nullptr;
+		SPlayerNetState* pNetState = pPlayer != nullptr ? &m_netState[ToIndex(pPlayer->m_playerHandle)] : nullptr;
+
+		// Entries of unknown players are still decoded to get to the next one
+		const SQuantizedPlayerState* pBaseline = pNetState != nullptr && params.baselineTick != 0 ? pNetState->stateHistory.Find(params.baselineTick) : nullptr;
+		SQuantizedPlayerState quantized;
+		const bool bDecoded = PlayerStateCodec::Decode(pBaseline, reader, quantized);
+
+		if (reader.HasOverflowed())
+		{
+			CryLog("[PlayerSystem] Truncated player snapshot %u", params.tick);
+			return;
+		}
+
+		if (pNetState == nullptr || !bDecoded)
+		{
+			bComplete = false;
+			continue;
+		}
+
+		pNetState->stateHistory.Add(params.tick, quantized);
+
+		// Snapshots are unordered, an older one only serves as a baseline, unless it can still fill a gap in a proxy's playback
+		const bool bNewer = pNetState->appliedSnapshot == 0 || static_cast<int32>(params.tick - pNetState->appliedSnapshot) > 0;
+		const bool bBuffered = GetNetRole(pPlayer->m_playerHandle) == EPlayerNetRole::Proxy && CSnapshotJitterBuffer::IsEnabled();
+		if (!bNewer && !bBuffered)
+			continue;
+
+		SPlayerAuthoritativeState state;
+		PlayerStateCodec::Dequantize(quantized, state);
+
+		if (bBuffered)
+		{
+			pNetState->jitterBuffer.Add(params.tick, gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64(), state, GetTickTime());
+		}
+		else
+		{
+			SetAuthoritativeState(pPlayer->m_playerHandle, state);
+		}
+
+		if (bNewer)
+		{
+			pNetState->appliedSnapshot = params.tick;
+		}
+	}
+
+	if (!bComplete || params.part >= SPlayerSnapshotParams::MaxAckedParts)
+		return;
+
+	if (m_lastReceivedSnapshot == 0 || static_cast<int32>(params.tick - m_lastReceivedSnapshot) > 0)
+	{
+		m_lastReceivedSnapshot = params.tick;
+		m_lastReceivedSnapshotParts = 0;
+	}
+	if (params.tick == m_lastReceivedSnapshot)
+	{
+		m_lastReceivedSnapshotParts |= BIT(params.part);
+	}
+}
+
+void CPlayerSystem::QueueInput(TPlayerHandle handle, EPlayerAction action, int activationMode, float value)
+{
+	SPlayerInputEvent event;
+	event.time = CryGetTicks();
+	event.handle = handle;
+	event.action = action;
+	event.activationMode = static_cast<uint8>(activationMode);
+	event.value = value;
+	m_inputBuffer.Push(event);
+}
+
+void CPlayerSystem::InjectInput(TPlayerHandle handle, EPlayerAction action, int activationMode, float value)
+{
+	SPlayerInputEvent event;
+	event.time = CryGetTicks();
+	event.handle = handle;
+	event.action = action;
+	event.activationMode = static_cast<uint8>(activationMode);
+	event.value = value;
+	m_injectedInput.push_back(event);
+}
+
+void CPlayerSystem::ConsumeInput(int64 cutoffTime)
+{
+	while (SPlayerInputEvent* pEvent = m_inputBuffer.Peek())
+	{
+		if (pEvent->time > cutoffTime)
+			break;
+
+		if (pEvent->handle != INVALID_PLAYER_HANDLE)
+		{
+			m_components[ToIndex(pEvent->handle)]->DispatchAction(pEvent->action, pEvent->activationMode, pEvent->value);
+		}
+		m_inputBuffer.Pop();
+	}
+
+	// Injected actions are stamped on the main thread in order, so the ones due form a prefix
+	size_t injected = 0;
+	for (; injected < m_injectedInput.size() && m_injectedInput[injected].time <= cutoffTime; ++injected)
+	{
+		const SPlayerInputEvent event = m_injectedInput[injected];
+		if (event.handle != INVALID_PLAYER_HANDLE)
+		{
+			m_components[ToIndex(event.handle)]->DispatchAction(event.action, event.activationMode, event.value);
+		}
+	}
+	m_injectedInput.erase(m_injectedInput.begin(), m_injectedInput.begin() + injected);
+
+	const uint32 dropped = m_inputBuffer.GetDropped();
+	if (dropped != m_reportedInputDrops)
+	{
+		CryWarning(VALIDATOR_MODULE_GAME, VALIDATOR_WARNING, "[PlayerSystem] Input buffer full, %u input events dropped", dropped - m_reportedInputDrops);
+		m_reportedInputDrops = dropped;
+	}
+}
+
+void CPlayerSystem::Update(float fFrametime)
+{
+	m_telemetry.Update(fFrametime);
+
+	if (m_components.empty() || gEnv->IsEditing())
+	{
+		m_inputBuffer.Clear();
+		m_injectedInput.clear();
+		return;
+	}
+
+	const float fTickTime = GetTickTime();
+	const int maxTicks = std::max(g_playerMaxTicksPerFrame, 1);
+	const int64 now = CryGetTicks();
+	const float fTicksPerSecond = static_cast<float>(CryGetTicksPerSec());
+
+	m_fAccumulator += fFrametime;
+
+	int ticks = 0;
+	while (m_fAccumulator >= fTickTime && ticks < maxTicks)
+	{
+		// This tick simulates up to (accumulator - tick time) seconds before now, later input belongs to the next ones
+		const int64 cutoffTime = g_playerInputTimestamps != 0 ? now - static_cast<int64>((m_fAccumulator - fTickTime) * fTicksPerSecond) : now;
+		ConsumeInput(cutoffTime);
+
+		const CTimeValue tickStart = gEnv->pTimer->GetAsyncTime();
+		Tick();
+
+		if (!m_tickListeners.empty())
+		{
+			const int64 microseconds = (gEnv->pTimer->GetAsyncTime() - tickStart).GetMicroSecondsAsInt64();
+			for (IPlayerTickListener* pListener : m_tickListeners)
+			{
+				pListener->OnPlayerTick(m_tick - 1, microseconds);
+			}
+		}
+
+		m_fAccumulator -= fTickTime;
+		++ticks;
+	}
+
+	if (m_fAccumulator >= fTickTime)
+	{
+		// Frame took longer than maxTicks, keep only the fraction for interpolation instead of catching up next frame
+		m_fAccumulator = fmodf(m_fAccumulator, fTickTime);
+	}
+
+	InterpolateProxies(fFrametime);
+	ApplyViews(m_fAccumulator / fTickTime, fFrametime);
+}
+
+void CPlayerSystem::Tick()
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::Tick");
+
+	m_previousYaw = m_yaw;
+	m_previousPitch = m_pitch;
+
+	m_physicsQueries.BeginTick(m_tick);
+
+	ConsumeCommands();
+	ReconcilePredictions();
+	UpdateJumps();
+	UpdateStances();
+	UpdateMovement();
+	UpdateRotation();
+	UpdatePitch();
+	FinishCommands();
+
+	// The mouse deltas and jump requests have been applied by this tick
+	std::fill(m_mouseX.begin(), m_mouseX.end(), 0.f);
+	std::fill(m_mouseY.begin(), m_mouseY.end(), 0.f);
+	std::fill(m_jumpRequested.begin(), m_jumpRequested.end(), 0);
+
+	ApplyVelocities();
+
+	if (gEnv->bServer)
+	{
+		RecordHistory();
+
+		if (g_playerStateSnapshots != 0)
+		{
+			WriteSnapshots();
+		}
+		else
+		{
+			MarkDirtyAspects();
+		}
+	}
+
+	// Runs this tick's queries on the job system while the rest of the frame goes on
+	m_physicsQueries.EndTick();
+
+	++m_tick;
+}
+
+void CPlayerSystem::ConsumeCommands()
+{
+	// Players not driven by local input get theirs from the network, whatever the local action maps wrote is dropped
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const EPlayerNetRole role = static_cast<EPlayerNetRole>(m_role[i]);
+		if (role == EPlayerNetRole::RemoteOwned)
+		{
+			SPlayerNetState& netState = m_netState[i];
+			if (!netState.receivedCommands.IsEmpty())
+			{
+				netState.command = netState.receivedCommands.Get(0);
+				netState.receivedCommands.PopFront();
+			}
+			else
+			{
+				// Nothing arrived in time, keep the previous input held, the client corrects for the extra tick
+				netState.command.bJump = false;
+			}
+
+			// Commands come from the client, keep them within what local input could produce
+			const SPlayerInputCommand& command = netState.command;
+			m_moveX[i] = crymath::clamp(command.moveX, -1.f, 1.f);
+			m_moveY[i] = crymath::clamp(command.moveY, -1.f, 1.f);
+			m_mouseX[i] = 0.f;
+			m_mouseY[i] = 0.f;
+			m_state[i] = std::min(command.state, static_cast<uint8>(EPlayerState::Sprinting));
+			m_desiredStance[i] = std::min(command.desiredStance, static_cast<uint8>(EPlayerStance::Standing));
+			m_jumpRequested[i] = command.bJump ? 1 : 0;
+		}
+		else if (role == EPlayerNetRole::Proxy)
+		{
+			SPlayerNetState& netState = m_netState[i];
+			if (netState.bProxyStatePending)
+			{
+				netState.bProxyStatePending = false;
+				m_yaw[i] = netState.proxyState.yaw;
+				m_pitch[i] = netState.proxyState.pitch;
+				m_state[i] = std::min(netState.proxyState.state, static_cast<uint8>(EPlayerState::Sprinting));
+				m_desiredStance[i] = std::min(netState.proxyState.stance, static_cast<uint8>(EPlayerStance::Standing));
+			}
+
+			m_moveX[i] = 0.f;
+			m_moveY[i] = 0.f;
+			m_mouseX[i] = 0.f;
+			m_mouseY[i] = 0.f;
+			m_jumpRequested[i] = 0;
+		}
+	}
+}
+
+void CPlayerSystem::ReconcilePredictions()
+{
+	// Corrections go in before this tick's prediction so they are part of the state it builds on
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (m_role[i] != static_cast<uint8>(EPlayerNetRole::Predicted) || !m_netState[i].prediction.HasAuthoritativeState())
+			continue;
+
+		CPlayerPrediction::SCorrection correction;
+		if (!m_netState[i].prediction.Reconcile(correction))
+			continue;
+
+		if (!correction.offset.IsZero())
+		{
+			m_components[i]->ApplyPositionCorrection(correction.offset);
+		}
+		if (correction.bStance && correction.stance != m_stance[i])
+		{
+			// Takes the server's stance without the clearance check, UpdateStances then retries the stance the player wants like the server does
+			m_components[i]->ApplyStanceCorrection(static_cast<EPlayerStance>(std::min(correction.stance, static_cast<uint8>(EPlayerStance::Standing))));
+		}
+	}
+}
+
+void CPlayerSystem::UpdateJumps()
+{
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (m_jumpRequested[i] != 0)
+		{
+			m_components[i]->TryJump();
+		}
+	}
+}
+
+void CPlayerSystem::UpdateStances()
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::UpdateStances");
+
+	// Stance changes need a physics query, so only the players that asked for a new stance are visited
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (m_desiredStance[i] != m_stance[i])
+		{
+			m_components[i]->TryUpdateStance();
+		}
+	}
+}
+
+void CPlayerSystem::UpdateMovement()
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::UpdateMovement");
+
+	// Movement uses the yaw of the previous tick, same as reading the entity rotation before UpdateRotation
+	PlayerKernels::SMovementStreams streams;
+	streams.pMoveX = m_moveX.data();
+	streams.pMoveY = m_moveY.data();
+	streams.pYaw = m_yaw.data();
+	streams.pState = m_state.data();
+	streams.pWalkSpeed = m_walkSpeed.data();
+	streams.pSprintSpeed = m_sprintSpeed.data();
+	streams.pSpeed = m_speed.data();
+	streams.pVelocityX = m_velocityX.data();
+	streams.pVelocityY = m_velocityY.data();
+
+	PlayerKernels::IntegrateMovement(streams, static_cast<uint32>(m_components.size()), GetKernelPath());
+}
+
+void CPlayerSystem::UpdateRotation()
+{
+	PlayerKernels::IntegrateYaw(m_yaw.data(), m_mouseX.data(), m_rotationSpeed.data(), static_cast<uint32>(m_components.size()), GetKernelPath());
+}
+
+void CPlayerSystem::UpdatePitch()
+{
+	PlayerKernels::IntegratePitch(m_pitch.data(), m_mouseY.data(), m_rotationSpeed.data(), m_pitchMin.data(), m_pitchMax.data(), static_cast<uint32>(m_components.size()), GetKernelPath());
+}
+
+void CPlayerSystem::FinishCommands()
+{
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		SPlayerNetState& netState = m_netState[i];
+
+		switch (static_cast<EPlayerNetRole>(m_role[i]))
+		{
+		case EPlayerNetRole::RemoteOwned:
+			// The owning client is authoritative on where it looks, the server only enforces the pitch limits, the yaw was wrapped on arrival
+			m_yaw[i] = netState.command.yaw;
+			m_pitch[i] = crymath::clamp(netState.command.pitch, m_pitchMin[i], m_pitchMax[i]);
+			break;
+
+		case EPlayerNetRole::Predicted:
+		{
+			SPlayerInputCommand& command = netState.command;
+			command.sequence = netState.prediction.NextSequence();
+			command.moveX = m_moveX[i];
+			command.moveY = m_moveY[i];
+			command.yaw = m_yaw[i];
+			command.pitch = m_pitch[i];
+			command.state = m_state[i];
+			command.desiredStance = m_desiredStance[i];
+			command.bJump = m_jumpRequested[i] != 0;
+
+			netState.prediction.Record(command, m_components[i]->GetEntity()->GetWorldPos(), m_stance[i]);
+			m_components[i]->SendInputCommands(netState.prediction.GetHistory());
+		}
+		break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void CPlayerSystem::ApplyVelocities()
+{
+	// Velocity only changes on a tick, physics integrates it in between. Proxies move with the server's physics updates.
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (m_role[i] == static_cast<uint8>(EPlayerNetRole::Proxy))
+			continue;
+
+		m_components[i]->ApplyVelocity(Vec3(m_velocityX[i], m_velocityY[i], 0.f));
+	}
+}
+
+void CPlayerSystem::InterpolateProxies(float fFrametime)
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::InterpolateProxies");
+
+	// Proxies are rendered at the buffer's sample, the same yaw and pitch on both ends so ApplyViews doesn't blend again
+	const bool bBuffered = CSnapshotJitterBuffer::IsEnabled();
+	const int64 now = gEnv->pTimer->GetAsyncTime().GetMicroSecondsAsInt64();
+	const float fTickTime = GetTickTime();
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (m_role[i] != static_cast<uint8>(EPlayerNetRole::Proxy))
+			continue;
+
+		// Placed from the buffer, simulating the proxy too would fight the positions set here. Without the buffer the server's physics moves it.
+		m_components[i]->SetSimulated(!bBuffered);
+
+		SPlayerAuthoritativeState state;
+		if (!bBuffered || !m_netState[i].jitterBuffer.Sample(now, fFrametime, fTickTime, state))
+			continue;
+
+		m_yaw[i] = m_previousYaw[i] = state.yaw;
+		m_pitch[i] = m_previousPitch[i] = state.pitch;
+		m_state[i] = std::min(state.state, static_cast<uint8>(EPlayerState::Sprinting));
+		m_desiredStance[i] = std::min(state.stance, static_cast<uint8>(EPlayerStance::Standing));
+
+		m_components[i]->ApplyInterpolatedPosition(state.position);
+	}
+}
+
+void CPlayerSystem::ApplyViews(float fAlpha, float fFrametime)
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::ApplyViews");
+
+	// Render the view between the last two ticks so rotation stays smooth at any frame rate
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		float yawDelta = m_yaw[i] - m_previousYaw[i];
+		yawDelta = yawDelta > gf_PI ? yawDelta - gf_PI2 : yawDelta;
+		yawDelta = yawDelta < -gf_PI ? yawDelta + gf_PI2 : yawDelta;
+
+		const float yaw = m_previousYaw[i] + yawDelta * fAlpha;
+		const float pitch = m_previousPitch[i] + (m_pitch[i] - m_previousPitch[i]) * fAlpha;
+
+		m_components[i]->ApplyView(yaw, pitch, fFrametime);
+	}
+}
+
+void CPlayerSystem::RecordHistory()
+{
+	// Same capsule TryUpdateStance tests against, using the stance the player is in now
+	m_lagCompensation.BeginFrame(m_tick);
+
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const Vec3 position = m_components[i]->GetEntity()->GetWorldPos();
+		const float height = m_stance[i] == static_cast<uint8>(EPlayerStance::Standing) ? m_capsuleHeightStanding[i] : m_capsuleHeightCrouch[i];
+		const float centerZ = position.z + m_capsuleGroundOffset[i] + m_capsuleRadius[i] + height * 0.5f;
+
+		CLagCompensationHistory::SCapsule capsule;
+		capsule.x = position.x;
+		capsule.y = position.y;
+		capsule.zBottom = centerZ - height * 0.5f;
+		capsule.zTop = centerZ + height * 0.5f;
+		capsule.radius = m_capsuleRadius[i];
+
+		m_lagCompensation.AddCapsule(m_indexToHandle[i], capsule);
+
+		if (m_stateRecorder.IsRecording())
+		{
+			m_stateRecorder.Record(m_tick, m_components[i]->GetEntityId(), position, m_components[i]->GetVelocity());
+		}
+	}
+}
+
+void CPlayerSystem::WriteSnapshots()
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::WriteSnapshots");
+
+	const uint32 count = static_cast<uint32>(m_components.size());
+	m_viewers.clear();
+	m_viewerIndices.clear();
+
+	for (uint32 i = 0; i < count; ++i)
+	{
+		SPlayerAuthoritativeState state;
+		GetAuthoritativeState(m_indexToHandle[i], state);
+		m_netState[i].stateHistory.Add(m_tick, PlayerStateCodec::Quantize(state));
+		m_interest.SetPosition(m_interestHandle[i], state.position);
+
+		if (m_role[i] == static_cast<uint8>(EPlayerNetRole::RemoteOwned) || m_netState[i].pSnapshotSink != nullptr)
+		{
+			m_viewers.push_back({ state.position, m_yaw[i], m_interestHandle[i] });
+			m_viewerIndices.push_back(i);
+		}
+	}
+
+	const bool bInterestManagement = g_playerInterestManagement != 0;
+	if (bInterestManagement)
+	{
+		m_interest.Update(m_viewers.data(), static_cast<uint32>(m_viewers.size()));
+	}
+
+	const bool bShareFragments = g_playerSnapshotFragments != 0;
+	const bool bTelemetry = m_telemetry.IsEnabled();
+	const int64 sendTime = CryGetTicks();
+	m_snapshotFragments.Begin(bShareFragments ? count : 0);
+
+	// One snapshot per client, carried by the RMI of the client's own player
+	for (uint32 viewer = 0; viewer < m_viewerIndices.size(); ++viewer)
+	{
+		const uint32 client = m_viewerIndices[viewer];
+		SPlayerNetState& clientState = m_netState[client];
+
+		// Older acks than the history reaches fall back to full states
+		const uint32 ackedTick = clientState.ackedSnapshot;
+		const bool bDelta = ackedTick != 0 && m_tick - ackedTick < CPlayerStateHistory::Length;
+
+		SPlayerSnapshotParams params;
+		uint8 groups[SPlayerSnapshotParams::MaxEntries];
+		params.tick = m_tick;
+		params.baselineTick = bDelta ? ackedTick : 0;
+		CBitWriter writer(params.bytes, SPlayerSnapshotParams::MaxBytes);
+		clientState.sentPlayers.Begin(m_tick, sendTime);
+
+		const uint32 entryCount = bInterestManagement ? m_interest.GetRelevantCount(viewer) : count;
+		const CInterestManager::SRelevantEntity* pRelevant = bInterestManagement ? m_interest.GetRelevant(viewer) : nullptr;
+
+		for (uint32 entry = 0; entry < entryCount; ++entry)
+		{
+			if (params.count == SPlayerSnapshotParams::MaxEntries || writer.GetByteCount() + PlayerStateCodec::MaxEntryBytes > SPlayerSnapshotParams::MaxBytes)
+			{
+				writer.Flush();
+				params.byteCount = static_cast<uint16>(writer.GetByteCount());
+				SendSnapshot(client, params, groups);
+
+				params.count = 0;
+				++params.part;
+				writer = CBitWriter(params.bytes, SPlayerSnapshotParams::MaxBytes);
+			}
+
+			const TPlayerHandle handle = pRelevant != nullptr ? pRelevant[entry].userId : m_indexToHandle[entry];
+			const uint32 i = ToIndex(handle);
+
+			// The client only has a baseline for players that were in the parts of the snapshot it acked
+			const CPlayerStateHistory& history = m_netState[i].stateHistory;
+			const bool bHasBaseline = bDelta && clientState.sentPlayers.Contains(ackedTick, handle, clientState.ackedSnapshotParts);
+			const SQuantizedPlayerState* pBaseline = bHasBaseline ? history.Find(ackedTick) : nullptr;
+			const SQuantizedPlayerState& current = *history.Find(m_tick);
+			const uint8 group = i == client ? m_interest.GetOwnGroup() : m_interest.GetGroup(m_interestHandle[i]);
+			const uint32 bitsBefore = writer.GetBitCount();
+			if (bShareFragments)
+			{
+				m_snapshotFragments.Append(i, bHasBaseline ? ackedTick : 0, writer, [pBaseline, &current](CBitWriter& fragmentWriter)
+				{
+					PlayerStateCodec::Encode(pBaseline, current, fragmentWriter);
+				});
+			}
+			else
+			{
+				PlayerStateCodec::Encode(pBaseline, current, writer);
+			}
+
+			if (bTelemetry)
+			{
+				m_telemetry.RecordMessage(group, m_telemetryClass, writer.GetBitCount() - bitsBefore);
+			}
+
+			groups[params.count] = group;
+			params.ids[params.count++] = m_components[i]->GetEntityId();
+			clientState.sentPlayers.Add(handle, group, params.part);
+		}
+
+		clientState.sentPlayers.End();
+
+		writer.Flush();
+		params.byteCount = static_cast<uint16>(writer.GetByteCount());
+		SendSnapshot(client, params, groups);
+	}
+}
+
+void CPlayerSystem::SendSnapshot(uint32 client, const SPlayerSnapshotParams& params, const uint8* pGroups)
+{
+	if (IPlayerSnapshotSink* pSink = m_netState[client].pSnapshotSink)
+	{
+		pSink->SendSnapshot(m_indexToHandle[client], params, pGroups);
+	}
+	else
+	{
+		m_components[client]->SendSnapshot(params);
+	}
+}
+
+void CPlayerSystem::MarkDirtyAspects()
+{
+	HOTPATH_PROFILE_SCOPE("CPlayerSystem::MarkDirtyAspects");
+
+	// Compared after quantization, changes too small to show up on the client don't cost anything
+	const uint32 count = static_cast<uint32>(m_components.size());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		SPlayerAuthoritativeState state;
+		GetAuthoritativeState(m_indexToHandle[i], state);
+		const SQuantizedPlayerState quantized = PlayerStateCodec::Quantize(state);
+
+		// Only the fields of the aspects marked are taken over, the others keep comparing against what was sent
+		SPlayerNetState& netState = m_netState[i];
+		SQuantizedPlayerState& sent = netState.aspectState;
+		NetworkAspectType dirty = 0;
+
+		const bool bMoved = quantized.position[0] != sent.position[0] || quantized.position[1] != sent.position[1] || quantized.position[2] != sent.position[2] || quantized.state != sent.state;
+		// An idle client keeps sending commands, they are acked now and then so its prediction history doesn't fill up
+		const bool bAckDue = quantized.lastCommand != sent.lastCommand && m_tick - netState.aspectMovementTick >= IdleCommandAckInterval;
+		if (bMoved || bAckDue)
+		{
+			dirty |= CPlayerComponent::PLAYER_MOVEMENT_ASPECT;
+			netState.aspectMovementTick = m_tick;
+			sent.lastCommand = quantized.lastCommand;
+			std::copy(std::begin(quantized.position), std::end(quantized.position), sent.position);
+			sent.state = quantized.state;
+		}
+		if (quantized.stance != sent.stance)
+		{
+			dirty |= CPlayerComponent::PLAYER_STANCE_ASPECT;
+			sent.stance = quantized.stance;
+		}
+		if (quantized.yaw != sent.yaw || quantized.pitch != sent.pitch)
+		{
+			dirty |= CPlayerComponent::PLAYER_VIEW_ASPECT;
+			sent.yaw = quantized.yaw;
+			sent.pitch = quantized.pitch;
+		}
+
+		if (dirty != 0)
+		{
+			m_components[i]->MarkAspectsDirty(dirty);
+
+			if (m_telemetry.IsEnabled())
+			{
+				RecordAspectTelemetry(i, dirty);
+			}
+		}
+	}
+}
+
+void CPlayerSystem::RecordAspectTelemetry(uint32 index, NetworkAspectType aspects)
+{
+	// Sizes by the policies the aspects serialize with: 'ui32' + 'lwld' + 'ui2', 'ui2', two 'ui16'
+	static constexpr uint32 MovementBits = 32 + 27 + 27 + 18 + 2;
+	static constexpr uint32 StanceBits = 2;
+	static constexpr uint32 ViewBits = 16 + 16;
+
+	const uint8 group = m_interest.GetGroup(m_interestHandle[index]);
+	if (aspects & CPlayerComponent::PLAYER_MOVEMENT_ASPECT)
+	{
+		m_telemetry.RecordMessage(group, m_telemetryClass, MovementBits);
+	}
+	if (aspects & CPlayerComponent::PLAYER_STANCE_ASPECT)
+	{
+		m_telemetry.RecordMessage(group, m_telemetryClass, StanceBits);
+	}
+	if (aspects & CPlayerComponent::PLAYER_VIEW_ASPECT)
+	{
+		m_telemetry.RecordMessage(group, m_telemetryClass, ViewBits);
+	}
+}
+
+void CPlayerSystem::LogSnapshotStats() const
+{
+	const uint32 encoded = m_snapshotFragments.GetEncodedCount();
+	const uint32 reused = m_snapshotFragments.GetReusedCount();
+	CryLogAlways("[PlayerSystem] Last snapshot tick: %u entries encoded, %u reused (%.1f sends per encode), %u bytes of shared fragments",
+		encoded, reused, encoded > 0 ? static_cast<float>(encoded + reused) / encoded : 0.f, m_snapshotFragments.GetByteCount());
+}
+
+uint32 CPlayerSystem::GetRewindTick(float fLatency) const
+{
+	const float fRewind = crymath::clamp(fLatency, 0.f, g_playerLagCompensationMaxRewind);
+	const uint32 ticks = static_cast<uint32>(fRewind / GetTickTime() + 0.5f);
+
+	const uint32 newestTick = m_lagCompensation.GetNewestTick();
+	const uint32 oldestTick = m_lagCompensation.GetOldestTick();
+	return ticks < newestTick - oldestTick ? newestTick - ticks : oldestTick;
+}
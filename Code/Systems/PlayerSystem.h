@@ -0,0 +1,285 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+#pragma once
+
+#include <vector>
+
+#include "PlayerKernels.h"
+#include "PhysicsQueryService.h"
+#include "PlayerInputBuffer.h"
+#include "Network/PlayerPrediction.h"
+#include "Network/LagCompensation.h"
+#include "Network/PlayerStateCodec.h"
+#include "Network/InterestManager.h"
+#include "Network/SnapshotFragmentCache.h"
+#include "Network/NetTelemetry.h"
+#include "Network/PlayerStateRecorder.h"
+#include "Network/SnapshotJitterBuffer.h"
+
+class CPlayerComponent;
+enum class EPlayerState;
+enum class EPlayerStance;
+
+typedef uint32 TPlayerHandle;
+static constexpr TPlayerHandle INVALID_PLAYER_HANDLE = ~0u;
+
+// Notified after every simulation tick with how long the tick took
+struct IPlayerTickListener
+{
+	virtual ~IPlayerTickListener() {}
+	virtual void OnPlayerTick(uint32 tick, int64 microseconds) = 0;
+};
+
+// Takes the snapshots of players whose client isn't connected through the engine, such as the loopback load test clients
+struct IPlayerSnapshotSink
+{
+	virtual ~IPlayerSnapshotSink() {}
+	// pGroups holds the Scheduler.xml group of every entry, as indices of CInterestManager::GetGroupName
+	virtual void SendSnapshot(TPlayerHandle viewer, const SPlayerSnapshotParams& params, const uint8* pGroups) = 0;
+};
+
+// Who drives the simulation of a player on this machine
+enum class EPlayerNetRole : uint8
+{
+	Authority,   // Simulated here from local input: single player, server host
+	RemoteOwned, // Server copy of a remote client's player, simulated from the commands that client sends
+	Predicted,   // Local player on a remote client, simulated ahead of the server and corrected by it
+	Proxy        // Another client's player, follows the server state
+};
+
+////////////////////////////////////////////////////////
+// Owns the per-tick state of every CPlayerComponent and
+// updates all players in one pass instead of one entity
+// update event per player.
+// The hot state is stored as structure-of-arrays so that
+// each step of the update only touches the fields it needs.
+// Simulation runs at a fixed tick rate, independent of the
+// render frame time; view rotation is interpolated between
+// the last two ticks when rendering.
+// In multiplayer the owning client predicts its player and
+// sends one input command per tick, the server simulates
+// the same commands and sends back the resulting state.
+// Every client gets one snapshot per tick of the players
+// relevant to it, most important first, delta encoded
+// against the last snapshot it acked.
+// Input actions are queued with their arrival time and
+// each tick consumes the ones that arrived before the
+// point in time it simulates up to.
+////////////////////////////////////////////////////////
+
+class CPlayerSystem
+{
+public:
+	// Tuning values copied out of the component on Reset, read by the update loops
+	struct SPlayerTuning
+	{
+		float fWalkSpeed;
+		float fSprintSpeed;
+		float fRotationSpeed;
+		float fPitchMin;
+		float fPitchMax;
+		float fCapsuleRadius;
+		float fCapsuleHeightStanding;
+		float fCapsuleHeightCrouch;
+		float fCapsuleGroundOffset;
+	};
+
+	void          RegisterConsoleCommands();
+	void          UnregisterConsoleCommands();
+
+	TPlayerHandle Register(CPlayerComponent* pComponent);
+	void          Unregister(TPlayerHandle handle);
+
+	void          ResetPlayer(TPlayerHandle handle, float fYaw, const SPlayerTuning& tuning);
+	void          SetNetRole(TPlayerHandle handle, EPlayerNetRole role);
+	EPlayerNetRole GetNetRole(TPlayerHandle handle) const { return static_cast<EPlayerNetRole>(m_role[ToIndex(handle)]); }
+
+	// Queues an action for the handlers of the player's component, called from the thread dispatching input
+	void          QueueInput(TPlayerHandle handle, EPlayerAction action, int activationMode, float value);
+	// Same for actions that don't come from the input system (bots, load test clients), main thread only.
+	// Kept out of the input buffer, hundreds of injected players would fill it and drop the local player's input.
+	void          InjectInput(TPlayerHandle handle, EPlayerAction action, int activationMode, float value);
+
+	// Input side, written by the action handlers of the component
+	void          SetMovementX(TPlayerHandle handle, float value) { m_moveX[ToIndex(handle)] = value; }
+	void          SetMovementY(TPlayerHandle handle, float value) { m_moveY[ToIndex(handle)] = value; }
+	// Mouse deltas add up until the next simulation tick consumes them
+	void          AddMouseDeltaX(TPlayerHandle handle, float value) { m_mouseX[ToIndex(handle)] += value; }
+	void          AddMouseDeltaY(TPlayerHandle handle, float value) { m_mouseY[ToIndex(handle)] += value; }
+	void          SetPlayerState(TPlayerHandle handle, EPlayerState state) { m_state[ToIndex(handle)] = static_cast<uint8>(state); }
+	void          SetDesiredStance(TPlayerHandle handle, EPlayerStance stance) { m_desiredStance[ToIndex(handle)] = static_cast<uint8>(stance); }
+	void          SetCurrentStance(TPlayerHandle handle, EPlayerStance stance) { m_stance[ToIndex(handle)] = static_cast<uint8>(stance); }
+	// Jumps are carried out on the next tick so they end up in that tick's input command
+	void          RequestJump(TPlayerHandle handle) { m_jumpRequested[ToIndex(handle)] = 1; }
+
+	// Network side, called from the RMI and NetSerialize of the component
+	void          ReceiveCommands(TPlayerHandle handle, const SPlayerInputCommand* pCommands, uint32 count);
+	void          GetAuthoritativeState(TPlayerHandle handle, SPlayerAuthoritativeState& state) const;
+	void          SetAuthoritativeState(TPlayerHandle handle, const SPlayerAuthoritativeState& state);
+	// Server: newest snapshot the client owning the player has received and which of its parts. Client: decodes and applies a snapshot.
+	void          AcknowledgeSnapshot(TPlayerHandle handle, uint32 tick, uint32 parts);
+	void          ReceiveSnapshot(const SPlayerSnapshotParams& params);
+	uint32        GetLastReceivedSnapshot() const { return m_lastReceivedSnapshot; }
+	uint32        GetLastReceivedSnapshotParts() const { return m_lastReceivedSnapshotParts; }
+	// Server: the player's snapshots go to pSink instead of its component's RMI, nullptr to stop
+	void          SetSnapshotSink(TPlayerHandle handle, IPlayerSnapshotSink* pSink) { m_netState[ToIndex(handle)].pSnapshotSink = pSink; }
+	// Client: player state assembled from the aspects received so far, while g_playerStateSnapshots is off
+	const SQuantizedPlayerState& GetReceivedAspectState(TPlayerHandle handle) const { return m_netState[ToIndex(handle)].aspectState; }
+	void          SetReceivedAspectState(TPlayerHandle handle, const SQuantizedPlayerState& state) { m_netState[ToIndex(handle)].aspectState = state; }
+
+	EPlayerState  GetPlayerState(TPlayerHandle handle) const { return static_cast<EPlayerState>(m_state[ToIndex(handle)]); }
+	EPlayerStance GetCurrentStance(TPlayerHandle handle) const { return static_cast<EPlayerStance>(m_stance[ToIndex(handle)]); }
+	EPlayerStance GetDesiredStance(TPlayerHandle handle) const { return static_cast<EPlayerStance>(m_desiredStance[ToIndex(handle)]); }
+	float         GetYaw(TPlayerHandle handle) const { return m_yaw[ToIndex(handle)]; }
+	float         GetPitch(TPlayerHandle handle) const { return m_pitch[ToIndex(handle)]; }
+	float         GetMovementSpeed(TPlayerHandle handle) const { return m_speed[ToIndex(handle)]; }
+
+	size_t        GetPlayerCount() const { return m_components.size(); }
+
+	// Index of the next simulation tick and its fixed duration
+	uint32        GetTick() const { return m_tick; }
+	float         GetTickTime() const;
+
+	void          AddTickListener(IPlayerTickListener* pListener) { stl::push_back_unique(m_tickListeners, pListener); }
+	void          RemoveTickListener(IPlayerTickListener* pListener) { stl::find_and_erase(m_tickListeners, pListener); }
+
+	// Advances the simulation by as many fixed ticks as fit into the frame time, then updates the view of every player
+	void          Update(float fFrametime);
+
+	// Physics queries issued during a tick are answered on the next one
+	CPhysicsQueryService& GetPhysicsQueries() { return m_physicsQueries; }
+
+	// Capsules of the last ticks on the server, recorded ids are player handles
+	const CLagCompensationHistory& GetLagCompensation() const { return m_lagCompensation; }
+	// Tick a client with the given latency was looking at, clamped to the recorded history
+	uint32        GetRewindTick(float fLatency) const;
+
+	// Decides which players go into each client's snapshot
+	CInterestManager& GetInterestManager() { return m_interest; }
+
+	// Replicated bits and ack latency per Scheduler.xml group
+	CNetTelemetry& GetNetTelemetry() { return m_telemetry; }
+
+	// Authoritative states for tuning the compression policies offline
+	CPlayerStateRecorder& GetStateRecorder() { return m_stateRecorder; }
+
+	// Logs how many snapshot entries the last tick encoded and how many it reused
+	void          LogSnapshotStats() const;
+
+private:
+	uint32        ToIndex(TPlayerHandle handle) const { return m_handleToIndex[handle]; }
+	PlayerKernels::EPath GetKernelPath() const;
+
+	void          ConsumeInput(int64 cutoffTime);
+	void          ResetNetState(uint32 index);
+	void          Tick();
+	void          ConsumeCommands();
+	void          ReconcilePredictions();
+	void          UpdateJumps();
+	void          UpdateStances();
+	void          UpdateMovement();
+	void          UpdateRotation();
+	void          UpdatePitch();
+	void          FinishCommands();
+	void          ApplyVelocities();
+	void          InterpolateProxies(float fFrametime);
+	void          ApplyViews(float fAlpha, float fFrametime);
+	void          RecordHistory();
+	void          WriteSnapshots();
+	void          SendSnapshot(uint32 client, const SPlayerSnapshotParams& params, const uint8* pGroups);
+	void          MarkDirtyAspects();
+	void          RecordAspectTelemetry(uint32 index, NetworkAspectType aspects);
+
+private:
+	// Per player networking state, only used by the RemoteOwned and Predicted roles
+	struct SPlayerNetState
+	{
+		CPlayerPrediction    prediction;       // Predicted: commands not yet acked by the server
+		CPlayerCommandBuffer receivedCommands; // RemoteOwned: commands waiting for their tick
+		uint32               lastReceived = 0;
+		SPlayerInputCommand  command;          // Command simulated by the current tick
+
+		// Server: quantized states sent in the last snapshots. Client: the ones received, the baselines of the next deltas
+		CPlayerStateHistory  stateHistory;
+		CSnapshotContentsHistory sentPlayers;     // RemoteOwned: handles of the players in the snapshots sent to the owning client
+		uint32               ackedSnapshot = 0;   // RemoteOwned: newest snapshot tick the owning client received
+		uint32               ackedSnapshotParts = 0; // RemoteOwned: bit per part of that snapshot the client stored
+		IPlayerSnapshotSink* pSnapshotSink = nullptr; // Server: takes the snapshots of a client not connected through the engine
+		uint32               appliedSnapshot = 0; // Client: snapshot tick of the state last applied
+		CSnapshotJitterBuffer jitterBuffer;       // Proxy: received snapshots, rendered a delay behind the server
+		SPlayerAuthoritativeState proxyState;     // Proxy: state received without the jitter buffer, applied by the next tick
+		bool                 bProxyStatePending = false;
+
+		// Server: state the aspects were last marked dirty with. Client: state assembled from the received aspects.
+		SQuantizedPlayerState aspectState;
+		uint32               aspectMovementTick = 0; // Server: tick the movement aspect was last marked dirty
+	};
+
+	// Sparse handle -> dense index lookup, dense arrays are kept packed with swap-and-pop
+	std::vector<uint32>            m_handleToIndex;
+	std::vector<TPlayerHandle>     m_indexToHandle;
+	std::vector<TPlayerHandle>     m_freeHandles;
+
+	std::vector<IPlayerTickListener*> m_tickListeners;
+
+	// Simulation time not yet consumed by a tick
+	float                          m_fAccumulator = 0.f;
+	uint32                         m_tick = 0;
+
+	// Client: server tick of the newest snapshot received and a bit per part of it stored completely, echoed back as the ack
+	uint32                         m_lastReceivedSnapshot = 0;
+	uint32                         m_lastReceivedSnapshotParts = 0;
+
+	std::vector<CPlayerComponent*> m_components;
+
+	// Hot state, one entry per player
+	std::vector<float>             m_moveX;
+	std::vector<float>             m_moveY;
+	std::vector<float>             m_mouseX;
+	std::vector<float>             m_mouseY;
+	std::vector<float>             m_yaw;
+	std::vector<float>             m_pitch;
+	std::vector<float>             m_previousYaw;
+	std::vector<float>             m_previousPitch;
+	std::vector<float>             m_speed;
+	std::vector<float>             m_velocityX;
+	std::vector<float>             m_velocityY;
+	std::vector<uint8>             m_state;
+	std::vector<uint8>             m_stance;
+	std::vector<uint8>             m_desiredStance;
+	std::vector<uint8>             m_jumpRequested;
+	std::vector<uint8>             m_role;
+
+	// Cold networking state, one entry per player
+	std::vector<SPlayerNetState>   m_netState;
+	std::vector<TInterestHandle>   m_interestHandle;
+
+	// Tuning, one entry per player
+	std::vector<float>             m_walkSpeed;
+	std::vector<float>             m_sprintSpeed;
+	std::vector<float>             m_rotationSpeed;
+	std::vector<float>             m_pitchMin;
+	std::vector<float>             m_pitchMax;
+	std::vector<float>             m_capsuleRadius;
+	std::vector<float>             m_capsuleHeightStanding;
+	std::vector<float>             m_capsuleHeightCrouch;
+	std::vector<float>             m_capsuleGroundOffset;
+
+	// Input actions waiting for their tick
+	CPlayerInputBuffer             m_inputBuffer;
+	uint32                         m_reportedInputDrops = 0;
+	std::vector<SPlayerInputEvent> m_injectedInput; // Oldest first, unbounded
+
+	// Clients the server writes snapshots for this tick, reused every tick
+	std::vector<CInterestManager::SViewer> m_viewers;
+	std::vector<uint32>            m_viewerIndices;
+	CInterestManager               m_interest;
+	CNetTelemetry                  m_telemetry { m_interest };
+	const uint8                    m_telemetryClass = m_telemetry.RegisterClass("Player");
+	CPlayerStateRecorder           m_stateRecorder;
+
+	// Player entries encoded this tick, shared by all snapshots
+	CSnapshotFragmentCache         m_snapshotFragments { PlayerStateCodec::MaxEntryBytes };
+
+	CLagCompensationHistory        m_lagCompensation;
+	CPhysicsQueryService           m_physicsQueries;
+};
@@ -0,0 +1,905 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Sizes the player position and velocity compression
+// policies from a recording of real play, instead of the
+// hand set 27/27/18 bits of 'wrld' / 'lwld':
+//  - per axis the smallest QuantizedVec3 range and bit
+//    count that keep the quantization error under the
+//    bound, checked against every recorded sample
+//  - the entropy of the quantized values, of their tick
+//    to tick deltas and of the positions extrapolated
+//    with the previous velocity
+//  - an adaptive delta model, residuals length coded with
+//    a range coder, tuned and round trip checked on the
+//    recording. It is lossless on the quantized values,
+//    so the error bound holds for it as well.
+// Writes the policies into a copy of CompressionPolicy.xml
+// and prints the size / error report:
+//   g_playerStateRecord start       (on the server, play, then stop)
+//   CompressionTuner --input players.psr --base Assets/Scripts/network/CompressionPolicy.xml
+// Built without the engine.
+////////////////////////////////////////////////////////
+
+#include "../../Network/PlayerStateRecording.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	enum EField : uint32_t
+	{
+		eField_PositionX,
+		eField_PositionY,
+		eField_PositionZ,
+		eField_VelocityX,
+		eField_VelocityY,
+		eField_VelocityZ,
+		eField_Count
+	};
+
+	const char* const s_fieldNames[eField_Count] = { "position x", "position y", "position z", "velocity x", "velocity y", "velocity z" };
+
+	bool IsPosition(uint32_t field) { return field < eField_VelocityX; }
+
+	enum EPredictor : uint32_t
+	{
+		ePredictor_Raw,         // Every value on its own
+		ePredictor_Delta,       // Against the previous tick
+		ePredictor_Extrapolate, // Previous tick moved by its velocity, positions only
+		ePredictor_Count
+	};
+
+	const char* const s_predictorNames[ePredictor_Count] = { "raw", "delta", "extrapolated" };
+
+	struct SOptions
+	{
+		std::string input;
+		std::string base;                              // CompressionPolicy.xml the policies are merged into
+		std::string policyOut = "CompressionPolicy.tuned.xml";
+		std::string reportOut;                         // Also printed to stdout
+		std::string positionPolicy = "plps";
+		std::string velocityPolicy = "plvl";
+		float       positionError = 0.005f;            // Meters
+		float       velocityError = 0.02f;             // Meters per second
+		float       margin = 0.1f;                     // Of the recorded extent, added on both sides of the ranges
+	};
+
+	// Same mapping as the engine's QuantizedVec3 and PlayerStateCodec, in float so its precision limits show up
+	struct SQuantizer
+	{
+		float    min = 0.f;
+		float    max = 1.f;
+		uint32_t bits = 1;
+
+		uint32_t MaxQuantized() const { return bits >= 32 ? 0xffffffffu : (1u << bits) - 1; }
+
+		uint32_t Quantize(float value) const
+		{
+			const float normalized = std::min(std::max((value - min) / (max - min), 0.f), 1.f);
+			return static_cast<uint32_t>(normalized * static_cast<float>(MaxQuantized()) + 0.5f);
+		}
+
+		float Dequantize(uint32_t quantized) const
+		{
+			return min + static_cast<float>(quantized) * (max - min) / static_cast<float>(MaxQuantized());
+		}
+
+		double Step() const { return (static_cast<double>(max) - min) / MaxQuantized(); }
+	};
+
+	struct SFieldResult
+	{
+		SQuantizer quantizer;
+		float      recordedMin = 0.f;
+		float      recordedMax = 0.f;
+		double     maxError = 0.0;
+		double     rmsError = 0.0;
+		bool       bBoundReached = true;
+		double     entropy[ePredictor_Count] = {}; // Bits per sample, NAN where the predictor doesn't apply
+		double     estimatedBits[ePredictor_Count] = {}; // What the range coder would spend per sample, NAN where the predictor doesn't apply
+		EPredictor predictor = ePredictor_Raw;
+		double     codedBits = 0.0;                // Adaptive model cost over the recording
+	};
+
+	// Output goes to stdout and the report file
+	FILE* s_pReport = nullptr;
+
+	void Print(const char* szFormat, ...)
+	{
+		va_list args;
+		va_start(args, szFormat);
+		if (s_pReport != nullptr)
+		{
+			va_list copy;
+			va_copy(copy, args);
+			vfprintf(s_pReport, szFormat, copy);
+			va_end(copy);
+		}
+		vprintf(szFormat, args);
+		va_end(args);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Range coder, carry propagating as in LZMA, frequencies up to 16 bits
+
+	class CRangeEncoder
+	{
+	public:
+		void Encode(uint32_t cumulative, uint32_t frequency, uint32_t total)
+		{
+			m_range /= total;
+			m_low += static_cast<uint64_t>(cumulative) * m_range;
+			m_range *= frequency;
+			while (m_range < TopValue)
+			{
+				m_range <<= 8;
+				ShiftLow();
+			}
+		}
+
+		void EncodeBits(uint64_t value, uint32_t count)
+		{
+			for (uint32_t shift = 0; shift < count; shift += 16)
+			{
+				const uint32_t chunk = std::min(count - shift, 16u);
+				Encode(static_cast<uint32_t>(value >> shift) & ((1u << chunk) - 1), 1, 1u << chunk);
+			}
+		}
+
+		void Finish()
+		{
+			for (int i = 0; i < 5; ++i)
+			{
+				ShiftLow();
+			}
+		}
+
+		const std::vector<uint8_t>& GetBytes() const { return m_bytes; }
+
+	private:
+		static constexpr uint32_t TopValue = 1u << 24;
+
+		void ShiftLow()
+		{
+			if (static_cast<uint32_t>(m_low) < 0xff000000u || (m_low >> 32) != 0)
+			{
+				const uint8_t carry = static_cast<uint8_t>(m_low >> 32);
+				uint8_t pending = m_cache;
+				do
+				{
+					m_bytes.push_back(static_cast<uint8_t>(pending + carry));
+					pending = 0xff;
+				}
+				while (--m_cacheSize != 0);
+				m_cache = static_cast<uint8_t>(m_low >> 24);
+			}
+			++m_cacheSize;
+			m_low = (m_low & 0x00ffffff) << 8;
+		}
+
+	private:
+		std::vector<uint8_t> m_bytes;
+		uint64_t             m_low = 0;
+		uint32_t             m_range = 0xffffffffu;
+		uint8_t              m_cache = 0;
+		uint64_t             m_cacheSize = 1;
+	};
+
+	class CRangeDecoder
+	{
+	public:
+		explicit CRangeDecoder(const std::vector<uint8_t>& bytes) : m_bytes(bytes)
+		{
+			for (int i = 0; i < 5; ++i)
+			{
+				m_code = (m_code << 8) | NextByte();
+			}
+		}
+
+		uint32_t GetFrequency(uint32_t total)
+		{
+			m_range /= total;
+			return std::min(m_code / m_range, total - 1);
+		}
+
+		void Decode(uint32_t cumulative, uint32_t frequency)
+		{
+			m_code -= cumulative * m_range;
+			m_range *= frequency;
+			while (m_range < TopValue)
+			{
+				m_code = (m_code << 8) | NextByte();
+				m_range <<= 8;
+			}
+		}
+
+		uint64_t DecodeBits(uint32_t count)
+		{
+			uint64_t value = 0;
+			for (uint32_t shift = 0; shift < count; shift += 16)
+			{
+				const uint32_t chunk = std::min(count - shift, 16u);
+				const uint32_t bits = GetFrequency(1u << chunk);
+				Decode(bits, 1);
+				value |= static_cast<uint64_t>(bits) << shift;
+			}
+			return value;
+		}
+
+	private:
+		static constexpr uint32_t TopValue = 1u << 24;
+
+		uint8_t NextByte() { return m_position < m_bytes.size() ? m_bytes[m_position++] : 0; }
+
+	private:
+		const std::vector<uint8_t>& m_bytes;
+		size_t                      m_position = 0;
+		uint32_t                    m_code = 0;
+		uint32_t                    m_range = 0xffffffffu;
+	};
+
+	// Parameters of the adaptive residual model, what the tuner searches over
+	struct SModelParams
+	{
+		uint32_t increment = 16;
+		uint32_t limit = 1u << 13; // Frequencies are halved once their total passes this
+	};
+
+	// Frequencies of the residual lengths, adapting as values are coded
+	class CAdaptiveModel
+	{
+	public:
+		// Zig-zagged residuals of up to 35 bits, plus zero
+		static constexpr uint32_t SymbolCount = 36;
+
+		explicit CAdaptiveModel(const SModelParams& params) : m_params(params)
+		{
+			m_frequencies.fill(1);
+		}
+
+		double Encode(CRangeEncoder& encoder, uint32_t symbol)
+		{
+			uint32_t cumulative = 0;
+			for (uint32_t i = 0; i < symbol; ++i)
+			{
+				cumulative += m_frequencies[i];
+			}
+			const double cost = std::log2(static_cast<double>(m_total) / m_frequencies[symbol]);
+			encoder.Encode(cumulative, m_frequencies[symbol], m_total);
+			Update(symbol);
+			return cost;
+		}
+
+		uint32_t Decode(CRangeDecoder& decoder)
+		{
+			const uint32_t target = decoder.GetFrequency(m_total);
+			uint32_t cumulative = 0;
+			uint32_t symbol = 0;
+			while (cumulative + m_frequencies[symbol] <= target)
+			{
+				cumulative += m_frequencies[symbol++];
+			}
+			decoder.Decode(cumulative, m_frequencies[symbol]);
+			Update(symbol);
+			return symbol;
+		}
+
+	private:
+		void Update(uint32_t symbol)
+		{
+			m_frequencies[symbol] += m_params.increment;
+			m_total += m_params.increment;
+			if (m_total > m_params.limit)
+			{
+				m_total = 0;
+				for (uint32_t& frequency : m_frequencies)
+				{
+					frequency = (frequency + 1) / 2;
+					m_total += frequency;
+				}
+			}
+		}
+
+	private:
+		SModelParams                          m_params;
+		std::array<uint32_t, SymbolCount>     m_frequencies;
+		uint32_t                              m_total = SymbolCount;
+	};
+
+	uint64_t ZigZag(int64_t value)   { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+	int64_t  UnZigZag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+	uint32_t BitLength(uint64_t value)
+	{
+		uint32_t length = 0;
+		while (value != 0)
+		{
+			++length;
+			value >>= 1;
+		}
+		return length;
+	}
+
+	// Length through the model, the bits below the leading one raw
+	double EncodeResidual(CRangeEncoder& encoder, CAdaptiveModel& model, int64_t residual)
+	{
+		const uint64_t zigZag = ZigZag(residual);
+		const uint32_t length = BitLength(zigZag);
+		double cost = model.Encode(encoder, length);
+		if (length > 1)
+		{
+			encoder.EncodeBits(zigZag, length - 1);
+			cost += length - 1;
+		}
+		return cost;
+	}
+
+	int64_t DecodeResidual(CRangeDecoder& decoder, CAdaptiveModel& model)
+	{
+		const uint32_t length = model.Decode(decoder);
+		if (length <= 1)
+			return UnZigZag(length);
+
+		return UnZigZag((uint64_t(1) << (length - 1)) | decoder.DecodeBits(length - 1));
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	// The recording regrouped per player, consecutive ticks of one player follow each other
+	struct SStreams
+	{
+		float                                  tickRate = 30.f;
+		std::vector<PlayerStateRecording::SSample> samples;
+		std::vector<bool>                      continues; // Sample is the tick after the previous one of the same player
+		std::array<std::vector<uint32_t>, eField_Count> quantized;
+	};
+
+	float GetValue(const PlayerStateRecording::SSample& sample, uint32_t field)
+	{
+		return IsPosition(field) ? sample.position[field] : sample.velocity[field - eField_VelocityX];
+	}
+
+	bool LoadRecording(const std::string& path, SStreams& streams)
+	{
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+		{
+			printf("Can't open %s\n", path.c_str());
+			return false;
+		}
+
+		PlayerStateRecording::SHeader header;
+		const bool bValid = fread(&header, sizeof(header), 1, pFile) == 1 && header.magic == PlayerStateRecording::Magic
+			&& header.version == PlayerStateRecording::Version && header.sampleSize == sizeof(PlayerStateRecording::SSample) && header.tickRate > 0.f;
+		if (!bValid)
+		{
+			printf("%s is not a player state recording of version %u\n", path.c_str(), PlayerStateRecording::Version);
+			fclose(pFile);
+			return false;
+		}
+
+		streams.tickRate = header.tickRate;
+		PlayerStateRecording::SSample sample;
+		while (fread(&sample, sizeof(sample), 1, pFile) == 1)
+		{
+			bool bFinite = true;
+			for (uint32_t field = 0; field < eField_Count; ++field)
+			{
+				bFinite &= std::isfinite(GetValue(sample, field));
+			}
+			if (bFinite)
+			{
+				streams.samples.push_back(sample);
+			}
+		}
+		fclose(pFile);
+
+		std::stable_sort(streams.samples.begin(), streams.samples.end(), [](const PlayerStateRecording::SSample& a, const PlayerStateRecording::SSample& b)
+		{
+			return a.entityId != b.entityId ? a.entityId < b.entityId : a.tick < b.tick;
+		});
+
+		streams.continues.resize(streams.samples.size());
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			streams.continues[i] = i > 0 && streams.samples[i - 1].entityId == streams.samples[i].entityId && streams.samples[i - 1].tick + 1 == streams.samples[i].tick;
+		}
+		return !streams.samples.empty();
+	}
+
+	// Smallest bit count whose quantization error stays under the bound for every sample
+	void TuneQuantizer(const SStreams& streams, uint32_t field, float errorBound, float margin, SFieldResult& result)
+	{
+		float recordedMin = GetValue(streams.samples[0], field);
+		float recordedMax = recordedMin;
+		for (const PlayerStateRecording::SSample& sample : streams.samples)
+		{
+			recordedMin = std::min(recordedMin, GetValue(sample, field));
+			recordedMax = std::max(recordedMax, GetValue(sample, field));
+		}
+		result.recordedMin = recordedMin;
+		result.recordedMax = recordedMax;
+
+		// Whole units, so the policy reads like the hand written ones and small changes in the recording don't move it
+		const float extent = recordedMax - recordedMin;
+		SQuantizer& quantizer = result.quantizer;
+		quantizer.min = std::floor(recordedMin - extent * margin);
+		quantizer.max = std::max(std::ceil(recordedMax + extent * margin), quantizer.min + 1.f);
+
+		const double levels = (static_cast<double>(quantizer.max) - quantizer.min) / (2.0 * errorBound) + 1.0;
+		quantizer.bits = std::min(std::max(static_cast<uint32_t>(std::ceil(std::log2(levels))), 1u), 32u);
+
+		for (;;)
+		{
+			double maxError = 0.0;
+			double squaredError = 0.0;
+			for (const PlayerStateRecording::SSample& sample : streams.samples)
+			{
+				const float value = GetValue(sample, field);
+				const double error = std::fabs(static_cast<double>(quantizer.Dequantize(quantizer.Quantize(value))) - value);
+				maxError = std::max(maxError, error);
+				squaredError += error * error;
+			}
+
+			result.maxError = maxError;
+			result.rmsError = std::sqrt(squaredError / streams.samples.size());
+			result.bBoundReached = maxError <= errorBound;
+
+			// Float rounding can add to the analytic error near the ends of the range
+			if (result.bBoundReached || quantizer.bits == 32)
+				break;
+
+			++quantizer.bits;
+		}
+	}
+
+	// What the decoder predicts for a sample, only valid when the sample continues the previous one
+	int64_t Predict(const SStreams& streams, const std::array<SFieldResult, eField_Count>& results, size_t index, uint32_t field, EPredictor predictor)
+	{
+		const int64_t previous = streams.quantized[field][index - 1];
+		if (predictor != ePredictor_Extrapolate)
+			return previous;
+
+		const uint32_t velocityField = field + eField_VelocityX;
+		const double velocity = results[velocityField].quantizer.Dequantize(streams.quantized[velocityField][index - 1]);
+		const int64_t moved = previous + static_cast<int64_t>(std::llround(velocity / streams.tickRate / results[field].quantizer.Step()));
+		return std::min<int64_t>(std::max<int64_t>(moved, 0), results[field].quantizer.MaxQuantized());
+	}
+
+	// Zero order entropy of the values, or of the residuals of continuing samples, in bits per sample.
+	// Samples starting a stream are counted at the fixed bit count.
+	double MeasureEntropy(const SStreams& streams, const std::array<SFieldResult, eField_Count>& results, uint32_t field, EPredictor predictor)
+	{
+		std::unordered_map<int64_t, uint64_t> counts;
+		uint64_t residualCount = 0;
+		uint64_t keyCount = 0;
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			if (predictor == ePredictor_Raw)
+			{
+				++counts[streams.quantized[field][i]];
+				++residualCount;
+			}
+			else if (streams.continues[i])
+			{
+				++counts[static_cast<int64_t>(streams.quantized[field][i]) - Predict(streams, results, i, field, predictor)];
+				++residualCount;
+			}
+			else
+			{
+				++keyCount;
+			}
+		}
+
+		double bits = static_cast<double>(keyCount) * results[field].quantizer.bits;
+		for (const auto& count : counts)
+		{
+			bits -= count.second * std::log2(static_cast<double>(count.second) / residualCount);
+		}
+		return bits / streams.samples.size();
+	}
+
+	// Bits per sample the coder spends with a predictor: raw values and samples starting a stream at the fixed bit count,
+	// residuals as the zero order entropy of their bit lengths, which the adaptive model approaches, plus the bits below
+	// the leading one
+	double EstimateCodedBits(const SStreams& streams, const std::array<SFieldResult, eField_Count>& results, uint32_t field, EPredictor predictor)
+	{
+		const uint32_t fixedBits = results[field].quantizer.bits;
+		if (predictor == ePredictor_Raw)
+			return fixedBits;
+
+		std::array<uint64_t, CAdaptiveModel::SymbolCount> lengthCounts = {};
+		uint64_t residualCount = 0;
+		double bits = 0.0;
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			if (!streams.continues[i])
+			{
+				bits += fixedBits;
+				continue;
+			}
+
+			const uint32_t length = BitLength(ZigZag(static_cast<int64_t>(streams.quantized[field][i]) - Predict(streams, results, i, field, predictor)));
+			++lengthCounts[length];
+			++residualCount;
+			bits += length > 1 ? length - 1 : 0;
+		}
+
+		for (uint64_t count : lengthCounts)
+		{
+			if (count > 0)
+			{
+				bits -= count * std::log2(static_cast<double>(count) / residualCount);
+			}
+		}
+		return bits / streams.samples.size();
+	}
+
+	// Codes every stream with the chosen predictors, returns the coded size and each field's share of it
+	std::vector<uint8_t> EncodeStreams(const SStreams& streams, std::array<SFieldResult, eField_Count>& results, const SModelParams& params)
+	{
+		CRangeEncoder encoder;
+		std::vector<CAdaptiveModel> models(eField_Count, CAdaptiveModel(params));
+		for (SFieldResult& result : results)
+		{
+			result.codedBits = 0.0;
+		}
+
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			for (uint32_t field = 0; field < eField_Count; ++field)
+			{
+				SFieldResult& result = results[field];
+				const uint32_t value = streams.quantized[field][i];
+				if (result.predictor == ePredictor_Raw || !streams.continues[i])
+				{
+					encoder.EncodeBits(value, result.quantizer.bits);
+					result.codedBits += result.quantizer.bits;
+				}
+				else
+				{
+					result.codedBits += EncodeResidual(encoder, models[field], static_cast<int64_t>(value) - Predict(streams, results, i, field, result.predictor));
+				}
+			}
+		}
+
+		encoder.Finish();
+		return encoder.GetBytes();
+	}
+
+	// Decodes into a copy of the streams and compares, the model is only proposed when this holds
+	bool VerifyRoundTrip(const SStreams& streams, const std::array<SFieldResult, eField_Count>& results, const SModelParams& params, const std::vector<uint8_t>& bytes)
+	{
+		SStreams decoded;
+		decoded.tickRate = streams.tickRate;
+		decoded.continues = streams.continues;
+		for (auto& values : decoded.quantized)
+		{
+			values.resize(streams.samples.size());
+		}
+
+		CRangeDecoder decoder(bytes);
+		std::vector<CAdaptiveModel> models(eField_Count, CAdaptiveModel(params));
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			for (uint32_t field = 0; field < eField_Count; ++field)
+			{
+				const SFieldResult& result = results[field];
+				uint32_t value;
+				if (result.predictor == ePredictor_Raw || !streams.continues[i])
+				{
+					value = static_cast<uint32_t>(decoder.DecodeBits(result.quantizer.bits));
+				}
+				else
+				{
+					value = static_cast<uint32_t>(Predict(decoded, results, i, field, result.predictor) + DecodeResidual(decoder, models[field]));
+				}
+
+				if (value != streams.quantized[field][i])
+					return false;
+
+				decoded.quantized[field][i] = value;
+			}
+		}
+		return true;
+	}
+
+	std::string FormatPolicy(const std::string& name, const std::array<SFieldResult, eField_Count>& results, uint32_t firstField, const char* szComment)
+	{
+		static const char* const s_axisTags[3] = { "XParams", "YParams", "ZParams" };
+
+		std::string policy = "\t<!-- CompressionTuner: ";
+		policy += szComment;
+		policy += " -->\n\t<Policy name=\"" + name + "\" impl=\"QuantizedVec3\">\n";
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			const SQuantizer& quantizer = results[firstField + axis].quantizer;
+			char line[128];
+			snprintf(line, sizeof(line), "\t\t<%s min=\"%g\" max=\"%g\" nbits=\"%u\"/>\n", s_axisTags[axis], quantizer.min, quantizer.max, quantizer.bits);
+			policy += line;
+		}
+		policy += "\t</Policy>\n";
+		return policy;
+	}
+
+	// Drops a policy of the given name and the generated comment in front of it
+	void RemovePolicy(std::string& xml, const std::string& name)
+	{
+		const size_t policyStart = xml.find("<Policy name=\"" + name + "\"");
+		if (policyStart == std::string::npos)
+			return;
+
+		const size_t policyEnd = xml.find("</Policy>", policyStart);
+		if (policyEnd == std::string::npos)
+			return;
+
+		size_t start = xml.rfind('\n', policyStart);
+		start = start == std::string::npos ? 0 : start + 1;
+		if (start >= 2)
+		{
+			const size_t previousLine = xml.rfind('\n', start - 2);
+			const size_t previousLineStart = previousLine == std::string::npos ? 0 : previousLine + 1;
+			if (xml.find("<!-- CompressionTuner:", previousLineStart) < start)
+			{
+				start = previousLineStart;
+			}
+		}
+
+		size_t end = xml.find('\n', policyEnd);
+		end = end == std::string::npos ? xml.size() : end + 1;
+		xml.erase(start, end - start);
+	}
+
+	bool WritePolicyFile(const SOptions& options, const std::string& policies)
+	{
+		std::string xml = "<CompressionPolicy>\n</CompressionPolicy>\n";
+		if (!options.base.empty())
+		{
+			FILE* pBase = fopen(options.base.c_str(), "rb");
+			if (pBase == nullptr)
+			{
+				printf("Can't open %s\n", options.base.c_str());
+				return false;
+			}
+
+			xml.clear();
+			char buffer[4096];
+			size_t read;
+			while ((read = fread(buffer, 1, sizeof(buffer), pBase)) > 0)
+			{
+				xml.append(buffer, read);
+			}
+			fclose(pBase);
+		}
+
+		RemovePolicy(xml, options.positionPolicy);
+		RemovePolicy(xml, options.velocityPolicy);
+
+		const size_t end = xml.rfind("</CompressionPolicy>");
+		if (end == std::string::npos)
+		{
+			printf("%s has no </CompressionPolicy>\n", options.base.c_str());
+			return false;
+		}
+		xml.insert(end, policies);
+
+		FILE* pFile = fopen(options.policyOut.c_str(), "wb");
+		if (pFile == nullptr)
+		{
+			printf("Can't write %s\n", options.policyOut.c_str());
+			return false;
+		}
+		fwrite(xml.data(), 1, xml.size(), pFile);
+		fclose(pFile);
+		return true;
+	}
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--input") == 0 && bHasValue)
+				options.input = argv[++i];
+			else if (strcmp(argv[i], "--base") == 0 && bHasValue)
+				options.base = argv[++i];
+			else if (strcmp(argv[i], "--policy") == 0 && bHasValue)
+				options.policyOut = argv[++i];
+			else if (strcmp(argv[i], "--report") == 0 && bHasValue)
+				options.reportOut = argv[++i];
+			else if (strcmp(argv[i], "--position-policy") == 0 && bHasValue)
+				options.positionPolicy = argv[++i];
+			else if (strcmp(argv[i], "--velocity-policy") == 0 && bHasValue)
+				options.velocityPolicy = argv[++i];
+			else if (strcmp(argv[i], "--position-error") == 0 && bHasValue)
+				options.positionError = std::max(static_cast<float>(atof(argv[++i])), 1e-6f);
+			else if (strcmp(argv[i], "--velocity-error") == 0 && bHasValue)
+				options.velocityError = std::max(static_cast<float>(atof(argv[++i])), 1e-6f);
+			else if (strcmp(argv[i], "--margin") == 0 && bHasValue)
+				options.margin = std::max(static_cast<float>(atof(argv[++i])), 0.f);
+			else
+				return false;
+		}
+		return !options.input.empty();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: CompressionTuner --input players.psr [--base CompressionPolicy.xml] [--policy CompressionPolicy.tuned.xml] [--report report.txt]\n"
+			"                         [--position-error 0.005] [--velocity-error 0.02] [--margin 0.1] [--position-policy plps] [--velocity-policy plvl]\n");
+		return 1;
+	}
+
+	SStreams streams;
+	if (!LoadRecording(options.input, streams))
+		return 1;
+
+	if (!options.reportOut.empty())
+	{
+		s_pReport = fopen(options.reportOut.c_str(), "w");
+		if (s_pReport == nullptr)
+		{
+			printf("Can't write %s\n", options.reportOut.c_str());
+			return 1;
+		}
+	}
+
+	size_t continuing = 0;
+	for (bool bContinues : streams.continues)
+	{
+		continuing += bContinues ? 1 : 0;
+	}
+	Print("%s: %zu samples at %.0f ticks per second, %zu of them continue the player's previous tick\n",
+		options.input.c_str(), streams.samples.size(), streams.tickRate, continuing);
+
+	// Fixed bit counts
+	std::array<SFieldResult, eField_Count> results;
+	for (uint32_t field = 0; field < eField_Count; ++field)
+	{
+		TuneQuantizer(streams, field, IsPosition(field) ? options.positionError : options.velocityError, options.margin, results[field]);
+
+		streams.quantized[field].resize(streams.samples.size());
+		for (size_t i = 0; i < streams.samples.size(); ++i)
+		{
+			streams.quantized[field][i] = results[field].quantizer.Quantize(GetValue(streams.samples[i], field));
+		}
+	}
+
+	// Entropy per predictor for the report. The coder sends raw values at the fixed bit count and only entropy codes
+	// residuals, so the predictor is chosen by the estimated coded size, a residual predictor only when it beats the fixed bits.
+	for (uint32_t field = 0; field < eField_Count; ++field)
+	{
+		SFieldResult& result = results[field];
+		result.predictor = ePredictor_Raw;
+		for (uint32_t predictor = 0; predictor < ePredictor_Count; ++predictor)
+		{
+			if (predictor == ePredictor_Extrapolate && !IsPosition(field))
+			{
+				result.entropy[predictor] = NAN;
+				result.estimatedBits[predictor] = NAN;
+				continue;
+			}
+
+			result.entropy[predictor] = MeasureEntropy(streams, results, field, static_cast<EPredictor>(predictor));
+			result.estimatedBits[predictor] = EstimateCodedBits(streams, results, field, static_cast<EPredictor>(predictor));
+			if (result.estimatedBits[predictor] < result.estimatedBits[result.predictor])
+			{
+				result.predictor = static_cast<EPredictor>(predictor);
+			}
+		}
+	}
+
+	// Adaptive model parameters, smallest coded size wins
+	static const uint32_t s_increments[] = { 4, 8, 16, 24, 32 };
+	static const uint32_t s_limits[] = { 1u << 10, 1u << 11, 1u << 12, 1u << 13, 1u << 14, 1u << 16 };
+
+	SModelParams bestParams;
+	size_t bestBytes = SIZE_MAX;
+	for (uint32_t increment : s_increments)
+	{
+		for (uint32_t limit : s_limits)
+		{
+			SModelParams params;
+			params.increment = increment;
+			params.limit = limit;
+			const size_t bytes = EncodeStreams(streams, results, params).size();
+			if (bytes < bestBytes)
+			{
+				bestBytes = bytes;
+				bestParams = params;
+			}
+		}
+	}
+
+	const std::vector<uint8_t> coded = EncodeStreams(streams, results, bestParams);
+	const bool bRoundTrip = VerifyRoundTrip(streams, results, bestParams, coded);
+
+	// Report
+	const double sampleCount = static_cast<double>(streams.samples.size());
+	Print("\nError bounds: position %g m, velocity %g m/s. Ranges are the recorded extent plus %.0f%% on both sides.\n",
+		options.positionError, options.velocityError, options.margin * 100.f);
+	Print("%-11s %10s %10s %10s %10s %5s %10s %10s | %7s %7s %7s | %-12s %7s %7s\n",
+		"field", "rec min", "rec max", "min", "max", "bits", "max err", "rms err", "H raw", "H delta", "H extr", "predictor", "est", "coded");
+
+	double fixedBits[2] = {};
+	double entropyBits[2] = {};
+	double codedBits[2] = {};
+	for (uint32_t field = 0; field < eField_Count; ++field)
+	{
+		const SFieldResult& result = results[field];
+		char extrapolated[16] = "-";
+		if (!std::isnan(result.entropy[ePredictor_Extrapolate]))
+		{
+			snprintf(extrapolated, sizeof(extrapolated), "%.2f", result.entropy[ePredictor_Extrapolate]);
+		}
+
+		Print("%-11s %10.2f %10.2f %10g %10g %5u %10.5f %10.5f | %7.2f %7.2f %7s | %-12s %7.2f %7.2f%s\n",
+			s_fieldNames[field], result.recordedMin, result.recordedMax, result.quantizer.min, result.quantizer.max, result.quantizer.bits,
+			result.maxError, result.rmsError, result.entropy[ePredictor_Raw], result.entropy[ePredictor_Delta], extrapolated,
+			s_predictorNames[result.predictor], result.estimatedBits[result.predictor], result.codedBits / sampleCount, result.bBoundReached ? "" : "  (bound not reachable in float)");
+
+		const uint32_t kind = IsPosition(field) ? 0 : 1;
+		fixedBits[kind] += result.quantizer.bits;
+		// Bound of what the coder does with the chosen predictor, raw values are never entropy coded
+		entropyBits[kind] += result.predictor == ePredictor_Raw ? result.quantizer.bits : result.entropy[result.predictor];
+		codedBits[kind] += result.codedBits / sampleCount;
+	}
+
+	// What the hand set 'lwld' policy does with the same positions
+	static const SQuantizer s_lwld[3] = { { -20.f, 4096.f, 27 }, { -20.f, 4096.f, 27 }, { -20.f, 1023.f, 18 } };
+	double lwldMaxError = 0.0;
+	for (const PlayerStateRecording::SSample& sample : streams.samples)
+	{
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			lwldMaxError = std::max(lwldMaxError, std::fabs(static_cast<double>(s_lwld[axis].Dequantize(s_lwld[axis].Quantize(sample.position[axis]))) - sample.position[axis]));
+		}
+	}
+
+	Print("\nBits per sample        position   velocity\n");
+	Print("  'lwld' (27/27/18)    %8.2f   %8s   max error %.5f m\n", 72.0, "-", lwldMaxError);
+	Print("  tuned fixed          %8.2f   %8.2f\n", fixedBits[0], fixedBits[1]);
+	Print("  entropy bound        %8.2f   %8.2f\n", entropyBits[0], entropyBits[1]);
+	Print("  adaptive range coded %8.2f   %8.2f   %zu bytes in total, %.2f bytes per sample\n", codedBits[0], codedBits[1], coded.size(), coded.size() / sampleCount);
+	Print("\nAdaptive model: per field, the residual against the predictor is zig-zagged, its bit length coded with an adaptive\n"
+		"frequency model (increment %u, halved above %u) and the bits below the leading one sent raw. The first sample of\n"
+		"a player, and fields whose residuals don't beat the fixed bits, are sent at the fixed bit count. Round trip %s.\n",
+		bestParams.increment, bestParams.limit, bRoundTrip ? "verified" : "FAILED");
+
+	if (s_pReport != nullptr)
+	{
+		fclose(s_pReport);
+	}
+
+	if (!bRoundTrip)
+		return 1;
+
+	char positionComment[256];
+	char velocityComment[256];
+	snprintf(positionComment, sizeof(positionComment), "player positions, error <= %g m, %.1f bits per sample with the adaptive delta model (increment %u, limit %u)",
+		options.positionError, codedBits[0], bestParams.increment, bestParams.limit);
+	snprintf(velocityComment, sizeof(velocityComment), "player velocities, error <= %g m/s, %.1f bits per sample with the adaptive delta model",
+		options.velocityError, codedBits[1]);
+
+	const std::string policies = FormatPolicy(options.positionPolicy, results, eField_PositionX, positionComment)
+		+ FormatPolicy(options.velocityPolicy, results, eField_VelocityX, velocityComment);
+	if (!WritePolicyFile(options, policies))
+		return 1;
+
+	printf("Wrote %s\n", options.policyOut.c_str());
+	return 0;
+}
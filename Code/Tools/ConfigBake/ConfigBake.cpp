@@ -0,0 +1,431 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Build step for Scripts/ConfigCache.bin, the XML the
+// game reads at startup flattened into one file it uses
+// in place instead of parsing (see ConfigBlobFile.h and
+// CConfigCache):
+//  - Scripts/network/Scheduler.xml
+//  - Scripts/network/EntityScheduler.xml
+//  - Libs/config/Profiles/default/actionmaps.xml
+// and any other game path given with --source. Each
+// document keeps the hash of the bytes it was baked
+// from, the game parses a source again when it changed.
+// Sources are text XML, a resource compiler's binary
+// XML is not read. The written file is read back and
+// compared with the parsed documents:
+//   ConfigBake --assets Assets [--source Libs/Foo.xml] [--output Assets/Scripts/ConfigCache.bin]
+// Built without the engine.
+////////////////////////////////////////////////////////
+
+#include "../../Systems/ConfigBlobFile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using ConfigBlobFile::SSourceNode;
+
+	struct SOptions
+	{
+		std::string              assets = "Assets";
+		std::string              output; // Defaults to <assets>/Scripts/ConfigCache.bin
+		std::vector<std::string> sources = { "Scripts/network/Scheduler.xml", "Scripts/network/EntityScheduler.xml", "Libs/config/Profiles/default/actionmaps.xml" };
+	};
+
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+			return false;
+
+		char buffer[4096];
+		size_t read;
+		contents.clear();
+		while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		{
+			contents.append(buffer, read);
+		}
+		fclose(pFile);
+		return true;
+	}
+
+	// Elements, attributes and text, what the game reads of its config. Comments, the
+	// declaration and doctypes are skipped, text is trimmed as the engine's parser does
+	class CXmlParser
+	{
+	public:
+		bool Parse(const std::string& text, SSourceNode& root, std::string& error)
+		{
+			m_text = text;
+			m_position = 0;
+			m_error.clear();
+
+			SkipMarkup();
+			const bool bParsed = m_position < m_text.size() && m_text[m_position] == '<' && ParseElement(root);
+			SkipMarkup();
+			if (bParsed && m_position != m_text.size())
+			{
+				Fail("content after the root element");
+			}
+			error = m_error.empty() && !bParsed ? "no root element" : m_error;
+			return bParsed && m_error.empty();
+		}
+
+	private:
+		bool Fail(const char* szError)
+		{
+			if (m_error.empty())
+			{
+				size_t line = 1;
+				for (size_t i = 0; i < m_position && i < m_text.size(); ++i)
+				{
+					line += m_text[i] == '\n' ? 1 : 0;
+				}
+				m_error = std::string(szError) + " on line " + std::to_string(line);
+			}
+			return false;
+		}
+
+		bool StartsWith(const char* szPrefix) const { return m_text.compare(m_position, strlen(szPrefix), szPrefix) == 0; }
+
+		void SkipSpace()
+		{
+			while (m_position < m_text.size() && isspace(static_cast<unsigned char>(m_text[m_position])))
+			{
+				++m_position;
+			}
+		}
+
+		bool SkipPast(const char* szEnd)
+		{
+			const size_t end = m_text.find(szEnd, m_position);
+			if (end == std::string::npos)
+				return Fail("unterminated markup");
+			m_position = end + strlen(szEnd);
+			return true;
+		}
+
+		// Whitespace, comments, <?...?> and <!...> outside of elements
+		void SkipMarkup()
+		{
+			for (SkipSpace(); m_position < m_text.size(); SkipSpace())
+			{
+				const char* szEnd = StartsWith("<!--") ? "-->" : StartsWith("<?") ? "?>" : StartsWith("<!") ? ">" : nullptr;
+				if (szEnd == nullptr || !SkipPast(szEnd))
+					break;
+			}
+		}
+
+		std::string ParseName()
+		{
+			const size_t start = m_position;
+			while (m_position < m_text.size() && (isalnum(static_cast<unsigned char>(m_text[m_position])) || strchr("_-.:", m_text[m_position]) != nullptr))
+			{
+				++m_position;
+			}
+			return m_text.substr(start, m_position - start);
+		}
+
+		bool Decode(size_t start, size_t end, std::string& value)
+		{
+			static const std::pair<const char*, char> entities[] = { { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' }, { "&quot;", '"' }, { "&apos;", '\'' } };
+
+			for (size_t i = start; i < end; ++i)
+			{
+				if (m_text[i] != '&')
+				{
+					value += m_text[i];
+					continue;
+				}
+
+				const size_t semicolon = m_text.find(';', i);
+				if (semicolon == std::string::npos || semicolon >= end)
+					return Fail("unterminated entity");
+
+				bool bKnown = false;
+				for (const auto& entity : entities)
+				{
+					if (m_text.compare(i, semicolon + 1 - i, entity.first) == 0)
+					{
+						value += entity.second;
+						bKnown = true;
+					}
+				}
+				if (!bKnown && m_text[i + 1] == '#')
+				{
+					const bool bHex = m_text[i + 2] == 'x' || m_text[i + 2] == 'X';
+					const unsigned long code = strtoul(m_text.c_str() + i + (bHex ? 3 : 2), nullptr, bHex ? 16 : 10);
+					// UTF-8, as the files are
+					if (code < 0x80)
+					{
+						value += static_cast<char>(code);
+					}
+					else if (code < 0x800)
+					{
+						value += static_cast<char>(0xc0 | (code >> 6));
+						value += static_cast<char>(0x80 | (code & 0x3f));
+					}
+					else if (code < 0x10000)
+					{
+						value += static_cast<char>(0xe0 | (code >> 12));
+						value += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+						value += static_cast<char>(0x80 | (code & 0x3f));
+					}
+					else
+					{
+						value += static_cast<char>(0xf0 | ((code >> 18) & 0x07));
+						value += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+						value += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+						value += static_cast<char>(0x80 | (code & 0x3f));
+					}
+					bKnown = true;
+				}
+				if (!bKnown)
+					return Fail("unknown entity");
+				i = semicolon;
+			}
+			return true;
+		}
+
+		bool ParseElement(SSourceNode& node)
+		{
+			++m_position;
+			node.tag = ParseName();
+			if (node.tag.empty())
+				return Fail("element without a name");
+
+			for (;;)
+			{
+				SkipSpace();
+				if (StartsWith("/>"))
+				{
+					m_position += 2;
+					return true;
+				}
+				if (StartsWith(">"))
+				{
+					++m_position;
+					break;
+				}
+
+				std::pair<std::string, std::string> attribute;
+				attribute.first = ParseName();
+				SkipSpace();
+				if (attribute.first.empty() || !StartsWith("="))
+					return Fail("malformed attribute");
+				++m_position;
+				SkipSpace();
+
+				const char quote = m_position < m_text.size() ? m_text[m_position] : '\0';
+				const size_t end = quote == '"' || quote == '\'' ? m_text.find(quote, m_position + 1) : std::string::npos;
+				if (end == std::string::npos || !Decode(m_position + 1, end, attribute.second))
+					return Fail("malformed attribute value");
+				m_position = end + 1;
+				node.attributes.push_back(std::move(attribute));
+			}
+
+			for (;;)
+			{
+				const size_t textEnd = m_text.find('<', m_position);
+				if (textEnd == std::string::npos)
+					return Fail("unterminated element");
+				if (!Decode(m_position, textEnd, node.content))
+					return false;
+				m_position = textEnd;
+
+				if (StartsWith("<!--"))
+				{
+					if (!SkipPast("-->"))
+						return false;
+				}
+				else if (StartsWith("<![CDATA["))
+				{
+					const size_t start = m_position + 9;
+					if (!SkipPast("]]>"))
+						return false;
+					node.content.append(m_text, start, m_position - 3 - start);
+				}
+				else if (StartsWith("<?"))
+				{
+					if (!SkipPast("?>"))
+						return false;
+				}
+				else if (StartsWith("</"))
+				{
+					m_position += 2;
+					if (ParseName() != node.tag)
+						return Fail("mismatched closing tag");
+					SkipSpace();
+					if (!StartsWith(">"))
+						return Fail("malformed closing tag");
+					++m_position;
+					break;
+				}
+				else
+				{
+					node.children.emplace_back();
+					if (!ParseElement(node.children.back()))
+						return false;
+				}
+			}
+
+			const size_t first = node.content.find_first_not_of(" \t\r\n");
+			node.content = first == std::string::npos ? std::string() : node.content.substr(first, node.content.find_last_not_of(" \t\r\n") + 1 - first);
+			return true;
+		}
+
+	private:
+		std::string m_text;
+		size_t      m_position = 0;
+		std::string m_error;
+	};
+
+	bool IsSame(const SSourceNode& left, const SSourceNode& right)
+	{
+		if (left.tag != right.tag || left.content != right.content || left.attributes != right.attributes || left.children.size() != right.children.size())
+			return false;
+
+		for (size_t i = 0; i < left.children.size(); ++i)
+		{
+			if (!IsSame(left.children[i], right.children[i]))
+				return false;
+		}
+		return true;
+	}
+
+	size_t CountNodes(const SSourceNode& node)
+	{
+		size_t count = 1;
+		for (const SSourceNode& child : node.children)
+		{
+			count += CountNodes(child);
+		}
+		return count;
+	}
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--assets") == 0 && bHasValue)
+				options.assets = argv[++i];
+			else if (strcmp(argv[i], "--output") == 0 && bHasValue)
+				options.output = argv[++i];
+			else if (strcmp(argv[i], "--source") == 0 && bHasValue)
+				options.sources.push_back(argv[++i]);
+			else
+				return false;
+		}
+
+		if (options.output.empty())
+		{
+			options.output = options.assets + "/Scripts/ConfigCache.bin";
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: ConfigBake [--assets Assets] [--source <game path>]... [--output Assets/Scripts/ConfigCache.bin]\n");
+		return 1;
+	}
+
+	ConfigBlobFile::CWriter writer;
+	std::vector<std::string> paths;
+	std::vector<std::string> texts;
+	std::vector<SSourceNode> documents;
+	for (const std::string& source : options.sources)
+	{
+		if (writer.HasDocument(source.c_str()))
+			continue;
+
+		std::string text, error;
+		SSourceNode root;
+		if (!ReadFile(options.assets + "/" + source, text))
+		{
+			printf("%s: could not be read\n", source.c_str());
+			return 1;
+		}
+		if (!CXmlParser().Parse(text, root, error))
+		{
+			printf("%s: %s\n", source.c_str(), error.c_str());
+			return 1;
+		}
+
+		printf("%-48s %8zu bytes %6zu nodes\n", source.c_str(), text.size(), CountNodes(root));
+		writer.AddDocument(source.c_str(), ConfigBlobFile::HashSource(text.data(), text.size()), static_cast<uint32_t>(text.size()), root);
+		paths.push_back(source);
+		texts.push_back(std::move(text));
+		documents.push_back(std::move(root));
+	}
+
+	const std::vector<uint8_t> file = writer.Write();
+
+	// Read back as the game does, from 8 byte aligned memory
+	std::vector<uint64_t> aligned((file.size() + 7) / 8);
+	memcpy(aligned.data(), file.data(), file.size());
+	ConfigBlobFile::CView view;
+	if (!view.Attach(aligned.data(), file.size()) || view.GetDocumentCount() != documents.size())
+	{
+		printf("The written file does not read back\n");
+		return 1;
+	}
+	for (size_t i = 0; i < documents.size(); ++i)
+	{
+		const uint32_t index = view.FindDocument(ConfigBlobFile::NormalizePath(paths[i].c_str()).c_str());
+		SSourceNode readBack;
+		if (index != ConfigBlobFile::NotFound)
+		{
+			view.ToSource(view.GetDocument(index).rootNode, readBack);
+		}
+		if (index == ConfigBlobFile::NotFound || !IsSame(readBack, documents[i]))
+		{
+			printf("%s does not read back as it was parsed\n", paths[i].c_str());
+			return 1;
+		}
+	}
+
+	FILE* pFile = fopen(options.output.c_str(), "wb");
+	const bool bWritten = pFile != nullptr && fwrite(file.data(), 1, file.size(), pFile) == file.size();
+	if (pFile == nullptr || fclose(pFile) != 0 || !bWritten)
+	{
+		printf("Could not write %s\n", options.output.c_str());
+		return 1;
+	}
+
+	// What a start pays for the documents either way, both from memory
+	const uint32_t iterations = 1000;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+	{
+		for (const std::string& text : texts)
+		{
+			SSourceNode root;
+			std::string error;
+			CXmlParser().Parse(text, root, error);
+		}
+	}
+	const double parseMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+	{
+		view.Attach(aligned.data(), file.size());
+	}
+	const double attachMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+	printf("Wrote %s: %zu documents, %zu bytes\n", options.output.c_str(), documents.size(), file.size());
+	printf("Parsing the sources takes %.1fus, checking the baked tables %.1fus\n", parseMicroseconds, attachMicroseconds);
+	return 0;
+}
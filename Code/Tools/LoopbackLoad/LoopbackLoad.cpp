@@ -0,0 +1,663 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Fake client load generator for CLoadTestServer. Opens
+// one UDP socket per simulated client against a server
+// on this machine, sends random input shaped like the
+// player action map every tick and consumes the player
+// snapshots, then reports:
+//  - bytes the server sent per tick
+//  - round trip latency per client
+//  - dropped packets, and dropped entries per Scheduler.xml group
+// Start the server with +g_loadTestPort 27016, then:
+//   LoopbackLoad --port 27016 --clients 256 --duration 30
+// Linux only, built without the engine.
+////////////////////////////////////////////////////////
+
+#include "../../Network/LoadTestProtocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	// Must match EPlayerAction in Components/PlayerActions.h
+	enum EAction : uint8_t
+	{
+		eAction_MoveForward,
+		eAction_MoveBackward,
+		eAction_MoveRight,
+		eAction_MoveLeft,
+		eAction_Sprint,
+		eAction_Canter,
+		eAction_Jump,
+		eAction_Crouch,
+		eAction_Yaw,
+		eAction_Pitch,
+		eAction_CamSwitch
+	};
+
+	// Must match EActionActivationMode of CryInput
+	enum EActivationMode : uint8_t
+	{
+		eActivation_OnPress = 1 << 0,
+		eActivation_OnRelease = 1 << 1,
+		eActivation_Always = 1 << 3
+	};
+
+	struct SOptions
+	{
+		int      port = 27016;
+		uint32_t clients = 256;
+		float    duration = 30.f;
+		float    warmup = 3.f;
+		float    connectRate = 100.f; // Clients per second, so the server isn't hit by hundreds of spawns in one frame
+		uint32_t seed = 1;
+	};
+
+	uint64_t NowMicroseconds()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	class CRandom
+	{
+	public:
+		explicit CRandom(uint32_t seed) : m_state(seed != 0 ? seed : 1) {}
+
+		uint32_t Next()
+		{
+			m_state ^= m_state << 13;
+			m_state ^= m_state >> 17;
+			m_state ^= m_state << 5;
+			return m_state;
+		}
+
+		float Range(float min, float max)
+		{
+			return min + (max - min) * static_cast<float>(Next() & 0xffffff) / static_cast<float>(0xffffff);
+		}
+
+	private:
+		uint32_t m_state;
+	};
+
+	// Samples of one value, percentiles are taken at the end
+	class CSamples
+	{
+	public:
+		void     Add(uint64_t value) { m_values.push_back(value); }
+		bool     IsEmpty() const     { return m_values.empty(); }
+		size_t   GetCount() const    { return m_values.size(); }
+
+		void     Sort() { std::sort(m_values.begin(), m_values.end()); }
+		uint64_t GetPercentile(double fraction) const
+		{
+			return m_values.empty() ? 0 : m_values[std::min(static_cast<size_t>(fraction * m_values.size()), m_values.size() - 1)];
+		}
+		double   GetMean() const
+		{
+			double total = 0.0;
+			for (uint64_t value : m_values)
+			{
+				total += static_cast<double>(value);
+			}
+			return m_values.empty() ? 0.0 : total / m_values.size();
+		}
+
+	private:
+		std::vector<uint64_t> m_values;
+	};
+
+	// Owns a socket descriptor, closed when destroyed. A moved from socket owns nothing.
+	class CSocket
+	{
+	public:
+		CSocket() = default;
+		~CSocket() { Reset(-1); }
+
+		CSocket(const CSocket&) = delete;
+		CSocket& operator=(const CSocket&) = delete;
+
+		CSocket(CSocket&& other) noexcept : m_descriptor(std::exchange(other.m_descriptor, -1)) {}
+		CSocket& operator=(CSocket&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset(std::exchange(other.m_descriptor, -1));
+			}
+			return *this;
+		}
+
+		int  Get() const     { return m_descriptor; }
+		bool IsValid() const { return m_descriptor >= 0; }
+
+		void Reset(int descriptor)
+		{
+			if (m_descriptor >= 0)
+			{
+				close(m_descriptor);
+			}
+			m_descriptor = descriptor;
+		}
+
+	private:
+		int m_descriptor = -1;
+	};
+
+	class CFakeClient
+	{
+	public:
+		CFakeClient(uint32_t index, uint32_t seed) : m_index(index), m_random(seed * 7919u + index) {}
+		~CFakeClient() = default;
+
+		// The socket has one owner, moving a client hands it over
+		CFakeClient(const CFakeClient&) = delete;
+		CFakeClient& operator=(const CFakeClient&) = delete;
+		CFakeClient(CFakeClient&&) noexcept = default;
+		CFakeClient& operator=(CFakeClient&&) noexcept = default;
+
+		bool Open(const sockaddr_in& server, int epoll)
+		{
+			m_socket.Reset(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+			if (!m_socket.IsValid())
+				return false;
+
+			// A tick of snapshots can arrive in one burst while the tool is busy with other clients
+			const int receiveBuffer = 1 << 20;
+			setsockopt(m_socket.Get(), SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+			if (connect(m_socket.Get(), reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0 || fcntl(m_socket.Get(), F_SETFL, O_NONBLOCK) != 0)
+				return false;
+
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.u32 = m_index;
+			return epoll_ctl(epoll, EPOLL_CTL_ADD, m_socket.Get(), &event) == 0;
+		}
+
+		bool IsWelcomed() const { return m_bWelcomed; }
+
+		void SendHello()
+		{
+			LoadTestProtocol::SInputPacket packet = {};
+			packet.magic = LoadTestProtocol::Magic;
+			packet.type = LoadTestProtocol::ePacket_Hello;
+			send(m_socket.Get(), &packet, offsetof(LoadTestProtocol::SInputPacket, actions), 0);
+		}
+
+		void SendBye()
+		{
+			LoadTestProtocol::SInputPacket packet = {};
+			packet.magic = LoadTestProtocol::Magic;
+			packet.type = LoadTestProtocol::ePacket_Bye;
+			send(m_socket.Get(), &packet, offsetof(LoadTestProtocol::SInputPacket, actions), 0);
+		}
+
+		// Same behavior as the random mode of CBotControllerComponent, as one input packet per tick
+		void SendInput(float tickTime)
+		{
+			LoadTestProtocol::SInputPacket packet = {};
+			packet.magic = LoadTestProtocol::Magic;
+			packet.type = LoadTestProtocol::ePacket_Input;
+			packet.sequence = ++m_inputSequence;
+			packet.ackedSnapshot = m_newestTick;
+			packet.ackedSnapshotParts = m_newestTickParts;
+			packet.clientTime = NowMicroseconds();
+
+			auto addAction = [&packet](uint8_t action, uint8_t activationMode, float value)
+			{
+				if (packet.actionCount < LoadTestProtocol::MaxActions)
+				{
+					packet.actions[packet.actionCount++] = { action, activationMode, { 0, 0 }, value };
+				}
+			};
+
+			m_time += tickTime;
+			if (m_time >= m_nextDecision)
+			{
+				m_nextDecision = m_time + m_random.Range(0.5f, 2.f);
+
+				if (m_moveAction != 0xff)
+				{
+					addAction(m_moveAction, eActivation_OnRelease, 0.f);
+					m_moveAction = 0xff;
+				}
+
+				// One in five decisions stands still
+				const uint32_t move = m_random.Next() % 5;
+				if (move < 4)
+				{
+					m_moveAction = static_cast<uint8_t>(eAction_MoveForward + move);
+					addAction(m_moveAction, eActivation_OnPress, 1.f);
+				}
+
+				m_turnRate = m_random.Range(-300.f, 300.f);
+
+				if ((m_random.Next() % 4) == 0)
+				{
+					m_bSprinting = !m_bSprinting;
+					addAction(eAction_Sprint, m_bSprinting ? eActivation_OnPress : eActivation_OnRelease, m_bSprinting ? 1.f : 0.f);
+				}
+				if ((m_random.Next() % 3) == 0)
+				{
+					addAction(eAction_Jump, eActivation_OnPress, 1.f);
+					addAction(eAction_Jump, eActivation_OnRelease, 0.f);
+				}
+				if ((m_random.Next() % 6) == 0)
+				{
+					m_bCrouching = !m_bCrouching;
+					addAction(eAction_Crouch, m_bCrouching ? eActivation_OnPress : eActivation_OnRelease, m_bCrouching ? 1.f : 0.f);
+				}
+			}
+
+			addAction(eAction_Yaw, eActivation_Always, -m_turnRate * tickTime);
+			addAction(eAction_Pitch, eActivation_Always, m_random.Range(-2.f, 2.f));
+
+			send(m_socket.Get(), &packet, offsetof(LoadTestProtocol::SInputPacket, actions) + packet.actionCount * sizeof(LoadTestProtocol::SAction), 0);
+		}
+
+		// Returns the tick rate of the server once welcomed, 0 otherwise
+		uint32_t Receive(bool bMeasuring, std::vector<std::string>& groupNames, std::vector<std::pair<uint32_t, uint32_t>>& serverTickBytes)
+		{
+			uint32_t tickRate = 0;
+			uint8_t buffer[LoadTestProtocol::MaxPacketSize];
+
+			for (;;)
+			{
+				const ssize_t size = recv(m_socket.Get(), buffer, sizeof(buffer), 0);
+				if (size <= 0)
+					break;
+
+				uint32_t magic;
+				if (static_cast<size_t>(size) < sizeof(magic) + 1)
+					continue;
+				memcpy(&magic, buffer, sizeof(magic));
+				if (magic != LoadTestProtocol::Magic)
+					continue;
+
+				const uint8_t type = buffer[sizeof(magic)];
+				if (type == LoadTestProtocol::ePacket_Welcome && static_cast<size_t>(size) >= sizeof(LoadTestProtocol::SWelcomePacket))
+				{
+					LoadTestProtocol::SWelcomePacket welcome;
+					memcpy(&welcome, buffer, sizeof(welcome));
+					m_bWelcomed = true;
+					tickRate = welcome.tickRate;
+
+					if (groupNames.empty())
+					{
+						for (uint8_t group = 0; group < std::min<uint32_t>(welcome.groupCount, LoadTestProtocol::MaxGroups); ++group)
+						{
+							groupNames.emplace_back(welcome.groupNames[group], strnlen(welcome.groupNames[group], LoadTestProtocol::MaxGroupNameLength));
+						}
+					}
+				}
+				else if (type == LoadTestProtocol::ePacket_Snapshot && static_cast<size_t>(size) >= sizeof(LoadTestProtocol::SSnapshotHeader))
+				{
+					LoadTestProtocol::SSnapshotHeader header;
+					memcpy(&header, buffer, sizeof(header));
+					if (static_cast<size_t>(size) != sizeof(header) + header.entryCount * (sizeof(uint32_t) + 1) + header.byteCount)
+						continue;
+
+					OnSnapshot(header, buffer + sizeof(header) + header.entryCount * sizeof(uint32_t), static_cast<uint32_t>(size), bMeasuring, serverTickBytes);
+				}
+			}
+
+			return tickRate;
+		}
+
+		void BeginMeasuring()
+		{
+			m_measureFirstSequence = m_newestSequence + 1;
+			m_packetsReceived = 0;
+			m_bytesReceived = 0;
+			std::fill(std::begin(m_groupEntriesReceived), std::end(m_groupEntriesReceived), 0);
+			std::copy(std::begin(m_groupEntriesSent), std::end(m_groupEntriesSent), m_groupEntriesSentBefore);
+		}
+
+		CSamples& GetRoundTrips()       { return m_roundTrips; }
+		CSamples& GetServerHolds()      { return m_serverHolds; }
+		uint64_t  GetBytesReceived() const { return m_bytesReceived; }
+		uint32_t  GetPacketsReceived() const { return m_packetsReceived; }
+
+		// Snapshots the server numbered after measuring began that never arrived, including the ones still in flight
+		uint32_t  GetPacketsDropped() const
+		{
+			const uint32_t sent = m_newestSequence >= m_measureFirstSequence ? m_newestSequence - m_measureFirstSequence + 1 : 0;
+			return sent > m_packetsReceived ? sent - m_packetsReceived : 0;
+		}
+
+		uint32_t  GetGroupEntriesSent(uint32_t group) const     { return m_groupEntriesSent[group] - m_groupEntriesSentBefore[group]; }
+		uint32_t  GetGroupEntriesReceived(uint32_t group) const { return m_groupEntriesReceived[group]; }
+
+	private:
+		void OnSnapshot(const LoadTestProtocol::SSnapshotHeader& header, const uint8_t* pGroups, uint32_t size, bool bMeasuring, std::vector<std::pair<uint32_t, uint32_t>>& serverTickBytes)
+		{
+			// Entries aren't decoded here, every part that arrived counts as stored, as the game client does for complete parts
+			if (m_newestTick == 0 || static_cast<int32_t>(header.tick - m_newestTick) > 0)
+			{
+				m_newestTick = header.tick;
+				m_newestTickParts = 0;
+			}
+			if (header.tick == m_newestTick && header.part < 32)
+			{
+				m_newestTickParts |= 1u << header.part;
+			}
+
+			// Packets arriving out of order still count as received, the cumulative counters come from the newest one
+			if (m_newestSequence == 0 || static_cast<int32_t>(header.sequence - m_newestSequence) > 0)
+			{
+				m_newestSequence = header.sequence;
+				std::copy(std::begin(header.groupEntriesSent), std::end(header.groupEntriesSent), m_groupEntriesSent);
+			}
+
+			if (!bMeasuring || static_cast<int32_t>(header.sequence - m_measureFirstSequence) < 0)
+				return;
+
+			++m_packetsReceived;
+			m_bytesReceived += size;
+			for (uint16_t i = 0; i < header.entryCount; ++i)
+			{
+				if (pGroups[i] < LoadTestProtocol::MaxGroups)
+				{
+					++m_groupEntriesReceived[pGroups[i]];
+				}
+			}
+
+			// The first snapshot of each server tick reports the previous tick
+			if (header.tick != m_lastReportedTick)
+			{
+				m_lastReportedTick = header.tick;
+				serverTickBytes.emplace_back(header.tick - 1, header.lastTickBytes);
+			}
+
+			if (header.echoedClientTime != 0)
+			{
+				const uint64_t roundTrip = NowMicroseconds() - header.echoedClientTime;
+				m_roundTrips.Add(roundTrip);
+				m_serverHolds.Add(std::min<uint64_t>(header.serverHoldMicroseconds, roundTrip));
+			}
+		}
+
+	private:
+		uint32_t m_index;
+		CSocket  m_socket;
+		CRandom  m_random;
+		bool     m_bWelcomed = false;
+
+		// Input state, as in CBotControllerComponent
+		float    m_time = 0.f;
+		float    m_nextDecision = 0.f;
+		float    m_turnRate = 0.f;
+		uint8_t  m_moveAction = 0xff;
+		bool     m_bSprinting = false;
+		bool     m_bCrouching = false;
+		uint32_t m_inputSequence = 0;
+
+		// Snapshot state
+		uint32_t m_newestTick = 0;
+		uint32_t m_newestTickParts = 0;
+		uint32_t m_newestSequence = 0;
+		uint32_t m_lastReportedTick = 0;
+		uint32_t m_measureFirstSequence = 1;
+		uint32_t m_packetsReceived = 0;
+		uint64_t m_bytesReceived = 0;
+		uint32_t m_groupEntriesSent[LoadTestProtocol::MaxGroups] = {};
+		uint32_t m_groupEntriesSentBefore[LoadTestProtocol::MaxGroups] = {};
+		uint32_t m_groupEntriesReceived[LoadTestProtocol::MaxGroups] = {};
+
+		CSamples m_roundTrips;
+		CSamples m_serverHolds;
+	};
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--port") == 0 && bHasValue)
+				options.port = atoi(argv[++i]);
+			else if (strcmp(argv[i], "--clients") == 0 && bHasValue)
+				options.clients = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+			else if (strcmp(argv[i], "--duration") == 0 && bHasValue)
+				options.duration = std::max(static_cast<float>(atof(argv[++i])), 1.f);
+			else if (strcmp(argv[i], "--warmup") == 0 && bHasValue)
+				options.warmup = std::max(static_cast<float>(atof(argv[++i])), 0.f);
+			else if (strcmp(argv[i], "--connect-rate") == 0 && bHasValue)
+				options.connectRate = std::max(static_cast<float>(atof(argv[++i])), 1.f);
+			else if (strcmp(argv[i], "--seed") == 0 && bHasValue)
+				options.seed = static_cast<uint32_t>(atoi(argv[++i]));
+			else
+				return false;
+		}
+		return true;
+	}
+
+	void Report(std::vector<CFakeClient>& clients, const std::vector<std::string>& groupNames, std::vector<std::pair<uint32_t, uint32_t>>& serverTickBytes, float duration)
+	{
+		// Every client reports the same server ticks, keep one sample per tick
+		std::sort(serverTickBytes.begin(), serverTickBytes.end());
+		serverTickBytes.erase(std::unique(serverTickBytes.begin(), serverTickBytes.end(), [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first == b.first; }), serverTickBytes.end());
+
+		CSamples tickBytes;
+		for (const auto& tick : serverTickBytes)
+		{
+			tickBytes.Add(tick.second);
+		}
+		tickBytes.Sort();
+
+		printf("Server send per tick over %u ticks: mean %.0f bytes, p50 %llu, p99 %llu, max %llu\n",
+			static_cast<uint32_t>(tickBytes.GetCount()), tickBytes.GetMean(),
+			static_cast<unsigned long long>(tickBytes.GetPercentile(0.5)), static_cast<unsigned long long>(tickBytes.GetPercentile(0.99)), static_cast<unsigned long long>(tickBytes.GetPercentile(1.0)));
+
+		// Latency: the distribution of every client's median and p99, so one slow client stands out
+		CSamples clientMedians;
+		CSamples clientP99s;
+		CSamples allHolds;
+		uint64_t bytesReceived = 0;
+		uint32_t packetsReceived = 0;
+		uint32_t packetsDropped = 0;
+		uint32_t silentClients = 0;
+
+		for (CFakeClient& client : clients)
+		{
+			CSamples& roundTrips = client.GetRoundTrips();
+			if (roundTrips.IsEmpty())
+			{
+				++silentClients;
+			}
+			else
+			{
+				roundTrips.Sort();
+				clientMedians.Add(roundTrips.GetPercentile(0.5));
+				clientP99s.Add(roundTrips.GetPercentile(0.99));
+			}
+
+			CSamples& holds = client.GetServerHolds();
+			holds.Sort();
+			allHolds.Add(holds.GetPercentile(0.5));
+
+			bytesReceived += client.GetBytesReceived();
+			packetsReceived += client.GetPacketsReceived();
+			packetsDropped += client.GetPacketsDropped();
+		}
+
+		clientMedians.Sort();
+		clientP99s.Sort();
+		allHolds.Sort();
+
+		printf("Client round trip (input sent -> snapshot echoing it received):\n");
+		printf("  median per client: best %.2fms, typical %.2fms, worst %.2fms\n",
+			clientMedians.GetPercentile(0.0) / 1000.0, clientMedians.GetPercentile(0.5) / 1000.0, clientMedians.GetPercentile(1.0) / 1000.0);
+		printf("  p99 per client:    best %.2fms, typical %.2fms, worst %.2fms\n",
+			clientP99s.GetPercentile(0.0) / 1000.0, clientP99s.GetPercentile(0.5) / 1000.0, clientP99s.GetPercentile(1.0) / 1000.0);
+		printf("  of which waiting for the server tick: typical %.2fms\n", allHolds.GetPercentile(0.5) / 1000.0);
+		if (silentClients > 0)
+		{
+			printf("  %u clients received no snapshots\n", silentClients);
+		}
+
+		printf("Snapshots: %u packets, %.1f KB/s per client, %u dropped (%.2f%%)\n",
+			packetsReceived, clients.empty() ? 0.0 : bytesReceived / 1024.0 / duration / clients.size(), packetsDropped,
+			packetsReceived + packetsDropped > 0 ? 100.0 * packetsDropped / (packetsReceived + packetsDropped) : 0.0);
+
+		printf("Entries per Scheduler.xml group:\n");
+		for (uint32_t group = 0; group < groupNames.size(); ++group)
+		{
+			uint64_t sent = 0;
+			uint64_t received = 0;
+			for (const CFakeClient& client : clients)
+			{
+				sent += client.GetGroupEntriesSent(group);
+				received += client.GetGroupEntriesReceived(group);
+			}
+
+			if (sent == 0)
+				continue;
+
+			const uint64_t dropped = sent > received ? sent - received : 0;
+			printf("  %-16s %10llu sent, %8llu dropped (%.2f%%)\n", groupNames[group].c_str(),
+				static_cast<unsigned long long>(sent), static_cast<unsigned long long>(dropped), 100.0 * dropped / sent);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: LoopbackLoad [--port 27016] [--clients 256] [--duration 30] [--warmup 3] [--connect-rate 100] [--seed 1]\n");
+		return 1;
+	}
+
+	sockaddr_in server = {};
+	server.sin_family = AF_INET;
+	server.sin_port = htons(static_cast<uint16_t>(options.port));
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	const int epoll = epoll_create1(0);
+	if (epoll < 0)
+	{
+		printf("epoll_create1 failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	std::vector<CFakeClient> clients;
+	clients.reserve(options.clients);
+	for (uint32_t i = 0; i < options.clients; ++i)
+	{
+		clients.emplace_back(i, options.seed);
+		if (!clients.back().Open(server, epoll))
+		{
+			printf("Can't open client socket %u: %s\n", i, strerror(errno));
+			return 1;
+		}
+	}
+
+	printf("%u clients connecting to 127.0.0.1:%d\n", options.clients, options.port);
+
+	std::vector<std::string> groupNames;
+	std::vector<std::pair<uint32_t, uint32_t>> serverTickBytes;
+	std::vector<epoll_event> events(256);
+
+	uint32_t tickRate = 0;
+	const uint64_t start = NowMicroseconds();
+	uint64_t nextTick = start;
+	uint64_t measureStart = 0;
+	uint64_t lastHello = start;
+	uint32_t helloCount = 0;
+	bool bMeasuring = false;
+
+	for (;;)
+	{
+		const uint64_t now = NowMicroseconds();
+		const float elapsed = static_cast<float>(now - start) / 1000000.f;
+
+		// Clients say hello at the connect rate, unanswered hellos are repeated every second
+		const uint32_t connecting = std::min(options.clients, static_cast<uint32_t>(elapsed * options.connectRate) + 1);
+		const bool bRepeatHellos = now - lastHello > 1000000;
+		for (uint32_t i = bRepeatHellos ? 0 : helloCount; i < connecting; ++i)
+		{
+			if (!clients[i].IsWelcomed())
+			{
+				clients[i].SendHello();
+			}
+		}
+		helloCount = connecting;
+		if (bRepeatHellos)
+		{
+			lastHello = now;
+		}
+
+		if (tickRate > 0 && now >= nextTick)
+		{
+			const float tickTime = 1.f / static_cast<float>(tickRate);
+			for (CFakeClient& client : clients)
+			{
+				if (client.IsWelcomed())
+				{
+					client.SendInput(tickTime);
+				}
+			}
+			nextTick += static_cast<uint64_t>(1000000.f * tickTime);
+			// Don't try to catch up after a stall, that would be a burst real clients don't send
+			nextTick = std::max(nextTick, now);
+		}
+
+		const uint32_t welcomed = static_cast<uint32_t>(std::count_if(clients.begin(), clients.end(), [](const CFakeClient& client) { return client.IsWelcomed(); }));
+		if (!bMeasuring && welcomed == options.clients && measureStart == 0)
+		{
+			measureStart = now + static_cast<uint64_t>(options.warmup * 1000000.f);
+			printf("All clients connected after %.1fs, measuring %.0fs after %.0fs warmup\n", elapsed, options.duration, options.warmup);
+		}
+		if (!bMeasuring && measureStart != 0 && now >= measureStart)
+		{
+			bMeasuring = true;
+			for (CFakeClient& client : clients)
+			{
+				client.BeginMeasuring();
+			}
+		}
+		if (bMeasuring && now >= measureStart + static_cast<uint64_t>(options.duration * 1000000.f))
+			break;
+		if (measureStart == 0 && elapsed > 30.f + options.clients / options.connectRate)
+		{
+			printf("Only %u of %u clients were accepted, is the server running with g_loadTestPort %d and a level loaded?\n", welcomed, options.clients, options.port);
+			return 1;
+		}
+
+		const int timeout = tickRate > 0 ? static_cast<int>(std::min<uint64_t>(nextTick > now ? (nextTick - now) / 1000 : 0, 10)) : 10;
+		const int count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), timeout);
+		for (int i = 0; i < count; ++i)
+		{
+			const uint32_t rate = clients[events[i].data.u32].Receive(bMeasuring, groupNames, serverTickBytes);
+			tickRate = rate > 0 ? rate : tickRate;
+		}
+	}
+
+	for (CFakeClient& client : clients)
+	{
+		client.SendBye();
+	}
+
+	Report(clients, groupNames, serverTickBytes, options.duration);
+	close(epoll);
+	return 0;
+}
@@ -0,0 +1,579 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Compares two ways of opening the .pak files of a
+// package and finding and reading every entry in them:
+//  - file by file: the central directory is read into the
+//    heap and sorted by name, and each entry is read with
+//    a seek and a copy, as a stdio based reader does
+//  - mapped: the archive is mapped once, CPakArchive
+//    indexes it with a perfect hash and entries are views
+//    into the mapping (Systems/PakArchive.h)
+// Both paths checksum the same bytes, so only the open,
+// lookup and access overhead differs. Every run also
+// checks that both paths find the same entries with the
+// same bytes.
+// Then inflates every deflated entry of the package one
+// after another, as a reader without a pipeline does, and
+// with CPakDecompressor (Systems/PakDecompressor.h) on 1
+// up to --threads inflaters. Level paks are queued at a
+// higher priority, delivery must keep to it and every
+// entry must match its crc.
+//   PakBenchmark --package "My Project2_package" [--iterations 20] [--threads 0]
+// The first iteration is the closest to a cold start, the
+// page cache is not dropped. Linux only, built without
+// the engine.
+////////////////////////////////////////////////////////
+
+#include "../../Systems/PakArchive.h"
+#include "../../Systems/PakDecompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	struct SOptions
+	{
+		std::string package = "My Project2_package";
+		uint32_t    iterations = 20;
+		uint32_t    threads = 0; // Up to one per hardware thread
+	};
+
+	// Microseconds of each iteration of one phase
+	class CTimings
+	{
+	public:
+		void   Add(double microseconds) { m_values.push_back(microseconds); }
+		double GetFirst() const         { return m_values.empty() ? 0.0 : m_values.front(); }
+		double GetMedian() const
+		{
+			if (m_values.empty())
+				return 0.0;
+
+			std::vector<double> sorted = m_values;
+			std::sort(sorted.begin(), sorted.end());
+			return sorted[sorted.size() / 2];
+		}
+
+	private:
+		std::vector<double> m_values;
+	};
+
+	struct SPhaseTimings
+	{
+		CTimings open;
+		CTimings lookup;
+		CTimings access;
+	};
+
+	double GetMicroseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void FindPaks(const std::string& directory, std::vector<std::string>& paks)
+	{
+		DIR* pDirectory = opendir(directory.c_str());
+		if (pDirectory == nullptr)
+			return;
+
+		while (const dirent* pEntry = readdir(pDirectory))
+		{
+			if (strcmp(pEntry->d_name, ".") == 0 || strcmp(pEntry->d_name, "..") == 0)
+				continue;
+
+			const std::string path = directory + "/" + pEntry->d_name;
+			struct stat status;
+			if (stat(path.c_str(), &status) != 0)
+				continue;
+
+			const size_t length = strlen(pEntry->d_name);
+			if (S_ISDIR(status.st_mode))
+			{
+				FindPaks(path, paks);
+			}
+			else if (length > 4 && strcasecmp(pEntry->d_name + length - 4, ".pak") == 0)
+			{
+				paks.push_back(path);
+			}
+		}
+		closedir(pDirectory);
+		std::sort(paks.begin(), paks.end());
+	}
+
+	std::string NormalizeName(const char* szName, size_t length)
+	{
+		std::string name(szName, length);
+		for (char& c : name)
+		{
+			c = c == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		}
+		return name;
+	}
+
+	uint64_t Checksum(const uint8_t* pData, size_t size)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			sum = sum * 31 + pData[i];
+		}
+		return sum;
+	}
+
+	uint16_t ReadU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+	uint32_t ReadU32(const uint8_t* p) { return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+	// The file by file path: stdio, a heap copy of the central directory and of every entry read
+	class CStdioPak
+	{
+	public:
+		struct SEntry
+		{
+			uint32_t compressedSize;
+			uint32_t localHeaderOffset;
+		};
+
+		CStdioPak() = default;
+		~CStdioPak() { Close(); }
+		CStdioPak(const CStdioPak&) = delete;
+		CStdioPak& operator=(const CStdioPak&) = delete;
+
+		bool Open(const char* szPath)
+		{
+			m_pFile = fopen(szPath, "rb");
+			if (m_pFile == nullptr)
+				return false;
+
+			fseek(m_pFile, 0, SEEK_END);
+			const long size = ftell(m_pFile);
+			const long tailSize = std::min<long>(size, 22 + 0xffff);
+			std::vector<uint8_t> tail(static_cast<size_t>(tailSize));
+			fseek(m_pFile, size - tailSize, SEEK_SET);
+			if (tailSize < 22 || fread(tail.data(), 1, tail.size(), m_pFile) != tail.size())
+				return false;
+
+			long endRecord = tailSize - 22;
+			while (ReadU32(&tail[static_cast<size_t>(endRecord)]) != 0x06054b50)
+			{
+				if (endRecord == 0)
+					return false;
+				--endRecord;
+			}
+
+			const uint16_t entryCount = ReadU16(&tail[static_cast<size_t>(endRecord) + 10]);
+			const uint32_t directorySize = ReadU32(&tail[static_cast<size_t>(endRecord) + 12]);
+			const uint32_t directoryOffset = ReadU32(&tail[static_cast<size_t>(endRecord) + 16]);
+			std::vector<uint8_t> directory(directorySize);
+			fseek(m_pFile, static_cast<long>(directoryOffset), SEEK_SET);
+			if (fread(directory.data(), 1, directory.size(), m_pFile) != directory.size())
+				return false;
+
+			size_t position = 0;
+			for (uint32_t i = 0; i < entryCount && position + 46 <= directory.size(); ++i)
+			{
+				const uint8_t* pHeader = &directory[position];
+				const uint16_t nameLength = ReadU16(pHeader + 28);
+				SEntry entry;
+				entry.compressedSize = ReadU32(pHeader + 20);
+				entry.localHeaderOffset = ReadU32(pHeader + 42);
+				m_entries[NormalizeName(reinterpret_cast<const char*>(pHeader + 46), nameLength)] = entry;
+				position += 46 + nameLength + ReadU16(pHeader + 30) + ReadU16(pHeader + 32);
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			if (m_pFile != nullptr)
+			{
+				fclose(m_pFile);
+				m_pFile = nullptr;
+			}
+			m_entries.clear();
+		}
+
+		const SEntry* Find(const char* szName, size_t length) const
+		{
+			const auto it = m_entries.find(NormalizeName(szName, length));
+			return it != m_entries.end() ? &it->second : nullptr;
+		}
+
+		bool Read(const SEntry& entry, std::vector<uint8_t>& data)
+		{
+			uint8_t header[30];
+			fseek(m_pFile, static_cast<long>(entry.localHeaderOffset), SEEK_SET);
+			if (fread(header, 1, sizeof(header), m_pFile) != sizeof(header))
+				return false;
+
+			data.resize(entry.compressedSize);
+			fseek(m_pFile, static_cast<long>(entry.localHeaderOffset) + 30 + ReadU16(header + 26) + ReadU16(header + 28), SEEK_SET);
+			return fread(data.data(), 1, data.size(), m_pFile) == data.size();
+		}
+
+	private:
+		FILE*                         m_pFile = nullptr;
+		std::map<std::string, SEntry> m_entries;
+	};
+
+	class CMappedPak
+	{
+	public:
+		CMappedPak() = default;
+		~CMappedPak() { Close(); }
+		CMappedPak(const CMappedPak&) = delete;
+		CMappedPak& operator=(const CMappedPak&) = delete;
+
+		bool Open(const char* szPath)
+		{
+			const int file = open(szPath, O_RDONLY);
+			if (file < 0)
+				return false;
+
+			struct stat status;
+			if (fstat(file, &status) == 0 && status.st_size > 0)
+			{
+				void* pData = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+				if (pData != MAP_FAILED)
+				{
+					m_pData = pData;
+					m_size = static_cast<size_t>(status.st_size);
+				}
+			}
+			close(file);
+			return m_pData != nullptr && m_archive.Open(m_pData, m_size);
+		}
+
+		void Close()
+		{
+			m_archive.Close();
+			if (m_pData != nullptr)
+			{
+				munmap(m_pData, m_size);
+				m_pData = nullptr;
+			}
+		}
+
+		const CPakArchive& GetArchive() const { return m_archive; }
+
+	private:
+		void*       m_pData = nullptr;
+		size_t      m_size = 0;
+		CPakArchive m_archive;
+	};
+
+	// Entries of a level's paks are needed first
+	int32_t GetInflatePriority(const std::string& pak)
+	{
+		return pak.find("/Levels/") != std::string::npos ? 1 : 0;
+	}
+
+	// Every deflated entry inflated one after another, each with a stream of its own as a reader without a pipeline does
+	bool InflateSequentially(const std::vector<CMappedPak>& archives, uint64_t& inflatedBytes)
+	{
+		bool bValid = true;
+		for (const CMappedPak& mapped : archives)
+		{
+			const CPakArchive& archive = mapped.GetArchive();
+			for (uint32_t index = 0; index < archive.GetEntryCount(); ++index)
+			{
+				const CPakArchive::SEntry& entry = archive.GetEntry(index);
+				const uint8_t* pSource = archive.GetData(index);
+				if (entry.method != CPakArchive::Deflated || pSource == nullptr)
+					continue;
+
+				// Never empty, zlib refuses a null output even for an entry of no bytes
+				std::vector<uint8_t> data(std::max<uint32_t>(entry.size, 1));
+				z_stream stream = {};
+				bool bInflated = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+				if (bInflated)
+				{
+					stream.next_in = const_cast<Bytef*>(pSource);
+					stream.avail_in = entry.compressedSize;
+					stream.next_out = data.data();
+					stream.avail_out = entry.size;
+					bInflated = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == entry.size;
+					inflateEnd(&stream);
+				}
+				bValid &= bInflated && crc32(0, data.data(), entry.size) == entry.crc;
+				inflatedBytes += entry.size;
+			}
+		}
+		return bValid;
+	}
+
+	// The same entries through the pipeline, delivery must follow priority and then queue order
+	bool InflatePipelined(const std::vector<CMappedPak>& archives, const std::vector<std::string>& paks, CPakDecompressor& decompressor)
+	{
+		uint64_t queued = 0;
+		for (size_t pak = 0; pak < archives.size(); ++pak)
+		{
+			const CPakArchive& archive = archives[pak].GetArchive();
+			for (uint32_t index = 0; index < archive.GetEntryCount(); ++index)
+			{
+				if (archive.GetEntry(index).method == CPakArchive::Deflated)
+				{
+					decompressor.Queue(archive, index, GetInflatePriority(paks[pak]), queued++);
+				}
+			}
+		}
+
+		bool bValid = true;
+		int32_t lastPriority = INT32_MAX;
+		uint64_t lastQueued = 0;
+		decompressor.DeliverAll([&](const CPakDecompressor::SResult& result)
+		{
+			bValid &= result.bValid && (result.priority < lastPriority || (result.priority == lastPriority && result.userData > lastQueued));
+			lastPriority = result.priority;
+			lastQueued = result.userData;
+		});
+		return bValid;
+	}
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--package") == 0 && bHasValue)
+				options.package = argv[++i];
+			else if (strcmp(argv[i], "--iterations") == 0 && bHasValue)
+				options.iterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else if (strcmp(argv[i], "--threads") == 0 && bHasValue)
+				options.threads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else
+				return false;
+		}
+		return options.iterations > 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: PakBenchmark [--package \"My Project2_package\"] [--iterations 20] [--threads 0]\n");
+		return 1;
+	}
+
+	std::vector<std::string> paks;
+	FindPaks(options.package, paks);
+	if (paks.empty())
+	{
+		printf("No .pak files in %s\n", options.package.c_str());
+		return 1;
+	}
+
+	// Names to look up, taken from the archives up front so neither path pays for them
+	std::vector<std::vector<std::string>> names(paks.size());
+	for (size_t pak = 0; pak < paks.size(); ++pak)
+	{
+		CMappedPak mapped;
+		if (!mapped.Open(paks[pak].c_str()))
+		{
+			printf("%s: not a pak CPakArchive can read\n", paks[pak].c_str());
+			return 1;
+		}
+		const CPakArchive& archive = mapped.GetArchive();
+		for (uint32_t i = 0; i < archive.GetEntryCount(); ++i)
+		{
+			names[pak].emplace_back(archive.GetName(i), archive.GetEntry(i).nameLength);
+		}
+	}
+
+	SPhaseTimings stdioTimings, mappedTimings;
+	uint64_t entryCount = 0, stdioBytesCopied = 0, storedViews = 0;
+	bool bMismatch = false;
+
+	for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+	{
+		// File by file
+		uint64_t stdioChecksum = 0;
+		{
+			std::vector<CStdioPak> archives(paks.size());
+			auto start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				archives[pak].Open(paks[pak].c_str());
+			}
+			stdioTimings.open.Add(GetMicroseconds(start));
+
+			std::vector<std::vector<const CStdioPak::SEntry*>> found(paks.size());
+			start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				for (const std::string& name : names[pak])
+				{
+					found[pak].push_back(archives[pak].Find(name.c_str(), name.size()));
+				}
+			}
+			stdioTimings.lookup.Add(GetMicroseconds(start));
+
+			std::vector<uint8_t> data;
+			start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				for (const CStdioPak::SEntry* pEntry : found[pak])
+				{
+					if (pEntry != nullptr && archives[pak].Read(*pEntry, data))
+					{
+						stdioChecksum += Checksum(data.data(), data.size());
+						stdioBytesCopied += iteration == 0 ? data.size() : 0;
+					}
+				}
+			}
+			stdioTimings.access.Add(GetMicroseconds(start));
+		}
+
+		// Mapped
+		uint64_t mappedChecksum = 0;
+		{
+			std::vector<CMappedPak> archives(paks.size());
+			auto start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				archives[pak].Open(paks[pak].c_str());
+			}
+			mappedTimings.open.Add(GetMicroseconds(start));
+
+			std::vector<std::vector<uint32_t>> found(paks.size());
+			start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				for (const std::string& name : names[pak])
+				{
+					found[pak].push_back(archives[pak].GetArchive().Find(name.c_str(), name.size()));
+				}
+			}
+			mappedTimings.lookup.Add(GetMicroseconds(start));
+
+			start = std::chrono::steady_clock::now();
+			for (size_t pak = 0; pak < paks.size(); ++pak)
+			{
+				const CPakArchive& archive = archives[pak].GetArchive();
+				for (const uint32_t index : found[pak])
+				{
+					const uint8_t* pData = index != CPakArchive::NotFound ? archive.GetData(index) : nullptr;
+					if (pData != nullptr)
+					{
+						mappedChecksum += Checksum(pData, archive.GetEntry(index).compressedSize);
+					}
+				}
+			}
+			mappedTimings.access.Add(GetMicroseconds(start));
+
+			if (iteration == 0)
+			{
+				for (size_t pak = 0; pak < paks.size(); ++pak)
+				{
+					const CPakArchive& archive = archives[pak].GetArchive();
+					entryCount += archive.GetEntryCount();
+					for (uint32_t index = 0; index < archive.GetEntryCount(); ++index)
+					{
+						size_t size;
+						storedViews += archive.GetStoredView(index, size) != nullptr ? 1 : 0;
+					}
+
+					// A name that isn't there must not find whatever shares its slot
+					bMismatch |= archive.Find("no/such/file.xml") != CPakArchive::NotFound;
+				}
+			}
+		}
+
+		bMismatch |= stdioChecksum != mappedChecksum;
+	}
+
+	printf("%u paks, %llu entries (%llu stored, served as views), %u iterations\n", static_cast<uint32_t>(paks.size()),
+		static_cast<unsigned long long>(entryCount), static_cast<unsigned long long>(storedViews), options.iterations);
+	printf("%-8s %14s %14s %14s %14s\n", "", "open", "lookup all", "ns/lookup", "read all");
+	const auto printRow = [entryCount](const char* szName, const SPhaseTimings& timings, bool bFirst)
+	{
+		const double lookup = bFirst ? timings.lookup.GetFirst() : timings.lookup.GetMedian();
+		printf("%-8s %12.1fus %12.1fus %14.1f %12.1fus\n", szName, bFirst ? timings.open.GetFirst() : timings.open.GetMedian(),
+			lookup, entryCount > 0 ? lookup * 1000.0 / static_cast<double>(entryCount) : 0.0, bFirst ? timings.access.GetFirst() : timings.access.GetMedian());
+	};
+
+	printf("First iteration:\n");
+	printRow("stdio", stdioTimings, true);
+	printRow("mapped", mappedTimings, true);
+	printf("Median:\n");
+	printRow("stdio", stdioTimings, false);
+	printRow("mapped", mappedTimings, false);
+
+	const double stdioTotal = stdioTimings.open.GetMedian() + stdioTimings.lookup.GetMedian();
+	const double mappedTotal = mappedTimings.open.GetMedian() + mappedTimings.lookup.GetMedian();
+	printf("Open and lookup: %.1fus -> %.1fus (%.1fx), %llu bytes no longer copied per start\n", stdioTotal, mappedTotal,
+		mappedTotal > 0.0 ? stdioTotal / mappedTotal : 0.0, static_cast<unsigned long long>(stdioBytesCopied));
+
+	if (bMismatch)
+	{
+		printf("MISMATCH: the paths found different entries or bytes\n");
+		return 1;
+	}
+
+	std::vector<CMappedPak> archives(paks.size());
+	for (size_t pak = 0; pak < paks.size(); ++pak)
+	{
+		archives[pak].Open(paks[pak].c_str());
+	}
+
+	CTimings sequentialTimings;
+	uint64_t inflatedBytes = 0;
+	bool bInflateFailed = false;
+	for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+	{
+		uint64_t bytes = 0;
+		const auto start = std::chrono::steady_clock::now();
+		bInflateFailed |= !InflateSequentially(archives, bytes);
+		sequentialTimings.Add(GetMicroseconds(start));
+		inflatedBytes = bytes;
+	}
+
+	const uint32_t maxThreads = options.threads > 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	printf("Inflating %llu bytes of deflated entries, median:\n", static_cast<unsigned long long>(inflatedBytes));
+	printf("  one after another %10.1fus %8.1f MB/s\n", sequentialTimings.GetMedian(),
+		sequentialTimings.GetMedian() > 0.0 ? static_cast<double>(inflatedBytes) / sequentialTimings.GetMedian() : 0.0);
+	for (uint32_t threads = 1;; threads = std::min(threads * 2, maxThreads))
+	{
+		// One decompressor per thread count, so its buffer pool is warm after the first iteration as during a level load
+		CPakDecompressor decompressor(threads);
+		CTimings pipelinedTimings;
+		for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			bInflateFailed |= !InflatePipelined(archives, paks, decompressor);
+			pipelinedTimings.Add(GetMicroseconds(start));
+		}
+
+		const CPakDecompressor::SStatistics statistics = decompressor.GetStatistics();
+		printf("  %2u inflaters       %10.1fus %8.1f MB/s %5.2fx, %llu buffers allocated, %llu reused\n", threads, pipelinedTimings.GetMedian(),
+			pipelinedTimings.GetMedian() > 0.0 ? static_cast<double>(inflatedBytes) / pipelinedTimings.GetMedian() : 0.0,
+			pipelinedTimings.GetMedian() > 0.0 ? sequentialTimings.GetMedian() / pipelinedTimings.GetMedian() : 0.0,
+			static_cast<unsigned long long>(statistics.buffersAllocated), static_cast<unsigned long long>(statistics.buffersReused));
+		if (threads == maxThreads)
+			break;
+	}
+
+	if (bInflateFailed)
+	{
+		printf("MISMATCH: an entry didn't inflate to its crc, or was delivered out of order\n");
+		return 1;
+	}
+	return 0;
+}
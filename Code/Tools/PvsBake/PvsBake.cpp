@@ -0,0 +1,726 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Bakes the potentially visible set of a level for the
+// server's interest management (see
+// CPotentiallyVisibleSet), so players behind solid walls
+// are not sent to clients that can't see them:
+//   PvsBake --level Assets/Levels/example [--cell 4] [--samples 8] [--dilate 1]
+// Occluders are the Designer objects of the level's
+// Layers/*.lyr, their triangulated meshes moved to the
+// world by the object's position, rotation and scale.
+// Terrain and brushes referencing .cgf files are not
+// occluders, leaving them out only makes the set more
+// permissive.
+// Two cells see each other when any segment between
+// samples spread over both of them misses every occluder.
+// The result is then grown by --dilate cells, covering
+// what the samples missed and entities moving between
+// updates. Linux only, built without the engine.
+////////////////////////////////////////////////////////
+
+#include "../../Network/PotentiallyVisibleSetFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+
+namespace
+{
+	struct SVec3
+	{
+		float x, y, z;
+
+		SVec3 operator+(const SVec3& other) const { return { x + other.x, y + other.y, z + other.z }; }
+		SVec3 operator-(const SVec3& other) const { return { x - other.x, y - other.y, z - other.z }; }
+		SVec3 operator*(float scale) const        { return { x * scale, y * scale, z * scale }; }
+		float operator[](int axis) const          { return axis == 0 ? x : (axis == 1 ? y : z); }
+	};
+
+	float Dot(const SVec3& a, const SVec3& b)   { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	SVec3 Cross(const SVec3& a, const SVec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+	struct STriangle
+	{
+		SVec3 v0, edge1, edge2;
+		SVec3 min, max;
+	};
+
+	struct SOptions
+	{
+		std::string level = "Assets/Levels/example";
+		std::string output; // Defaults to <level>/visibility.pvs
+		float       cellSize = 4.f;
+		uint32_t    samples = 8;
+		uint32_t    dilate = 1;
+		float       height = 8.f; // Space above the highest occluder players can be in
+		uint32_t    threads = 0;
+	};
+
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+			return false;
+
+		contents.clear();
+		char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		{
+			contents.append(buffer, read);
+		}
+		fclose(pFile);
+		return true;
+	}
+
+	std::vector<std::string> ListFiles(const std::string& directory, const char* szExtension)
+	{
+		std::vector<std::string> files;
+		DIR* pDirectory = opendir(directory.c_str());
+		if (pDirectory == nullptr)
+			return files;
+
+		const size_t extensionLength = strlen(szExtension);
+		while (const dirent* pEntry = readdir(pDirectory))
+		{
+			const size_t length = strlen(pEntry->d_name);
+			if (length > extensionLength && strcasecmp(pEntry->d_name + length - extensionLength, szExtension) == 0)
+			{
+				files.push_back(directory + "/" + pEntry->d_name);
+			}
+		}
+		closedir(pDirectory);
+
+		// readdir order depends on the file system, the hash must not
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	uint32_t HashBytes(uint32_t hash, const void* pData, size_t size)
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= pBytes[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	std::string GetAttribute(const std::string& xml, size_t tagStart, const char* szAttribute)
+	{
+		const size_t tagEnd = xml.find('>', tagStart);
+		const std::string key = std::string(" ") + szAttribute + "=\"";
+		const size_t start = xml.find(key, tagStart);
+		if (start == std::string::npos || start > tagEnd)
+			return std::string();
+
+		const size_t valueStart = start + key.size();
+		return xml.substr(valueStart, xml.find('"', valueStart) - valueStart);
+	}
+
+	bool ParseFloats(const std::string& value, float* pValues, int count)
+	{
+		const char* szValue = value.c_str();
+		for (int i = 0; i < count; ++i)
+		{
+			char* szEnd;
+			pValues[i] = strtof(szValue, &szEnd);
+			if (szEnd == szValue)
+				return false;
+			szValue = *szEnd == ',' ? szEnd + 1 : szEnd;
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> DecodeBase64(const std::string& text)
+	{
+		std::vector<uint8_t> bytes;
+		bytes.reserve(text.size() * 3 / 4);
+		uint32_t accumulator = 0;
+		int bits = 0;
+		for (const char c : text)
+		{
+			int value;
+			if (c >= 'A' && c <= 'Z')      value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+')             value = 62;
+			else if (c == '/')             value = 63;
+			else                           continue;
+
+			accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+			bits += 6;
+			if (bits >= 8)
+			{
+				bits -= 8;
+				bytes.push_back(static_cast<uint8_t>(accumulator >> bits));
+			}
+		}
+		return bytes;
+	}
+
+	template<typename T>
+	T ReadValue(const std::vector<uint8_t>& bytes, size_t offset)
+	{
+		T value;
+		memcpy(&value, bytes.data() + offset, sizeof(T));
+		return value;
+	}
+
+	// Sandbox's Designer mesh, version 2: seven counts (the 3rd positions, 4th normals, 5th indices, 6th texture coordinates),
+	// then float positions, float normals, float UVs and uint16 indices
+	bool AddDesignerMesh(const std::vector<uint8_t>& mesh, const float position[3], const float rotation[4], const float scale[3], std::vector<STriangle>& triangles)
+	{
+		static constexpr size_t HeaderSize = 7 * sizeof(uint32_t);
+		if (mesh.size() < HeaderSize)
+			return false;
+
+		const uint32_t positionCount = ReadValue<uint32_t>(mesh, 8);
+		const uint32_t normalCount = ReadValue<uint32_t>(mesh, 12);
+		const uint32_t indexCount = ReadValue<uint32_t>(mesh, 16);
+		const uint32_t texCoordCount = ReadValue<uint32_t>(mesh, 20);
+		const size_t indexOffset = HeaderSize + static_cast<size_t>(positionCount) * 12 + static_cast<size_t>(normalCount) * 12 + static_cast<size_t>(texCoordCount) * 8;
+		if (indexCount % 3 != 0 || indexOffset + static_cast<size_t>(indexCount) * 2 > mesh.size())
+			return false;
+
+		// Quaternion as the layer stores it, w first
+		const float w = rotation[0], qx = rotation[1], qy = rotation[2], qz = rotation[3];
+		std::vector<SVec3> vertices(positionCount);
+		for (uint32_t i = 0; i < positionCount; ++i)
+		{
+			const SVec3 local = { ReadValue<float>(mesh, HeaderSize + i * 12) * scale[0], ReadValue<float>(mesh, HeaderSize + i * 12 + 4) * scale[1], ReadValue<float>(mesh, HeaderSize + i * 12 + 8) * scale[2] };
+			const SVec3 axis = { qx, qy, qz };
+			const SVec3 t = Cross(axis, local) * 2.f;
+			const SVec3 rotated = local + t * w + Cross(axis, t);
+			vertices[i] = rotated + SVec3 { position[0], position[1], position[2] };
+		}
+
+		for (uint32_t i = 0; i < indexCount; i += 3)
+		{
+			uint16_t index[3];
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				index[corner] = ReadValue<uint16_t>(mesh, indexOffset + (i + corner) * 2);
+				if (index[corner] >= positionCount)
+					return false;
+			}
+
+			STriangle triangle;
+			triangle.v0 = vertices[index[0]];
+			triangle.edge1 = vertices[index[1]] - triangle.v0;
+			triangle.edge2 = vertices[index[2]] - triangle.v0;
+			triangle.min = { std::min({ vertices[index[0]].x, vertices[index[1]].x, vertices[index[2]].x }), std::min({ vertices[index[0]].y, vertices[index[1]].y, vertices[index[2]].y }), std::min({ vertices[index[0]].z, vertices[index[1]].z, vertices[index[2]].z }) };
+			triangle.max = { std::max({ vertices[index[0]].x, vertices[index[1]].x, vertices[index[2]].x }), std::max({ vertices[index[0]].y, vertices[index[1]].y, vertices[index[2]].y }), std::max({ vertices[index[0]].z, vertices[index[1]].z, vertices[index[2]].z }) };
+
+			// Degenerate triangles block nothing
+			if (Dot(Cross(triangle.edge1, triangle.edge2), Cross(triangle.edge1, triangle.edge2)) > 1e-12f)
+			{
+				triangles.push_back(triangle);
+			}
+		}
+		return true;
+	}
+
+	// Collects the occluders of one layer file, returns how many Designer objects it had
+	uint32_t LoadLayer(const std::string& xml, std::vector<STriangle>& triangles, uint32_t& skipped)
+	{
+		uint32_t objects = 0;
+		for (size_t start = xml.find("<Object "); start != std::string::npos; start = xml.find("<Object ", start + 1))
+		{
+			const std::string type = GetAttribute(xml, start, "Type");
+			if (type != "Designer")
+			{
+				skipped += type == "Brush" ? 1 : 0;
+				continue;
+			}
+
+			float position[3] = { 0.f, 0.f, 0.f };
+			float rotation[4] = { 1.f, 0.f, 0.f, 0.f };
+			float scale[3] = { 1.f, 1.f, 1.f };
+			ParseFloats(GetAttribute(xml, start, "Pos"), position, 3);
+			ParseFloats(GetAttribute(xml, start, "Rotate"), rotation, 4);
+			ParseFloats(GetAttribute(xml, start, "Scale"), scale, 3);
+
+			const size_t end = xml.find("</Object>", start);
+			const size_t mesh = xml.find("<Mesh ", start);
+			if (mesh == std::string::npos || mesh > end || !AddDesignerMesh(DecodeBase64(GetAttribute(xml, mesh, "BinaryData")), position, rotation, scale, triangles))
+			{
+				printf("  %s: no mesh this tool can read, skipped\n", GetAttribute(xml, start, "Name").c_str());
+				++skipped;
+				continue;
+			}
+			++objects;
+		}
+		return objects;
+	}
+
+	class CVisibilityBaker
+	{
+	public:
+		CVisibilityBaker(const std::vector<STriangle>& triangles, const SVec3& origin, float cellSize, const uint32_t cellCount[3])
+			: m_triangles(triangles)
+			, m_origin(origin)
+			, m_cellSize(cellSize)
+		{
+			std::copy(cellCount, cellCount + 3, m_cellCount);
+			m_totalCells = cellCount[0] * cellCount[1] * cellCount[2];
+			m_rowWords = (m_totalCells + 63) / 64;
+
+			// Triangles by the cells their bounds touch, segments only test the ones of the cells they cross
+			m_cellTriangles.resize(m_totalCells);
+			for (uint32_t i = 0; i < triangles.size(); ++i)
+			{
+				int32_t minCell[3], maxCell[3];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					minCell[axis] = std::max(GetCellCoordinate(triangles[i].min[axis], axis), 0);
+					maxCell[axis] = std::min(GetCellCoordinate(triangles[i].max[axis], axis), static_cast<int32_t>(m_cellCount[axis]) - 1);
+				}
+				for (int32_t z = minCell[2]; z <= maxCell[2]; ++z)
+					for (int32_t y = minCell[1]; y <= maxCell[1]; ++y)
+						for (int32_t x = minCell[0]; x <= maxCell[0]; ++x)
+							m_cellTriangles[GetCellIndex(x, y, z)].push_back(i);
+			}
+		}
+
+		uint32_t GetCellCount() const { return m_totalCells; }
+		uint32_t GetRowWords() const  { return m_rowWords; }
+
+		std::vector<uint64_t> Bake(uint32_t samplesPerCell, uint32_t threadCount, uint64_t& segmentsTested)
+		{
+			std::vector<SVec3> samples(static_cast<size_t>(m_totalCells) * samplesPerCell);
+			for (uint32_t cell = 0; cell < m_totalCells; ++cell)
+			{
+				GenerateSamples(cell, samplesPerCell, &samples[static_cast<size_t>(cell) * samplesPerCell]);
+			}
+
+			// Each pair is tested once by the thread owning its lower cell, the upper half is mirrored afterwards
+			std::vector<uint64_t> bits(static_cast<size_t>(m_totalCells) * m_rowWords, 0);
+			std::atomic<uint32_t> nextCell(0);
+			std::atomic<uint64_t> segments(0);
+			auto worker = [&]()
+			{
+				uint64_t localSegments = 0;
+				for (uint32_t a = nextCell++; a < m_totalCells; a = nextCell++)
+				{
+					uint64_t* pRow = &bits[static_cast<size_t>(a) * m_rowWords];
+					for (uint32_t b = a; b < m_totalCells; ++b)
+					{
+						if (AreNeighbors(a, b) || CanSee(&samples[static_cast<size_t>(a) * samplesPerCell], &samples[static_cast<size_t>(b) * samplesPerCell], samplesPerCell, localSegments))
+						{
+							pRow[b >> 6] |= uint64_t(1) << (b & 63);
+						}
+					}
+				}
+				segments += localSegments;
+			};
+
+			std::vector<std::thread> threads;
+			for (uint32_t i = 0; i < threadCount; ++i)
+			{
+				threads.emplace_back(worker);
+			}
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+
+			for (uint32_t a = 0; a < m_totalCells; ++a)
+			{
+				for (uint32_t b = a + 1; b < m_totalCells; ++b)
+				{
+					if ((bits[static_cast<size_t>(a) * m_rowWords + (b >> 6)] >> (b & 63)) & 1)
+					{
+						bits[static_cast<size_t>(b) * m_rowWords + (a >> 6)] |= uint64_t(1) << (a & 63);
+					}
+				}
+			}
+
+			segmentsTested = segments;
+			return bits;
+		}
+
+		// Everything seen from a cell grows by radius cells in every direction
+		std::vector<uint64_t> Dilate(const std::vector<uint64_t>& bits, uint32_t radius) const
+		{
+			std::vector<uint64_t> dilated(bits.size(), 0);
+			for (uint32_t a = 0; a < m_totalCells; ++a)
+			{
+				const uint64_t* pRow = &bits[static_cast<size_t>(a) * m_rowWords];
+				uint64_t* pDilated = &dilated[static_cast<size_t>(a) * m_rowWords];
+				for (uint32_t b = 0; b < m_totalCells; ++b)
+				{
+					if (((pRow[b >> 6] >> (b & 63)) & 1) == 0)
+						continue;
+
+					int32_t cell[3];
+					GetCellCoordinates(b, cell);
+					const int32_t r = static_cast<int32_t>(radius);
+					for (int32_t z = std::max(cell[2] - r, 0); z <= std::min(cell[2] + r, static_cast<int32_t>(m_cellCount[2]) - 1); ++z)
+						for (int32_t y = std::max(cell[1] - r, 0); y <= std::min(cell[1] + r, static_cast<int32_t>(m_cellCount[1]) - 1); ++y)
+							for (int32_t x = std::max(cell[0] - r, 0); x <= std::min(cell[0] + r, static_cast<int32_t>(m_cellCount[0]) - 1); ++x)
+							{
+								const uint32_t index = GetCellIndex(x, y, z);
+								pDilated[index >> 6] |= uint64_t(1) << (index & 63);
+							}
+				}
+			}
+			return dilated;
+		}
+
+	private:
+		int32_t  GetCellCoordinate(float value, int axis) const { return static_cast<int32_t>(floorf((value - m_origin[axis]) / m_cellSize)); }
+		uint32_t GetCellIndex(int32_t x, int32_t y, int32_t z) const { return static_cast<uint32_t>(x) + m_cellCount[0] * (static_cast<uint32_t>(y) + m_cellCount[1] * static_cast<uint32_t>(z)); }
+
+		void GetCellCoordinates(uint32_t index, int32_t cell[3]) const
+		{
+			cell[0] = static_cast<int32_t>(index % m_cellCount[0]);
+			cell[1] = static_cast<int32_t>((index / m_cellCount[0]) % m_cellCount[1]);
+			cell[2] = static_cast<int32_t>(index / (m_cellCount[0] * m_cellCount[1]));
+		}
+
+		bool AreNeighbors(uint32_t a, uint32_t b) const
+		{
+			int32_t cellA[3], cellB[3];
+			GetCellCoordinates(a, cellA);
+			GetCellCoordinates(b, cellB);
+			return std::abs(cellA[0] - cellB[0]) <= 1 && std::abs(cellA[1] - cellB[1]) <= 1 && std::abs(cellA[2] - cellB[2]) <= 1;
+		}
+
+		// Stratified over the cell, one jittered sample per part of a 2x2x2 split first, kept off the faces so
+		// a sample on a wall's surface doesn't see through it. Seeded by the cell, every bake gives the same set.
+		void GenerateSamples(uint32_t cell, uint32_t count, SVec3* pSamples) const
+		{
+			int32_t coordinates[3];
+			GetCellCoordinates(cell, coordinates);
+			uint32_t state = cell * 2654435761u + 1;
+			auto random = [&state]()
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return static_cast<float>(state >> 8) / 16777216.f;
+			};
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const uint32_t octant = i % 8;
+				float offset[3];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const float half = ((octant >> axis) & 1) != 0 ? 0.5f : 0.f;
+					offset[axis] = 0.05f + 0.9f * (half + 0.5f * random());
+				}
+				pSamples[i] = m_origin + SVec3 { (coordinates[0] + offset[0]) * m_cellSize, (coordinates[1] + offset[1]) * m_cellSize, (coordinates[2] + offset[2]) * m_cellSize };
+			}
+		}
+
+		bool CanSee(const SVec3* pSamplesA, const SVec3* pSamplesB, uint32_t count, uint64_t& segments) const
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				for (uint32_t j = 0; j < count; ++j)
+				{
+					++segments;
+					if (!IsBlocked(pSamplesA[i], pSamplesB[j]))
+						return true;
+				}
+			}
+			return false;
+		}
+
+		// Walks the cells the segment crosses (Amanatides and Woo) and tests the triangles listed in them
+		bool IsBlocked(const SVec3& from, const SVec3& to) const
+		{
+			const SVec3 direction = to - from;
+			int32_t cell[3], step[3], last[3];
+			float next[3], delta[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				cell[axis] = GetCellCoordinate(from[axis], axis);
+				last[axis] = GetCellCoordinate(to[axis], axis);
+				step[axis] = direction[axis] > 0.f ? 1 : (direction[axis] < 0.f ? -1 : 0);
+				if (step[axis] == 0)
+				{
+					next[axis] = delta[axis] = INFINITY;
+					continue;
+				}
+
+				const float boundary = m_origin[axis] + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * m_cellSize;
+				next[axis] = (boundary - from[axis]) / direction[axis];
+				delta[axis] = m_cellSize / std::fabs(direction[axis]);
+			}
+
+			for (;;)
+			{
+				if (cell[0] >= 0 && cell[1] >= 0 && cell[2] >= 0 && cell[0] < static_cast<int32_t>(m_cellCount[0]) && cell[1] < static_cast<int32_t>(m_cellCount[1]) && cell[2] < static_cast<int32_t>(m_cellCount[2]))
+				{
+					for (const uint32_t triangle : m_cellTriangles[GetCellIndex(cell[0], cell[1], cell[2])])
+					{
+						if (Intersects(m_triangles[triangle], from, direction))
+							return true;
+					}
+				}
+
+				if (cell[0] == last[0] && cell[1] == last[1] && cell[2] == last[2])
+					return false;
+
+				const int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+				if (next[axis] > 1.f)
+					return false;
+				cell[axis] += step[axis];
+				next[axis] += delta[axis];
+			}
+		}
+
+		// Moller-Trumbore, both faces block, hits at the segment's ends don't count
+		static bool Intersects(const STriangle& triangle, const SVec3& origin, const SVec3& direction)
+		{
+			const SVec3 p = Cross(direction, triangle.edge2);
+			const float determinant = Dot(triangle.edge1, p);
+			if (std::fabs(determinant) < 1e-9f)
+				return false;
+
+			const float inverse = 1.f / determinant;
+			const SVec3 s = origin - triangle.v0;
+			const float u = Dot(s, p) * inverse;
+			if (u < 0.f || u > 1.f)
+				return false;
+
+			const SVec3 q = Cross(s, triangle.edge1);
+			const float v = Dot(direction, q) * inverse;
+			if (v < 0.f || u + v > 1.f)
+				return false;
+
+			const float t = Dot(triangle.edge2, q) * inverse;
+			return t > 1e-4f && t < 1.f - 1e-4f;
+		}
+
+	private:
+		const std::vector<STriangle>&      m_triangles;
+		std::vector<std::vector<uint32_t>> m_cellTriangles;
+		SVec3                              m_origin;
+		float                              m_cellSize;
+		uint32_t                           m_cellCount[3];
+		uint32_t                           m_totalCells;
+		uint32_t                           m_rowWords;
+	};
+
+	// Level size from the header of leveldata/Heightmap.dat, which starts with the terrain's settings as XML
+	bool GetTerrainSize(const std::string& level, float& size)
+	{
+		std::string heightmap;
+		if (!ReadFile(level + "/leveldata/Heightmap.dat", heightmap))
+			return false;
+
+		const size_t tag = heightmap.find("<Heightmap ");
+		if (tag == std::string::npos)
+			return false;
+
+		const float width = strtof(GetAttribute(heightmap, tag, "Width").c_str(), nullptr);
+		const std::string unitSize = GetAttribute(heightmap, tag, "UnitSize");
+		size = width * (unitSize.empty() ? 1.f : strtof(unitSize.c_str(), nullptr));
+		return size > 0.f;
+	}
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--level") == 0 && bHasValue)
+				options.level = argv[++i];
+			else if (strcmp(argv[i], "--output") == 0 && bHasValue)
+				options.output = argv[++i];
+			else if (strcmp(argv[i], "--cell") == 0 && bHasValue)
+				options.cellSize = strtof(argv[++i], nullptr);
+			else if (strcmp(argv[i], "--samples") == 0 && bHasValue)
+				options.samples = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else if (strcmp(argv[i], "--dilate") == 0 && bHasValue)
+				options.dilate = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else if (strcmp(argv[i], "--height") == 0 && bHasValue)
+				options.height = strtof(argv[++i], nullptr);
+			else if (strcmp(argv[i], "--threads") == 0 && bHasValue)
+				options.threads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else
+				return false;
+		}
+
+		if (options.output.empty())
+		{
+			options.output = options.level + "/visibility.pvs";
+		}
+		if (options.threads == 0)
+		{
+			options.threads = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		return options.cellSize > 0.f && options.samples > 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: PvsBake [--level Assets/Levels/example] [--output <level>/visibility.pvs] [--cell 4] [--samples 8] [--dilate 1] [--height 8] [--threads 0]\n");
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// The hash covers everything the set depends on, the runtime logs it to tell bakes apart
+	uint32_t sourceHash = HashBytes(2166136261u, &options.cellSize, sizeof(options.cellSize));
+	sourceHash = HashBytes(sourceHash, &options.samples, sizeof(options.samples));
+	sourceHash = HashBytes(sourceHash, &options.dilate, sizeof(options.dilate));
+	sourceHash = HashBytes(sourceHash, &options.height, sizeof(options.height));
+
+	std::vector<STriangle> triangles;
+	uint32_t skipped = 0;
+	const std::vector<std::string> layers = ListFiles(options.level + "/Layers", ".lyr");
+	for (const std::string& path : layers)
+	{
+		std::string xml;
+		if (!ReadFile(path, xml))
+			continue;
+
+		sourceHash = HashBytes(sourceHash, xml.data(), xml.size());
+		const size_t before = triangles.size();
+		const uint32_t objects = LoadLayer(xml, triangles, skipped);
+		printf("%-52s %3u occluders, %5u triangles\n", path.c_str(), objects, static_cast<uint32_t>(triangles.size() - before));
+	}
+
+	if (layers.empty())
+	{
+		printf("No layers in %s/Layers\n", options.level.c_str());
+		return 1;
+	}
+	if (skipped > 0)
+	{
+		printf("%u brushes without a readable mesh are not occluders\n", skipped);
+	}
+
+	// Horizontally the terrain, vertically from the lowest occluder to --height above the highest
+	SVec3 min = { 0.f, 0.f, 0.f };
+	SVec3 max = { 0.f, 0.f, 0.f };
+	if (!triangles.empty())
+	{
+		min = max = triangles[0].min;
+		for (const STriangle& triangle : triangles)
+		{
+			min = { std::min(min.x, triangle.min.x), std::min(min.y, triangle.min.y), std::min(min.z, triangle.min.z) };
+			max = { std::max(max.x, triangle.max.x), std::max(max.y, triangle.max.y), std::max(max.z, triangle.max.z) };
+		}
+	}
+
+	float terrainSize;
+	if (GetTerrainSize(options.level, terrainSize))
+	{
+		min.x = min.y = 0.f;
+		max.x = max.y = terrainSize;
+	}
+	max.z += options.height;
+
+	const SVec3 origin = { floorf(min.x / options.cellSize) * options.cellSize, floorf(min.y / options.cellSize) * options.cellSize, floorf(min.z / options.cellSize) * options.cellSize };
+	uint32_t cellCount[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		cellCount[axis] = std::max(static_cast<uint32_t>(ceilf((max[axis] - origin[axis]) / options.cellSize)), 1u);
+	}
+
+	if (static_cast<uint64_t>(cellCount[0]) * cellCount[1] * cellCount[2] > 65536)
+	{
+		printf("%u x %u x %u cells, more than 65536, use a larger --cell\n", cellCount[0], cellCount[1], cellCount[2]);
+		return 1;
+	}
+
+	CVisibilityBaker baker(triangles, origin, options.cellSize, cellCount);
+	printf("Baking %u x %u x %u cells of %.1fm from (%.1f, %.1f, %.1f), %u samples per cell, %u threads\n",
+		cellCount[0], cellCount[1], cellCount[2], options.cellSize, origin.x, origin.y, origin.z, options.samples, options.threads);
+
+	uint64_t segments = 0;
+	std::vector<uint64_t> bits = baker.Bake(options.samples, options.threads, segments);
+	if (options.dilate > 0)
+	{
+		bits = baker.Dilate(bits, options.dilate);
+	}
+
+	// Cells seeing the same set share a row, open areas collapse into a few
+	const uint32_t totalCells = baker.GetCellCount();
+	const uint32_t rowWords = baker.GetRowWords();
+	std::vector<uint32_t> rowIndex(totalCells);
+	std::vector<uint64_t> rows;
+	std::map<std::vector<uint64_t>, uint32_t> uniqueRows;
+	uint64_t visiblePairs = 0;
+	for (uint32_t cell = 0; cell < totalCells; ++cell)
+	{
+		std::vector<uint64_t> row(bits.begin() + static_cast<size_t>(cell) * rowWords, bits.begin() + static_cast<size_t>(cell + 1) * rowWords);
+		for (const uint64_t word : row)
+		{
+			visiblePairs += static_cast<uint64_t>(__builtin_popcountll(word));
+		}
+
+		const auto inserted = uniqueRows.emplace(row, static_cast<uint32_t>(uniqueRows.size()));
+		if (inserted.second)
+		{
+			rows.insert(rows.end(), row.begin(), row.end());
+		}
+		rowIndex[cell] = inserted.first->second;
+	}
+
+	PotentiallyVisibleSetFile::SHeader header;
+	header.magic = PotentiallyVisibleSetFile::Magic;
+	header.version = PotentiallyVisibleSetFile::Version;
+	header.cellCountX = cellCount[0];
+	header.cellCountY = cellCount[1];
+	header.cellCountZ = cellCount[2];
+	header.rowWords = rowWords;
+	header.rowCount = static_cast<uint32_t>(uniqueRows.size());
+	header.sourceHash = sourceHash;
+	header.origin[0] = origin.x;
+	header.origin[1] = origin.y;
+	header.origin[2] = origin.z;
+	header.cellSize = options.cellSize;
+
+	FILE* pFile = fopen(options.output.c_str(), "wb");
+	if (pFile == nullptr)
+	{
+		printf("Can't write %s\n", options.output.c_str());
+		return 1;
+	}
+
+	const uint64_t padding = 0;
+	const size_t rowIndexSize = totalCells * sizeof(uint32_t);
+	fwrite(&header, sizeof(header), 1, pFile);
+	fwrite(rowIndex.data(), sizeof(uint32_t), rowIndex.size(), pFile);
+	fwrite(&padding, 1, PotentiallyVisibleSetFile::GetRowIndexSize(totalCells) - rowIndexSize, pFile);
+	fwrite(rows.data(), sizeof(uint64_t), rows.size(), pFile);
+	const bool bWritten = ferror(pFile) == 0;
+	fclose(pFile);
+
+	if (!bWritten)
+	{
+		printf("Can't write %s\n", options.output.c_str());
+		return 1;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%u triangles, %llu segments tested, %.1f%% of cell pairs visible\n", static_cast<uint32_t>(triangles.size()),
+		static_cast<unsigned long long>(segments), 100.0 * static_cast<double>(visiblePairs) / (static_cast<double>(totalCells) * totalCells));
+	printf("Wrote %s: %u cells, %u distinct rows, %llu bytes, source %08x, %.2fs\n", options.output.c_str(), totalCells, header.rowCount,
+		static_cast<unsigned long long>(PotentiallyVisibleSetFile::GetFileSize(header)), sourceHash, seconds);
+	return 0;
+}
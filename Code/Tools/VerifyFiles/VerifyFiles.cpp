@@ -0,0 +1,351 @@
+// Copyright 2016-2019 Crytek GmbH / Crytek Group. All rights reserved.
+
+////////////////////////////////////////////////////////
+// Checks the files of a package against the md5s of its
+// download manifests (every filelist.xml, text or the
+// binary CryXmlB the resource compiler writes) with
+// CFileVerifier (Systems/FileVerifier.h), as the game
+// does for a level before loading it.
+// --all also hashes every other file of the package, to
+// time a check of all of it. Each run times:
+//  - cold: no cache, every file is hashed, on 1 thread
+//    and on --threads
+//  - warm: the cache written by the cold run, unchanged
+//    files are only stat'ed
+//   VerifyFiles --package "My Project2_package" [--all] [--cache VerifyFiles.cache] [--iterations 5] [--threads 0]
+// Exits with 1 when a file doesn't match its manifest.
+// The page cache is not dropped, cold only means nothing
+// was hashed before. Linux only, built without the
+// engine.
+////////////////////////////////////////////////////////
+
+#include "../../Systems/FileVerifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+namespace
+{
+	struct SOptions
+	{
+		std::string package = "My Project2_package";
+		std::string cache = "VerifyFiles.cache";
+		uint32_t    iterations = 5;
+		uint32_t    threads = 0; // Up to one per hardware thread
+		bool        bAll = false;
+	};
+
+	struct SManifestFile
+	{
+		std::string path;
+		std::string md5;
+	};
+
+	double GetMilliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void FindFiles(const std::string& directory, std::vector<std::string>& files)
+	{
+		DIR* pDirectory = opendir(directory.c_str());
+		if (pDirectory == nullptr)
+			return;
+
+		while (const dirent* pEntry = readdir(pDirectory))
+		{
+			if (strcmp(pEntry->d_name, ".") == 0 || strcmp(pEntry->d_name, "..") == 0)
+				continue;
+
+			const std::string path = directory + "/" + pEntry->d_name;
+			struct stat status;
+			if (stat(path.c_str(), &status) != 0)
+				continue;
+
+			if (S_ISDIR(status.st_mode))
+			{
+				FindFiles(path, files);
+			}
+			else if (S_ISREG(status.st_mode))
+			{
+				files.push_back(path);
+			}
+		}
+		closedir(pDirectory);
+		std::sort(files.begin(), files.end());
+	}
+
+	bool ReadFile(const std::string& path, std::string& contents)
+	{
+		FILE* pFile = fopen(path.c_str(), "rb");
+		if (pFile == nullptr)
+			return false;
+
+		char buffer[4096];
+		size_t read;
+		contents.clear();
+		while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+		{
+			contents.append(buffer, read);
+		}
+		fclose(pFile);
+		return true;
+	}
+
+	uint16_t ReadU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+	uint32_t ReadU32(const uint8_t* p) { return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+	std::string GetTextAttribute(const std::string& text, size_t element, size_t end, const char* szName)
+	{
+		const std::string key = std::string(" ") + szName + "=\"";
+		const size_t value = text.find(key, element);
+		if (value > end)
+			return std::string();
+
+		const size_t valueStart = value + key.size();
+		return text.substr(valueStart, text.find('"', valueStart) - valueStart);
+	}
+
+	// <file src="..." md5="..."/> elements of a text manifest
+	void ParseTextManifest(const std::string& text, std::vector<SManifestFile>& files)
+	{
+		for (size_t element = text.find("<file"); element != std::string::npos; element = text.find("<file", element + 1))
+		{
+			const size_t end = text.find('>', element);
+			if (end == std::string::npos || !isspace(static_cast<unsigned char>(text[element + 5])))
+				continue;
+
+			SManifestFile file;
+			file.path = GetTextAttribute(text, element, end, "src");
+			file.md5 = GetTextAttribute(text, element, end, "md5");
+			if (!file.path.empty())
+			{
+				files.push_back(file);
+			}
+		}
+	}
+
+	// The same elements of a CryXmlB manifest: a header of table offsets and counts, 28 byte
+	// nodes, 8 byte attributes, and strings referenced by offset
+	bool ParseBinaryManifest(const std::string& data, std::vector<SManifestFile>& files)
+	{
+		const uint8_t* pData = reinterpret_cast<const uint8_t*>(data.data());
+		const size_t headerSize = 8 + 9 * 4;
+		if (data.size() < headerSize || memcmp(pData, "CryXmlB", 8) != 0)
+			return false;
+
+		const uint32_t nodeTable = ReadU32(pData + 12), nodeCount = ReadU32(pData + 16);
+		const uint32_t attributeTable = ReadU32(pData + 20), attributeCount = ReadU32(pData + 24);
+		const uint32_t stringData = ReadU32(pData + 36), stringDataSize = ReadU32(pData + 40);
+		if (static_cast<uint64_t>(nodeTable) + nodeCount * 28ull > data.size() || static_cast<uint64_t>(attributeTable) + attributeCount * 8ull > data.size()
+			|| static_cast<uint64_t>(stringData) + stringDataSize > data.size() || stringDataSize == 0 || pData[stringData + stringDataSize - 1] != 0)
+			return false;
+
+		auto getString = [&](uint32_t offset) { return offset < stringDataSize ? reinterpret_cast<const char*>(pData + stringData + offset) : ""; };
+		for (uint32_t node = 0; node < nodeCount; ++node)
+		{
+			const uint8_t* pNode = pData + nodeTable + node * 28;
+			if (strcmp(getString(ReadU32(pNode)), "file") != 0)
+				continue;
+
+			const uint16_t count = ReadU16(pNode + 8);
+			const uint32_t first = ReadU32(pNode + 20);
+			if (static_cast<uint64_t>(first) + count > attributeCount)
+				return false;
+
+			SManifestFile file;
+			for (uint32_t attribute = first; attribute < first + count; ++attribute)
+			{
+				const uint8_t* pAttribute = pData + attributeTable + attribute * 8;
+				const char* szKey = getString(ReadU32(pAttribute));
+				if (strcmp(szKey, "src") == 0)
+					file.path = getString(ReadU32(pAttribute + 4));
+				else if (strcmp(szKey, "md5") == 0)
+					file.md5 = getString(ReadU32(pAttribute + 4));
+			}
+			if (!file.path.empty())
+			{
+				files.push_back(file);
+			}
+		}
+		return true;
+	}
+
+	// Paths the manifests list, relative to their folder, with the md5s they expect
+	bool ReadManifests(const std::vector<std::string>& packageFiles, std::vector<SManifestFile>& files)
+	{
+		for (const std::string& path : packageFiles)
+		{
+			const size_t slash = path.rfind('/');
+			if (strcasecmp(path.c_str() + slash + 1, "filelist.xml") != 0)
+				continue;
+
+			std::string contents;
+			std::vector<SManifestFile> listed;
+			if (!ReadFile(path, contents))
+			{
+				printf("%s: could not be read\n", path.c_str());
+				return false;
+			}
+			if (contents.compare(0, 7, "CryXmlB") != 0)
+			{
+				ParseTextManifest(contents, listed);
+			}
+			else if (!ParseBinaryManifest(contents, listed))
+			{
+				printf("%s: not a CryXmlB file VerifyFiles can read\n", path.c_str());
+				return false;
+			}
+			for (SManifestFile& file : listed)
+			{
+				file.path = path.substr(0, slash + 1) + file.path;
+				files.push_back(file);
+			}
+		}
+		return true;
+	}
+
+	void AddFiles(CFileVerifier& verifier, const SOptions& options, const std::vector<std::string>& packageFiles, const std::vector<SManifestFile>& manifestFiles)
+	{
+		std::set<std::string> listed;
+		for (const SManifestFile& file : manifestFiles)
+		{
+			verifier.Add(file.path, file.path, file.md5);
+			listed.insert(file.path);
+		}
+		if (options.bAll)
+		{
+			for (const std::string& path : packageFiles)
+			{
+				if (listed.count(path) == 0)
+				{
+					verifier.Add(path, path, std::string());
+				}
+			}
+		}
+	}
+
+	bool ParseOptions(int argc, char** argv, SOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool bHasValue = i + 1 < argc;
+			if (strcmp(argv[i], "--package") == 0 && bHasValue)
+				options.package = argv[++i];
+			else if (strcmp(argv[i], "--cache") == 0 && bHasValue)
+				options.cache = argv[++i];
+			else if (strcmp(argv[i], "--iterations") == 0 && bHasValue)
+				options.iterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else if (strcmp(argv[i], "--threads") == 0 && bHasValue)
+				options.threads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			else if (strcmp(argv[i], "--all") == 0)
+				options.bAll = true;
+			else
+				return false;
+		}
+		return options.iterations > 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	SOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: VerifyFiles [--package \"My Project2_package\"] [--all] [--cache VerifyFiles.cache] [--iterations 5] [--threads 0]\n");
+		return 1;
+	}
+
+	std::vector<std::string> packageFiles;
+	FindFiles(options.package, packageFiles);
+	std::vector<SManifestFile> manifestFiles;
+	if (!ReadManifests(packageFiles, manifestFiles))
+		return 1;
+
+	if (manifestFiles.empty() && !options.bAll)
+	{
+		printf("No files listed by a filelist.xml in %s, --all checks every file\n", options.package.c_str());
+		return 1;
+	}
+
+	const uint32_t threads = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<uint32_t> threadCounts = { 1 };
+	if (threads > 1)
+	{
+		threadCounts.push_back(threads);
+	}
+
+	// Cold, the cache is dropped before every run
+	printf("%-24s %10s %8s %14s %10s\n", "run", "files", "hashed", "bytes", "ms");
+	CFileVerifier::SStatistics statistics;
+	for (const uint32_t threadCount : threadCounts)
+	{
+		for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+		{
+			remove(options.cache.c_str());
+			CFileVerifier verifier;
+			verifier.LoadCache(options.cache);
+			AddFiles(verifier, options, packageFiles, manifestFiles);
+
+			const auto start = std::chrono::steady_clock::now();
+			verifier.Verify(threadCount);
+			verifier.SaveCache(options.cache);
+			const double milliseconds = GetMilliseconds(start);
+
+			statistics = verifier.GetStatistics();
+			if (iteration == 0)
+			{
+				const std::string run = "cold, " + std::to_string(threadCount) + (threadCount == 1 ? " thread" : " threads");
+				printf("%-24s %10u %8u %14llu %10.2f\n", run.c_str(), statistics.files, statistics.hashed, static_cast<unsigned long long>(statistics.bytesHashed), milliseconds);
+			}
+		}
+	}
+
+	// Warm, with the cache of the last cold run
+	std::vector<double> warm;
+	bool bFailed = false;
+	for (uint32_t iteration = 0; iteration < options.iterations; ++iteration)
+	{
+		CFileVerifier verifier;
+		const auto start = std::chrono::steady_clock::now();
+		verifier.LoadCache(options.cache);
+		AddFiles(verifier, options, packageFiles, manifestFiles);
+		verifier.Verify(threads);
+		if (verifier.IsCacheDirty())
+		{
+			verifier.SaveCache(options.cache);
+		}
+		warm.push_back(GetMilliseconds(start));
+
+		statistics = verifier.GetStatistics();
+		if (iteration + 1 == options.iterations)
+		{
+			for (const CFileVerifier::SFile& file : verifier.GetFiles())
+			{
+				if (file.result != CFileVerifier::EResult::Verified && file.result != CFileVerifier::EResult::Recorded)
+				{
+					printf("  %s %s\n", file.key.c_str(), CFileVerifier::GetResultName(file.result));
+					bFailed = true;
+				}
+			}
+		}
+	}
+	std::sort(warm.begin(), warm.end());
+	printf("%-24s %10u %8u %14llu %10.2f (median of %u, %u unchanged)\n", "warm", statistics.files, statistics.hashed,
+		static_cast<unsigned long long>(statistics.bytesHashed), warm[warm.size() / 2], options.iterations, statistics.fromCache);
+
+	printf("%zu files listed by manifests, %s\n", manifestFiles.size(), bFailed ? "some don't match" : "all match");
+	return bFailed ? 1 : 0;
+}